@@ -51,6 +51,8 @@
 #include "D4EnumDefs.h"
 #include "D4Enum.h"
 #include "XMLWriter.h"
+#include "Hyperslab.h"
+#include "ProjectionOverlay.h"
 
 #include "util.h"
 #include "debug.h"
@@ -75,7 +77,8 @@ Array::dimension::dimension(D4Dimension *d) : dim(d), use_sdim_for_slice(true)
 void
 Array::_duplicate(const Array &a)
 {
-    _shape = a._shape;
+    // Holds the constraint the current overlay has for 'a', if it's shared
+    _shape = a.m_shape();
 
     // Deep copy the Maps if they are being used.
     if (a.d_maps) {
@@ -93,6 +96,66 @@ Array::_duplicate(const Array &a)
 // in which case that means they want the whole thing. Array projection
 // should probably work this way too, but it doesn't. 9/21/2001 jhrg
 
+// The dimensions, with the constraint this Array has or, if the Array is
+// shared, the one in the current ProjectionOverlay. Reading them doesn't
+// copy them into the overlay.
+const std::vector<Array::dimension> &
+Array::m_shape() const
+{
+    ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(this);
+    return v && v->has_shape ? v->shape : _shape;
+}
+
+// The dimensions to write a constraint to. If the Array is shared, they
+// are copied into the current overlay when it first constrains them; a
+// shared Array can't be constrained outside of a ProjectionOverlay::Scope.
+std::vector<Array::dimension> &
+Array::m_writable_shape()
+{
+    if (!is_shared())
+        return _shape;
+
+    ProjectionOverlay *overlay = ProjectionOverlay::current();
+    if (!overlay)
+        throw InternalErr(__FILE__, __LINE__, "The shared Array '" + name() + "' was constrained outside of a ProjectionOverlay::Scope.");
+
+    ProjectionOverlay::Variable &v = overlay->variable(this);
+    if (!v.has_shape) {
+        v.shape = _shape;
+        v.has_shape = true;
+    }
+
+    return v.shape;
+}
+
+// A Dim_iter got before the overlay copied the dimensions points into
+// _shape; the constraint for that dimension is at the same place in the copy.
+static inline bool
+points_into(const std::vector<Array::dimension> &shape, Array::Dim_iter i)
+{
+    return !shape.empty() && &*i >= &shape.front() && &*i <= &shape.back();
+}
+
+const Array::dimension &
+Array::m_dimension(Dim_iter i) const
+{
+    const std::vector<dimension> &shape = m_shape();
+    if (&shape != &_shape && points_into(_shape, i))
+        return shape[&*i - &_shape.front()];
+
+    return *i;
+}
+
+Array::dimension &
+Array::m_writable_dimension(Dim_iter i)
+{
+    std::vector<dimension> &shape = m_writable_shape();
+    if (&shape != &_shape && points_into(_shape, i))
+        return shape[&*i - &_shape.front()];
+
+    return *i;
+}
+
 /** @deprecated Calling this method should never be necessary. It is used
     internally called whenever the size of the Array is changed, e.g., by a
     constraint.
@@ -103,7 +166,8 @@ void
 Array::update_length(int)
 {
     int length = 1;
-    for (Dim_citer i = _shape.begin(); i != _shape.end(); i++) {
+    const std::vector<dimension> &shape = m_shape();
+    for (Dim_citer i = shape.begin(); i != shape.end(); i++) {
 #if 0
         // If the size of any dimension is zero, then the array is not
         // capable of storing any values. jhrg 1/28/16
@@ -230,7 +294,8 @@ Array::transform_to_dap4(D4Group *root, Constructor */*container*/)
 	}
 
 	// Copy the D2 attributes to D4 Attributes
-	dest->attributes()->transform_to_dap4(get_attr_table());
+	if (has_attr_table())
+		dest->attributes()->transform_to_dap4(get_attr_table());
 
 	dest->set_is_dap4(true);
 
@@ -403,9 +468,11 @@ Array::clear_all_dims()
 void
 Array::reset_constraint()
 {
+    std::vector<dimension> &shape = m_writable_shape();
+
     set_length(-1);
 
-    for (Dim_iter i = _shape.begin(); i != _shape.end(); i++) {
+    for (Dim_iter i = shape.begin(); i != shape.end(); i++) {
         (*i).start = 0;
         (*i).stop = (*i).size - 1;
         (*i).stride = 1;
@@ -460,7 +527,7 @@ specified do not match the array variable.";
 void
 Array::add_constraint(Dim_iter i, int start, int stride, int stop)
 {
-    dimension &d = *i ;
+    dimension &d = m_writable_dimension(i);
 
     // if stop is -1, set it to the array's max element index
     // jhrg 12/20/12
@@ -493,7 +560,7 @@ Array::add_constraint(Dim_iter i, int start, int stride, int stop)
 void
 Array::add_constraint(Dim_iter i, D4Dimension *dim)
 {
-    dimension &d = *i ;
+    dimension &d = m_writable_dimension(i);
 
     if (dim->constrained())
     	add_constraint(i, dim->c_start(), dim->c_stride(), dim->c_stop());
@@ -505,18 +572,49 @@ Array::add_constraint(Dim_iter i, D4Dimension *dim)
 	d.use_sdim_for_slice = true;
 }
 
-/** Returns an iterator to the first dimension of the Array. */
+/** @brief Load the constrained values from a buffer.
+ *
+ * Copy the values selected by the array's current constraint out of a
+ * row-major buffer holding the whole array, or any hyperslab of it that
+ * contains the constrained values. This saves handlers that read a block
+ * of data from writing their own start/stride/stop loops. It's only for
+ * arrays of cardinal types. The caller still sets read_p().
+ *
+ * @param values The values of \c slab.
+ * @param slab The part of the array held in \c values; use
+ * Hyperslab(*this, false) for the whole array.
+ * @param threads Use up to this many threads to copy large arrays.
+ * @exception InternalErr if the array's type is not cardinal or \c slab
+ * does not contain the constrained values. */
+void
+Array::set_value_slice(const void *values, const Hyperslab &slab, unsigned int threads)
+{
+    Hyperslab constraint(*this);
+
+    set_length(constraint.elements());
+    m_create_cardinal_data_buffer_for_type(length());
+    if (length() == 0)
+        return;
+
+    Hyperslab::extract(slab, values, var()->width(), constraint, get_buf(), threads);
+}
+
+/** Returns an iterator to the first dimension of the Array. Use
+    add_constraint() to change a dimension's constraint, not the iterator.
+    If the Array is shared, take dim_end() before the loop that constrains
+    it: the first constraint copies the dimensions into the current
+    ProjectionOverlay. */
 Array::Dim_iter
 Array::dim_begin()
 {
-    return _shape.begin() ;
+    return const_cast<std::vector<dimension>&>(m_shape()).begin() ;
 }
 
 /** Returns an iterator past the last dimension of the Array. */
 Array::Dim_iter
 Array::dim_end()
 {
-    return _shape.end() ;
+    return const_cast<std::vector<dimension>&>(m_shape()).end() ;
 }
 
 //TODO Many of these methods take a bool parameter that serves no use; remove.
@@ -532,7 +630,7 @@ Array::dim_end()
 unsigned int
 Array::dimensions(bool /*constrained*/)
 {
-    return _shape.size();
+    return m_shape().size();
 }
 
 /** Return the size of the array dimension referred to by <i>i</i>.
@@ -557,11 +655,11 @@ Array::dimension_size(Dim_iter i, bool constrained)
 {
     int size = 0;
 
-    if (!_shape.empty()) {
+    if (!m_shape().empty()) {
         if (constrained)
-            size = (*i).c_size;
+            size = m_dimension(i).c_size;
         else
-            size = (*i).size;
+            size = m_dimension(i).size;
     }
 
     return size;
@@ -588,7 +686,7 @@ Array::dimension_size(Dim_iter i, bool constrained)
 int
 Array::dimension_start(Dim_iter i, bool /*constrained*/)
 {
-    return (!_shape.empty()) ? (*i).start : 0;
+    return (!m_shape().empty()) ? m_dimension(i).start : 0;
 }
 
 /** Use this function to return the stop index of an array
@@ -612,7 +710,7 @@ Array::dimension_start(Dim_iter i, bool /*constrained*/)
 int
 Array::dimension_stop(Dim_iter i, bool /*constrained*/)
 {
-    return (!_shape.empty()) ? (*i).stop : 0;
+    return (!m_shape().empty()) ? m_dimension(i).stop : 0;
 }
 
 /** Use this function to return the stride value of an array
@@ -637,7 +735,7 @@ Array::dimension_stop(Dim_iter i, bool /*constrained*/)
 int
 Array::dimension_stride(Dim_iter i, bool /*constrained*/)
 {
-    return (!_shape.empty()) ? (*i).stride : 0;
+    return (!m_shape().empty()) ? m_dimension(i).stride : 0;
 }
 
 /** This function returns the name of the dimension indicated with
@@ -658,16 +756,16 @@ Array::dimension_name(Dim_iter i)
     // to call it before the Array object has been properly set
     // this will cause an exception which is the user's fault.
     // (User in this context is the developer of the surrogate library.)
-    if (_shape.empty())
+    if (m_shape().empty())
         throw  InternalErr(__FILE__, __LINE__,
                            "*This* array has no dimensions.");
-    return (*i).name;
+    return m_dimension(i).name;
 }
 
 D4Dimension *
 Array::dimension_D4dim(Dim_iter i)
 {
-	return (!_shape.empty()) ? (*i).dim : 0;
+	return (!m_shape().empty()) ? m_dimension(i).dim : 0;
 }
 
 D4Maps *
@@ -718,30 +816,29 @@ public:
 		// because of the need to print the constrained size of a dimension. I think that
 		// the constraint information has to be kept here and not in the dimension (since they
 		// are shared dims). Could hack print_dap4() to take the constrained size, however.
-		if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Dim") < 0)
+		if (xml.start_element("Dim") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Dim element");
 
 		string name = (d.dim) ? d.dim->fully_qualified_name() : d.name;
 		// If there is a name, there must be a Dimension (named dimension) in scope
 		// so write its name but not its size.
 		if (!d_constrained && !name.empty()) {
-			if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*) name.c_str())
-					< 0) throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
+			if (xml.write_attribute("name", name.c_str()) < 0)
+				throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 		}
 		else if (d.use_sdim_for_slice) {
 			assert(!name.empty());
-			if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*) name.c_str())
-					< 0) throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
+			if (xml.write_attribute("name", name.c_str()) < 0)
+				throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 		}
 		else {
 			ostringstream size;
 			size << (d_constrained ? d.c_size : d.size);
-			if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "size",
-					(const xmlChar*) size.str().c_str()) < 0)
+			if (xml.write_attribute("size", size.str().c_str()) < 0)
 				throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 		}
 
-		if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+		if (xml.end_element() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not end Dim element");
 	}
 };
@@ -780,11 +877,11 @@ Array::print_dap4(XMLWriter &xml, bool constrained /* default: false*/)
 {
 	if (constrained && !send_p()) return;
 
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) var()->type_name().c_str()) < 0)
+	if (xml.start_element(var()->type_name().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write " + type_name() + " element");
 
 	if (!name().empty())
-		if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+		if (xml.write_attribute("name", name().c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
 	// Hack job... Copied from D4Enum::print_xml_writer. jhrg 11/12/13
@@ -795,7 +892,7 @@ Array::print_dap4(XMLWriter &xml, bool constrained /* default: false*/)
 			// print the FQN for the enum def; D4Group::FQN() includes the trailing '/'
 			path = static_cast<D4Group*>(e->enumeration()->parent()->parent())->FQN() + path;
 		}
-		if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "enum", (const xmlChar*)path.c_str()) < 0)
+		if (xml.write_attribute("enum", path.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write attribute for enum");
 	}
 
@@ -812,7 +909,7 @@ Array::print_dap4(XMLWriter &xml, bool constrained /* default: false*/)
 
 	for_each(maps()->map_begin(), maps()->map_end(), PrintD4MapXMLWriter(xml));
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end " + type_name() + " element");
 }
 
@@ -866,7 +963,7 @@ void Array::print_decl(ostream &out, string space, bool print_semi, bool constra
     // print it, but w/o semicolon
     var()->print_decl(out, space, false, constraint_info, constrained);
 
-    for (Dim_citer i = _shape.begin(); i != _shape.end(); i++) {
+    for (Dim_citer i = dim_begin(); i != dim_end(); i++) {
         out << "[";
         if ((*i).name != "") {
             out << id2www((*i).name) << " = ";
@@ -890,9 +987,9 @@ void Array::print_decl(ostream &out, string space, bool print_semi, bool constra
 void
 Array::print_xml(FILE *out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, "Array");
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /**
@@ -901,9 +998,9 @@ Array::print_xml(FILE *out, string space, bool constrained)
 void
 Array::print_xml(ostream &out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, "Array");
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 /**
@@ -912,9 +1009,9 @@ Array::print_xml(ostream &out, string space, bool constrained)
 void
 Array::print_as_map_xml(FILE *out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, "Map");
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /**
@@ -923,9 +1020,9 @@ Array::print_as_map_xml(FILE *out, string space, bool constrained)
 void
 Array::print_as_map_xml(ostream &out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, "Map");
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 /**
@@ -934,9 +1031,9 @@ Array::print_as_map_xml(ostream &out, string space, bool constrained)
 void
 Array::print_xml_core(FILE *out, string space, bool constrained, string tag)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, tag);
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /**
@@ -945,9 +1042,9 @@ Array::print_xml_core(FILE *out, string space, bool constrained, string tag)
 void
 Array::print_xml_core(ostream &out, string space, bool constrained, string tag)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer_core(xml, constrained, tag);
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 void
@@ -971,19 +1068,19 @@ public:
 
     void operator()(Array::dimension &d)
     {
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"dimension") < 0)
+        if (xml.start_element("dimension") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write dimension element");
 
         if (!d.name.empty())
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d.name.c_str()) < 0)
+            if (xml.write_attribute("name", d.name.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
         ostringstream size;
         size << (d_constrained ? d.c_size : d.size);
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "size", (const xmlChar*)size.str().c_str()) < 0)
+        if (xml.write_attribute("size", size.str().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end dimension element");
     }
 };
@@ -994,14 +1091,15 @@ Array::print_xml_writer_core(XMLWriter &xml, bool constrained, string tag)
     if (constrained && !send_p())
         return;
 
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)tag.c_str()) < 0)
+    if (xml.start_element(tag.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write " + tag + " element");
 
     if (!name().empty())
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+        if (xml.write_attribute("name", name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-    get_attr_table().print_xml_writer(xml);
+    if (has_attr_table())
+        get_attr_table().print_xml_writer(xml);
 
     BaseType *btp = var();
     string tmp_name = btp->name();
@@ -1011,7 +1109,7 @@ Array::print_xml_writer_core(XMLWriter &xml, bool constrained, string tag)
 
     for_each(dim_begin(), dim_end(), PrintArrayDimXMLWriter(xml, constrained));
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end " + tag + " element");
 }
 
@@ -1118,7 +1216,7 @@ Array::print_val(ostream &out, string space, bool print_decl_p)
 
     unsigned int *shape = new unsigned int[dimensions(true)];
     unsigned int index = 0;
-    for (Dim_iter i = _shape.begin(); i != _shape.end() && index < dimensions(true); ++i)
+    for (Dim_iter i = dim_begin(); i != dim_end() && index < dimensions(true); ++i)
         shape[index++] = dimension_size(i, true);
 
     print_array(out, 0, dimensions(true), shape);
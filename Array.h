@@ -57,6 +57,7 @@ class D4Maps;
 class XMLWriter;
 class D4Dimension;
 class D4Dimensions;
+struct Hyperslab;
 
 const int DODS_MAX_ARRAY = DODS_INT_MAX;
 
@@ -173,6 +174,12 @@ public:
 private:
     std::vector<dimension> _shape; // list of dimensions (i.e., the shape)
 
+    const std::vector<dimension> &m_shape() const;
+    std::vector<dimension> &m_writable_shape();
+
+    const dimension &m_dimension(std::vector<dimension>::iterator i) const;
+    dimension &m_writable_dimension(std::vector<dimension>::iterator i);
+
     void update_dimension_pointers(D4Dimensions *old_dims, D4Dimensions *new_dims);
 
     friend class ArrayTest;
@@ -228,6 +235,8 @@ public:
 
     virtual void clear_constraint(); // deprecated
 
+    virtual void set_value_slice(const void *values, const Hyperslab &slab, unsigned int threads = 1);
+
     virtual void update_length(int size = 0); // should be used internally only
 
     Dim_iter dim_begin() ;
@@ -36,6 +36,7 @@
 #include <sstream>
 
 #include "AttrTable.h"
+#include "AttrValues.h"
 
 #include "util.h"
 #include "escaping.h"
@@ -53,6 +54,8 @@ using std::cerr;
 using std::string;
 using std::endl;
 using std::vector;
+using std::map;
+using std::make_pair;
 
 namespace libdap {
 
@@ -154,6 +157,40 @@ AttrType String_to_AttrType(const string &s)
         return Attr_unknown;
 }
 
+void AttrTable::entry::delete_entry()
+{
+    if (is_alias) // alias copies the pointers.
+        return;
+    if (type == Attr_container) {
+        delete attributes; attributes = 0;
+    }
+    else {
+        delete attr; attr = 0;
+    }
+}
+
+void AttrTable::entry::clone(const entry &rhs)
+{
+    switch (rhs.type) {
+    case Attr_unknown:
+        break;
+    case Attr_container: {
+        if (rhs.is_alias)
+            attributes = rhs.attributes;
+        else
+            attributes = new AttrTable(*rhs.attributes);
+        break;
+    }
+    default: {
+        if (rhs.is_alias)
+            attr = rhs.attr;
+        else
+            attr = new AttrValues(*rhs.attr);
+        break;
+    }
+    }
+}
+
 /** Clone the given attribute table in <tt>this</tt>.
  Protected. */
 void AttrTable::clone(const AttrTable &at)
@@ -171,7 +208,7 @@ void AttrTable::clone(const AttrTable &at)
     for (; i != ie; ++i) {
         // this deep-copies containers recursively
         entry *e = new entry(*(*i));
-        attr_map.push_back(e);
+        m_add_entry(e);
 
         // If the entry being added was a container,
         // set its parent to this to maintain invariant.
@@ -203,6 +240,44 @@ void AttrTable::delete_attr_table()
         delete *i;
     }
     attr_map.clear();
+    d_attr_index.clear();
+}
+
+// Private. Add an entry to the end of the table and index its name; an
+// entry with the same name already in the table keeps its place in the index.
+void AttrTable::m_add_entry(entry *e)
+{
+    attr_map.push_back(e);
+    d_attr_index.insert(make_pair(e->name, attr_map.size() - 1));
+}
+
+// Private. Remove an entry from the table, without deleting it, and update
+// the index: the entries after it move down one, and if it was the first
+// entry with its name, the next one with that name, if any, takes its place.
+AttrTable::Attr_iter AttrTable::m_remove_entry(Attr_iter iter)
+{
+    unsigned int pos = iter - attr_map.begin();
+    string name = (*iter)->name;
+
+    iter = attr_map.erase(iter);
+
+    for (map<string, unsigned int>::iterator i = d_attr_index.begin(), e = d_attr_index.end(); i != e; ++i)
+        if (i->second > pos)
+            --i->second;
+
+    map<string, unsigned int>::iterator p = d_attr_index.find(name);
+    if (p != d_attr_index.end() && p->second == pos) {
+        Attr_iter next = iter;
+        while (next != attr_map.end() && (*next)->name != name)
+            ++next;
+
+        if (next == attr_map.end())
+            d_attr_index.erase(p);
+        else
+            p->second = next - attr_map.begin();
+    }
+
+    return iter;
 }
 
 AttrTable::~AttrTable()
@@ -322,7 +397,7 @@ unsigned int AttrTable::append_attr(const string &name, const string &type, cons
         throw Error(string("An attribute called `") + name + string("' already exists but is a container."));
 
     if (iter != attr_map.end()) { // Must be a new attribute value; add it.
-        (*iter)->attr->push_back(value);
+        (*iter)->attr->append(value);
         return (*iter)->attr->size();
     }
     else { // Must be a completely new attribute; add it
@@ -331,10 +406,10 @@ unsigned int AttrTable::append_attr(const string &name, const string &type, cons
         e->name = lname;
         e->is_alias = false;
         e->type = String_to_AttrType(type); // Record type using standard names.
-        e->attr = new vector<string> ;
-        e->attr->push_back(value);
+        e->attr = new AttrValues(e->type);
+        e->attr->append(value);
 
-        attr_map.push_back(e);
+        m_add_entry(e);
 
         return e->attr->size(); // return the length of the attr vector
     }
@@ -376,9 +451,7 @@ unsigned int AttrTable::append_attr(const string &name, const string &type, vect
         throw Error(string("An attribute called `") + name + string("' already exists but is a container."));
 
     if (iter != attr_map.end()) { // Must be new attribute values; add.
-        vector<string>::iterator i = values->begin();
-        while (i != values->end())
-            (*iter)->attr->push_back(*i++);
+        (*iter)->attr->append(*values);
 
         return (*iter)->attr->size();
     }
@@ -388,14 +461,70 @@ unsigned int AttrTable::append_attr(const string &name, const string &type, vect
         e->name = lname;
         e->is_alias = false;
         e->type = String_to_AttrType(type); // Record type using standard names.
-        e->attr = new vector<string> (*values);
+        e->attr = new AttrValues(e->type);
+        e->attr->assign(*values);
 
-        attr_map.push_back(e);
+        m_add_entry(e);
 
         return e->attr->size(); // return the length of the attr vector
     }
 }
 
+/** This version of append_attr() takes values held by an AttrValues
+ object, which may be in binary form; they are copied without being
+ formatted as text. Use it to add numeric attributes read from binary data:
+
+ \code
+ AttrValues range(Attr_float64);
+ range.append(minmax, 2);
+ at.append_attr("actual_range", range);
+ \endcode
+
+ The type of the attribute is the type of \e values. As with the other
+ versions, the values are appended to those of an existing attribute with
+ the same name and type, and an Error is thrown if the attribute exists
+ with a different type or is a container.
+
+ @brief Add an attribute to the table.
+ @return Returns the length of the added attribute value.
+ @param name The name of the attribute to add or modify.
+ @param values The values. Note: The values are COPIED, not stored. */
+unsigned int AttrTable::append_attr(const string &name, const AttrValues &values)
+{
+#if WWW_ENCODING
+    string lname = www2id(name);
+#else
+    string lname = remove_space_encoding(name);
+#endif
+    if (values.type() == Attr_container || values.type() == Attr_unknown)
+        throw InternalErr(__FILE__, __LINE__, "Attribute values must have a simple type.");
+
+    Attr_iter iter = simple_find(lname);
+
+    if (iter != attr_map.end() && ((*iter)->type != values.type()))
+        throw Error(string("An attribute called `") + name + string("' already exists but is of a different type"));
+    if (iter != attr_map.end() && (get_type(iter) == "Container"))
+        throw Error(string("An attribute called `") + name + string("' already exists but is a container."));
+
+    if (iter != attr_map.end()) {
+        (*iter)->attr->append(values);
+
+        return (*iter)->attr->size();
+    }
+    else {
+        entry *e = new entry;
+
+        e->name = lname;
+        e->is_alias = false;
+        e->type = values.type();
+        e->attr = new AttrValues(values);
+
+        m_add_entry(e);
+
+        return e->attr->size();
+    }
+}
+
 /** Create and append an attribute container to this AttrTable. If this
  attribute table already contains an attribute container called
  <tt>name</tt> an exception is thrown. Return a pointer to the new container.
@@ -456,7 +585,7 @@ AttrTable::append_container(AttrTable *at, const string &name)
     e->type = Attr_container;
     e->attributes = at;
 
-    attr_map.push_back(e);
+    m_add_entry(e);
 
     at->d_parent = this;
 
@@ -511,23 +640,19 @@ void AttrTable::find(const string &target, AttrTable **at, Attr_iter *iter)
 AttrTable *
 AttrTable::recurrsive_find(const string &target, Attr_iter *location)
 {
-    Attr_iter i = attr_begin();
-    while (i != attr_end()) {
-        if (target == (*i)->name) {
-            *location = i;
-            return this;
-        }
-        else if ((*i)->type == Attr_container) {
+    // Containers ahead of target in this table are searched first, so only
+    // those need to be visited; the name itself is found using the index.
+    Attr_iter found = simple_find(target);
+    for (Attr_iter i = attr_begin(); i != found; ++i) {
+        if ((*i)->type == Attr_container) {
             AttrTable *at = (*i)->attributes->recurrsive_find(target, location);
             if (at)
                 return at;
         }
-
-        ++i;
     }
 
-    *location = i;
-    return 0;
+    *location = found;
+    return found != attr_end() ? this : 0;
 }
 
 // Made public for callers that want non-recursive find.  [mjohnson 6 oct 09]
@@ -539,13 +664,13 @@ AttrTable::recurrsive_find(const string &target, Attr_iter *location)
  @return An Attr_iter which references \c target. */
 AttrTable::Attr_iter AttrTable::simple_find(const string &target)
 {
-    Attr_iter i;
-    for (i = attr_map.begin(); i != attr_map.end(); ++i) {
-        if (target == (*i)->name) {
-            break;
-        }
-    }
-    return i;
+    map<string, unsigned int>::const_iterator p = d_attr_index.find(target);
+    if (p == d_attr_index.end())
+        return attr_map.end();
+
+    assert(p->second < attr_map.size() && attr_map[p->second]->name == target);
+
+    return attr_map.begin() + p->second;
 }
 
 /** Look in this attribute table for an attribute container named
@@ -584,11 +709,11 @@ AttrTable::simple_find_container(const string &target)
     if (get_name() == target)
         return this;
 
-    for (Attr_iter i = attr_map.begin(); i != attr_map.end(); ++i) {
-        if (is_container(i) && target == (*i)->name) {
-            return (*i)->attributes;
-        }
-    }
+    // Names are unique within a table: append_attr() adds values to an
+    // existing attribute and the other methods refuse a name already used.
+    Attr_iter i = simple_find(target);
+    if (i != attr_map.end() && is_container(i))
+        return (*i)->attributes;
 
     return 0;
 }
@@ -639,9 +764,9 @@ unsigned int AttrTable::get_attr_num(const string &name)
 /** Get a pointer to the vector of values associated with the attribute
  referenced by Pix <tt>p</tt> or named <tt>name</tt>.
 
- Note that all values in an attribute table are stored as string data.
- They may be converted to a more appropriate internal format by the
- calling program.
+ The values are returned as strings; values held in binary form are
+ formatted and become text. Use get_attr_values() to read them without
+ that conversion.
 
  @return If the indicated attribute is a container, this function
  returns the null pointer.  Otherwise returns a pointer to the
@@ -655,6 +780,17 @@ AttrTable::get_attr_vector(const string &name)
     return (p != attr_map.end()) ? get_attr_vector(p) : 0;
 }
 
+/** Get the values of the attribute named \e name, in the form they are
+ held; use AttrValues::data() to read numeric values without parsing them.
+ @brief Get the values of an attribute.
+ @return Null if the attribute doesn't exist or is a container. */
+AttrValues *
+AttrTable::get_attr_values(const string &name)
+{
+    Attr_iter p = simple_find(name);
+    return (p != attr_map.end()) ? get_attr_values(p) : 0;
+}
+
 /** Delete the attribute named <tt>name</tt>. If <tt>i</tt> is given, and
  the attribute has a vector value, delete the <tt>i</tt>$^th$
  element of the vector.
@@ -683,7 +819,7 @@ void AttrTable::del_attr(const string &name, int i)
     if (iter != attr_map.end()) {
         if (i == -1) { // Delete the whole attribute
             entry *e = *iter;
-            attr_map.erase(iter);
+            m_remove_entry(iter);
             delete e;
             e = 0;
         }
@@ -693,10 +829,8 @@ void AttrTable::del_attr(const string &name, int i)
             if ((*iter)->type == Attr_container)
                 return;
 
-            vector<string> *sxp = (*iter)->attr;
-
-            assert(i >= 0 && i < (int) sxp->size());
-            sxp->erase(sxp->begin() + i); // rm the element
+            assert(i >= 0 && i < (int) (*iter)->attr->size());
+            (*iter)->attr->erase(i); // rm the element
         }
     }
 }
@@ -796,9 +930,10 @@ AttrTable::Attr_iter AttrTable::del_attr_table(Attr_iter iter)
         e->attributes = 0;
     }
 
+    Attr_iter next = m_remove_entry(iter);
     delete e;
 
-    return attr_map.erase(iter);
+    return next;
 }
 
 /** Get the type name of an attribute referenced by \e iter.
@@ -851,7 +986,7 @@ string AttrTable::get_attr(Attr_iter iter, unsigned int i)
 {
     assert(iter != attr_map.end());
 
-    return (*iter)->type == Attr_container ? (string) "None" : (*(*iter)->attr)[i];
+    return (*iter)->type == Attr_container ? (string) "None" : (*iter)->attr->value(i);
 }
 
 string AttrTable::get_attr(const string &name, unsigned int i)
@@ -863,9 +998,9 @@ string AttrTable::get_attr(const string &name, unsigned int i)
 /** Returns a pointer to the vector of values associated with the
  attribute referenced by iterator \e iter.
 
- Note that all values in an attribute table are stored as string data.
- They may be converted to a more appropriate internal format by the
- calling program.
+ The values are returned as strings; values held in binary form are
+ formatted and become text, since the caller may change the vector. Use
+ get_attr_values() to read them without that conversion.
 
  @param iter Reference to the Attribute.
  @return If the indicated attribute is a container, this function
@@ -873,6 +1008,18 @@ string AttrTable::get_attr(const string &name, unsigned int i)
  the attribute vector value. */
 vector<string> *
 AttrTable::get_attr_vector(Attr_iter iter)
+{
+    assert(iter != attr_map.end());
+    return (*iter)->type != Attr_container ? &(*iter)->attr->text() : 0;
+}
+
+/** Get the values of the attribute referenced by \e iter, in the form they
+ are held.
+
+ @param iter Reference to the Attribute.
+ @return Null if the attribute is a container. */
+AttrValues *
+AttrTable::get_attr_values(Attr_iter iter)
 {
     assert(iter != attr_map.end());
     return (*iter)->type != Attr_container ? (*iter)->attr : 0;
@@ -923,7 +1070,7 @@ void AttrTable::add_container_alias(const string &name, AttrTable *src)
 
     e->attributes = src;
 
-    attr_map.push_back(e);
+    m_add_entry(e);
 }
 
 /** Assume \e source names an attribute value in some container. Add an alias
@@ -989,7 +1136,7 @@ void AttrTable::add_value_alias(AttrTable *das, const string &name, const string
     else
         e->attr = (*iter)->attr;
 
-    attr_map.push_back(e);
+    m_add_entry(e);
 }
 
 // Deprecated
@@ -1040,6 +1187,7 @@ void AttrTable::erase()
     }
 
     attr_map.erase(attr_map.begin(), attr_map.end());
+    d_attr_index.clear();
 
     d_name = "";
 }
@@ -1188,12 +1336,12 @@ void AttrTable::simple_print(ostream &out, string pad, Attr_iter i, bool derefer
 #else
         out << pad << get_type(i) << " " << add_space_encoding(get_name(i)) << " ";
 #endif
-        vector<string> *sxp = (*i)->attr;
-        vector<string>::iterator last = sxp->end() - 1;
-        for (vector<string>::iterator i = sxp->begin(); i != last; ++i) {
-            write_string_attribute_for_das(out, *i, ", ");
+        AttrValues *values = (*i)->attr;
+        unsigned int last = values->size() - 1;
+        for (unsigned int j = 0; j < last; ++j) {
+            write_string_attribute_for_das(out, values->value(j), ", ");
         }
-        write_string_attribute_for_das(out, *last, ";\n");
+        write_string_attribute_for_das(out, values->value(last), ";\n");
     }
         break;
 
@@ -1203,12 +1351,12 @@ void AttrTable::simple_print(ostream &out, string pad, Attr_iter i, bool derefer
 #else
         out << pad << get_type(i) << " " << add_space_encoding(get_name(i)) << " ";
 #endif
-        vector<string> *sxp = (*i)->attr;
-        vector<string>::iterator last = sxp->end() - 1;
-        for (vector<string>::iterator i = sxp->begin(); i != last; ++i) {
-            write_xml_attribute_for_das(out, *i, ", ");
+        AttrValues *values = (*i)->attr;
+        unsigned int last = values->size() - 1;
+        for (unsigned int j = 0; j < last; ++j) {
+            write_xml_attribute_for_das(out, values->value(j), ", ");
         }
-        write_xml_attribute_for_das(out, *last, ";\n");
+        write_xml_attribute_for_das(out, values->value(last), ";\n");
     }
         break;
 
@@ -1218,12 +1366,13 @@ void AttrTable::simple_print(ostream &out, string pad, Attr_iter i, bool derefer
 #else
         out << pad << get_type(i) << " " << add_space_encoding(get_name(i)) << " ";
 #endif
-        vector<string> *sxp = (*i)->attr;
-        vector<string>::iterator last = sxp->end() - 1;
-        for (vector<string>::iterator i = sxp->begin(); i != last; ++i) {
-            out << *i << ", ";
+        // Values held in binary form are formatted one at a time
+        AttrValues *values = (*i)->attr;
+        unsigned int last = values->size() - 1;
+        for (unsigned int j = 0; j < last; ++j) {
+            out << values->value(j) << ", ";
         }
-        out << *last << ";\n";
+        out << values->value(last) << ";\n";
     }
         break;
     }
@@ -1311,9 +1460,9 @@ void AttrTable::print(ostream &out, string pad, bool dereference)
  @deprecated */
 void AttrTable::print_xml(FILE *out, string pad, bool /*constrained*/)
 {
-    XMLWriter xml(pad);
+    XMLWriter xml(out, pad);
     print_xml_writer(xml);
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 
 #if OLD_XML_MOETHODS
     ostringstream oss;
@@ -1376,9 +1525,9 @@ void AttrTable::print_xml(FILE *out, string pad, bool /*constrained*/)
  */
 void AttrTable::print_xml(ostream &out, string pad, bool /*constrained*/)
 {
-    XMLWriter xml(pad);
+    XMLWriter xml(out, pad);
     print_xml_writer(xml);
-    out << xml.get_doc();
+    xml.end_document();
 
 #if 0
     for (Attr_iter i = attr_begin(); i != attr_end(); ++i) {
@@ -1425,64 +1574,57 @@ void AttrTable::print_xml_writer(XMLWriter &xml)
 {
     for (Attr_iter i = attr_begin(); i != attr_end(); ++i) {
         if ((*i)->is_alias) {
-            if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Alias") < 0)
+            if (xml.start_element("Alias") < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write Alias element");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name",
-                    (const xmlChar*) get_name(i).c_str()) < 0)
+            if (xml.write_attribute("name", get_name(i).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "Attribute",
-                    (const xmlChar*) (*i)->aliased_to.c_str()) < 0)
+            if (xml.write_attribute("Attribute", (*i)->aliased_to.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-            if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+            if (xml.end_element() < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not end Alias element");
         }
         else if (is_container(i)) {
-            if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Attribute") < 0)
+            if (xml.start_element("Attribute") < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write Attribute element");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name",
-                    (const xmlChar*) get_name(i).c_str()) < 0)
+            if (xml.write_attribute("name", get_name(i).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "type",
-                    (const xmlChar*) get_type(i).c_str()) < 0)
+            if (xml.write_attribute("type", get_type(i).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
             get_attr_table(i)->print_xml_writer(xml);
 
-            if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+            if (xml.end_element() < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not end Attribute element");
         }
         else {
-            if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Attribute") < 0)
+            if (xml.start_element("Attribute") < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write Attribute element");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name",
-                    (const xmlChar*) get_name(i).c_str()) < 0)
+            if (xml.write_attribute("name", get_name(i).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "type",
-                    (const xmlChar*) get_type(i).c_str()) < 0)
+            if (xml.write_attribute("type", get_type(i).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
             if (get_attr_type(i) == Attr_other_xml) {
                 if (get_attr_num(i) != 1)
                     throw Error("OtherXML attributes cannot be vector-valued.");
-                // Replaced xmltextWriterWriteString with xmlTextWriterWriteRaw to keep the
-                // libxml2 code from escaping the xml (which was breaking all of the inferencing
-                // code. jhrg
-                if (xmlTextWriterWriteRaw(xml.get_writer(), (const xmlChar*) get_attr(i, 0).c_str()) < 0)
+                // Use write_raw() and not write_string() to keep the writer from
+                // escaping the xml (which was breaking all of the inferencing code). jhrg
+                if (xml.write_raw(get_attr(i, 0).c_str()) < 0)
                     throw InternalErr(__FILE__, __LINE__, "Could not write OtherXML value");
             }
             else {
                 for (unsigned j = 0; j < get_attr_num(i); ++j) {
-                    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "value") < 0)
+                    if (xml.start_element("value") < 0)
                         throw InternalErr(__FILE__, __LINE__, "Could not write value element");
 
-                    if (xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) get_attr(i, j).c_str()) < 0)
+                    if (xml.write_string(get_attr(i, j).c_str()) < 0)
                         throw InternalErr(__FILE__, __LINE__, "Could not write attribute value");
 
-                    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+                    if (xml.end_element() < 0)
                         throw InternalErr(__FILE__, __LINE__, "Could not end value element");
                 }
             }
-            if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+            if (xml.end_element() < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not end Attribute element");
         }
     }
@@ -1532,12 +1674,11 @@ void AttrTable::dump(ostream &strm) const
                 strm << DapIndent::LMarg << "attr: " << e->name << " of type " << type << endl;
                 DapIndent::Indent();
                 strm << DapIndent::LMarg;
-                vector<string>::const_iterator iter = e->attr->begin();
-                vector<string>::const_iterator last = e->attr->end() - 1;
-                for (; iter != last; ++iter) {
-                    strm << (*iter) << ", ";
+                unsigned int last = e->attr->size() - 1;
+                for (unsigned int j = 0; j < last; ++j) {
+                    strm << e->attr->value(j) << ", ";
                 }
-                strm << (*(e->attr->end() - 1)) << endl;
+                strm << e->attr->value(last) << endl;
                 DapIndent::UnIndent();
             }
         }
@@ -35,6 +35,7 @@
 #define _attrtable_h 1
 
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -57,6 +58,8 @@ using std::vector;
 namespace libdap
 {
 
+class AttrValues;
+
 /** <b>AttrType</b> identifies the data types which may appear in an
     attribute table object.
 
@@ -100,9 +103,10 @@ AttrType String_to_AttrType(const string &s);
     each name, either a type and a value, or another attribute table.
     The attribute value can be a vector containing many values of the
     same type.  The attributes can have any of the types listed in the
-    <tt>AttrType</tt> list.  However, all attribute types are stored as
-    string data, except for the container type, which is stored as a
-    pointer to another attribute table.
+    <tt>AttrType</tt> list. The values are held by an AttrValues object,
+    which stores values of the numeric types in binary form when they are
+    added that way, and all other values as string data. The container type
+    is stored as a pointer to another attribute table.
 
     Each element in the attribute table can itself be an attribute
     table.  The table can also contain ``alias'' attributes whose
@@ -159,9 +163,9 @@ public:
         bool is_global; // use this to mark non-container attributes. see below.
 
         // If type == Attr_container, use attributes to read the contained
-        // table, otherwise use attr to read the vector of values.
+        // table, otherwise use attr to read the values.
         AttrTable *attributes;
-        std::vector<string> *attr; // a vector of values. jhrg 12/5/94
+        AttrValues *attr; // the values. jhrg 12/5/94
 
         entry(): name(""), type(Attr_unknown), is_alias(false),
                 aliased_to(""), is_global(true), attributes(0), attr(0) {}
@@ -172,51 +176,14 @@ public:
             clone(rhs);
         }
 
-        void delete_entry()
-        {
-            if (is_alias) // alias copies the pointers.
-                return;
-            if (type == Attr_container) {
-                delete attributes; attributes = 0;
-            }
-            else {
-                delete attr; attr = 0;
-            }
-        }
+        void delete_entry();
 
         virtual ~entry()
         {
             delete_entry();
         }
 
-        void clone(const entry &rhs)
-        {
-#if 0
-            name = rhs.name;
-            type = rhs.type;
-            is_alias = rhs.is_alias;
-            aliased_to = rhs.aliased_to;
-            is_global = rhs.is_global;
-#endif
-            switch (rhs.type) {
-            case Attr_unknown:
-                break;
-            case Attr_container: {
-                if (rhs.is_alias)
-                    attributes = rhs.attributes;
-                else
-                    attributes = new AttrTable(*rhs.attributes);
-                break;
-            }
-            default: {
-                if (rhs.is_alias)
-                    attr = rhs.attr;
-                else
-                    attr = new std::vector<string>(*rhs.attr);
-                break;
-            }
-            }
-        }
+        void clone(const entry &rhs);
 
         entry &operator=(const entry &rhs)
         {
@@ -236,6 +203,11 @@ private:
     AttrTable *d_parent;
     std::vector<entry *> attr_map;
 
+    // The position in attr_map of the first entry with each name. attr_map
+    // keeps the order entries are printed in; this makes the lookups by name
+    // in simple_find() and simple_find_container() logarithmic.
+    std::map<string, unsigned int> d_attr_index;
+
     // Use this to mark container attributes. Look at the methods
     // is_global_attribute() and set_is_...., esp. at the versions that take
     // an iterator. This code is tricky because it has to track both whole
@@ -246,7 +218,11 @@ private:
 
     void delete_attr_table();
 
+    void m_add_entry(entry *e);
+    Attr_iter m_remove_entry(Attr_iter iter);
+
     friend class AttrTableTest;
+    friend class MetadataSnapshot;
 
 protected:
     void clone(const AttrTable &at);
@@ -283,6 +259,7 @@ public:
 				     const string &value);
     virtual unsigned int append_attr(const string &name, const string &type,
 				     vector<string> *values);
+    virtual unsigned int append_attr(const string &name, const AttrValues &values);
 
     virtual AttrTable *append_container(const string &name);
     virtual AttrTable *append_container(AttrTable *at, const string &name);
@@ -302,6 +279,7 @@ public:
     virtual unsigned int get_attr_num(const string &name);
     virtual string get_attr(const string &name, unsigned int i = 0);
     virtual vector<string> *get_attr_vector(const string &name);
+    virtual AttrValues *get_attr_values(const string &name);
     virtual void del_attr(const string &name, int i = -1);
 
     virtual Attr_iter attr_begin();
@@ -316,6 +294,7 @@ public:
     virtual unsigned int get_attr_num(Attr_iter iter);
     virtual string get_attr(Attr_iter iter, unsigned int i = 0);
     virtual std::vector<string> *get_attr_vector(Attr_iter iter);
+    virtual AttrValues *get_attr_values(Attr_iter iter);
     virtual bool is_global_attribute(Attr_iter iter);
     virtual void set_is_global_attribute(Attr_iter iter, bool ga);
 
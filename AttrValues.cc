@@ -0,0 +1,402 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AttrValues.h"
+#include "dods-limits.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+// DODS_FLT_MAX plus half the distance to the next larger float: the largest
+// text that doesn't round to infinity
+static const double max_float32_text = 3.4028235677973366e+38;
+
+// Parse a whole string as a signed integer in [min, max]
+static bool parse_signed(const string &value, long long min, long long max, long long &v)
+{
+    const char *s = value.c_str();
+    char *end;
+    errno = 0;
+    v = strtoll(s, &end, 0);     // `0' --> use the value to determine base
+
+    return end != s && *end == '\0' && errno == 0 && v >= min && v <= max;
+}
+
+// strtoull() accepts a leading minus sign; unsigned values may not have one
+static bool parse_unsigned(const string &value, unsigned long long max, unsigned long long &v)
+{
+    const char *s = value.c_str();
+    if (strchr(s, '-'))
+        return false;
+
+    char *end;
+    errno = 0;
+    v = strtoull(s, &end, 0);
+
+    return end != s && *end == '\0' && errno == 0 && v <= max;
+}
+
+static bool parse_double(const string &value, double &v)
+{
+    const char *s = value.c_str();
+    char *end;
+    errno = 0;
+    v = strtod(s, &end);
+
+    return end != s && *end == '\0' && errno != ERANGE;
+}
+
+// The shortest text that reads back as the same value, using between
+// 'digits' and 'max_digits' significant digits.
+template<typename T>
+static string format_float(T v, int digits, int max_digits)
+{
+    if (v != v)
+        return "NaN";
+
+    ostringstream oss;
+    for (int p = digits; p <= max_digits; ++p) {
+        oss.str("");
+        oss.precision(p);
+        oss << v;
+        if (static_cast<T>(strtod(oss.str().c_str(), 0)) == v)
+            break;
+    }
+
+    return oss.str();
+}
+
+/** Make an empty set of values.
+ * @param type The type of the values; only numeric types can be held in
+ * binary form. */
+AttrValues::AttrValues(AttrType type) :
+    d_type(type), d_binary(false), d_has_text(true)
+{
+}
+
+/** @return True if values of \c type can be held in binary form. */
+bool AttrValues::is_numeric(AttrType type)
+{
+    return width(type) != 0;
+}
+
+/** @return The size in bytes of one value of a numeric type, or 0 for
+ * the other types. */
+unsigned int AttrValues::width(AttrType type)
+{
+    switch (type) {
+    case Attr_byte:
+        return sizeof(dods_byte);
+    case Attr_int16:
+        return sizeof(dods_int16);
+    case Attr_uint16:
+        return sizeof(dods_uint16);
+    case Attr_int32:
+        return sizeof(dods_int32);
+    case Attr_uint32:
+        return sizeof(dods_uint32);
+    case Attr_float32:
+        return sizeof(dods_float32);
+    case Attr_float64:
+        return sizeof(dods_float64);
+    default:
+        return 0;
+    }
+}
+
+/** Change the type of the values. Values held in binary form are converted
+ * to text first. */
+void AttrValues::set_type(AttrType type)
+{
+    if (type == d_type)
+        return;
+
+    text();
+    d_type = type;
+}
+
+/** @return The number of values. */
+unsigned int AttrValues::size() const
+{
+    return d_binary ? d_data.size() / width(d_type) : d_text.size();
+}
+
+void AttrValues::m_check_type(AttrType type) const
+{
+    if (type != d_type)
+        throw InternalErr(__FILE__, __LINE__,
+                "Attribute values of type " + AttrType_to_String(d_type) + " accessed as "
+                        + AttrType_to_String(type) + ".");
+}
+
+// Append the binary form of 'value' to d_data; return false, leaving d_data
+// as it was, if 'value' is not a valid value of d_type.
+bool AttrValues::m_append_binary(const string &value)
+{
+    long long s;
+    unsigned long long u;
+    double d;
+
+    switch (d_type) {
+    case Attr_byte: {
+        // As liberal as check_byte(): anything that fits in eight bits
+        if (!parse_signed(value, DODS_SCHAR_MIN, DODS_UCHAR_MAX, s))
+            return false;
+        dods_byte v = static_cast<dods_byte>(s);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_int16: {
+        if (!parse_signed(value, DODS_SHRT_MIN, DODS_SHRT_MAX, s))
+            return false;
+        dods_int16 v = static_cast<dods_int16>(s);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_uint16: {
+        if (!parse_unsigned(value, DODS_USHRT_MAX, u))
+            return false;
+        dods_uint16 v = static_cast<dods_uint16>(u);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_int32: {
+        if (!parse_signed(value, DODS_INT_MIN, DODS_INT_MAX, s))
+            return false;
+        dods_int32 v = static_cast<dods_int32>(s);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_uint32: {
+        if (!parse_unsigned(value, DODS_UINT_MAX, u))
+            return false;
+        dods_uint32 v = static_cast<dods_uint32>(u);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_float32: {
+        // Anything that rounds to a Float32; the shortest text for values
+        // near DODS_FLT_MAX is a little larger than it
+        if (!parse_double(value, d) || fabs(d) >= max_float32_text)
+            return false;
+        dods_float32 v = static_cast<dods_float32>(d);
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    case Attr_float64: {
+        if (!parse_double(value, d))
+            return false;
+        dods_float64 v = d;
+        d_data.insert(d_data.end(), (char*) &v, (char*) &v + sizeof(v));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Format the i-th value held in binary form.
+string AttrValues::m_format(unsigned int i) const
+{
+    const char *p = &d_data[i * width(d_type)];
+
+    ostringstream oss;
+    switch (d_type) {
+    case Attr_byte:
+        oss << static_cast<unsigned int>(*reinterpret_cast<const dods_byte*>(p));
+        break;
+    case Attr_int16:
+        oss << *reinterpret_cast<const dods_int16*>(p);
+        break;
+    case Attr_uint16:
+        oss << *reinterpret_cast<const dods_uint16*>(p);
+        break;
+    case Attr_int32:
+        oss << *reinterpret_cast<const dods_int32*>(p);
+        break;
+    case Attr_uint32:
+        oss << *reinterpret_cast<const dods_uint32*>(p);
+        break;
+    case Attr_float32:
+        return format_float(*reinterpret_cast<const dods_float32*>(p), 6, 9);
+    case Attr_float64:
+        return format_float(*reinterpret_cast<const dods_float64*>(p), 15, 17);
+    default:
+        throw InternalErr(__FILE__, __LINE__, "Binary attribute values of type " + AttrType_to_String(d_type));
+    }
+
+    return oss.str();
+}
+
+// Make the binary form from the text, keeping the text.
+void AttrValues::m_make_binary()
+{
+    if (d_binary)
+        return;
+
+    d_data.clear();
+    for (vector<string>::const_iterator i = d_text.begin(); i != d_text.end(); ++i) {
+        if (!m_append_binary(*i)) {
+            d_data.clear();
+            throw Error(malformed_expr, "The attribute value '" + *i + "' is not a valid " + AttrType_to_String(d_type) + ".");
+        }
+    }
+
+    DBG(cerr << "AttrValues: converted " << d_text.size() << " values to binary" << endl);
+
+    d_binary = true;
+
+    // With no values there's no text worth keeping
+    if (d_text.empty())
+        d_has_text = false;
+}
+
+// Make the text form from the binary values, keeping them.
+void AttrValues::m_make_text() const
+{
+    if (d_has_text)
+        return;
+
+    d_text.clear();
+    d_text.reserve(size());
+    for (unsigned int i = 0; i < size(); ++i)
+        d_text.push_back(m_format(i));
+
+    d_has_text = true;
+}
+
+/** Append a value given as text. If the values are held in binary form and
+ * \c value is not a valid value of the type, they become text.
+ * @param value The value */
+void AttrValues::append(const string &value)
+{
+    if (d_binary && !m_append_binary(value)) {
+        m_make_text();
+        d_data.clear();
+        d_binary = false;
+    }
+
+    if (d_has_text)
+        d_text.push_back(value);
+}
+
+/** Append values given as text. */
+void AttrValues::append(const vector<string> &values)
+{
+    for (vector<string>::const_iterator i = values.begin(); i != values.end(); ++i)
+        append(*i);
+}
+
+/** Append the values held by another object. Binary values of the same
+ * type are copied without being formatted or parsed. */
+void AttrValues::append(const AttrValues &values)
+{
+    if (values.d_binary && values.d_type == d_type && (d_binary || d_text.empty())) {
+        unsigned int n = size();
+        m_make_binary();
+
+        d_data.insert(d_data.end(), values.d_data.begin(), values.d_data.end());
+
+        if (d_has_text)
+            for (unsigned int i = n; i < size(); ++i)
+                d_text.push_back(values.value(i - n));
+    }
+    else {
+        append(values.text());
+    }
+}
+
+/** Replace the values with values given as text. */
+void AttrValues::assign(const vector<string> &values)
+{
+    clear();
+    d_text = values;
+}
+
+/** Get one value as text.
+ * @param i The index of the value; must be less than size(). */
+string AttrValues::value(unsigned int i) const
+{
+    return d_has_text ? d_text[i] : m_format(i);
+}
+
+/** Get the values as text. Values held in binary form are formatted, and
+ * the text kept, the first time this is called. */
+const vector<string> &
+AttrValues::text() const
+{
+    m_make_text();
+    return d_text;
+}
+
+/** Get the values as text that the caller can change. Values held in
+ * binary form are formatted and then dropped, so they can't be out of date
+ * with the text. */
+vector<string> &
+AttrValues::text()
+{
+    m_make_text();
+
+    d_data.clear();
+    d_binary = false;
+
+    return d_text;
+}
+
+/** Remove the i-th value. */
+void AttrValues::erase(unsigned int i)
+{
+    if (d_binary) {
+        unsigned int w = width(d_type);
+        d_data.erase(d_data.begin() + i * w, d_data.begin() + (i + 1) * w);
+    }
+
+    if (d_has_text)
+        d_text.erase(d_text.begin() + i);
+}
+
+/** Remove all the values. */
+void AttrValues::clear()
+{
+    d_data.clear();
+    d_binary = false;
+    d_text.clear();
+    d_has_text = true;
+}
+
+} // namespace libdap
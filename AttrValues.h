@@ -0,0 +1,157 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _attr_values_h
+#define _attr_values_h
+
+#include <string>
+#include <vector>
+
+#ifndef _attrtable_h
+#include "AttrTable.h"
+#endif
+
+#ifndef __DODS_DATATYPES__
+#include "dods-datatypes.h"
+#endif
+
+namespace libdap {
+
+/** The values of one attribute, used by both AttrTable and D4Attribute.
+ *
+ * Values of the numeric types (Byte, Int16, UInt16, Int32, UInt32, Float32
+ * and Float64) can be stored in binary form, as an array of the type's
+ * values, instead of as text. Handlers that build attributes from binary
+ * data should add them that way using the typed append(); they take less
+ * memory and can be read back with data() without being parsed. The text
+ * form is made only when it's needed: value() formats one value, text()
+ * formats all of them.
+ *
+ * Values added as text, which is what the DAS and DMR parsers do, are kept
+ * as text so they print exactly as they were read. Calling data() on them
+ * converts them to binary once, keeping the text.
+ *
+ * The non-const text() returns the vector of strings for callers that
+ * modify it (AttrTable::get_attr_vector() returns it). Because the binary
+ * values could then be out of date, that drops them and the values are text
+ * from then on.
+ *
+ * Values of the other types, and of DAP4 types that have no AttrType, are
+ * always text.
+ */
+class AttrValues {
+    AttrType d_type;
+
+    // The values are in d_data if d_binary is true and in d_text if d_has_text
+    // is true; one or both are set. d_text is a cache when both are.
+    std::vector<char> d_data;
+    bool d_binary;
+
+    mutable std::vector<std::string> d_text;
+    mutable bool d_has_text;
+
+    static AttrType m_type_of(const dods_byte *) { return Attr_byte; }
+    static AttrType m_type_of(const dods_int16 *) { return Attr_int16; }
+    static AttrType m_type_of(const dods_uint16 *) { return Attr_uint16; }
+    static AttrType m_type_of(const dods_int32 *) { return Attr_int32; }
+    static AttrType m_type_of(const dods_uint32 *) { return Attr_uint32; }
+    static AttrType m_type_of(const dods_float32 *) { return Attr_float32; }
+    static AttrType m_type_of(const dods_float64 *) { return Attr_float64; }
+
+    void m_check_type(AttrType type) const;
+    void m_make_binary();
+    void m_make_text() const;
+    bool m_append_binary(const std::string &value);
+    std::string m_format(unsigned int i) const;
+
+public:
+    AttrValues(AttrType type = Attr_unknown);
+
+    static bool is_numeric(AttrType type);
+    static unsigned int width(AttrType type);
+
+    AttrType type() const { return d_type; }
+    void set_type(AttrType type);
+
+    unsigned int size() const;
+    bool empty() const { return size() == 0; }
+
+    /** @return True if the values are held in binary form. */
+    bool is_binary() const { return d_binary; }
+
+    /** @return True if the values are held as text, which may be as well
+     * as in binary form. */
+    bool has_text() const { return d_has_text; }
+
+    void append(const std::string &value);
+    void append(const std::vector<std::string> &values);
+    void assign(const std::vector<std::string> &values);
+    void append(const AttrValues &values);
+
+    /** Append values in binary form. The type of the values must match
+     * the type of this object.
+     * @param values The values
+     * @param n How many values
+     * @exception InternalErr if the type doesn't match.
+     * @exception Error if values already held as text can't be converted
+     * to the type. */
+    template<typename T> void append(const T *values, unsigned int n)
+    {
+        m_check_type(m_type_of(values));
+        m_make_binary();
+
+        const char *p = reinterpret_cast<const char*>(values);
+        d_data.insert(d_data.end(), p, p + n * sizeof(T));
+
+        if (d_has_text)
+            for (unsigned int i = size() - n; i < size(); ++i)
+                d_text.push_back(m_format(i));
+    }
+
+    /** Get the values in binary form. If they are held as text, they are
+     * converted once; later calls don't parse them again.
+     * @return A pointer to the size() values, or null if there are none.
+     * @exception InternalErr if T doesn't match the type of this object.
+     * @exception Error if a value held as text is not a valid value of
+     * the type. */
+    template<typename T> const T *data()
+    {
+        m_check_type(m_type_of(static_cast<const T*>(0)));
+        m_make_binary();
+
+        return d_data.empty() ? 0 : reinterpret_cast<const T*>(&d_data[0]);
+    }
+
+    std::string value(unsigned int i) const;
+
+    const std::vector<std::string> &text() const;
+    std::vector<std::string> &text();
+
+    void erase(unsigned int i);
+    void clear();
+};
+
+} // namespace libdap
+
+#endif // _attr_values_h
@@ -57,12 +57,15 @@
 #include "Sequence.h"
 #include "Grid.h"
 
+#include "AttrValues.h"
 #include "D4Attributes.h"
 #include "DMR.h"
 #include "XMLWriter.h"
 #include "D4BaseTypeFactory.h"
 
 #include "InternalErr.h"
+#include "VarIndex.h"
+#include "ProjectionOverlay.h"
 
 #include "util.h"
 #include "escaping.h"
@@ -92,11 +95,25 @@ BaseType::m_duplicate(const BaseType &bt)
     d_is_read = bt.d_is_read; // added, reza
     d_is_send = bt.d_is_send; // added, reza
     d_in_selection = bt.d_in_selection;
+
+    // A copy of a shared variable isn't shared; it holds the projection
+    // the current overlay has for the variable.
+    d_is_shared = false;
+    if (ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(&bt)) {
+        if (v->has_read) d_is_read = v->read;
+        if (v->has_send) d_is_send = v->send;
+        if (v->has_selection) d_in_selection = v->in_selection;
+    }
     d_is_synthesized = bt.d_is_synthesized; // 5/11/2001 jhrg
 
     d_parent = bt.d_parent; // copy pointers 6/4/2001 jhrg
+    d_dds_index = 0;        // the copy isn't in bt's DDS
 
-    d_attr = bt.d_attr;  // Deep copy.
+    // Deep copy; an empty table isn't copied
+    if (bt.has_attr_table())
+        d_attr = new AttrTable(*bt.d_attr);
+    else
+        d_attr = 0;
 
     if (bt.d_attributes)
         d_attributes = new D4Attributes(*bt.d_attributes); // deep copy
@@ -123,8 +140,8 @@ BaseType::m_duplicate(const BaseType &bt)
     @param is_dap4 True if this is a DAP4 variable. Default is False
     @see Type */
 BaseType::BaseType(const string &n, const Type &t, bool is_dap4)
-        : d_name(n), d_type(t), d_dataset(""), d_is_read(false), d_is_send(false),
-        d_parent(0), d_attributes(0), d_is_dap4(is_dap4),
+        : d_name(n), d_dataset(""), d_parent(0), d_dds_index(0), d_attr(0), d_attributes(0), d_type(t),
+        d_is_read(false), d_is_send(false), d_is_dap4(is_dap4), d_is_shared(false),
         d_in_selection(false), d_is_synthesized(false)
 {}
 
@@ -141,8 +158,8 @@ BaseType::BaseType(const string &n, const Type &t, bool is_dap4)
     @param is_dap4 True if this is a DAP4 variable.
     @see Type */
 BaseType::BaseType(const string &n, const string &d, const Type &t, bool is_dap4)
-        : d_name(n), d_type(t), d_dataset(d), d_is_read(false), d_is_send(false),
-        d_parent(0), d_attributes(0), d_is_dap4(is_dap4),
+        : d_name(n), d_dataset(d), d_parent(0), d_dds_index(0), d_attr(0), d_attributes(0), d_type(t),
+        d_is_read(false), d_is_send(false), d_is_dap4(is_dap4), d_is_shared(false),
         d_in_selection(false), d_is_synthesized(false)
 {}
 
@@ -157,6 +174,8 @@ BaseType::~BaseType()
 {
     DBG2(cerr << "Entering ~BaseType (" << this << ")" << endl);
 
+    delete d_attr;
+
     if (d_attributes)
         delete d_attributes;
 
@@ -170,8 +189,18 @@ BaseType::operator=(const BaseType &rhs)
     if (this == &rhs)
         return *this;
 
+    delete d_attr;
+    delete d_attributes;
+
+    // A variable in a DDS stays there
+    VarIndex *dds_index = d_dds_index;
+
     m_duplicate(rhs);
 
+    d_dds_index = dds_index;
+
+    VarIndex::name_changed(this);   // the name may have changed
+
     DBG(cerr << "Exiting BaseType::operator=" << endl);
     return *this;
 }
@@ -186,12 +215,12 @@ string BaseType::toString()
     oss << "BaseType (" << this << "):" << endl
     << "          _name: " << name() << endl
     << "          _type: " << type_name() << endl
-    << "          _dataset: " << d_dataset << endl
+    << "          _dataset: " << d_dataset.str() << endl
     << "          _read_p: " << d_is_read << endl
     << "          _send_p: " << d_is_send << endl
     << "          _synthesized_p: " << d_is_synthesized << endl
-    << "          d_parent: " << d_parent << endl
-    << "          d_attr: " << hex << &d_attr << dec << endl;
+    << "          d_parent: " << get_parent() << endl
+    << "          d_attr: " << hex << d_attr << dec << endl;
 
     return oss.str();
 }
@@ -217,7 +246,8 @@ BaseType::transform_to_dap4(D4Group */*root*/, Constructor */*container*/)
 	BaseType *dest = ptr_duplicate();
 
 	// Copy the D2 attributes from 'this' to dest's D4 Attributes
-	dest->attributes()->transform_to_dap4(get_attr_table());
+	if (has_attr_table())
+		dest->attributes()->transform_to_dap4(get_attr_table());
 
 	dest->set_is_dap4(true);
 
@@ -241,18 +271,18 @@ BaseType::dump(ostream &strm) const
 
     strm << DapIndent::LMarg << "name: " << name() << endl ;
     strm << DapIndent::LMarg << "type: " << type_name() << endl ;
-    strm << DapIndent::LMarg << "dataset: " << d_dataset << endl ;
+    strm << DapIndent::LMarg << "dataset: " << d_dataset.str() << endl ;
     strm << DapIndent::LMarg << "read_p: " << d_is_read << endl ;
     strm << DapIndent::LMarg << "send_p: " << d_is_send << endl ;
     strm << DapIndent::LMarg << "synthesized_p: " << d_is_synthesized << endl ;
-    strm << DapIndent::LMarg << "parent: " << (void *)d_parent << endl ;
+    strm << DapIndent::LMarg << "parent: " << (void *)get_parent() << endl ;
     strm << DapIndent::LMarg << "attributes: " << endl ;
     DapIndent::Indent() ;
 
     if (d_attributes)
         d_attributes->dump(strm);
-    else
-        d_attr.dump(strm) ;
+    else if (d_attr)
+        d_attr->dump(strm) ;
 
     DapIndent::UnIndent() ;
 
@@ -264,7 +294,7 @@ BaseType::dump(ostream &strm) const
 string
 BaseType::name() const
 {
-    return d_name;
+    return d_name.str();
 }
 
 /**
@@ -290,6 +320,7 @@ BaseType::set_name(const string &n)
 {
     string name = n;
     d_name = www2id(name); // www2id writes into its param.
+    VarIndex::name_changed(this);
 }
 
 /** @brief Returns the name of the dataset used to create this instance
@@ -302,7 +333,7 @@ BaseType::set_name(const string &n)
 string
 BaseType::dataset() const
 {
-    return d_dataset;
+    return d_dataset.str();
 }
 
 /** @brief Returns the type of the class instance. */
@@ -424,7 +455,8 @@ BaseType::set_synthesized_p(bool state)
 bool
 BaseType::read_p()
 {
-    return d_is_read;
+    ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(this);
+    return v && v->has_read ? v->read : d_is_read;
 }
 
 /** Sets the value of the <tt>read_p</tt> property. This indicates that the
@@ -478,7 +510,14 @@ BaseType::set_read_p(bool state)
 
 #if 1
     if (!d_is_synthesized) {
-        d_is_read = state;
+        if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+            ProjectionOverlay::Variable &v = overlay->variable(this);
+            v.has_read = true;
+            v.read = state;
+        }
+        else {
+            d_is_read = state;
+        }
     }
 #else
     d_is_read = state;
@@ -498,7 +537,8 @@ BaseType::set_read_p(bool state)
 bool
 BaseType::send_p()
 {
-    return d_is_send;
+    ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(this);
+    return v && v->has_send ? v->send : d_is_send;
 }
 
 /** Sets the value of the <tt>send_p</tt> flag.  This
@@ -514,7 +554,15 @@ BaseType::set_send_p(bool state)
 {
     DBG2(cerr << "Calling BaseType::set_send_p() for: " << this->name()
         << endl);
-    d_is_send = state;
+
+    if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+        ProjectionOverlay::Variable &v = overlay->variable(this);
+        v.has_send = true;
+        v.send = state;
+    }
+    else {
+        d_is_send = state;
+    }
 }
 
 
@@ -526,7 +574,10 @@ BaseType::set_send_p(bool state)
 AttrTable &
 BaseType::get_attr_table()
 {
-    return d_attr;
+    if (!d_attr)
+        d_attr = new AttrTable;
+
+    return *d_attr;
 }
 
 /** Set this variable's attribute table.
@@ -534,7 +585,10 @@ BaseType::get_attr_table()
 void
 BaseType::set_attr_table(const AttrTable &at)
 {
-    d_attr = at;
+    if (!d_attr)
+        d_attr = new AttrTable;
+
+    *d_attr = at;
 }
 
 /** DAP4 Attribute methods
@@ -602,7 +656,7 @@ void BaseType::transfer_attributes(AttrTable *at_container) {
 			if (at->get_attr_type(at_p) == Attr_container)
 				get_attr_table().append_container(new AttrTable(*at->get_attr_table(at_p)), at->get_name(at_p));
 			else
-				get_attr_table().append_attr(at->get_name(at_p), at->get_type(at_p), at->get_attr_vector(at_p));
+				get_attr_table().append_attr(at->get_name(at_p), *at->get_attr_values(at_p));
 
 			at_p++;
 		}
@@ -623,7 +677,8 @@ void BaseType::transfer_attributes(AttrTable *at_container) {
 bool
 BaseType::is_in_selection()
 {
-    return d_in_selection;
+    ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(this);
+    return v && v->has_selection ? v->in_selection : d_in_selection;
 }
 
 /** Set the \e in_selection property to \e state. This property indicates
@@ -638,7 +693,14 @@ BaseType::is_in_selection()
 void
 BaseType::set_in_selection(bool state)
 {
-    d_in_selection = state;
+    if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+        ProjectionOverlay::Variable &v = overlay->variable(this);
+        v.has_selection = true;
+        v.in_selection = state;
+    }
+    else {
+        d_in_selection = state;
+    }
 }
 
 // Protected method.
@@ -659,6 +721,7 @@ BaseType::set_parent(BaseType *parent)
         throw InternalErr("Call to set_parent with incorrect variable type.");
 
     d_parent = parent;
+    d_dds_index = 0;
 }
 
 // Public method.
@@ -1025,9 +1088,9 @@ BaseType::print_val(FILE *out, string space, bool print_decl_p)
 void
 BaseType::print_xml(FILE *out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /** Write the XML representation of this variable. This method is used to
@@ -1040,9 +1103,9 @@ BaseType::print_xml(FILE *out, string space, bool constrained)
 void
 BaseType::print_xml(ostream &out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 /** Write the XML representation of this variable. This method is used to
@@ -1057,20 +1120,20 @@ BaseType::print_xml_writer(XMLWriter &xml, bool constrained)
     if (constrained && !send_p())
         return;
 
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)type_name().c_str()) < 0)
+    if (xml.start_element(type_name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write " + type_name() + " element");
 
     if (!name().empty())
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+    if (xml.write_attribute("name", name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     if (is_dap4())
         attributes()->print_dap4(xml);
 
-    if (!is_dap4() && get_attr_table().get_size() > 0)
+    if (!is_dap4() && has_attr_table())
         get_attr_table().print_xml_writer(xml);
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end " + type_name() + " element");
 }
 
@@ -48,6 +48,7 @@
 #include <string>
 
 #include "AttrTable.h"
+#include "InternedString.h"
 
 #include "InternalErr.h"
 
@@ -70,6 +71,7 @@ class Marshaller;
 class UnMarshaller;
 
 class Constructor;
+class VarIndex;
 class XMLWrter;
 
 class DMR;
@@ -117,31 +119,41 @@ class D4Attributes;
 class BaseType : public DapObj
 {
 private:
-    string d_name;  // name of the instance
-    Type d_type;   // instance's type
-    string d_dataset; // name of the dataset used to create this BaseType
-
-    bool d_is_read;  // true if the value has been read
-    bool d_is_send;  // Is the variable in the projection?
+    // The names are interned since a dataset may have many thousands of
+    // variables, often with the same names and always with the same dataset.
+    InternedString d_name;  // name of the instance
+    InternedString d_dataset; // name of the dataset used to create this BaseType
 
     // d_parent points to the Constructor or Vector which holds a particular
     // variable. It is null for simple variables. The Vector and Constructor
     // classes must maintain this variable.
     BaseType *d_parent;
 
-    // Attributes for this variable. Added 05/20/03 jhrg
-    AttrTable d_attr;
+    // For a variable at the top level of a DDS, the index of the DDS's
+    // variables, which is marked when the variable is renamed; else null.
+    VarIndex *d_dds_index;
+
+    // Attributes for this variable. Added 05/20/03 jhrg. Most variables
+    // have none, so the table is made by get_attr_table() when first used.
+    AttrTable *d_attr;
 
     D4Attributes *d_attributes;
 
-    bool d_is_dap4;         // True if this is a DAP4 variable, false ... DAP2
+    Type d_type;   // instance's type
 
-    // These are non-empty only for DAP4 variables. Added 9/27/12 jhrg
+    // The flags are packed into the bytes following d_type
+    bool d_is_read:1;  // true if the value has been read
+    bool d_is_send:1;  // Is the variable in the projection?
+    bool d_is_dap4:1;  // True if this is a DAP4 variable, false ... DAP2
+    bool d_is_shared:1; // Set by ProjectionOverlay::share()
+
+    friend class ProjectionOverlay;
+    friend class VarIndex;
 
 protected:
     // These were/are used for DAP2 CEs, but not for DAP4 ones
-    bool d_in_selection; // Is the variable in the selection?
-    bool d_is_synthesized; // true if the variable is synthesized
+    bool d_in_selection:1; // Is the variable in the selection?
+    bool d_is_synthesized:1; // true if the variable is synthesized
 
     void m_duplicate(const BaseType &bt);
 
@@ -230,6 +242,15 @@ public:
     virtual AttrTable &get_attr_table();
     virtual void set_attr_table(const AttrTable &at);
 
+    /** @return True if this variable has DAP2 attributes. Unlike
+     * get_attr_table(), this doesn't make a table for variables without any. */
+    bool has_attr_table() const { return d_attr && d_attr->get_size() > 0; }
+
+    /** @return True if this variable is part of a tree passed to
+     * ProjectionOverlay::share(); its projection is then held by the
+     * overlay in use, if any. */
+    bool is_shared() const { return d_is_shared; }
+
     // DAP4 attributes
     virtual D4Attributes *attributes();
     virtual void set_attributes(D4Attributes *);
@@ -72,6 +72,7 @@ Constructor::m_duplicate(const Constructor &c)
 	// Clear out any spurious vars in Constructor::d_vars
 	// Moved from Grid::m_duplicate. jhrg 4/3/13
 	d_vars.clear(); // [mjohnson 10 Sep 2009]
+	d_var_index.changed();
 
 	Vars_citer i = c.d_vars.begin();
 	while (i != c.d_vars.end()) {
@@ -145,7 +146,8 @@ Constructor::transform_to_dap4(D4Group *root, Constructor *dest)
     }
 
     // Add attributes
-	dest->attributes()->transform_to_dap4(get_attr_table());
+	if (has_attr_table())
+		dest->attributes()->transform_to_dap4(get_attr_table());
 
     dest->set_is_dap4(true);
 
@@ -268,27 +270,18 @@ Constructor::var(const string &n, btp_stack &s)
 BaseType *
 Constructor::m_leaf_match(const string &name, btp_stack *s)
 {
-    for (Vars_iter i = d_vars.begin(); i != d_vars.end(); i++) {
-        if ((*i)->name() == name) {
-            if (s) {
-                DBG(cerr << "Pushing " << this->name() << endl);
-                s->push(static_cast<BaseType *>(this));
-            }
-            return *i;
-        }
-        if ((*i)->is_constructor_type()) {
-            BaseType *btp = (*i)->var(name, false, s);
-            if (btp) {
-                if (s) {
-                    DBG(cerr << "Pushing " << this->name() << endl);
-                    s->push(static_cast<BaseType *>(this));
-                }
-                return btp;
-            }
-        }
+    VarIndex::Path path;
+    BaseType *btp = d_var_index.find_leaf(d_vars, name, s ? &path : 0);
+    if (btp && s) {
+        // Push the constructors that hold btp innermost first, as the
+        // recursive search did
+        for (VarIndex::Path::reverse_iterator i = path.rbegin(); i != path.rend(); ++i)
+            s->push(*i);
+        DBG(cerr << "Pushing " << this->name() << endl);
+        s->push(static_cast<BaseType *>(this));
     }
 
-    return 0;
+    return btp;
 }
 
 // Protected method
@@ -296,13 +289,12 @@ BaseType *
 Constructor::m_exact_match(const string &name, btp_stack *s)
 {
     // Look for name at the top level first.
-    for (Vars_iter i = d_vars.begin(); i != d_vars.end(); i++) {
-        if ((*i)->name() == name) {
-            if (s)
-                s->push(static_cast<BaseType *>(this));
+    BaseType *btp = d_var_index.find(d_vars, name);
+    if (btp) {
+        if (s)
+            s->push(static_cast<BaseType *>(this));
 
-            return *i;
-        }
+        return btp;
     }
 
     // If it was not found using the simple search, look for a dot and
@@ -397,6 +389,7 @@ Constructor::add_var(BaseType *bt, Part)
     BaseType *btp = bt->ptr_duplicate();
     btp->set_parent(this);
     d_vars.push_back(btp);
+    VarIndex::vars_changed(this);
 }
 
 /** Adds an element to a Constructor.
@@ -414,6 +407,7 @@ Constructor::add_var_nocopy(BaseType *bt, Part)
 #endif
     bt->set_parent(this);
     d_vars.push_back(bt);
+    VarIndex::vars_changed(this);
 }
 
 /** Remove an element from a Constructor.
@@ -428,6 +422,7 @@ Constructor::del_var(const string &n)
             BaseType *bt = *i ;
             d_vars.erase(i) ;
             delete bt ; bt = 0;
+            VarIndex::vars_changed(this);
             return;
         }
     }
@@ -440,6 +435,7 @@ Constructor::del_var(Vars_iter i)
         BaseType *bt = *i;
         d_vars.erase(i);
         delete bt;
+        VarIndex::vars_changed(this);
     }
 }
 
@@ -658,9 +654,9 @@ Constructor::print_val(ostream &out, string space, bool print_decl_p)
 void
 Constructor::print_xml(FILE *out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /**
@@ -669,9 +665,9 @@ Constructor::print_xml(FILE *out, string space, bool constrained)
 void
 Constructor::print_xml(ostream &out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 class PrintFieldXMLWriter : public unary_function<BaseType *, void>
@@ -695,16 +691,16 @@ Constructor::print_xml_writer(XMLWriter &xml, bool constrained)
     if (constrained && !send_p())
         return;
 
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)type_name().c_str()) < 0)
+    if (xml.start_element(type_name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write " + type_name() + " element");
 
     if (!name().empty())
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+        if (xml.write_attribute("name", name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     // DAP2 prints attributes first. For some reason we decided that DAP4 should
     // print them second. No idea why... jhrg 8/15/14
-    if (!is_dap4() && get_attr_table().get_size() > 0)
+    if (!is_dap4() && has_attr_table())
         get_attr_table().print_xml_writer(xml);
 
     bool has_variables = (var_begin() != var_end());
@@ -717,11 +713,11 @@ Constructor::print_xml_writer(XMLWriter &xml, bool constrained)
 #if 0
     // Moved up above so that the DDX tests for various handles will still work.
     // jhrg 8/15/14
-    if (!is_dap4() && get_attr_table().get_size() > 0)
+    if (!is_dap4() && has_attr_table())
         get_attr_table().print_xml_writer(xml);
 #endif
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end " + type_name() + " element");
 }
 
@@ -745,11 +741,11 @@ Constructor::print_dap4(XMLWriter &xml, bool constrained)
     if (constrained && !send_p())
         return;
 
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)type_name().c_str()) < 0)
+    if (xml.start_element(type_name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write " + type_name() + " element");
 
     if (!name().empty())
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+        if (xml.write_attribute("name", name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     bool has_variables = (var_begin() != var_end());
@@ -758,7 +754,7 @@ Constructor::print_dap4(XMLWriter &xml, bool constrained)
 
     attributes()->print_dap4(xml);
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end " + type_name() + " element");
 }
 
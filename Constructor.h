@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "BaseType.h"
+#include "VarIndex.h"
 
 class Crc32;
 
@@ -45,6 +46,11 @@ class Constructor: public BaseType
 private:
     Constructor();  // No default ctor.
 
+    VarIndex d_var_index;   // Names of d_vars and the variables they hold
+
+    friend class ProjectionOverlay;
+    friend class VarIndex;
+
 protected:
     std::vector<BaseType *> d_vars;
 
@@ -35,63 +35,55 @@ void D4AsyncUtil::writeD4AsyncRequired(XMLWriter &xml, long expectedDelay, long
 
 	// ------ AsynchronousResponse Element and Attributes - BEGIN
 
-	/*
-	int	xmlTextWriterWriteAttributeNS	(xmlTextWriterPtr writer,
-						 const xmlChar * prefix,
-						 const xmlChar * name,
-						 const xmlChar * namespaceURI,
-						 const xmlChar * content)
-	*/
-
 	if(stylesheet_ref){
 		string href = "href='" + *stylesheet_ref +"'";
-		if(xmlTextWriterStartPI(xml.get_writer(), (const xmlChar*) "xml-stylesheet") < 0)
+		if(xml.start_pi("xml-stylesheet") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not start XML Processing Instruction.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) "type='text/xsl'") < 0)
+		if(xml.write_string("type='text/xsl'") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) " ") < 0)
+		if(xml.write_string(" ") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) href.c_str()) < 0)
+		if(xml.write_string(href.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterEndPI(xml.get_writer()) < 0)
+		if(xml.end_pi() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not Close XML Processing Instruction.");
 	}
 
 	DapXmlNamspaces dapns;
-	if (xmlTextWriterStartElementNS(xml.get_writer(),
-			(const xmlChar*)"dap",
-			(const xmlChar*) "AsynchronousResponse",
-			(const xmlChar*) dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
+	if (xml.start_element_ns(
+			"dap",
+			"AsynchronousResponse",
+			dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write AsynchronousResponse element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "status", (const xmlChar *) "required") < 0)
+	if (xml.write_attribute("status", "required") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
 
 
 	// ------ expectedDelay Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:expectedDelay") < 0)
+	if (xml.start_element("dap:expectedDelay") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write expectedDelay element");
 	ostringstream oss;
 	oss << expectedDelay;
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "seconds", (const xmlChar*) oss.str().c_str()) < 0)
+	if (xml.write_attribute("seconds", oss.str().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end expectedDelay element");
 	// ------ expectedDelay Element and Attributes - END
 
 
 	// ------ responseLifetime Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:responseLifetime") < 0)
+	if (xml.start_element("dap:responseLifetime") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write expectedDelay element");
 	ostringstream oss2;
 	oss2 << responseLifetime;
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "seconds", (const xmlChar*) oss2.str().c_str()) < 0)
+	if (xml.write_attribute("seconds", oss2.str().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'seconds'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end responseLifetime element");
 	// ------ responseLifetime Element and Attributes - END
 
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end AsynchronousResponse element");
 	// ------ AsynchronousResponse Element and Attributes - END
 }
@@ -109,63 +101,63 @@ void D4AsyncUtil::writeD4AsyncAccepted(XMLWriter &xml, long expectedDelay, long
 
 	if(stylesheet_ref){
 		string href = "href='" + *stylesheet_ref +"'";
-		if(xmlTextWriterStartPI(xml.get_writer(), (const xmlChar*) "xml-stylesheet") < 0)
+		if(xml.start_pi("xml-stylesheet") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not start XML Processing Instruction.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) "type='text/xsl'") < 0)
+		if(xml.write_string("type='text/xsl'") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) " ") < 0)
+		if(xml.write_string(" ") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) href.c_str()) < 0)
+		if(xml.write_string(href.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterEndPI(xml.get_writer()) < 0)
+		if(xml.end_pi() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not Close XML Processing Instruction.");
 	}
 
-	if (xmlTextWriterStartElementNS(xml.get_writer(),
-			(const xmlChar*)"dap",
-			(const xmlChar*) "AsynchronousResponse",
-			(const xmlChar*) dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
+	if (xml.start_element_ns(
+			"dap",
+			"AsynchronousResponse",
+			dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write AsynchronousResponse element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "status", (const xmlChar *) "accepted") < 0)
+	if (xml.write_attribute("status", "accepted") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
 
 
 	// ------ expectedDelay Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:expectedDelay") < 0)
+	if (xml.start_element("dap:expectedDelay") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write expectedDelay element");
 	ostringstream oss;
 	oss << expectedDelay;
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "seconds", (const xmlChar*) oss.str().c_str()) < 0)
+	if (xml.write_attribute("seconds", oss.str().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'seconds'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end expectedDelay element");
 	// ------ expectedDelay Element and Attributes - END
 
 
 	// ------ responseLifetime Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:responseLifetime") < 0)
+	if (xml.start_element("dap:responseLifetime") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write expectedDelay element");
 	ostringstream oss2;
 	oss2 << responseLifetime;
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "seconds", (const xmlChar*) oss2.str().c_str()) < 0)
+	if (xml.write_attribute("seconds", oss2.str().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'seconds'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end responseLifetime element");
 	// ------ responseLifetime Element and Attributes - END
 
 
 	// ------ link Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:link") < 0)
+	if (xml.start_element("dap:link") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write expectedDelay element");
 
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "href", (const xmlChar*) asyncResourceUrl.c_str()) < 0)
+	if (xml.write_attribute("href", asyncResourceUrl.c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'href'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end link element");
 	// ------ link Element and Attributes - END
 
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end AsynchronousResponse element");
 	// ------ AsynchronousResponse Element and Attributes - END
 }
@@ -183,27 +175,27 @@ void D4AsyncUtil::writeD4AsyncPending(XMLWriter &xml, string *stylesheet_ref)  {
 
 	if(stylesheet_ref){
 		string href = "href='" + *stylesheet_ref +"'";
-		if(xmlTextWriterStartPI(xml.get_writer(), (const xmlChar*) "xml-stylesheet") < 0)
+		if(xml.start_pi("xml-stylesheet") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not start XML Processing Instruction.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) "type='text/xsl'") < 0)
+		if(xml.write_string("type='text/xsl'") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) " ") < 0)
+		if(xml.write_string(" ") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) href.c_str()) < 0)
+		if(xml.write_string(href.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterEndPI(xml.get_writer()) < 0)
+		if(xml.end_pi() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not Close XML Processing Instruction.");
 	}
 
-	if (xmlTextWriterStartElementNS(xml.get_writer(),
-			(const xmlChar*)"dap",
-			(const xmlChar*) "AsynchronousResponse",
-			(const xmlChar*) dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
+	if (xml.start_element_ns(
+			"dap",
+			"AsynchronousResponse",
+			dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write AsynchronousResponse element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "status", (const xmlChar *) "pending") < 0)
+	if (xml.write_attribute("status", "pending") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end AsynchronousResponse element");
 	// ------ AsynchronousResponse Element and Attributes - END
 }
@@ -222,27 +214,27 @@ void D4AsyncUtil::writeD4AsyncResponseGone(XMLWriter &xml, string *stylesheet_re
 
 	if(stylesheet_ref){
 		string href = "href='" + *stylesheet_ref +"'";
-		if(xmlTextWriterStartPI(xml.get_writer(), (const xmlChar*) "xml-stylesheet") < 0)
+		if(xml.start_pi("xml-stylesheet") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not start XML Processing Instruction.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) "type='text/xsl'") < 0)
+		if(xml.write_string("type='text/xsl'") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) " ") < 0)
+		if(xml.write_string(" ") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) href.c_str()) < 0)
+		if(xml.write_string(href.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterEndPI(xml.get_writer()) < 0)
+		if(xml.end_pi() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not Close XML Processing Instruction.");
 	}
 
-	if (xmlTextWriterStartElementNS(xml.get_writer(),
-			(const xmlChar*)"dap",
-			(const xmlChar*) "AsynchronousResponse",
-			(const xmlChar*) dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
+	if (xml.start_element_ns(
+			"dap",
+			"AsynchronousResponse",
+			dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write AsynchronousResponse element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "status", (const xmlChar *) "gone") < 0)
+	if (xml.write_attribute("status", "gone") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end AsynchronousResponse element");
 	// ------ AsynchronousResponse Element and Attributes - END
 }
@@ -261,43 +253,43 @@ void D4AsyncUtil::writeD4AsyncResponseRejected(XMLWriter &xml, RejectReasonCode
 
 	if(stylesheet_ref){
 		string href = "href='" + *stylesheet_ref +"'";
-		if(xmlTextWriterStartPI(xml.get_writer(), (const xmlChar*) "xml-stylesheet") < 0)
+		if(xml.start_pi("xml-stylesheet") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not start XML Processing Instruction.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) "type='text/xsl'") < 0)
+		if(xml.write_string("type='text/xsl'") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) " ") < 0)
+		if(xml.write_string(" ") < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) href.c_str()) < 0)
+		if(xml.write_string(href.c_str()) < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not write Processing Instruction content.");
-		if(xmlTextWriterEndPI(xml.get_writer()) < 0)
+		if(xml.end_pi() < 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not Close XML Processing Instruction.");
 	}
 
-	if (xmlTextWriterStartElementNS(xml.get_writer(),
-			(const xmlChar*)"dap",
-			(const xmlChar*) "AsynchronousResponse",
-			(const xmlChar*) dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
+	if (xml.start_element_ns(
+			"dap",
+			"AsynchronousResponse",
+			dapns.getDapNamespaceString(DAP_4_0).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write AsynchronousResponse element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "status", (const xmlChar *) "rejected") < 0)
+	if (xml.write_attribute("status", "rejected") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'status'");
 
 	// ------ reason Element and Attributes
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dap:reason") < 0)
+	if (xml.start_element("dap:reason") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write reason element");
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "code", (const xmlChar*) getRejectReasonCodeString(code).c_str()) < 0)
+	if (xml.write_attribute("code", getRejectReasonCodeString(code).c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for 'code'");
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end reason element");
 	// ------ reason Element and Attributes - END
 
 
 	// ------ description Element and Attributes
-	if (xmlTextWriterWriteElement(xml.get_writer(), (const xmlChar*) "dap:description", (const xmlChar*) description.c_str()) < 0)
+	if (xml.write_element("dap:description", description.c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write description element");
 
 	// ------ description Element and Attributes - END
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end AsynchronousResponse element");
 	// ------ AsynchronousResponse Element and Attributes - END
 
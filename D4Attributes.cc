@@ -105,6 +105,40 @@ string D4AttributeTypeToString(D4AttributeType at)
     }
 }
 
+/** The AttrType used to hold the values of a DAP4 attribute type. The
+ * DAP4 types that have no AttrType, and so are held as text, map to
+ * Attr_unknown. */
+AttrType D4AttributeTypeToAttrType(D4AttributeType at)
+{
+    switch (at) {
+        case attr_byte_c:
+        case attr_uint8_c:
+            return Attr_byte;
+        case attr_int16_c:
+            return Attr_int16;
+        case attr_uint16_c:
+            return Attr_uint16;
+        case attr_int32_c:
+            return Attr_int32;
+        case attr_uint32_c:
+            return Attr_uint32;
+        case attr_float32_c:
+            return Attr_float32;
+        case attr_float64_c:
+            return Attr_float64;
+        case attr_str_c:
+            return Attr_string;
+        case attr_url_c:
+            return Attr_url;
+        case attr_otherxml_c:
+            return Attr_other_xml;
+        case attr_container_c:
+            return Attr_container;
+        default:
+            return Attr_unknown;
+    }
+}
+
 D4AttributeType StringToD4AttributeType(string s)
 {
     downcase(s);
@@ -208,61 +242,61 @@ D4Attributes::transform_to_dap4(AttrTable &at)
 		}
 		case Attr_byte: {
 			D4Attribute *a = new D4Attribute(name, attr_byte_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_int16: {
 			D4Attribute *a = new D4Attribute(name, attr_int16_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_uint16: {
 			D4Attribute *a = new D4Attribute(name, attr_uint16_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_int32: {
 			D4Attribute *a = new D4Attribute(name, attr_int32_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_uint32: {
 			D4Attribute *a = new D4Attribute(name, attr_uint32_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_float32: {
 			D4Attribute *a = new D4Attribute(name, attr_float32_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_float64: {
 			D4Attribute *a = new D4Attribute(name, attr_float64_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_string: {
 			D4Attribute *a = new D4Attribute(name, attr_str_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_url: {
 			D4Attribute *a = new D4Attribute(name, attr_url_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
 		case Attr_other_xml: {
 			D4Attribute *a = new D4Attribute(name, attr_otherxml_c);
-			a->add_value_vector(*at.get_attr_vector(i));
+			a->values().append(*at.get_attr_values(i));
 			add_attribute_nocopy(a);
 			break;
 		}
@@ -334,11 +368,11 @@ D4Attributes::get(const string &fqn)
 void
 D4Attribute::print_dap4(XMLWriter &xml) const
 {
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Attribute") < 0)
+    if (xml.start_element("Attribute") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write Attribute element");
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+    if (xml.write_attribute("name", name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "type", (const xmlChar*) D4AttributeTypeToString(type()).c_str()) < 0)
+    if (xml.write_attribute("type", D4AttributeTypeToString(type()).c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for type");
 
     switch (type()) {
@@ -351,21 +385,21 @@ D4Attribute::print_dap4(XMLWriter &xml) const
         case attr_otherxml_c:
             if (num_values() != 1)
                 throw Error("OtherXML attributes cannot be vector-valued.");
-            if (xmlTextWriterWriteRaw(xml.get_writer(), (const xmlChar*) value(0).c_str()) < 0)
+            if (xml.write_raw(value(0).c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write OtherXML value");
             break;
 
         default: {
-            // Assume only valid types make it into instances
-            D4AttributeCIter i = d_values.begin();//value_begin();
-            while (i != d_values.end()) {
-                if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Value") < 0)
+            // Assume only valid types make it into instances. Values held in
+            // binary form are formatted one at a time.
+            for (unsigned int i = 0; i < num_values(); ++i) {
+                if (xml.start_element("Value") < 0)
                     throw InternalErr(__FILE__, __LINE__, "Could not write value element");
 
-                if (xmlTextWriterWriteString(xml.get_writer(), (const xmlChar*) (*i++).c_str()) < 0)
+                if (xml.write_string(value(i).c_str()) < 0)
                     throw InternalErr(__FILE__, __LINE__, "Could not write attribute value");
 
-                if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+                if (xml.end_element() < 0)
                     throw InternalErr(__FILE__, __LINE__, "Could not end value element");
             }
 
@@ -373,7 +407,7 @@ D4Attribute::print_dap4(XMLWriter &xml) const
         }
     }
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end Attribute element");
 }
 
@@ -31,6 +31,7 @@
 
 #include "DapObj.h"
 #include "D4AttributeType.h"
+#include "AttrValues.h"
 #include "XMLWriter.h"
 
 using namespace std;
@@ -41,6 +42,8 @@ namespace libdap
 class AttrTable;
 class D4Attributes;
 
+AttrType D4AttributeTypeToAttrType(D4AttributeType at);
+
 class D4Attribute : public DapObj {
     string d_name;
     D4AttributeType d_type;    // Attributes are limited to the simple types
@@ -51,8 +54,9 @@ class D4Attribute : public DapObj {
     D4Attributes *d_attributes;
 
     // IF d_type is attr_otherxml_c, the first string in d_values holds the
-    // XML, otherwise, the strings hold attributes of type d_type.
-    vector<string> d_values;
+    // XML, otherwise, it holds values of type d_type. Numeric values may be
+    // held in binary form; the representation is the one AttrTable uses.
+    AttrValues d_values;
 
     // perform a deep copy
     void m_duplicate(const D4Attribute &src);
@@ -63,26 +67,34 @@ public:
 
     D4Attribute() : d_name(""), d_type(attr_null_c), d_attributes(0) {}
     D4Attribute(const string &name, D4AttributeType type)
-        : d_name(name), d_type(type), d_attributes(0) {}
+        : d_name(name), d_type(type), d_attributes(0), d_values(D4AttributeTypeToAttrType(type)) {}
 
     D4Attribute(const D4Attribute &src);
     ~D4Attribute();
     D4Attribute &operator=(const D4Attribute &rhs);
 
-    string name() const { return d_name; }
+    const string &name() const { return d_name; }
     void set_name(const string &name) { d_name = name; }
 
     D4AttributeType type() const { return d_type; }
-    void set_type(D4AttributeType type) { d_type = type; }
+    void set_type(D4AttributeType type) {
+        d_type = type;
+        d_values.set_type(D4AttributeTypeToAttrType(type));
+    }
 
-    void add_value(const string &value) { d_values.push_back(value); }
-    void add_value_vector(const vector<string> &values) { d_values = values; }
+    void add_value(const string &value) { d_values.append(value); }
+    void add_value_vector(const vector<string> &values) { d_values.assign(values); }
 
-    D4AttributeIter value_begin() { return d_values.begin(); }
-    D4AttributeIter value_end() { return d_values.end(); }
+    // These make values held in binary form text; see AttrValues::text()
+    D4AttributeIter value_begin() { return d_values.text().begin(); }
+    D4AttributeIter value_end() { return d_values.text().end(); }
 
     unsigned int num_values() const { return d_values.size(); }
-    string value(unsigned int i) const { return d_values[i]; }
+    string value(unsigned int i) const { return d_values.value(i); }
+
+    /// The values, in the form they are held; see AttrValues
+    AttrValues &values() { return d_values; }
+    const AttrValues &values() const { return d_values; }
 
     D4Attributes *attributes();
 
@@ -37,15 +37,24 @@
 
 
 
+#include <pthread.h>
+
 #include <cassert>
 #include <cstring>
 #include <sstream>
+#include <algorithm>
+#include <vector>
+
+#include <libxml/parser.h>
 
 #include "D4Connect.h"
 #include "HTTPConnect.h"
 #include "Response.h"
 #include "DMR.h"
 #include "D4Group.h"
+#include "D4BaseTypeFactory.h"
+#include "Array.h"
+#include "crc.h"
 
 #include "D4ParserSax2.h"
 #include "chunked_stream.h"
@@ -54,6 +63,7 @@
 
 #include "escaping.h"
 #include "mime_util.h"
+#include "util.h"
 #include "debug.h"
 
 
@@ -119,6 +129,41 @@ void D4Connect::process_dmr(DMR &dmr, Response &rs)
     }
 }
 
+/** Parse the DMR of a DAP4 data response. The DMR and a CRLF pair are the
+ first chunk of the response; the DMR is passed to the parser as it is
+ read, so it is built while the rest of the chunk is still arriving.
+
+ @param cis The chunked response, positioned at the first chunk.
+ @param dmr Parse the DMR into this object. */
+static void read_dmr_chunk(chunked_istream &cis, DMR &dmr)
+{
+    int chunk_size = cis.read_next_chunk_header();
+    if (chunk_size < 2)
+        throw Error("Found an unexpected end of input (EOF) while reading a DAP4 data response.");
+
+    D4ParserSax2 parser;
+    // permissive mode allows references to Maps that are not in the response.
+    // Use this mode when parsing a data response (but not the DMR). jhrg 4/13/16
+    parser.set_strict(false);
+    parser.begin_parse(&dmr);
+
+    // '-2' to discard the CRLF pair
+    int bytes_left = chunk_size - 2;
+    char buf[CHUNK_SIZE];
+    while (bytes_left > 0) {
+        cis.read(buf, min(bytes_left, CHUNK_SIZE));
+        if (cis.gcount() == 0)
+            throw Error("Found an unexpected end of input (EOF) while reading the DMR of a DAP4 data response.");
+
+        parser.parse_chunk(buf, cis.gcount());
+        bytes_left -= cis.gcount();
+    }
+
+    parser.end_parse();
+
+    cis.read(buf, 2);
+}
+
 /** This private method process data from both local and remote sources. It
  exists to eliminate duplication of code. */
 void D4Connect::process_data(DMR &data, Response &rs)
@@ -162,23 +207,7 @@ void D4Connect::process_data(DMR &data, Response &rs)
 #endif
         // parse the DMR, stopping when the boundary is found.
         try {
-            // force chunk read
-            // get chunk size
-            int chunk_size = cis.read_next_chunk();
-            if (chunk_size < 0)
-                throw Error("Found an unexpected end of input (EOF) while reading a DAP4 data response. (1)");
-
-            // get chunk
-            char chunk[chunk_size];
-            cis.read(chunk, chunk_size);
-            // parse char * with given size
-            D4ParserSax2 parser;
-            // permissive mode allows references to Maps that are not in the response.
-            // Use this mode when parsing a data response (but not the DMR). jhrg 4/13/16
-            parser.set_strict(false);
-
-            // '-2' to discard the CRLF pair
-            parser.intern(chunk, chunk_size - 2, &data);
+            read_dmr_chunk(cis, data);
         }
         catch (Error &e) {
             cerr << "Exception: " << e.get_error_message() << endl;
@@ -208,6 +237,38 @@ void D4Connect::process_data(DMR &data, Response &rs)
     }
 }
 
+/** Read a DAP4 data response (the DMR chunk and the data chunks) from \c in
+ and store the values in \c dmr. This is the body of request_dap4_data().
+
+ @param dmr Parse the response into this DMR.
+ @param in Read the chunked response from this stream. */
+static void read_data_response(DMR &dmr, istream &in)
+{
+#if BYTE_ORDER_PREFIX
+    // Read the byte-order byte; used later on
+    char byte_order;
+    in >> byte_order;
+#endif
+
+    // get a chunked input stream
+#if BYTE_ORDER_PREFIX
+    chunked_istream cis(in, 1024, byte_order);
+#else
+    chunked_istream cis(in, CHUNK_SIZE);
+#endif
+
+    // parse the DMR
+    read_dmr_chunk(cis, dmr);
+
+    // Read data and store in the DMR
+#if BYTE_ORDER_PREFIX
+    D4StreamUnMarshaller um(cis, byte_order);
+#else
+    D4StreamUnMarshaller um(cis, cis.twiddle_bytes());
+#endif
+    dmr.root()->deserialize(um, dmr);
+}
+
 /** Use when you cannot use libcurl.
 
  @note This method tests for MIME headers with lines terminated by CRLF
@@ -395,49 +456,9 @@ void D4Connect::request_dap4_data(DMR &dmr, const string expr)
         case unknown_type:
             DBG(cerr << "Response type unknown, assuming it's a DAP4 Data response." << endl);
             /* no break */
-        case dap4_data: {
-#if BYTE_ORDER_PREFIX
-            istream &in = *rs->get_cpp_stream();
-            // Read the byte-order byte; used later on
-            char byte_order;
-            in >> byte_order;
-#endif
-
-            // get a chunked input stream
-#if BYTE_ORDER_PREFIX
-            chunked_istream cis(*(rs->get_cpp_stream()), 1024, byte_order);
-#else
-            chunked_istream cis(*(rs->get_cpp_stream()), CHUNK_SIZE);
-#endif
-
-            // parse the DMR, stopping when the boundary is found.
-
-            // force chunk read
-            // get chunk size
-            int chunk_size = cis.read_next_chunk();
-            if (chunk_size < 0)
-                throw Error("Found an unexpected end of input (EOF) while reading a DAP4 data response. (2)");
-
-            // get chunk
-            char chunk[chunk_size];
-            cis.read(chunk, chunk_size);
-            // parse char * with given size
-            D4ParserSax2 parser;
-            // permissive mode allows references to Maps that are not in the response.
-            parser.set_strict(false);
-            // '-2' to discard the CRLF pair
-            parser.intern(chunk, chunk_size - 2, &dmr, false /*debug*/);
-
-            // Read data and store in the DMR
-#if BYTE_ORDER_PREFIX
-            D4StreamUnMarshaller um(cis, byte_order);
-#else
-            D4StreamUnMarshaller um(cis, cis.twiddle_bytes());
-#endif
-            dmr.root()->deserialize(um, dmr);
-
+        case dap4_data:
+            read_data_response(dmr, *rs->get_cpp_stream());
             break;
-        }
 
         case dap4_error:
             throw InternalErr(__FILE__, __LINE__, "DAP4 errors are not processed yet.");
@@ -461,6 +482,279 @@ void D4Connect::request_dap4_data(DMR &dmr, const string expr)
     delete rs;
 }
 
+/** One piece of an Array read by D4Connect::request_dap4_array(). Each piece
+ is a run of rows along the Array's first (slowest varying) dimension and is
+ read by its own thread using its own HTTPConnect. */
+struct ArrayPiece {
+    D4Connect *connect; // The D4Connect making the request
+    HTTPConnect *http;
+    string url;         // The DAP4 data URL, with the piece's constraint
+    string var_name;    // FQN of the Array
+    DMR *dmr;           // The piece's DMR is read into this
+    BaseType *proto;    // The template variable of the whole Array
+    char *values;       // Where the piece goes in the whole Array's buffer
+    unsigned int length;// The number of values in the piece
+    string error;       // Non-empty if the piece could not be read
+
+    ArrayPiece() : connect(0), http(0), dmr(0), proto(0), values(0), length(0) { }
+};
+
+/** Get the response for \c url using \c http. request_dap4_array() uses
+ this, from several threads at once, to get each piece of the Array.
+
+ @param http Make the request using this HTTPConnect.
+ @param url The URL to request.
+ @return The response; the caller must delete it. */
+Response *D4Connect::fetch_url(HTTPConnect &http, const string &url)
+{
+    return http.fetch_url(url);
+}
+
+/** Read \c length values of the type of \c proto into \c values. These are
+ the numeric cases of Vector::deserialize(). */
+static void read_values(D4StreamUnMarshaller &um, BaseType *proto, char *values, int64_t length)
+{
+    switch (proto->type()) {
+    case dods_float32_c:
+        um.get_vector_float32(values, length);
+        break;
+
+    case dods_float64_c:
+        um.get_vector_float64(values, length);
+        break;
+
+    default:
+        if (proto->width() == 1)
+            um.get_vector(values, length);
+        else
+            um.get_vector(values, length, proto->width());
+        break;
+    }
+}
+
+/** Compute the CRC32 checksum of \c length values of \c width bytes as the
+ server computed it. The server computes the checksum using its own byte
+ order, so if the values were swapped when they were read, swap them back
+ a block at a time. */
+static Crc32::checksum values_checksum(const char *values, int64_t length, int width, bool twiddled)
+{
+    Crc32 checksum;
+
+    if (!twiddled || width == 1) {
+        checksum.AddData(reinterpret_cast<const uint8_t*>(values), length * width);
+        return checksum.GetCrc32();
+    }
+
+    vector<char> block(4096 * width);
+    for (int64_t i = 0; i < length; i += 4096) {
+        int64_t n = min<int64_t>(4096, length - i);
+        copy(values + i * width, values + (i + n) * width, block.begin());
+        for (vector<char>::iterator v = block.begin(); v != block.begin() + n * width; v += width)
+            reverse(v, v + width);
+        checksum.AddData(reinterpret_cast<uint8_t*>(&block[0]), n * width);
+    }
+
+    return checksum.GetCrc32();
+}
+
+/** Thread function used by request_dap4_array(). Read one piece straight
+ into its place in the whole Array's buffer and check its values against
+ the checksum sent by the server. Errors are recorded in the ArrayPiece
+ since they cannot be thrown across threads. */
+void *D4Connect::read_array_piece(void *arg)
+{
+    ArrayPiece *piece = static_cast<ArrayPiece*>(arg);
+
+    Response *rs = 0;
+    try {
+        rs = piece->connect->fetch_url(*piece->http, piece->url);
+
+        if (rs->get_type() != dap4_data && rs->get_type() != unknown_type)
+            throw Error("Response type not handled (got " + long_to_string(rs->get_type()) + ").");
+
+        istream &in = *rs->get_cpp_stream();
+#if BYTE_ORDER_PREFIX
+        char byte_order;
+        in >> byte_order;
+        chunked_istream cis(in, 1024, byte_order);
+#else
+        chunked_istream cis(in, CHUNK_SIZE);
+#endif
+
+        // Only the DMR of the piece is parsed into its own object; the values
+        // are not deserialized into it and then copied.
+        read_dmr_chunk(cis, *piece->dmr);
+
+        Array *a = dynamic_cast<Array*>(piece->dmr->root()->find_var(piece->var_name));
+        if (!a)
+            throw Error("The response to '" + piece->url + "' did not include " + piece->var_name + ".");
+
+        if (a->var()->type() != piece->proto->type() || a->length() != static_cast<int>(piece->length))
+            throw Error("The response to '" + piece->url + "' does not match the request for " + piece->var_name + ".");
+
+#if BYTE_ORDER_PREFIX
+        D4StreamUnMarshaller um(cis, byte_order);
+#else
+        D4StreamUnMarshaller um(cis, cis.twiddle_bytes());
+#endif
+        read_values(um, piece->proto, piece->values, piece->length);
+
+        // The checksum is sent in the server's byte order, like the values
+        Crc32::checksum crc = um.get_checksum();
+        bool twiddled = um.is_source_big_endian() != is_host_big_endian();
+        if (twiddled)
+            reverse(reinterpret_cast<char*>(&crc), reinterpret_cast<char*>(&crc) + sizeof(crc));
+
+        if (crc != values_checksum(piece->values, piece->length, piece->proto->width(), twiddled))
+            throw Error("The checksum for the response to '" + piece->url + "' does not match its data.");
+    }
+    catch (Error &e) {
+        piece->error = e.get_error_message();
+    }
+    catch (std::exception &e) {
+        piece->error = e.what();
+    }
+    catch (...) {
+        piece->error = "Unknown error while reading " + piece->url;
+    }
+
+    delete rs;
+
+    return 0;
+}
+
+static void delete_array_pieces(vector<ArrayPiece> &pieces)
+{
+    for (vector<ArrayPiece>::iterator i = pieces.begin(); i != pieces.end(); ++i) {
+        delete i->http;
+        delete i->dmr;
+        i->http = 0;
+        i->dmr = 0;
+    }
+}
+
+/** @brief Read the values of one large Array using several requests at once.
+
+ Split the Array along its first (slowest varying) dimension into \c pieces
+ runs of rows and request each run as a separate DAP4 data response. The
+ requests are made concurrently, each from its own thread and HTTPConnect
+ (which share connections, see HTTPConnectionPool). Each piece is read
+ directly into its part of the Array's value buffer and its CRC32 checksum
+ is checked. The result is the same as if the whole Array had
+ been read using request_dap4_data().
+
+ The Array must be part of \c dmr, which is typically built using
+ request_dmr(). Any constraint already set on the Array's dimensions (see
+ Array::add_constraint()) is used. If the first dimension has fewer rows
+ than \c pieces, fewer pieces are used.
+
+ @note Only Arrays of numeric types (including Enums) are supported.
+
+ @param dmr The DMR that holds \c array
+ @param array Read values for this Array.
+ @param pieces Split the request into this many concurrent requests.
+ @exception Error Thrown if any of the pieces could not be read or if a
+ piece's checksum does not match its data. */
+void D4Connect::request_dap4_array(DMR &dmr, Array *array, unsigned int pieces)
+{
+    if (!d_http)
+        throw Error("request_dap4_array() requires a remote (http) dataset.");
+
+    if (!array || array->dimensions() == 0)
+        throw InternalErr(__FILE__, __LINE__, "request_dap4_array() requires an Array with at least one dimension.");
+
+    if (!array->var()->is_simple_type() || array->var()->type() == dods_str_c || array->var()->type() == dods_url_c)
+        throw Error("request_dap4_array() requires an Array of a numeric type.");
+
+    string name = array->FQN();
+
+    Array::Dim_iter d = array->dim_begin();
+    int start = array->dimension_start(d, true);
+    int stride = array->dimension_stride(d, true);
+    int rows = array->dimension_size(d, true);
+
+    // The constraint on the remaining dimensions is the same for every piece
+    unsigned int row_length = 1;
+    ostringstream rest;
+    for (Array::Dim_iter i = d + 1; i != array->dim_end(); ++i) {
+        rest << "[" << array->dimension_start(i, true) << ":" << array->dimension_stride(i, true) << ":"
+            << array->dimension_stop(i, true) << "]";
+        row_length *= array->dimension_size(i, true);
+    }
+
+    if (rows == 0 || row_length == 0)
+        return;
+
+    if (pieces == 0)
+        pieces = 1;
+    if (pieces > static_cast<unsigned int>(rows))
+        pieces = rows;
+
+    D4BaseTypeFactory local_factory;
+    D4BaseTypeFactory *factory = dmr.factory() ? dmr.factory() : &local_factory;
+
+    array->set_read_p(false);
+    array->reserve_value_capacity(rows * row_length);
+    char *values = array->get_buf();
+    int width = array->var()->width();
+
+    vector<ArrayPiece> piece_list(pieces);
+    try {
+        for (unsigned int k = 0; k < pieces; ++k) {
+            // rows [first, last] of the constrained first dimension
+            int first = (static_cast<long long>(rows) * k) / pieces;
+            int last = (static_cast<long long>(rows) * (k + 1)) / pieces - 1;
+
+            ostringstream ce;
+            ce << name << "[" << start + first * stride << ":" << stride << ":" << start + last * stride << "]"
+                << rest.str();
+
+            ArrayPiece &piece = piece_list[k];
+            piece.connect = this;
+            piece.url = build_dap4_ce(".dap", ce.str());
+            piece.var_name = name;
+            piece.proto = array->var();
+            piece.values = values + static_cast<int64_t>(first) * row_length * width;
+            piece.length = (last - first + 1) * row_length;
+
+            piece.http = new HTTPConnect(RCReader::instance());
+            piece.http->copy_request_settings(*d_http);
+
+            piece.dmr = new DMR(factory, dmr.name());
+
+            DBG(cerr << "D4Connect::request_dap4_array() - piece " << k << ": " << piece.url << endl);
+        }
+
+        // libxml2 must be initialized before it is used by more than one thread.
+        xmlInitParser();
+
+        vector<pthread_t> threads(pieces);
+        vector<bool> started(pieces, false);
+        for (unsigned int k = 0; k < pieces; ++k)
+            started[k] = pthread_create(&threads[k], 0, read_array_piece, &piece_list[k]) == 0;
+
+        // If a thread could not be started, read that piece here.
+        for (unsigned int k = 0; k < pieces; ++k) {
+            if (started[k])
+                pthread_join(threads[k], 0);
+            else
+                read_array_piece(&piece_list[k]);
+        }
+
+        for (unsigned int k = 0; k < pieces; ++k)
+            if (!piece_list[k].error.empty())
+                throw Error(piece_list[k].error);
+
+        array->set_read_p(true);
+    }
+    catch (...) {
+        delete_array_pieces(piece_list);
+        throw;
+    }
+
+    delete_array_pieces(piece_list);
+}
+
 void D4Connect::read_dmr(DMR &dmr, Response &rs)
 {
     parse_mime(rs);
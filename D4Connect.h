@@ -35,6 +35,7 @@ namespace libdap
 
 class HTTPConnect;
 class DMR;
+class Array;
 class Response;
 
 class D4Connect
@@ -57,12 +58,16 @@ private:
 
     std::string build_dap4_ce(const std::string requestSuffix, const std::string expr);
 
+    static void *read_array_piece(void *arg);
+
 protected:
     /** @name Suppress the C++ defaults for these. */
     D4Connect();
     D4Connect(const D4Connect &);
     D4Connect &operator=(const D4Connect &);
 
+    virtual Response *fetch_url(HTTPConnect &http, const std::string &url);
+
 public:
     D4Connect(const std::string &url, std::string uname = "", std::string password = "");
 
@@ -100,6 +105,7 @@ public:
 
     virtual void request_dmr(DMR &dmr, const std::string expr = "");
     virtual void request_dap4_data(DMR &dmr, const std::string expr = "");
+    virtual void request_dap4_array(DMR &dmr, Array *array, unsigned int pieces);
 #if 0
     virtual void request_version();
 #endif
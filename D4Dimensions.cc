@@ -29,12 +29,104 @@
 #include "XMLWriter.h"
 #include "D4Dimensions.h"
 #include "D4Group.h"
+#include "ProjectionOverlay.h"
 
 #include "Error.h"
 #include "InternalErr.h"
 
 namespace libdap {
 
+// A copy isn't shared; it holds the constraint the current overlay has for
+// the dimension it's made from.
+void
+D4Dimension::m_duplicate(const D4Dimension &d)
+{
+	d_name = d.d_name;
+	d_size = d.d_size;
+	d_parent = d.d_parent;
+
+	d_constrained = d.constrained();
+	d_c_start = d.c_start();
+	d_c_stride = d.c_stride();
+	d_c_stop = d.c_stop();
+	d_used_by_projected_var = d.used_by_projected_var();
+
+	d_is_shared = false;
+}
+
+/// @return True if the dimension has been sliced
+bool
+D4Dimension::constrained() const
+{
+	ProjectionOverlay::Dimension *d = ProjectionOverlay::lookup(this);
+	return d ? d->constrained : d_constrained;
+}
+
+unsigned long long
+D4Dimension::c_start() const
+{
+	ProjectionOverlay::Dimension *d = ProjectionOverlay::lookup(this);
+	return d ? d->start : d_c_start;
+}
+
+unsigned long long
+D4Dimension::c_stride() const
+{
+	ProjectionOverlay::Dimension *d = ProjectionOverlay::lookup(this);
+	return d ? d->stride : d_c_stride;
+}
+
+unsigned long long
+D4Dimension::c_stop() const
+{
+	ProjectionOverlay::Dimension *d = ProjectionOverlay::lookup(this);
+	return d ? d->stop : d_c_stop;
+}
+
+bool
+D4Dimension::used_by_projected_var() const
+{
+	ProjectionOverlay::Dimension *d = ProjectionOverlay::lookup(this);
+	return d ? d->used_by_projected_var : d_used_by_projected_var;
+}
+
+void
+D4Dimension::set_used_by_projected_var(bool state)
+{
+	if (ProjectionOverlay *overlay = ProjectionOverlay::current(this))
+		overlay->dimension(this).used_by_projected_var = state;
+	else
+		d_used_by_projected_var = state;
+}
+
+void
+D4Dimension::set_constraint(unsigned long long start, unsigned long long stride, unsigned long long stop)
+{
+	if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+		ProjectionOverlay::Dimension &d = overlay->dimension(this);
+		d.start = start;
+		d.stride = stride;
+		d.stop = stop;
+		d.constrained = true;
+		return;
+	}
+
+	d_c_start = start;
+	d_c_stride = stride;
+	d_c_stop = stop;
+	d_constrained = true;
+}
+
+/** Set the name of the dimension. If it belongs to a D4Dimensions, that
+ * object's index of names is updated. */
+void
+D4Dimension::set_name(const string &name)
+{
+	d_name = name;
+	if (d_parent)
+		d_parent->m_index_names();
+}
+
 void
 D4Dimension::set_size(const string &size)
 {
@@ -82,41 +174,48 @@ D4Dimension::fully_qualified_name() const
 void
 D4Dimension::print_dap4(XMLWriter &xml) const
 {
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Dimension") < 0)
+	if (xml.start_element("Dimension") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write Dimension element");
 
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d_name.c_str()) < 0)
+	if (xml.write_attribute("name", d_name.c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 #if 0
 	// Use FQNs when things are referenced, not when they are defined
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)fully_qualified_name().c_str()) < 0)
+	if (xml.write_attribute("name", fully_qualified_name().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 #endif
 	ostringstream oss;
-	if (d_constrained)
-	    oss << (d_c_stop - d_c_start) / d_c_stride + 1;
+	if (constrained())
+	    oss << (c_stop() - c_start()) / c_stride() + 1;
 	else
 	    oss << d_size;
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "size", (const xmlChar*) oss.str().c_str()) < 0)
+	if (xml.write_attribute("size", oss.str().c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for size");
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end Dimension element");
 }
 
-// Note that in order for this to work the second argument must not be a reference.
-// jhrg 8/20/13
-static bool
-dim_name_eq(D4Dimension *d, const string name)
+void
+D4Dimensions::m_index_names()
 {
-	return d->name() == name;
+    d_names.clear();
+    for (D4DimensionsCIter i = d_dims.begin(), e = d_dims.end(); i != e; ++i)
+        d_names.insert(make_pair((*i)->name(), *i));
 }
 
+/**
+ * Find a dimension by name.
+ * @note The names are kept in a map that D4Dimension::set_name() keeps
+ * up to date, so this does not search the dimensions.
+ * @param name The name of the dimension
+ * @return The first dimension with that name, or null
+ */
 D4Dimension *
 D4Dimensions::find_dim(const string &name)
 {
-	D4DimensionsIter d = find_if(d_dims.begin(), d_dims.end(), bind2nd(ptr_fun(dim_name_eq), name));
-	return (d != d_dims.end()) ? *d: 0;
+    map<string, D4Dimension*>::iterator n = d_names.find(name);
+    return (n != d_names.end()) ? n->second : 0;
 }
 
 void
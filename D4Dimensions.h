@@ -25,6 +25,7 @@
 #ifndef D4DIMENSIONS_H_
 #define D4DIMENSIONS_H_
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -49,14 +50,27 @@ class D4Dimension {
 
     bool d_used_by_projected_var;
 
+    bool d_is_shared;   // Set by ProjectionOverlay::share()
+
+    void m_duplicate(const D4Dimension &d);
+
+    friend class ProjectionOverlay;
+
 public:
     D4Dimension() : d_name(""), d_size(0),  d_parent(0), d_constrained(false), d_c_start(0), d_c_stride(0),
-            d_c_stop(0), d_used_by_projected_var(false) {}
+            d_c_stop(0), d_used_by_projected_var(false), d_is_shared(false) {}
     D4Dimension(const string &name, unsigned long size, D4Dimensions *d = 0) : d_name(name), d_size(size), d_parent(d),
-            d_constrained(false), d_c_start(0), d_c_stride(0), d_c_stop(0), d_used_by_projected_var(false) {}
+            d_constrained(false), d_c_start(0), d_c_stride(0), d_c_stop(0), d_used_by_projected_var(false),
+            d_is_shared(false) {}
+    D4Dimension(const D4Dimension &d) { m_duplicate(d); }
+
+    D4Dimension &operator=(const D4Dimension &rhs) {
+        if (this != &rhs) m_duplicate(rhs);
+        return *this;
+    }
 
     string name() const {return d_name;}
-    void set_name(const string &name) { d_name = name; }
+    void set_name(const string &name);
     string fully_qualified_name() const;
 
     unsigned long size() const { return d_size; }
@@ -67,13 +81,16 @@ public:
     D4Dimensions *parent() const { return d_parent; }
     void set_parent(D4Dimensions *d) { d_parent = d; }
 
-    bool constrained() const { return d_constrained; }
-    unsigned long long c_start() const { return d_c_start; }
-    unsigned long long c_stride() const { return d_c_stride; }
-    unsigned long long c_stop() const { return d_c_stop; }
+    bool constrained() const;
+    unsigned long long c_start() const;
+    unsigned long long c_stride() const;
+    unsigned long long c_stop() const;
+
+    bool used_by_projected_var() const;
+    void set_used_by_projected_var(bool state);
 
-    bool used_by_projected_var() const { return d_used_by_projected_var; }
-    void set_used_by_projected_var(bool state) { d_used_by_projected_var = state; }
+    /// True if this is part of a DMR passed to ProjectionOverlay::share()
+    bool is_shared() const { return d_is_shared; }
 
     /**
      * Set this Shared Diemension's constraint. While an Array Dimension object uses a
@@ -83,12 +100,7 @@ public:
      * @param stride The stride for the slice
      * @param stop The stopping index (never greater than size -1)
      */
-    void set_constraint(unsigned long long start, unsigned long long stride, unsigned long long stop) {
-        d_c_start = start;
-        d_c_stride = stride;
-        d_c_stop = stop;
-        d_constrained = true;
-    }
+    void set_constraint(unsigned long long start, unsigned long long stride, unsigned long long stop);
 
     void print_dap4(XMLWriter &xml) const;
 };
@@ -103,6 +115,14 @@ class D4Dimensions {
 
     D4Group *d_parent;		// the group that holds this set of D4Dimensions; weak pointer, don't delete
 
+    // The first dimension with each name, kept as dimensions are added so
+    // the parser and the CE evaluator don't search d_dims for every name.
+    map<string, D4Dimension*> d_names;
+
+    void m_index_names();
+
+    friend class D4Dimension;   // set_name() updates d_names
+
 protected:
     // Note Code in Array depends on the order of these 'new' dimensions
     // matching the 'old' dimensions they are derived from. See
@@ -115,6 +135,8 @@ protected:
         }
 
         d_parent = rhs.d_parent;
+
+        m_index_names();
     }
 
 public:
@@ -157,7 +179,11 @@ public:
     /** Append a new dimension.
      * @param dim Pointer to the D4Dimension object to add; copies the pointer
      */
-    void add_dim_nocopy(D4Dimension *dim) { dim->set_parent(this); d_dims.push_back(dim); }
+    void add_dim_nocopy(D4Dimension *dim) {
+        dim->set_parent(this);
+        d_dims.push_back(dim);
+        d_names.insert(make_pair(dim->name(), dim)); // keeps the first
+    }
 
     /// Get an iterator to the start of the dimensions
     D4DimensionsIter dim_begin() { return d_dims.begin(); }
@@ -185,6 +211,7 @@ public:
     void insert_dim_nocopy(D4Dimension *dim, D4DimensionsIter i) {
     	dim->set_parent(this);
         d_dims.insert(i, dim);
+        m_index_names();
     }
 
     void print_dap4(XMLWriter &xml, bool constrained = false) const;
@@ -477,11 +477,11 @@ D4Enum::print_xml_writer(XMLWriter &xml, bool constrained)
     if (constrained && !send_p())
         return;
 
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"Enum") < 0)
+    if (xml.start_element("Enum") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write Enum element");
 
     if (!name().empty())
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+        if (xml.write_attribute("name", name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
 
@@ -493,15 +493,15 @@ D4Enum::print_xml_writer(XMLWriter &xml, bool constrained)
     	// print the FQN for the enum def; D4Group::FQN() includes the trailing '/'
     	path = static_cast<D4Group*>(d_enum_def->parent()->parent())->FQN() + path;
     }
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "enum", (const xmlChar*)path.c_str()) < 0)
+    if (xml.write_attribute("enum", path.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for enum");
 
     attributes()->print_dap4(xml);
 
-    if (get_attr_table().get_size() > 0)
+    if (has_attr_table())
         get_attr_table().print_xml_writer(xml);
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end Enum element");
 }
 
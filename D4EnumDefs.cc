@@ -65,35 +65,51 @@ D4EnumDef::is_valid_enum_value(long long value)
     }
 }
 
-// Note that in order for this to work the second argument must not be a reference.
-// jhrg 8/20/13
-static bool
-enum_def_name_eq(D4EnumDef *d, const string name)
+void
+D4EnumDefs::m_index_names()
 {
-    return d->name() == name;
+    d_names.clear();
+    for (D4EnumDefCIter i = d_enums.begin(), e = d_enums.end(); i != e; ++i)
+        d_names.insert(make_pair((*i)->name(), *i));
 }
 
+/**
+ * Find an enumeration definition by name. The names are kept in a map
+ * that D4EnumDef::set_name() keeps up to date.
+ * @param name The name of the enumeration
+ * @return The first enumeration with that name, or null
+ */
 D4EnumDef *
 D4EnumDefs::find_enum_def(const string &name)
 {
-    D4EnumDefIter d = find_if(d_enums.begin(), d_enums.end(), bind2nd(ptr_fun(enum_def_name_eq), name));
-    return (d != d_enums.end()) ? *d: 0;
+    map<string, D4EnumDef*>::iterator n = d_names.find(name);
+    return (n != d_names.end()) ? n->second : 0;
+}
+
+/** Set the name of the enumeration. If it belongs to a D4EnumDefs, that
+ * object's index of names is updated. */
+void
+D4EnumDef::set_name(const string &n)
+{
+    d_name = n;
+    if (d_parent)
+        d_parent->m_index_names();
 }
 
 void D4EnumDef::print_value(XMLWriter &xml, const D4EnumDef::tuple &tuple) const
 {
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"EnumConst") < 0)
+    if (xml.start_element("EnumConst") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write EnumConst element");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)tuple.label.c_str()) < 0)
+    if (xml.write_attribute("name", tuple.label.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     ostringstream oss;
     oss << tuple.value;
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "value", (const xmlChar*)oss.str().c_str()) < 0)
+    if (xml.write_attribute("value", oss.str().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for value");
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end EnumConst element");
 }
 
@@ -107,19 +123,19 @@ void D4EnumDef::print_dap4(XMLWriter &xml) const
 
 void D4EnumDefs::m_print_enum(XMLWriter &xml, D4EnumDef *e) const
 {
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"Enumeration") < 0)
+    if (xml.start_element("Enumeration") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write Enumeration element");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)e->name().c_str()) < 0)
+    if (xml.write_attribute("name", e->name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "basetype", (const xmlChar*)D4type_name(e->type()).c_str()) < 0)
+    if (xml.write_attribute("basetype", D4type_name(e->type()).c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     // print each of e.values
     e->print_dap4(xml);
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end Enumeration element");
 }
 
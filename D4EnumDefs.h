@@ -25,6 +25,7 @@
 #ifndef D4ENUMDEF_H_
 #define D4ENUMDEF_H_
 
+#include <map>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -73,7 +74,7 @@ public:
     }
 
     string name() const { return d_name; }
-    void set_name(const string &n) { d_name = n; }
+    void set_name(const string &n);
 
     Type type() const { return d_type; }
     void set_type(Type t) { d_type = t; }
@@ -102,15 +103,24 @@ class D4EnumDefs {
 
     D4Group *d_parent;		// the group that holds this set of D4EnumDefs; weak pointer, don't delete
 
+    // The first enumeration with each name, kept as they are added
+    map<string, D4EnumDef*> d_names;
+
     void m_print_enum(XMLWriter &xml, D4EnumDef *e) const;
+    void m_index_names();
+
+    friend class D4EnumDef;     // set_name() updates d_names
 
     void m_duplicate(const D4EnumDefs &rhs) {
         D4EnumDefCIter i = rhs.d_enums.begin();
         while (i != rhs.d_enums.end()) {
             d_enums.push_back(new D4EnumDef(**i++));    // deep copy
+            d_enums.back()->set_parent(this);
         }
 
         d_parent = rhs.d_parent;
+
+        m_index_names();
     }
 
 public:
@@ -150,6 +160,7 @@ public:
     void add_enum_nocopy(D4EnumDef *enum_def) {
     	enum_def->set_parent(this);
         d_enums.push_back(enum_def);
+        d_names.insert(make_pair(enum_def->name(), enum_def)); // keeps the first
     }
 
     /// Get an iterator to the start of the enumerations
@@ -172,6 +183,7 @@ public:
     	D4EnumDef *enum_def_copy = new D4EnumDef(*enum_def);
     	enum_def_copy->set_parent(this);
         d_enums.insert(i, enum_def_copy);
+        m_index_names();
     }
 
     void print_dap4(XMLWriter &xml, bool constrained = false) const;
@@ -90,7 +90,10 @@ void D4Group::m_duplicate(const D4Group &g)
 #endif
 
 	// enums; deep copy
-	if (g.d_enum_defs) d_enum_defs = new D4EnumDefs(*g.d_enum_defs);
+	if (g.d_enum_defs) {
+		d_enum_defs = new D4EnumDefs(*g.d_enum_defs);
+		d_enum_defs->set_parent(this);
+	}
 
     // groups
     groupsCIter i = g.d_groups.begin();
@@ -185,19 +188,36 @@ D4Group::FQN() const
 	return (name() == "/") ? "/" : static_cast<D4Group*>(get_parent())->FQN() + name() + "/";
 }
 
-// Note that in order for this to work the second argument must not be a reference.
-// jhrg 8/20/13
-static bool
-name_eq(D4Group *g, const string name)
+void
+D4Group::m_index_groups()
 {
-	return g->name() == name;
+    d_group_names.clear();
+    for (groupsCIter i = d_groups.begin(), e = d_groups.end(); i != e; ++i)
+        d_group_names.insert(make_pair((*i)->name(), *i));
 }
 
+/**
+ * Find a child of this group by name. The names of the child groups are
+ * kept in a map that set_name() keeps up to date.
+ * @param grp_name The name of the group
+ * @return The first child group with that name, or null
+ */
 D4Group *
 D4Group::find_child_grp(const string &grp_name)
 {
-	groupsIter g = find_if(grp_begin(), grp_end(), bind2nd(ptr_fun(name_eq), grp_name));
-	return (g == grp_end()) ? 0: *g;
+    map<string, D4Group*>::iterator n = d_group_names.find(grp_name);
+    return (n != d_group_names.end()) ? n->second : 0;
+}
+
+/** Set the name of the group. If it is the child of another group, the
+ * parent's index of its children is updated. */
+void
+D4Group::set_name(const string &n)
+{
+    Constructor::set_name(n);
+
+    if (get_parent() && get_parent()->type() == dods_group_c)
+        static_cast<D4Group*>(get_parent())->m_index_groups();
 }
 
 // TODO Add constraint param? jhrg 11/17/13
@@ -365,6 +385,11 @@ D4Group::find_enum_def(const string &path)
 /**
  * Find a variable using it's FUlly Qualified Name (FQN). The leading '/' is optional.
  *
+ * Each part of the path is looked up in an index: the child groups by
+ * find_child_grp() and the variables, and the fields of Structures, by
+ * Constructor::var(). So the cost of a lookup depends on the depth of the
+ * path, not on the number of groups and variables in the DMR.
+ *
  * @param path The FQN to the variable
  * @return A BaseType* to the variable of null if it was not found
  * @see BaseType::FQN()
@@ -577,10 +602,10 @@ D4Group::print_dap4(XMLWriter &xml, bool constrained)
         if (constrained && !send_p())
             return;
 
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) type_name().c_str()) < 0)
+        if (xml.start_element(type_name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write " + type_name() + " element");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*) name().c_str()) < 0)
+        if (xml.write_attribute("name", name().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
     }
 
@@ -606,7 +631,7 @@ D4Group::print_dap4(XMLWriter &xml, bool constrained)
         (*g++)->print_dap4(xml, constrained);
 
     if (!name().empty() && name() != "/") {
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end " + type_name() + " element");
     }
 }
@@ -22,6 +22,7 @@
 #ifndef D4GROUP_H_
 #define D4GROUP_H_
 
+#include <map>
 #include <string>
 
 #include "Constructor.h"
@@ -58,7 +59,11 @@ private:
     // work as expected when making Groups.
     vector<D4Group*> d_groups;
 
+    // The first child group with each name, kept as groups are added
+    map<string, D4Group*> d_group_names;
+
     BaseType *m_find_map_source_helper(const string &name);
+    void m_index_groups();
 
 protected:
     void m_duplicate(const D4Group &g);
@@ -85,6 +90,7 @@ public:
         return d_dims;
     }
 
+    virtual void set_name(const string &n);
     virtual std::string FQN() const;
 
     D4Dimension *find_dim(const string &path);
@@ -120,10 +126,12 @@ public:
     void add_group_nocopy(D4Group *g) {
     	g->set_parent(this);
         d_groups.push_back(g);
+        d_group_names.insert(make_pair(g->name(), g)); // keeps the first
     }
     void insert_group_nocopy(D4Group *g, groupsIter i) {
     	g->set_parent(this);
         d_groups.insert(i, g);
+        m_index_groups();
     }
 
     D4Group *find_child_grp(const string &grp_name);
@@ -33,13 +33,13 @@ using namespace libdap;
 void
 D4Map::print_dap4(XMLWriter &xml)
 {
-	if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Map") < 0)
+	if (xml.start_element("Map") < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write Map element");
 
-	if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d_name.c_str()) < 0)
+	if (xml.write_attribute("name", d_name.c_str()) < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-	if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+	if (xml.end_element() < 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not end Map element");
 
 }
@@ -28,6 +28,8 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 
 #include <cstring>
 #include <cstdarg>
@@ -91,9 +93,43 @@ static const char *states[] = {
         "parser_end"
 };
 
-static bool is_not(const char *name, const char *tag)
+// The text of the names in D4ParserSax2::XMLName, in the same order
+static const char *xml_names[] = {
+        "Dataset", "Group", "Attribute", "Value", "Enumeration", "EnumConst",
+        "Dimension", "Dim", "Map", "Structure", "Sequence",
+
+        "name", "size", "type", "basetype", "value", "enum", "dapVersion",
+        "dmrVersion", "base"
+};
+
+// The type names get_type() knows; see process_variable()
+static const char *variable_names[] = {
+        "Byte", "Char", "Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32",
+        "Int64", "UInt64", "Float32", "Float64", "String", "Url", "URL", "Enum",
+        "Opaque", "Array", "Structure", "Sequence", "Grid"
+};
+
+/** Look up the names the parser uses in the dictionary of the libxml2
+ * parser context; call this once the context is made. */
+void D4ParserSax2::intern_names()
+{
+    for (int i = 0; i < xml_name_count; ++i)
+        d_names[i] = xmlDictLookup(context->dict, (const xmlChar *) xml_names[i], -1);
+
+    d_dap4_ns = xmlDictLookup(context->dict, (const xmlChar *) DapXmlNamspaces::getDapNamespaceString(DAP_4_0).c_str(), -1);
+
+    d_types.clear();
+    for (unsigned int i = 0; i < sizeof(variable_names) / sizeof(variable_names[0]); ++i)
+        d_types.insert(make_pair(xmlDictLookup(context->dict, (const xmlChar *) variable_names[i], -1),
+                get_type(variable_names[i])));
+}
+
+/** @return The type of the variable an element declares, or dods_null_c if
+ * the element is not a variable. */
+Type D4ParserSax2::type_of(const xmlChar *name) const
 {
-    return strcmp(name, tag) != 0;
+    map<const xmlChar*, Type>::const_iterator i = d_types.find(name);
+    return i == d_types.end() ? dods_null_c : i->second;
 }
 
 /** @brief Return the current Enumeration definition
@@ -125,25 +161,28 @@ D4ParserSax2::dim_def()    {
     return d_dim_def;
 }
 
-/** Dump XML attributes to local store so they can be easily manipulated.
- * XML attribute names are always folded to lower case.
+/** Record the XML attributes of the current element so they can be easily
+ * found. Only pointers to libxml2's values are kept.
  * @param attributes The XML attribute array
  * @param nb_attributes The number of attributes
  */
 void D4ParserSax2::transfer_xml_attrs(const xmlChar **attributes, int nb_attributes)
 {
-    if (!xml_attrs.empty())
-        xml_attrs.clear(); // erase old attributes
+    xml_attrs.clear(); // erase old attributes
 
-    // Make a value using the attribute name and the prefix, namespace URI
-    // and the value. The prefix might be null.
+    // Each attribute is five pointers: the name, the prefix, the namespace
+    // URI and the start and end of the value. The prefix might be null.
     unsigned int index = 0;
     for (int i = 0; i < nb_attributes; ++i, index += 5) {
-        xml_attrs.insert(map<string, XMLAttribute>::value_type(string((const char *)attributes[index]),
-                                                               XMLAttribute(attributes + index + 1)));
-
-        DBG(cerr << "XML Attribute '" << (const char *)attributes[index] << "': "
-                << xml_attrs[(const char *)attributes[index]].value << endl);
+        XMLAttribute attr;
+        attr.localname = attributes[index];
+        attr.prefix = attributes[index + 1];
+        attr.nsURI = attributes[index + 2];
+        attr.value = (const char *) attributes[index + 3];
+        attr.value_end = (const char *) attributes[index + 4];
+        xml_attrs.push_back(attr);
+
+        DBG(cerr << "XML Attribute '" << (const char *)attributes[index] << "': " << attr.text() << endl);
     }
 }
 
@@ -162,49 +201,71 @@ void D4ParserSax2::transfer_xml_ns(const xmlChar **namespaces, int nb_namespaces
     }
 }
 
-/** Is a required XML attribute present? Attribute names are always lower case.
+/** Find an XML attribute of the current element.
+ * @note To use this method, first call transfer_xml_attrs.
+ * @return The attribute, or null if the element doesn't have it. */
+const D4ParserSax2::XMLAttribute *
+D4ParserSax2::xml_attr(XMLName n) const
+{
+    for (vector<XMLAttribute>::const_iterator i = xml_attrs.begin(), e = xml_attrs.end(); i != e; ++i)
+        if (i->localname == d_names[n])
+            return &*i;
+
+    return 0;
+}
+
+/** @return The value of an XML attribute of the current element, or the
+ * empty string if the element doesn't have it. */
+string D4ParserSax2::xml_attr_value(XMLName n) const
+{
+    const XMLAttribute *attr = xml_attr(n);
+    return attr ? attr->text() : "";
+}
+
+/** @return True if the current element has the XML attribute and its value
+ * is \c value. */
+bool D4ParserSax2::xml_attr_is(XMLName n, const char *value) const
+{
+    const XMLAttribute *attr = xml_attr(n);
+    if (!attr)
+        return false;
+
+    size_t len = attr->value_end - attr->value;
+    return len == strlen(value) && memcmp(attr->value, value, len) == 0;
+}
+
+/** Is a required XML attribute present?
  * @note To use this method, first call transfer_xml_attrs.
  * @param attr The XML attribute
  * @return True if the XML attribute was present in the last tag, otherwise
  * it sets the global error state and returns false.
  */
-bool D4ParserSax2::check_required_attribute(const string & attr)
+bool D4ParserSax2::check_required_attribute(XMLName attr)
 {
-    if (xml_attrs.find(attr) == xml_attrs.end()) {
-        dmr_error(this, "Required attribute '%s' not found.", attr.c_str());
+    if (!check_attribute(attr)) {
+        dmr_error(this, "Required attribute '%s' not found.", xml_names[attr]);
         return false;
     }
     else
         return true;
 }
 
-/** Is a XML attribute present? Attribute names are always lower case.
- * @note To use this method, first call transfer_xml_attrs.
- * @param attr The XML attribute
- * @return True if the XML attribute was present in the last/current tag,
- * false otherwise.
- */
-bool D4ParserSax2::check_attribute(const string & attr)
-{
-    return (xml_attrs.find(attr) != xml_attrs.end());
-}
-
-bool D4ParserSax2::process_dimension_def(const char *name, const xmlChar **attrs, int nb_attributes)
+bool D4ParserSax2::process_dimension_def(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Dimension"))
+    if (!is(name, dimension_n))
         return false;
 
     transfer_xml_attrs(attrs, nb_attributes);
 
-    if (!(check_required_attribute("name") && check_required_attribute("size"))) {
+    if (!(check_required_attribute(name_n) && check_required_attribute(size_n))) {
         dmr_error(this, "The required attribute 'name' or 'size' was missing from a Dimension element.");
         return false;
     }
 
     // This getter (dim_def) allocates a new object if needed.
-    dim_def()->set_name(xml_attrs["name"].value);
+    dim_def()->set_name(xml_attr_value(name_n));
     try {
-        dim_def()->set_size(xml_attrs["size"].value);
+        dim_def()->set_size(xml_attr_value(size_n));
     }
     catch (Error &e) {
         dmr_error(this, e.get_error_message().c_str());
@@ -231,18 +292,18 @@ bool D4ParserSax2::process_dimension_def(const char *name, const xmlChar **attrs
  * @param nb_attributes The number of XML Attributes
  * @return True if the element is a Dim, false otherwise.
  */
-bool D4ParserSax2::process_dimension(const char *name, const xmlChar **attrs, int nb_attributes)
+bool D4ParserSax2::process_dimension(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Dim"))
+    if (!is(name, dim_n))
         return false;
 
     transfer_xml_attrs(attrs, nb_attributes);
 
-	if (check_attribute("size") && check_attribute("name")) {
+	if (check_attribute(size_n) && check_attribute(name_n)) {
 		dmr_error(this, "Only one of 'size' and 'name' are allowed in a Dim element, but both were used.");
 		return false;
 	}
-	if (!(check_attribute("size") || check_attribute("name"))) {
+	if (!(check_attribute(size_n) || check_attribute(name_n))) {
 		dmr_error(this, "Either 'size' or 'name' must be used in a Dim element.");
 		return false;
 	}
@@ -267,12 +328,12 @@ bool D4ParserSax2::process_dimension(const char *name, const xmlChar **attrs, in
 	assert(top_basetype()->is_vector_type());
 
 	Array *a = static_cast<Array*>(top_basetype());
-    if (check_attribute("size")) {
-    	a->append_dim(atoi(xml_attrs["size"].value.c_str())); // low budget code for now. jhrg 8/20/13
+    if (check_attribute(size_n)) {
+    	a->append_dim(atoi(xml_attr_value(size_n).c_str())); // low budget code for now. jhrg 8/20/13
         return true;
     }
-    else if (check_attribute("name")) {
-    	string name = xml_attrs["name"].value;
+    else if (check_attribute(name_n)) {
+    	string name = xml_attr_value(name_n);
 
     	D4Dimension *dim = 0;
     	if (name[0] == '/')		// lookup the Dimension in the root group
@@ -289,14 +350,14 @@ bool D4ParserSax2::process_dimension(const char *name, const xmlChar **attrs, in
     return false;
 }
 
-bool D4ParserSax2::process_map(const char *name, const xmlChar **attrs, int nb_attributes)
+bool D4ParserSax2::process_map(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Map"))
+    if (!is(name, map_n))
         return false;
 
     transfer_xml_attrs(attrs, nb_attributes);
 
-	if (!check_attribute("name")) {
+	if (!check_attribute(name_n)) {
 		dmr_error(this, "The 'name' attribute must be used in a Map element.");
 		return false;
 	}
@@ -322,8 +383,8 @@ bool D4ParserSax2::process_map(const char *name, const xmlChar **attrs, int nb_a
 
 	Array *a = static_cast<Array*>(top_basetype());
 
-	string map_name = xml_attrs["name"].value;
-	if (xml_attrs["name"].value[0] != '/')
+	string map_name = xml_attr_value(name_n);
+	if (map_name[0] != '/')
 		map_name = top_group()->FQN() + map_name;
 
     Array *map_source = 0;	// The array variable that holds the data for the Map
@@ -347,21 +408,21 @@ bool D4ParserSax2::process_map(const char *name, const xmlChar **attrs, int nb_a
 	return true;
 }
 
-bool D4ParserSax2::process_group(const char *name, const xmlChar **attrs, int nb_attributes)
+bool D4ParserSax2::process_group(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Group"))
+    if (!is(name, group_n))
         return false;
 
     transfer_xml_attrs(attrs, nb_attributes);
 
-    if (!check_required_attribute("name")) {
+    if (!check_required_attribute(name_n)) {
         dmr_error(this, "The required attribute 'name' was missing from a Group element.");
         return false;
     }
 
-    BaseType *btp = dmr()->factory()->NewVariable(dods_group_c, xml_attrs["name"].value);
+    BaseType *btp = dmr()->factory()->NewVariable(dods_group_c, xml_attr_value(name_n));
     if (!btp) {
-        dmr_fatal_error(this, "Could not instantiate the Group '%s'.", xml_attrs["name"].value.c_str());
+        dmr_fatal_error(this, "Could not instantiate the Group '%s'.", xml_attr_value(name_n).c_str());
         return false;
     }
 
@@ -392,25 +453,28 @@ bool D4ParserSax2::process_group(const char *name, const xmlChar **attrs, int nb
  @param name The start tag name
  @param attrs The tag's XML attributes
  @return True if the tag was an \c Attribute or \c Alias tag */
-inline bool D4ParserSax2::process_attribute(const char *name, const xmlChar **attrs, int nb_attributes)
+inline bool D4ParserSax2::process_attribute(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Attribute"))
+    if (!is(name, attribute_n))
         return false;
 
     // These methods set the state to parser_error if a problem is found.
     transfer_xml_attrs(attrs, nb_attributes);
 
     // add error
-    if (!(check_required_attribute(string("name")) && check_required_attribute(string("type")))) {
+    if (!(check_required_attribute(name_n) && check_required_attribute(type_n))) {
         dmr_error(this, "The required attribute 'name' or 'type' was missing from an Attribute element.");
         return false;
     }
 
-    if (xml_attrs["type"].value == "Container") {
+    // The Value elements that follow are added to a new attribute
+    d_attr = 0;
+
+    if (xml_attr_is(type_n, "Container")) {
         push_state(inside_attribute_container);
 
-        DBG(cerr << "Pushing attribute container " << xml_attrs["name"].value << endl);
-        D4Attribute *child = new D4Attribute(xml_attrs["name"].value, attr_container_c);
+        DBG(cerr << "Pushing attribute container " << xml_attr_value(name_n) << endl);
+        D4Attribute *child = new D4Attribute(xml_attr_value(name_n), attr_container_c);
 
         D4Attributes *tos = top_attributes();
         // add return
@@ -423,17 +487,17 @@ inline bool D4ParserSax2::process_attribute(const char *name, const xmlChar **at
         tos->add_attribute_nocopy(child);
         push_attributes(child->attributes());
     }
-    else if (xml_attrs["type"].value == "OtherXML") {
+    else if (xml_attr_is(type_n, "OtherXML")) {
         push_state(inside_other_xml_attribute);
 
-        dods_attr_name = xml_attrs["name"].value;
-        dods_attr_type = xml_attrs["type"].value;
+        dods_attr_name = xml_attr_value(name_n);
+        dods_attr_type = xml_attr_value(type_n);
     }
     else {
         push_state(inside_attribute);
 
-        dods_attr_name = xml_attrs["name"].value;
-        dods_attr_type = xml_attrs["type"].value;
+        dods_attr_name = xml_attr_value(name_n);
+        dods_attr_type = xml_attr_value(type_n);
     }
 
     return true;
@@ -444,30 +508,30 @@ inline bool D4ParserSax2::process_attribute(const char *name, const xmlChar **at
  @param name The start tag name
  @param attrs The tag's XML attributes
  @return True if the tag was an \c Enumeration */
-inline bool D4ParserSax2::process_enum_def(const char *name, const xmlChar **attrs, int nb_attributes)
+inline bool D4ParserSax2::process_enum_def(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "Enumeration"))
+    if (!is(name, enumeration_n))
         return false;
 
     transfer_xml_attrs(attrs, nb_attributes);
 
-    if (!(check_required_attribute("name") && check_required_attribute("basetype"))) {
+    if (!(check_required_attribute(name_n) && check_required_attribute(basetype_n))) {
         dmr_error(this, "The required attribute 'name' or 'basetype' was missing from an Enumeration element.");
         return false;
     }
 
-    Type t = get_type(xml_attrs["basetype"].value.c_str());
+    Type t = get_type(xml_attr_value(basetype_n).c_str());
     if (!is_integer_type(t)) {
         dmr_error(this, "The Enumeration '%s' must have an integer type, instead the type '%s' was used.",
-                xml_attrs["name"].value.c_str(), xml_attrs["basetype"].value.c_str());
+                xml_attr_value(name_n).c_str(), xml_attr_value(basetype_n).c_str());
         return false;
     }
 
     // This getter allocates a new object if needed.
-    string enum_def_path = xml_attrs["name"].value;
+    string enum_def_path = xml_attr_value(name_n);
 #if 0
 	// Use FQNs when things are referenced, not when they are defined
-    if (xml_attrs["name"].value[0] != '/')
+    if (xml_attr_value(name_n)[0] != '/')
     	enum_def_path = top_group()->FQN() + enum_def_path;
 #endif
     enum_def()->set_name(enum_def_path);
@@ -476,33 +540,33 @@ inline bool D4ParserSax2::process_enum_def(const char *name, const xmlChar **att
     return true;
 }
 
-inline bool D4ParserSax2::process_enum_const(const char *name, const xmlChar **attrs, int nb_attributes)
+inline bool D4ParserSax2::process_enum_const(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    if (is_not(name, "EnumConst"))
+    if (!is(name, enum_const_n))
         return false;
 
     // These methods set the state to parser_error if a problem is found.
     transfer_xml_attrs(attrs, nb_attributes);
 
-    if (!(check_required_attribute("name") && check_required_attribute("value"))) {
+    if (!(check_required_attribute(name_n) && check_required_attribute(value_attr_n))) {
         dmr_error(this, "The required attribute 'name' or 'value' was missing from an EnumConst element.");
         return false;
     }
 
-    istringstream iss(xml_attrs["value"].value);
+    istringstream iss(xml_attr_value(value_attr_n));
     long long value = 0;
     iss >> skipws >> value;
     if (iss.fail() || iss.bad()) {
         dmr_error(this, "Expected an integer value for an Enumeration constant, got '%s' instead.",
-                xml_attrs["value"].value.c_str());
+                xml_attr_value(value_attr_n).c_str());
     }
     else if (!enum_def()->is_valid_enum_value(value)) {
         dmr_error(this, "In an Enumeration constant, the value '%s' cannot fit in a variable of type '%s'.",
-                xml_attrs["value"].value.c_str(), D4type_name(d_enum_def->type()).c_str());
+                xml_attr_value(value_attr_n).c_str(), D4type_name(d_enum_def->type()).c_str());
     }
     else {
         // unfortunate choice of names... args are 'label' and 'value'
-        enum_def()->add_value(xml_attrs["name"].value, value);
+        enum_def()->add_value(xml_attr_value(name_n), value);
     }
 
     return true;
@@ -513,9 +577,9 @@ inline bool D4ParserSax2::process_enum_const(const char *name, const xmlChar **a
  @param name The start element name
  @param attrs The element's XML attributes
  @return True if the element was a variable */
-inline bool D4ParserSax2::process_variable(const char *name, const xmlChar **attrs, int nb_attributes)
+inline bool D4ParserSax2::process_variable(const xmlChar *name, const xmlChar **attrs, int nb_attributes)
 {
-    Type t = get_type(name);
+    Type t = type_of(name);
     if (is_simple_type(t)) {
         process_variable_helper(t, inside_simple_type, attrs, nb_attributes);
         return true;
@@ -547,16 +611,16 @@ void D4ParserSax2::process_variable_helper(Type t, ParseState s, const xmlChar *
 {
     transfer_xml_attrs(attrs, nb_attributes);
 
-    if (check_required_attribute("name")) {
-        BaseType *btp = dmr()->factory()->NewVariable(t, xml_attrs["name"].value);
+    if (check_required_attribute(name_n)) {
+        BaseType *btp = dmr()->factory()->NewVariable(t, xml_attr_value(name_n));
         if (!btp) {
-            dmr_fatal_error(this, "Could not instantiate the variable '%s'.", xml_attrs["name"].value.c_str());
+            dmr_fatal_error(this, "Could not instantiate the variable '%s'.", xml_attr_value(name_n).c_str());
             return;
         }
 
-        if ((t == dods_enum_c) && check_required_attribute("enum")) {
+        if ((t == dods_enum_c) && check_required_attribute(enum_n)) {
             D4EnumDef *enum_def = 0;
-            string enum_path = xml_attrs["enum"].value;
+            string enum_path = xml_attr_value(enum_n);
 			if (enum_path[0] == '/')
                 enum_def = dmr()->root()->find_enum_def(enum_path);
             else
@@ -577,6 +641,43 @@ void D4ParserSax2::process_variable_helper(Type t, ParseState s, const xmlChar *
     }
 }
 
+/** Add a value to the attribute named by the current Attribute element.
+ * The attribute is found, or made, for the first value; later values of
+ * the same element are added to it directly.
+ * @param value The value */
+void D4ParserSax2::add_attribute_value(const string &value)
+{
+    if (!d_attr) {
+        D4Attributes *attrs = top_attributes();
+
+        // get() treats a '.' as a separator; look for other names here
+        if (dods_attr_name.find('.') != string::npos) {
+            d_attr = attrs->get(dods_attr_name);
+        }
+        else {
+            for (D4Attributes::D4AttributesIter i = attrs->attribute_begin(), e = attrs->attribute_end(); i != e; ++i) {
+                if ((*i)->name() == dods_attr_name) {
+                    d_attr = *i;
+                    break;
+                }
+            }
+        }
+
+        if (!d_attr) {
+            d_attr = new D4Attribute(dods_attr_name, StringToD4AttributeType(dods_attr_type));
+            attrs->add_attribute_nocopy(d_attr);
+        }
+    }
+
+    d_attr->add_value(value);
+}
+
+// Order XML attributes by name
+bool D4ParserSax2::xml_attr_less(const XMLAttribute *a, const XMLAttribute *b)
+{
+    return strcmp((const char *) a->localname, (const char *) b->localname) < 0;
+}
+
 /** @name SAX Parser Callbacks
 
  These methods are declared static in the class header. This gives them C
@@ -650,40 +751,33 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
     if (parser->debug()) cerr << "Start element " << localname << "  prefix:  "<< (prefix?(char *)prefix:"null") << "  ns: "<< (URI?(char *)URI:"null")
     		   << " (state: " << states[parser->get_state()] << ")" << endl;
 
-    if(parser->get_state() != parser_error){
-        string dap4_ns_name = DapXmlNamspaces::getDapNamespaceString(DAP_4_0);
-        if (parser->debug()) cerr << "dap4_ns_name:         " << dap4_ns_name << endl;
-
-        string this_element_ns_name = (URI != 0) ? ((char *)URI) : "";
-        if (parser->debug()) cerr << "this_element_ns_name: " << this_element_ns_name << endl;
-
-        if(this_element_ns_name.compare(dap4_ns_name)){
+    if (parser->get_state() != parser_error) {
+        // The namespace URIs are in the parser's dictionary too
+        if (URI != parser->d_dap4_ns && !(URI && strcmp((const char *) URI, (const char *) parser->d_dap4_ns) == 0)) {
             if (parser->debug()) cerr << "Start of non DAP4 element: " << localname << " detected." << endl;
-        	parser->push_state(not_dap4_element);
-        	// return;
+            parser->push_state(not_dap4_element);
         }
     }
 
-
     switch (parser->get_state()) {
         case parser_start:
-            if (is_not(localname, "Dataset"))
+            if (!parser->is(l, dataset_n))
                 D4ParserSax2::dmr_error(parser, "Expected DMR to start with a Dataset element; found '%s' instead.", localname);
 
             parser->root_ns = URI ? (const char *) URI : "";
             parser->transfer_xml_attrs(attributes, nb_attributes);
 
-            if (parser->check_required_attribute(string("name")))
-                parser->dmr()->set_name(parser->xml_attrs["name"].value);
+            if (parser->check_required_attribute(name_n))
+                parser->dmr()->set_name(parser->xml_attr_value(name_n));
 
-            if (parser->check_attribute("dapVersion"))
-                parser->dmr()->set_dap_version(parser->xml_attrs["dapVersion"].value);
+            if (parser->check_attribute(dap_version_n))
+                parser->dmr()->set_dap_version(parser->xml_attr_value(dap_version_n));
 
-            if (parser->check_attribute("dmrVersion"))
-                parser->dmr()->set_dmr_version(parser->xml_attrs["dmrVersion"].value);
+            if (parser->check_attribute(dmr_version_n))
+                parser->dmr()->set_dmr_version(parser->xml_attr_value(dmr_version_n));
 
-            if (parser->check_attribute("base"))
-                parser->dmr()->set_request_xml_base(parser->xml_attrs["base"].value);
+            if (parser->check_attribute(base_n))
+                parser->dmr()->set_request_xml_base(parser->xml_attr_value(base_n));
 
             if (!parser->root_ns.empty())
                 parser->dmr()->set_namespace(parser->root_ns);
@@ -700,17 +794,17 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
             // must be present; other groups are optional
         case inside_dataset:
         case inside_group:
-            if (parser->process_enum_def(localname, attributes, nb_attributes))
+            if (parser->process_enum_def(l, attributes, nb_attributes))
                 parser->push_state(inside_enum_def);
-            else if (parser->process_dimension_def(localname, attributes, nb_attributes))
+            else if (parser->process_dimension_def(l, attributes, nb_attributes))
                 parser->push_state(inside_dim_def);
-            else if (parser->process_group(localname, attributes, nb_attributes))
+            else if (parser->process_group(l, attributes, nb_attributes))
                 parser->push_state(inside_group);
-            else if (parser->process_variable(localname, attributes, nb_attributes))
+            else if (parser->process_variable(l, attributes, nb_attributes))
                 // This will push either inside_simple_type or inside_structure
                 // onto the parser state stack.
                break;
-            else if (parser->process_attribute(localname, attributes, nb_attributes))
+            else if (parser->process_attribute(l, attributes, nb_attributes))
                 // This will push either inside_attribute, inside_attribute_container
                 // or inside_otherxml_attribute onto the parser state stack
                 break;
@@ -719,16 +813,16 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
             break;
 
         case inside_attribute_container:
-            if (parser->process_attribute(localname, attributes, nb_attributes))
+            if (parser->process_attribute(l, attributes, nb_attributes))
                 break;
             else
                 D4ParserSax2::dmr_error(parser, "Expected an Attribute element; found '%s' instead.", localname);
             break;
 
         case inside_attribute:
-            if (parser->process_attribute(localname, attributes, nb_attributes))
+            if (parser->process_attribute(l, attributes, nb_attributes))
                 break;
-            else if (strcmp(localname, "Value") == 0)
+            else if (parser->is(l, value_n))
                 parser->push_state(inside_attribute_value);
             else
                 dmr_error(parser, "Expected an 'Attribute' or 'Value' element; found '%s' instead.", localname);
@@ -767,15 +861,23 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
 
             if (nb_attributes != 0) {
                 parser->transfer_xml_attrs(attributes, nb_attributes);
-                for (XMLAttrMap::iterator i = parser->xml_attr_begin(); i != parser->xml_attr_end(); ++i) {
+
+                // Write them sorted by name, as the text was before the
+                // XML attributes were held in a vector
+                vector<const XMLAttribute*> sorted;
+                for (vector<XMLAttribute>::const_iterator i = parser->xml_attrs.begin(); i != parser->xml_attrs.end(); ++i)
+                    sorted.push_back(&*i);
+                sort(sorted.begin(), sorted.end(), xml_attr_less);
+
+                for (vector<const XMLAttribute*>::iterator i = sorted.begin(); i != sorted.end(); ++i) {
                     parser->other_xml.append(" ");
-                    if (!i->second.prefix.empty()) {
-                        parser->other_xml.append(i->second.prefix);
+                    if ((*i)->prefix) {
+                        parser->other_xml.append((const char *) (*i)->prefix);
                         parser->other_xml.append(":");
                     }
-                    parser->other_xml.append(i->first);
+                    parser->other_xml.append((const char *) (*i)->localname);
                     parser->other_xml.append("=\"");
-                    parser->other_xml.append(i->second.value);
+                    parser->other_xml.append((*i)->value, (*i)->value_end);
                     parser->other_xml.append("\"");
                 }
             }
@@ -785,7 +887,7 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
 
         case inside_enum_def:
             // process an EnumConst element
-            if (parser->process_enum_const(localname, attributes, nb_attributes))
+            if (parser->process_enum_const(l, attributes, nb_attributes))
                 parser->push_state(inside_enum_const);
             else
                 dmr_error(parser, "Expected an 'EnumConst' element; found '%s' instead.", localname);
@@ -812,26 +914,26 @@ void D4ParserSax2::dmr_start_element(void *p, const xmlChar *l, const xmlChar *p
             break;
 
         case inside_simple_type:
-            if (parser->process_attribute(localname, attributes, nb_attributes))
+            if (parser->process_attribute(l, attributes, nb_attributes))
                 break;
-            else if (parser->process_dimension(localname, attributes, nb_attributes))
+            else if (parser->process_dimension(l, attributes, nb_attributes))
             	parser->push_state(inside_dim);
-            else if (parser->process_map(localname, attributes, nb_attributes))
+            else if (parser->process_map(l, attributes, nb_attributes))
             	parser->push_state(inside_map);
             else
                 dmr_error(parser, "Expected an 'Attribute', 'Dim' or 'Map' element; found '%s' instead.", localname);
             break;
 
         case inside_constructor:
-            if (parser->process_variable(localname, attributes, nb_attributes))
+            if (parser->process_variable(l, attributes, nb_attributes))
                 // This will push either inside_simple_type or inside_structure
                 // onto the parser state stack.
                 break;
-            else if (parser->process_attribute(localname, attributes, nb_attributes))
+            else if (parser->process_attribute(l, attributes, nb_attributes))
                 break;
-            else if (parser->process_dimension(localname, attributes, nb_attributes))
+            else if (parser->process_dimension(l, attributes, nb_attributes))
                 parser->push_state(inside_dim);
-            else if (parser->process_map(localname, attributes, nb_attributes))
+            else if (parser->process_map(l, attributes, nb_attributes))
             	parser->push_state(inside_map);
             else
                 D4ParserSax2::dmr_error(parser, "Expected an Attribute, Dim, Map or variable element; found '%s' instead.", localname);
@@ -873,7 +975,7 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
         break;
 
     case inside_dataset:
-        if (is_not(localname, "Dataset"))
+        if (!parser->is(l, dataset_n))
             D4ParserSax2::dmr_error(parser, "Expected an end Dataset tag; found '%s' instead.", localname);
 
         parser->pop_state();
@@ -886,7 +988,7 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
         break;
 
     case inside_group: {
-        if (is_not(localname, "Group"))
+        if (!parser->is(l, group_n))
             D4ParserSax2::dmr_error(parser, "Expected an end tag for a Group; found '%s' instead.", localname);
 
         if (!parser->empty_basetype() || parser->empty_group())
@@ -899,7 +1001,7 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
     }
 
     case inside_attribute_container:
-        if (is_not(localname, "Attribute"))
+        if (!parser->is(l, attribute_n))
             D4ParserSax2::dmr_error(parser, "Expected an end Attribute tag; found '%s' instead.", localname);
 
         parser->pop_state();
@@ -907,49 +1009,30 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
         break;
 
     case inside_attribute:
-        if (is_not(localname, "Attribute"))
+        if (!parser->is(l, attribute_n))
             D4ParserSax2::dmr_error(parser, "Expected an end Attribute tag; found '%s' instead.", localname);
 
         parser->pop_state();
         break;
 
     case inside_attribute_value: {
-        if (is_not(localname, "Value"))
+        if (!parser->is(l, value_n))
             D4ParserSax2::dmr_error(parser, "Expected an end value tag; found '%s' instead.", localname);
 
         parser->pop_state();
 
-        // The old code added more values using the name and type as
-        // indexes to find the correct attribute. Use get() for that
-        // now. Or fix this code to keep a pointer to the to attribute...
-        D4Attributes *attrs = parser->top_attributes();
-        D4Attribute *attr = attrs->get(parser->dods_attr_name);
-        if (!attr) {
-            attr = new D4Attribute(parser->dods_attr_name, StringToD4AttributeType(parser->dods_attr_type));
-            attrs->add_attribute_nocopy(attr);
-        }
-        attr->add_value(parser->char_data);
-
-        parser->char_data = ""; // Null this after use.
+        parser->add_attribute_value(parser->char_data);
+        parser->char_data.clear(); // Null this after use.
         break;
     }
 
     case inside_other_xml_attribute: {
-        if (strcmp(localname, "Attribute") == 0 && parser->root_ns == (const char *) URI) {
+        if (parser->is(l, attribute_n) && parser->root_ns == (const char *) URI) {
             parser->pop_state();
 
-            // The old code added more values using the name and type as
-            // indexes to find the correct attribute. Use get() for that
-            // now. Or fix this code to keep a pointer to the to attribute...
-            D4Attributes *attrs = parser->top_attributes();
-            D4Attribute *attr = attrs->get(parser->dods_attr_name);
-            if (!attr) {
-                attr = new D4Attribute(parser->dods_attr_name, StringToD4AttributeType(parser->dods_attr_type));
-                attrs->add_attribute_nocopy(attr);
-            }
-            attr->add_value(parser->other_xml);
+            parser->add_attribute_value(parser->other_xml);
 
-            parser->other_xml = ""; // Null this after use.
+            parser->other_xml.clear(); // Null this after use.
         }
         else {
             if (parser->other_xml_depth == 0) {
@@ -971,7 +1054,7 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
     }
 
     case inside_enum_def:
-        if (is_not(localname, "Enumeration"))
+        if (!parser->is(l, enumeration_n))
             D4ParserSax2::dmr_error(parser, "Expected an end Enumeration tag; found '%s' instead.", localname);
         if (!parser->top_group())
             D4ParserSax2::dmr_fatal_error(parser,
@@ -987,14 +1070,14 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
         break;
 
     case inside_enum_const:
-        if (is_not(localname, "EnumConst"))
+        if (!parser->is(l, enum_const_n))
             D4ParserSax2::dmr_error(parser, "Expected an end EnumConst tag; found '%s' instead.", localname);
 
         parser->pop_state();
         break;
 
     case inside_dim_def: {
-        if (is_not(localname, "Dimension"))
+        if (!parser->is(l, dimension_n))
             D4ParserSax2::dmr_error(parser, "Expected an end Dimension tag; found '%s' instead.", localname);
 
         if (!parser->top_group())
@@ -1016,7 +1099,7 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
     }
 
     case inside_simple_type:
-        if (is_simple_type(get_type(localname))) {
+        if (is_simple_type(parser->type_of(l))) {
             BaseType *btp = parser->top_basetype();
             parser->pop_basetype();
             parser->pop_attributes();
@@ -1046,21 +1129,21 @@ void D4ParserSax2::dmr_end_element(void *p, const xmlChar *l, const xmlChar *pre
         break;
 
     case inside_dim:
-        if (is_not(localname, "Dim"))
+        if (!parser->is(l, dim_n))
             D4ParserSax2::dmr_fatal_error(parser, "Expected an end Dim tag; found '%s' instead.", localname);
 
         parser->pop_state();
         break;
 
     case inside_map:
-        if (is_not(localname, "Map"))
+        if (!parser->is(l, map_n))
             D4ParserSax2::dmr_fatal_error(parser, "Expected an end Map tag; found '%s' instead.", localname);
 
         parser->pop_state();
         break;
 
     case inside_constructor: {
-        if (strcmp(localname, "Structure") != 0 && strcmp(localname, "Sequence") != 0) {
+        if (!parser->is(l, structure_n) && !parser->is(l, sequence_n)) {
             D4ParserSax2::dmr_error(parser, "Expected an end tag for a constructor; found '%s' instead.", localname);
             return;
         }
@@ -1231,16 +1314,21 @@ void D4ParserSax2::dmr_error(void *p, const char *msg, ...)
 }
 //@}
 
-/** Clean up after a parse operation. If the parser encountered an error,
- * throw either an Error or InternalErr object.
- */
-void D4ParserSax2::cleanup_parse()
+/** If a parse was started with begin_parse() but not ended, because
+ * reading the document threw, free what it holds. */
+D4ParserSax2::~D4ParserSax2()
 {
-    bool wellFormed = context->wellFormed;
-    bool valid = context->valid;
+    if (context)
+        free_parse();
+}
 
-    context->sax = NULL;
+/** Free the parser context and the objects made by the parse that were
+ * not added to the DMR. */
+void D4ParserSax2::free_parse()
+{
+    // context->sax is libxml2's copy of ddx_sax_parser, so it's freed too
     xmlFreeParserCtxt(context);
+    context = 0;
 
     delete d_enum_def;
     d_enum_def = 0;
@@ -1254,6 +1342,17 @@ void D4ParserSax2::cleanup_parse()
         delete top_basetype();
         pop_basetype();
     }
+}
+
+/** Clean up after a parse operation. If the parser encountered an error,
+ * throw either an Error or InternalErr object.
+ */
+void D4ParserSax2::cleanup_parse()
+{
+    bool wellFormed = context->wellFormed;
+    bool valid = context->valid;
+
+    free_parse();
 
     if (!wellFormed)
         throw Error("The DMR was not well formed. " + error_msg);
@@ -1281,44 +1380,39 @@ void D4ParserSax2::cleanup_parse()
  */
 void D4ParserSax2::intern(istream &f, DMR *dest_dmr, bool debug)
 {
-    d_debug = debug;
-
     // Code example from libxml2 docs re: read from a stream.
 
     if (!f.good())
         throw Error("Input stream not open or read error");
-    if (!dest_dmr)
-        throw InternalErr(__FILE__, __LINE__, "DMR object is null");
-
-    d_dmr = dest_dmr; // dump values here
 
     const int size = 1024;
     char chars[size];
     int line = 1;
 
     f.getline(chars, size);
-    int res = f.gcount();
-    if (res == 0) throw Error("No input found while parsing the DMR.");
-
-    if (debug) cerr << "line: (" << line++ << "): " << chars << endl;
+    if (f.gcount() == 0) throw Error("No input found while parsing the DMR.");
 
-    context = xmlCreatePushParserCtxt(&ddx_sax_parser, this, chars, res - 1, "stream");
-    context->validate = true;
-    push_state(parser_start);
+    begin_parse(dest_dmr, debug);
 
-    f.getline(chars, size);
     while ((f.gcount() > 0) && (get_state() != parser_end)) {
         if (debug) cerr << "line: (" << line++ << "): " << chars << endl;
-        xmlParseChunk(context, chars, f.gcount() - 1, 0);
+
+        // gcount() includes the newline getline() removed, unless the line
+        // was longer than 'chars' (failbit) or the last one (eofbit). A
+        // long line is passed to the parser in pieces.
+        int res = f.gcount();
+        if (f.fail() && !f.eof())
+            f.clear();
+        else if (!f.eof())
+            --res;
+
+        parse_chunk(chars, res);
         f.getline(chars, size);
     }
 
-    // This call ends the parse.
-    xmlParseChunk(context, chars, 0, 1/*terminate*/);
-
     // This checks that the state on the parser stack is parser_end and throws
     // an exception if it's not (i.e., the loop exited with gcount() == 0).
-    cleanup_parse();
+    end_parse();
 }
 
 /** Parse a DMR document stored in a string.
@@ -1350,24 +1444,63 @@ void D4ParserSax2::intern(const char *buffer, int size, DMR *dest_dmr, bool debu
 {
     if (!(size > 0)) return;
 
-    d_debug = debug;
+    begin_parse(dest_dmr, debug);
 
-    // Code example from libxml2 docs re: read from a stream.
+    // libxml2 refuses to look ahead more than 10MB in one chunk, so pass
+    // large documents to it in pieces.
+    const int chunk = 64 * 1024;
+    for (int pos = 0; pos < size && get_state() != parser_end; pos += chunk)
+        parse_chunk(buffer + pos, min(size - pos, chunk));
+
+    end_parse();
+}
+
+/** Start parsing a DMR that will be passed to the parser a piece at a
+ * time, using parse_chunk(), as it is read. A client uses this to build
+ * the DMR while the rest of it is still arriving. Call end_parse() once
+ * the whole document has been passed to the parser.
+ *
+ * @param dest_dmr Value/result parameter; dumps the information to this DMR
+ * instance.
+ * @param debug If true, ouput helpful debugging messages, False by default
+ * @exception InternalErr Thrown if \c dest_dmr is null.
+ */
+void D4ParserSax2::begin_parse(DMR *dest_dmr, bool debug)
+{
+    d_debug = debug;
 
     if (!dest_dmr) throw InternalErr(__FILE__, __LINE__, "DMR object is null");
     d_dmr = dest_dmr; // dump values in dest_dmr
 
     push_state(parser_start);
-    context = xmlCreatePushParserCtxt(&ddx_sax_parser, this, buffer, size, "stream");
+    context = xmlCreatePushParserCtxt(&ddx_sax_parser, this, 0, 0, "stream");
+    if (!context)
+        throw InternalErr(__FILE__, __LINE__, "Could not make the XML parser.");
+
     context->validate = true;
-    //push_state(parser_start);
-    //xmlParseChunk(context, buffer, size, 0);
+    intern_names();
+}
 
+/** Parse the next part of a DMR. The document may be split anywhere.
+ * @param buffer The text
+ * @param size The number of bytes in \c buffer
+ */
+void D4ParserSax2::parse_chunk(const char *buffer, int size)
+{
+    xmlParseChunk(context, buffer, size, 0);
+}
+
+/** Finish parsing a DMR started with begin_parse().
+ * @exception Error Thrown if the XML document could not be parsed.
+ * @exception InternalErr Thrown if an internal error is found.
+ */
+void D4ParserSax2::end_parse()
+{
     // This call ends the parse.
-    xmlParseChunk(context, buffer, 0, 1/*terminate*/);
+    xmlParseChunk(context, 0, 0, 1/*terminate*/);
 
     // This checks that the state on the parser stack is parser_end and throws
-    // an exception if it's not (i.e., the loop exited with gcount() == 0).
+    // an exception if it's not.
     cleanup_parse();
 }
 
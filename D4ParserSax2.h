@@ -34,9 +34,12 @@
 #include <iostream>
 #include <map>
 #include <stack>
+#include <vector>
 
 #include <libxml/parserInternals.h>
 
+#include "Type.h"
+
 #define CRLF "\r\n"
 
 namespace libdap
@@ -49,6 +52,7 @@ class D4Group;
 class D4Attributes;
 class D4EnumDef;
 class D4Dimension;
+class D4Attribute;
 
 /** Parse the XML text which encodes the network/persistent representation of
     the DMR object. In the current implementation, the DMR is held by an
@@ -117,6 +121,33 @@ private:
         parser_end
     };
 
+    /** The names of the elements and XML attributes the parser uses. They
+     * are looked up in the dictionary of the libxml2 parser when a parse
+     * starts. libxml2 passes element and attribute names from that
+     * dictionary to the callbacks, so a name is matched by comparing
+     * pointers instead of text. */
+    enum XMLName {
+        // Elements
+        dataset_n, group_n, attribute_n, value_n, enumeration_n, enum_const_n,
+        dimension_n, dim_n, map_n, structure_n, sequence_n,
+
+        // XML attributes
+        name_n, size_n, type_n, basetype_n, value_attr_n, enum_n, dap_version_n,
+        dmr_version_n, base_n,
+
+        xml_name_count
+    };
+
+    const xmlChar *d_names[xml_name_count];
+    const xmlChar *d_dap4_ns;
+    bool is(const xmlChar *name, XMLName n) const { return name == d_names[n]; }
+
+    // The variable elements and their types
+    std::map<const xmlChar*, Type> d_types;
+    Type type_of(const xmlChar *name) const;
+
+    void intern_names();
+
     xmlSAXHandler ddx_sax_parser;
 
     // The results of the parse operation are stored in these fields.
@@ -172,6 +203,7 @@ private:
     // These hold temporary values read during the parse.
     string dods_attr_name; // DAP4 attributes, not XML attributes
     string dods_attr_type; // ... not XML ...
+    D4Attribute *d_attr;   // The attribute the Value elements are added to
     string char_data;  // char data in value elements; null after use
     string root_ns;     // What is the namespace of the root node (Group)
 
@@ -180,49 +212,31 @@ private:
 
     bool d_strict;
 
-    class XMLAttribute {
-        public:
-        string prefix;
-        string nsURI;
-        string value;
-
-        void clone(const XMLAttribute &src) {
-            prefix = src.prefix;
-            nsURI = src.nsURI;
-            value = src.value;
-        }
-
-        XMLAttribute() : prefix(""), nsURI(""), value("") {}
-        XMLAttribute(const string &p, const string &ns, const string &v)
-            : prefix(p), nsURI(ns), value(v) {}
-        // 'attributes' as passed from libxml2 is a five element array but this
-        // ctor gets the back four elements.
-        XMLAttribute(const xmlChar **attributes/*[4]*/) {
-            prefix = attributes[0] != 0 ? (const char *)attributes[0]: "";
-            nsURI = attributes[1] != 0 ? (const char *)attributes[1]: "";
-            value = string((const char *)attributes[2], (const char *)attributes[3]);
-        }
-        XMLAttribute(const XMLAttribute &rhs) {
-            clone(rhs);
-        }
-        XMLAttribute &operator=(const XMLAttribute &rhs) {
-            if (this == &rhs)
-                return *this;
-            clone(rhs);
-            return *this;
-        }
+    /** An XML attribute of the element being processed. The pointers are
+     * libxml2's and are valid only until the start element callback
+     * returns. */
+    struct XMLAttribute {
+        const xmlChar *localname;
+        const xmlChar *prefix;
+        const xmlChar *nsURI;
+        const char *value;
+        const char *value_end;
+
+        string text() const { return string(value, value_end); }
     };
 
-    typedef map<string, XMLAttribute> XMLAttrMap;
-    XMLAttrMap xml_attrs; // dump XML attributes here
-
-    XMLAttrMap::iterator xml_attr_begin() { return xml_attrs.begin(); }
+    // Reused for each element, so collecting the attributes doesn't allocate
+    std::vector<XMLAttribute> xml_attrs;
 
-    XMLAttrMap::iterator xml_attr_end() {  return xml_attrs.end(); }
+    const XMLAttribute *xml_attr(XMLName n) const;
+    string xml_attr_value(XMLName n) const;
+    bool xml_attr_is(XMLName n, const char *value) const;
+    static bool xml_attr_less(const XMLAttribute *a, const XMLAttribute *b);
 
     map<string, string> namespace_table;
 
     void cleanup_parse();
+    void free_parse();
 
     /** @name Parser Actions
 
@@ -232,21 +246,22 @@ private:
     //@{
     void transfer_xml_attrs(const xmlChar **attrs, int nb_attributes);
     void transfer_xml_ns(const xmlChar **namespaces, int nb_namespaces);
-    bool check_required_attribute(const string &attr);
-    bool check_attribute(const string & attr);
+    bool check_required_attribute(XMLName attr);
+    bool check_attribute(XMLName attr) const { return xml_attr(attr) != 0; }
     void process_variable_helper(Type t, ParseState s, const xmlChar **attrs, int nb_attributes);
 
     void process_enum_const_helper(const xmlChar **attrs, int nb_attributes);
     void process_enum_def_helper(const xmlChar **attrs, int nb_attributes);
 
-    bool process_dimension(const char *name, const xmlChar **attrs, int nb_attrs);
-    bool process_dimension_def(const char *name, const xmlChar **attrs, int nb_attrs);
-    bool process_map(const char *name, const xmlChar **attrs, int nb_attributes);
-    bool process_attribute(const char *name, const xmlChar **attrs, int nb_attributes);
-    bool process_variable(const char *name, const xmlChar **attrs, int nb_attributes);
-    bool process_group(const char *name, const xmlChar **attrs, int nb_attributes);
-    bool process_enum_def(const char *name, const xmlChar **attrs, int nb_attributes);
-    bool process_enum_const(const char *name, const xmlChar **attrs, int nb_attributes);
+    bool process_dimension(const xmlChar *name, const xmlChar **attrs, int nb_attrs);
+    bool process_dimension_def(const xmlChar *name, const xmlChar **attrs, int nb_attrs);
+    bool process_map(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    bool process_attribute(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    bool process_variable(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    bool process_group(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    bool process_enum_def(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    bool process_enum_const(const xmlChar *name, const xmlChar **attrs, int nb_attributes);
+    void add_attribute_value(const string &value);
 
     void finish_variable(const char *tag, Type t, const char *expected);
     //@}
@@ -258,9 +273,12 @@ public:
         d_dmr(0), d_enum_def(0), d_dim_def(0),
         other_xml(""), other_xml_depth(0), unknown_depth(0),
         error_msg(""), context(0),
-        dods_attr_name(""), dods_attr_type(""),
+        dods_attr_name(""), dods_attr_type(""), d_attr(0),
         char_data(""), root_ns(""), d_debug(false), d_strict(true)
     {
+        memset(d_names, 0, sizeof(d_names));
+        d_dap4_ns = 0;
+
         //xmlSAXHandler ddx_sax_parser;
         memset(&ddx_sax_parser, 0, sizeof(xmlSAXHandler));
 
@@ -278,10 +296,16 @@ public:
         ddx_sax_parser.endElementNs = &D4ParserSax2::dmr_end_element;
     }
 
+    ~D4ParserSax2();
+
     void intern(istream &f, DMR *dest_dmr, bool debug = false);
     void intern(const string &document, DMR *dest_dmr, bool debug = false);
     void intern(const char *buffer, int size, DMR *dest_dmr, bool debug = false);
 
+    void begin_parse(DMR *dest_dmr, bool debug = false);
+    void parse_chunk(const char *buffer, int size);
+    void end_parse();
+
     /**
      * @defgroup strict The 'strict' mode
      * @{
@@ -37,6 +37,7 @@
 
 #include "D4RValue.h"
 #include "D4FilterClause.h"     // also contains D4FilterClauseList
+#include "ProjectionOverlay.h"
 
 #include "debug.h"
 #include "Error.h"
@@ -119,7 +120,8 @@ void D4Sequence::m_duplicate(const D4Sequence &s)
     }
 
     d_copy_clauses = s.d_copy_clauses;
-    d_clauses = (s.d_clauses != 0) ? new D4FilterClauseList(*s.d_clauses) : 0;    // deep copy if != 0
+    D4FilterClauseList *clauses = s.m_clauses();
+    d_clauses = (clauses != 0) ? new D4FilterClauseList(*clauses) : 0;    // deep copy if != 0
 }
 
 // Public member functions
@@ -232,18 +234,20 @@ bool D4Sequence::read_next_instance(bool filter)
     bool eof = false;
     bool done = false;
 
+    D4FilterClauseList *clauses = m_clauses();
+
     do {
         eof = read();
         if (eof) {  // bail if EOF
             continue;
         }
         // if we are supposed to filter and the clauses eval to true, we're done
-        else if (filter && d_clauses && d_clauses->value()) {
+        else if (filter && clauses && clauses->value()) {
             d_length++;
             done = true;
         }
         // else if we're not supposed to filter or there are no clauses, we're done
-        else if (!filter || !d_clauses) {
+        else if (!filter || !clauses) {
             d_length++;
             done = true;
         }
@@ -415,10 +419,28 @@ void D4Sequence::deserialize(D4StreamUnMarshaller &um, DMR &dmr)
  */
 D4FilterClauseList & D4Sequence::clauses()
 {
+    // A shared sequence's filter is part of the current request's overlay
+    if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+        ProjectionOverlay::Variable &v = overlay->variable(this);
+        if (!v.clauses) v.clauses = new D4FilterClauseList();
+        return *v.clauses;
+    }
+
     if (!d_clauses) d_clauses = new D4FilterClauseList();
     return *d_clauses;
 }
 
+// The filter clauses, or null if there are none.
+D4FilterClauseList *D4Sequence::m_clauses() const
+{
+    if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+        ProjectionOverlay::Variable *v = overlay->find(this);
+        return v ? v->clauses : 0;
+    }
+
+    return d_clauses;
+}
+
 
 #if INDEX_SUBSETTING
 /** Set the start, stop and stride for a row-number type constraint.
@@ -144,6 +144,8 @@ private:
     // that. ...purely an optimization.
     bool d_copy_clauses;
 
+    D4FilterClauseList *m_clauses() const;
+
 protected:
     // This holds the values of the sequence. Values are stored in
     // instances of BaseTypeRow objects which hold instances of BaseType.
@@ -30,6 +30,7 @@
 
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <fcntl.h>
@@ -38,9 +39,13 @@
 #include <stdlib.h>
 #endif
 
+#include <stdint.h>
+
 #include <string>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <cstring>
 #include <cerrno>
 
@@ -72,6 +77,81 @@ static const unsigned long long BYTES_PER_MEG = 1048576ULL;
 // 2^64 / 2^20 == 2^44
 static const unsigned long long MAX_CACHE_SIZE_IN_MEGABYTES = (1ULL << 44);
 
+// The cache info file starts with this header. The size of the cache is
+// first so that get_cache_size() only has to read one number.
+struct IndexHeader {
+    unsigned long long size;
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    unsigned long long generation;
+};
+
+static const char INDEX_MAGIC[8] = "DAPCIDX";
+static const uint32_t INDEX_VERSION = 2;
+
+// Index log records
+static const char INDEX_ADD = 'A';      // name, size, time
+static const char INDEX_USE = 'U';      // name, time
+static const char INDEX_DELETE = 'D';   // name
+
+// Rewrite the log when it holds this many more records than twice the
+// number of files in the cache.
+static const unsigned long INDEX_LOG_SLACK = 1024;
+
+// Longer names mean the log is corrupt.
+static const uint32_t MAX_INDEX_NAME = 64 * 1024;
+
+static void put_bytes(string &buf, const void *src, size_t n)
+{
+    buf.append(static_cast<const char *>(src), n);
+}
+
+static bool get_bytes(const string &buf, string::size_type &pos, void *dest, size_t n)
+{
+    if (buf.size() - pos < n)
+        return false;
+
+    memcpy(dest, buf.data() + pos, n);
+    pos += n;
+    return true;
+}
+
+/** Add a record to an index log buffer. */
+static void put_index_record(string &buf, char op, const string &name, unsigned long long size = 0,
+        long long time = 0)
+{
+    buf.append(1, op);
+    uint32_t len = name.size();
+    put_bytes(buf, &len, sizeof(len));
+    buf.append(name);
+
+    int64_t t = time;
+    if (op == INDEX_ADD)
+        put_bytes(buf, &size, sizeof(size));
+    if (op == INDEX_ADD || op == INDEX_USE)
+        put_bytes(buf, &t, sizeof(t));
+}
+
+/** Read the header of the cache info file.
+ * @return False if the file has no (valid) header. */
+static bool read_index_header(int fd, IndexHeader &header)
+{
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        return false;
+
+    return memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) == 0 && header.version == INDEX_VERSION;
+}
+
+/** The time in microseconds; the index records times this precisely so
+ * that files used in the same second are still ordered. */
+static long long now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
 DAPCache3 *DAPCache3::d_instance = 0;
 
 
@@ -89,11 +169,89 @@ DAPCache3 *DAPCache3::d_instance = 0;
  * size is 0, or if cache dir does not exist.
  */
 DAPCache3::DAPCache3(const string &cache_dir, const string &prefix, unsigned long long size) :
-        d_cache_dir(cache_dir), d_prefix(prefix), d_max_cache_size_in_bytes(size)
+        d_cache_dir(cache_dir), d_prefix(prefix), d_max_cache_size_in_bytes(size), d_index_size(0),
+        d_policy(new DAPCacheLRUPolicy), d_index_generation(0), d_index_offset(0), d_index_records(0),
+        d_cache_info_fd(-1)
 {
+    pthread_mutex_init(&d_cache_mutex, 0);
+    pthread_mutex_init(&d_in_flight_lock, 0);
+    pthread_cond_init(&d_in_flight_cond, 0);
+
+    reset_statistics();
     m_initialize_cache_info();
 }
 
+/** Record the uses of files that have not been written to the index and
+ * close the cache info file. */
+DAPCache3::~DAPCache3()
+{
+    if (d_cache_info_fd >= 0 && !d_pending_uses.empty()) {
+        try {
+            lock_cache_write();
+            try {
+                m_load_index();
+
+                string records;
+                m_add_uses(records);
+                m_append_index(records);
+            }
+            catch (...) {
+                unlock_cache();
+                throw;
+            }
+
+            unlock_cache();
+        }
+        catch (...) {
+            // The uses are lost; that only changes what's purged first.
+            DBG(cerr << "DAP Cache: could not record file uses" << endl);
+        }
+    }
+
+    if (d_cache_info_fd >= 0)
+        close(d_cache_info_fd);
+
+    delete d_policy;
+
+    pthread_cond_destroy(&d_in_flight_cond);
+    pthread_mutex_destroy(&d_in_flight_lock);
+    pthread_mutex_destroy(&d_cache_mutex);
+}
+
+/** @brief Change the policy used to purge and admit files.
+ *
+ * The cache takes ownership of the policy. The statistics are reset so
+ * that they describe the new policy. All the processes sharing a cache
+ * should use the same policy.
+ *
+ * @param policy The new policy; must not be null. */
+void DAPCache3::set_policy(DAPCachePolicy *policy)
+{
+    if (!policy)
+        throw InternalErr(__FILE__, __LINE__, "The cache policy must not be null.");
+
+    delete d_policy;
+    d_policy = policy;
+
+    // Priorities are the policy's; reorder the files using the new one.
+    m_rebuild_heap();
+
+    reset_statistics();
+}
+
+/** @brief Zero the hit, miss and purge counts. */
+void DAPCache3::reset_statistics()
+{
+    d_stats.policy = d_policy->name();
+    d_stats.hits = 0;
+    d_stats.misses = 0;
+    d_stats.bytes_saved = 0;
+    d_stats.admitted = 0;
+    d_stats.rejected = 0;
+    d_stats.purged = 0;
+    d_stats.bytes_purged = 0;
+}
+
 void DAPCache3::delete_instance() {
     DBG(cerr << "DAPCache3::delete_instance() - Deleting singleton DAPCache3 instance." << endl);
     delete d_instance;
@@ -185,6 +343,8 @@ inline void DAPCache3::m_record_descriptor(const string &file, int fd) {
 
 inline int DAPCache3::m_get_descriptor(const string &file) {
     FilesAndLockDescriptors::iterator i = d_locks.find(file);
+    if (i == d_locks.end())
+        throw InternalErr(__FILE__, __LINE__, "The cache file " + file + " is not locked.");
     int fd = i->second;
     DBG(cerr << "DAP Cache: getting descriptor: " << file << ", " << fd << endl);
     d_locks.erase(i);
@@ -248,6 +408,59 @@ static bool getSharedLock(const string &file_name, int &ref_fd)
     return true;
 }
 
+/** Get a shared read lock on an existing file without blocking.
+
+ @param file_name The name of the file.
+ @param ref_fp if successful, the file descriptor of the file on which we
+ have a shared read lock.
+ @param busy Value-result parameter; set to true if the file exists but
+ another process has it locked for writing.
+
+ @return If the file does not exist or is locked for writing, return false,
+ otherwise return true.
+
+ @exception Error is thrown to indicate a number of untoward
+ events. */
+static bool getSharedLockNB(const string &file_name, int &ref_fd, bool &busy)
+{
+	DBG(cerr << "getSharedLockNB: " << file_name <<endl);
+
+    busy = false;
+
+    int fd;
+    if ((fd = open(file_name.c_str(), O_RDONLY)) < 0) {
+        switch (errno) {
+        case ENOENT:
+            return false;
+
+        default:
+            throw InternalErr(__FILE__, __LINE__, get_errno());
+        }
+    }
+
+    struct flock *l = lock(F_RDLCK);
+    if (fcntl(fd, F_SETLK, l) == -1) {
+        switch (errno) {
+        case EAGAIN:
+        case EACCES:
+            close(fd);
+            busy = true;
+            return false;
+
+        default: {
+            close(fd);
+            ostringstream oss;
+            oss << "cache process: " << l->l_pid << " triggered a locking error: " << get_errno();
+            throw InternalErr(__FILE__, __LINE__, oss.str());
+        }
+        }
+    }
+
+    // Success
+    ref_fd = fd;
+    return true;
+}
+
 /** Get an exclusive read/write lock on an existing file.
 
  @param file_name The name of the file.
@@ -442,17 +655,22 @@ void DAPCache3::m_initialize_cache_info()
     d_cache_info = d_cache_dir + "/dap.cache.info";
 
     // See if we can create it. If so, that means it doesn't exist. So make it and
-    // set the cache initial size to zero.
+    // set the cache initial size to zero and the index to empty.
+    pthread_mutex_lock(&d_cache_mutex); // unlock_cache() releases this
     if (createLockedFile(d_cache_info, d_cache_info_fd)) {
-		// initialize the cache size to zero
-		unsigned long long size = 0;
-		if (write(d_cache_info_fd, &size, sizeof(unsigned long long)) != sizeof(unsigned long long))
-			throw InternalErr(__FILE__, __LINE__, "Could not write size info to the cache info file in startup!");
+		try {
+			m_write_index();
+		}
+		catch (...) {
+			unlock_cache();
+			throw;
+		}
 
 		// This leaves the d_cache_info_fd file descriptor open
 		unlock_cache();
 	}
 	else {
+		pthread_mutex_unlock(&d_cache_mutex);
 		if ((d_cache_info_fd = open(d_cache_info.c_str(), O_RDWR)) == -1) {
 			throw InternalErr(__FILE__, __LINE__, get_errno());
 		}
@@ -563,18 +781,77 @@ bool DAPCache3::get_read_lock(const string &target, int &fd)
 {
 	lock_cache_read();
 
-    bool status = getSharedLock(target, fd);
+	bool busy = false;
+	bool status;
+	try {
+	    status = getSharedLockNB(target, fd, busy);
+	}
+	catch (...) {
+	    unlock_cache();
+	    throw;
+	}
 
-    DBG(cerr << "DAP Cache: read_lock: " << target << "(" << status << ")" << endl);
+    DBG(cerr << "DAP Cache: read_lock: " << target << "(" << status << ", " << busy << ")" << endl);
 
     if (status)
-    	m_record_descriptor(target, fd);
+        m_record_read(target, fd);
+    else if (!busy)
+        ++d_stats.misses;
 
     unlock_cache();
 
+    // The file is being written; wait without holding the cache lock
+    if (busy)
+        return m_wait_for_file(target, fd);
+
     return status;
 }
 
+/** Private. Note that \c target was read using \c fd. Call with the cache
+ * locked. */
+void DAPCache3::m_record_read(const string &target, int fd)
+{
+    m_record_descriptor(target, fd);
+    // Written to the index the next time the cache is locked for writing
+    d_pending_uses.push_back(PendingUse(target, now()));
+
+    struct stat buf;
+    ++d_stats.hits;
+    if (fstat(fd, &buf) == 0)
+        d_stats.bytes_saved += buf.st_size;
+}
+
+/** Private. Wait for the process writing \c target to finish. The cache
+ * must not be locked, since the writer locks it once it's done.
+ *
+ * @return False if the writer gave up on the file or it was purged before
+ * this process could lock it. */
+bool DAPCache3::m_wait_for_file(const string &target, int &fd)
+{
+    if (!getSharedLock(target, fd)) {
+        lock_cache_read();
+        ++d_stats.misses;
+        unlock_cache();
+        return false;
+    }
+
+    // A file that's been unlinked is no use
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || buf.st_nlink == 0) {
+        unlock(fd);
+        lock_cache_read();
+        ++d_stats.misses;
+        unlock_cache();
+        return false;
+    }
+
+    lock_cache_read();
+    m_record_read(target, fd);
+    unlock_cache();
+
+    return true;
+}
+
 /** @brief Create a file in the cache and lock it for write access.
  * If the file does not exist, make it, open it for read-write access and
  * get an exclusive lock on it. The locking operation blocks, although that
@@ -591,7 +868,14 @@ bool DAPCache3::create_and_lock(const string &target, int &fd)
 {
 	lock_cache_write();
 
-    bool status = createLockedFile(target, fd);
+    bool status;
+    try {
+        status = createLockedFile(target, fd);
+    }
+    catch (...) {
+        unlock_cache();
+        throw;
+    }
 
     DBG(cerr << "DAP Cache: create_and_lock: " << target << "(" << status << ")" << endl);
 
@@ -631,6 +915,78 @@ void DAPCache3::exclusive_to_shared_lock(int fd)
     }
 }
 
+/** @brief Get a file from the cache, making it if needed.
+ *
+ * If \c target is in the cache, get a shared read lock on it. If not,
+ * make it using \c producer, add it to the cache and return it with a
+ * shared read lock. Only one caller makes the file: other threads of this
+ * process wait on a condition variable and other processes wait on the new
+ * file's lock, then read the file. If the producer throws, the file is
+ * removed, one of the waiters makes it instead and the exception is
+ * passed on.
+ *
+ * Release the file using unlock_and_close(fd); when several threads have
+ * the same file, unlock_and_close(target) might close another thread's
+ * descriptor.
+ *
+ * @param target The name of the file
+ * @param producer Makes the file
+ * @param fd Value-result parameter; a file descriptor open for reading
+ * @return True if this call made the file, false if it was in the cache.
+ */
+bool DAPCache3::get_or_create(const string &target, DAPCacheProducer &producer, int &fd)
+{
+    // Wait while another thread of this process works on the file; it can't
+    // see this thread's fcntl(2) locks or be stopped by them.
+    pthread_mutex_lock(&d_in_flight_lock);
+    while (d_in_flight.find(target) != d_in_flight.end())
+        pthread_cond_wait(&d_in_flight_cond, &d_in_flight_lock);
+    d_in_flight.insert(target);
+    pthread_mutex_unlock(&d_in_flight_lock);
+
+    try {
+        // get_read_lock() waits for other processes that are making the file.
+        // If the one making it gives up, try to make it here.
+        while (!get_read_lock(target, fd)) {
+            if (!create_and_lock(target, fd))
+                continue;
+
+            try {
+                producer.produce(target, fd);
+            }
+            catch (...) {
+                // Unlink before unlocking so waiting processes see it's gone
+                unlink(target.c_str());
+                unlock_and_close(fd);
+                throw;
+            }
+
+            exclusive_to_shared_lock(fd);
+            update_cache_info(target);
+            update_and_purge(target);
+
+            m_end_flight(target);
+            return true;
+        }
+    }
+    catch (...) {
+        m_end_flight(target);
+        throw;
+    }
+
+    m_end_flight(target);
+    return false;
+}
+
+/** Private. Let other threads waiting in get_or_create() at \c target go. */
+void DAPCache3::m_end_flight(const string &target)
+{
+    pthread_mutex_lock(&d_in_flight_lock);
+    d_in_flight.erase(target);
+    pthread_cond_broadcast(&d_in_flight_cond);
+    pthread_mutex_unlock(&d_in_flight_lock);
+}
+
 /** Get an exclusive lock on the 'cache info' file. The 'cache info' file
  * is used to control certain cache actions, ensuring that they are atomic.
  * These include making sure that the create_and_lock() and read_and_lock()
@@ -643,8 +999,12 @@ void DAPCache3::lock_cache_write()
 {
     DBG(cerr << "lock_cache - d_cache_info_fd: " << d_cache_info_fd << endl);
 
+    pthread_mutex_lock(&d_cache_mutex);
+
     if (fcntl(d_cache_info_fd, F_SETLKW, lock(F_WRLCK)) == -1) {
-        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to lock the cache-control file" + get_errno());
+        string err = get_errno();
+        pthread_mutex_unlock(&d_cache_mutex);
+        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to lock the cache-control file" + err);
     }
 }
 
@@ -655,8 +1015,12 @@ void DAPCache3::lock_cache_read()
 {
     DBG(cerr << "lock_cache - d_cache_info_fd: " << d_cache_info_fd << endl);
 
+    pthread_mutex_lock(&d_cache_mutex);
+
     if (fcntl(d_cache_info_fd, F_SETLKW, lock(F_RDLCK)) == -1) {
-        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to lock the cache-control file" + get_errno());
+        string err = get_errno();
+        pthread_mutex_unlock(&d_cache_mutex);
+        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to lock the cache-control file" + err);
     }
 }
 
@@ -669,8 +1033,13 @@ void DAPCache3::unlock_cache()
 {
     DBG(cerr << "DAP Cache: unlock: cache_info (fd: " << d_cache_info_fd << ")" << endl);
 
-    if (fcntl(d_cache_info_fd, F_SETLK, lock(F_UNLCK)) == -1) {
-        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to unlock the cache-control file" + get_errno());
+    int status = fcntl(d_cache_info_fd, F_SETLK, lock(F_UNLCK));
+    string err = get_errno();
+
+    pthread_mutex_unlock(&d_cache_mutex);
+
+    if (status == -1) {
+        throw InternalErr(__FILE__, __LINE__, "An error occurred trying to unlock the cache-control file" + err);
     }
 }
 
@@ -689,7 +1058,18 @@ void DAPCache3::unlock_and_close(const string &file_name)
 {
     DBG(cerr << "DAP Cache: unlock file: " << file_name << endl);
 
-    unlock(m_get_descriptor(file_name));
+    pthread_mutex_lock(&d_cache_mutex);
+    int fd;
+    try {
+        fd = m_get_descriptor(file_name);
+    }
+    catch (...) {
+        pthread_mutex_unlock(&d_cache_mutex);
+        throw;
+    }
+    pthread_mutex_unlock(&d_cache_mutex);
+
+    unlock(fd);
 }
 
 /** Unlock the file. This does not do any name mangling; it
@@ -701,6 +1081,16 @@ void DAPCache3::unlock_and_close(int fd)
 {
     DBG(cerr << "DAP Cache: unlock fd: " << fd << endl);
 
+    // Forget the descriptor if it was recorded
+    pthread_mutex_lock(&d_cache_mutex);
+    for (FilesAndLockDescriptors::iterator i = d_locks.begin(); i != d_locks.end(); ++i) {
+        if (i->second == fd) {
+            d_locks.erase(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d_cache_mutex);
+
     unlock(fd);
 
     DBG(cerr << "DAP Cache: unlock " << fd << " Success" << endl);
@@ -708,46 +1098,42 @@ void DAPCache3::unlock_and_close(int fd)
 
 /** @brief Update the cache info file to include 'target'
  *
- * Add the size of the named file to the total cache size recorded in the
- * cache info file. The cache info file is exclusively locked by this
- * method for its duration. This updates the cache info file and returns
- * the new size.
+ * Add the named file to the index in the cache info file and its size to
+ * the total cache size. If the file is already in the index, its size is
+ * replaced. The cache info file is exclusively locked by this method for
+ * its duration. This updates the cache info file and returns the new size.
  *
  * @param target The name of the file
  * @return The new size of the cache
  */
 unsigned long long DAPCache3::update_cache_info(const string &target)
 {
-	try {
-		lock_cache_write();
-
-		if (lseek(d_cache_info_fd, 0, SEEK_SET) == -1)
-			throw InternalErr(__FILE__, __LINE__, "Could not rewind to front of cache info file.");
+	lock_cache_write();
 
-		// read the size from the cache info file
-		unsigned long long current_size;
-		if (read(d_cache_info_fd, &current_size, sizeof(unsigned long long)) != sizeof(unsigned long long))
-			throw InternalErr(__FILE__, __LINE__, "Could not get read size info from the cache info file!");
+	try {
+		m_load_index();
 
 		struct stat buf;
-		int statret = stat(target.c_str(), &buf);
-		if (statret == 0)
-			current_size += buf.st_size;
-		else
+		if (stat(target.c_str(), &buf) != 0)
 			throw InternalErr(__FILE__, __LINE__, "Could not read the size of the new file: " + target + " : " + get_errno());
 
-		DBG(cerr << "DAP Cache: cache size updated to: " << current_size << endl);
+		string records;
+		m_add_uses(records);
 
-		if (lseek(d_cache_info_fd, 0, SEEK_SET) == -1)
-			throw InternalErr(__FILE__, __LINE__, "Could not rewind to front of cache info file.");
+		long long time = now();
+		m_apply_record(INDEX_ADD, target, buf.st_size, time);
+		put_index_record(records, INDEX_ADD, target, buf.st_size, time);
 
-		if(write(d_cache_info_fd, &current_size, sizeof(unsigned long long)) != sizeof(unsigned long long))
-			throw InternalErr(__FILE__, __LINE__, "Could not write size info from the cache info file!");
+		m_append_index(records);
+
+		DBG(cerr << "DAP Cache: cache size updated to: " << d_index_size << endl);
 
 		unlock_cache();
-		return current_size;
+		return d_index_size;
 	}
 	catch (...) {
+		// Read the whole index again next time
+		d_index_offset = 0;
 		unlock_cache();
 		throw;
 	}
@@ -771,9 +1157,9 @@ bool DAPCache3::cache_too_big(unsigned long long current_size) const
  */
 unsigned long long DAPCache3::get_cache_size()
 {
-	try {
-		lock_cache_read();
+	lock_cache_read();
 
+	try {
 		if (lseek(d_cache_info_fd, 0, SEEK_SET) == -1)
 	        throw InternalErr(__FILE__, __LINE__, "Could not rewind to front of cache info file.");
 		// read the size from the cache info file
@@ -791,6 +1177,306 @@ unsigned long long DAPCache3::get_cache_size()
 }
 
 
+/** @name Cache index
+ *
+ * These private methods maintain the index of cached files kept in the cache
+ * info file. Call them with the cache info file locked for writing. A record
+ * is a one character type code, the length of the file's name, the name
+ * and then, for an add record, the file's size and time of last use or, for
+ * a use record, the time. The file uses the host's byte order.
+ */
+//@{
+
+/** Read the records other processes have added to the index since this
+ * process last read it. If the log was rewritten, read all of it.
+ *
+ * @return False if the cache info file holds no index or the index is
+ * corrupt. */
+bool DAPCache3::m_read_index()
+{
+    IndexHeader header;
+    if (!read_index_header(d_cache_info_fd, header))
+        return false;
+
+    if (d_index_offset == 0 || header.generation != d_index_generation) {
+        d_index.clear();
+        d_purge_heap.clear();
+        d_index_size = 0;
+        d_index_records = 0;
+        d_index_offset = sizeof(IndexHeader);
+        d_index_generation = header.generation;
+    }
+
+    struct stat st;
+    if (fstat(d_cache_info_fd, &st) != 0 || st.st_size < d_index_offset)
+        return false;
+
+    string buf(st.st_size - d_index_offset, '\0');
+    if (!buf.empty() && pread(d_cache_info_fd, &buf[0], buf.size(), d_index_offset) != (ssize_t) buf.size())
+        return false;
+
+    string::size_type pos = 0;
+    while (pos < buf.size()) {
+        char op = buf[pos++];
+        uint32_t len;
+        if (!get_bytes(buf, pos, &len, sizeof(len)) || len > MAX_INDEX_NAME || buf.size() - pos < len)
+            return false;
+
+        string name = buf.substr(pos, len);
+        pos += len;
+
+        unsigned long long size = 0;
+        int64_t t = 0;
+        if (op == INDEX_ADD && !get_bytes(buf, pos, &size, sizeof(size)))
+            return false;
+        if ((op == INDEX_ADD || op == INDEX_USE) && !get_bytes(buf, pos, &t, sizeof(t)))
+            return false;
+        if (op != INDEX_ADD && op != INDEX_USE && op != INDEX_DELETE)
+            return false;
+
+        m_apply_record(op, name, size, t);
+        ++d_index_records;
+    }
+
+    d_index_offset = st.st_size;
+    return true;
+}
+
+/** Bring the index up to date. If it's missing or corrupt, rebuild it. */
+void DAPCache3::m_load_index()
+{
+    if (!m_read_index())
+        m_rebuild_index();
+}
+
+/** Rebuild the index by reading the cache directory. This is the only place
+ * the directory is read; it's done when the index is missing or corrupt. */
+void DAPCache3::m_rebuild_index()
+{
+    DBG(cerr << "DAP Cache: rebuilding the index of " << d_cache_dir << endl);
+
+    CacheFiles contents;
+    m_collect_cache_dir_info(contents);
+
+    d_index.clear();
+    d_purge_heap.clear();
+    d_index_size = 0;
+    for (CacheFiles::iterator i = contents.begin(); i != contents.end(); ++i) {
+        if (i->name != d_cache_info)
+            m_index_file(i->name, i->size, i->time * 1000000LL);
+    }
+
+    m_write_index();
+}
+
+/** Write the whole index, replacing the log. Other processes see the new
+ * generation number and read it all again. */
+void DAPCache3::m_write_index()
+{
+    IndexHeader header;
+    unsigned long long generation = d_index_generation;
+    if (read_index_header(d_cache_info_fd, header))
+        generation = max(generation, header.generation);
+
+    memset(&header, 0, sizeof(header));
+    header.size = d_index_size;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.generation = generation + 1;
+
+    string buf;
+    put_bytes(buf, &header, sizeof(header));
+    for (CacheIndex::iterator i = d_index.begin(); i != d_index.end(); ++i)
+        put_index_record(buf, INDEX_ADD, i->first, i->second.size, i->second.time);
+
+    if (pwrite(d_cache_info_fd, buf.data(), buf.size(), 0) != (ssize_t) buf.size()
+            || ftruncate(d_cache_info_fd, buf.size()) != 0)
+        throw InternalErr(__FILE__, __LINE__, "Could not write the cache index: " + get_errno());
+
+    d_index_generation = header.generation;
+    d_index_offset = buf.size();
+    d_index_records = d_index.size();
+}
+
+/** Append records to the index and record the new cache size. Call after
+ * m_load_index() so that the records follow those of other processes. */
+void DAPCache3::m_append_index(const string &records)
+{
+    if (!records.empty()) {
+        if (pwrite(d_cache_info_fd, records.data(), records.size(), d_index_offset) != (ssize_t) records.size())
+            throw InternalErr(__FILE__, __LINE__, "Could not write to the cache index: " + get_errno());
+
+        d_index_offset += records.size();
+
+        // Count the records
+        string::size_type pos = 0;
+        while (pos < records.size()) {
+            char op = records[pos];
+            uint32_t len;
+            memcpy(&len, records.data() + pos + 1, sizeof(len));
+            pos += 1 + sizeof(len) + len + (op == INDEX_ADD ? sizeof(unsigned long long) : 0)
+                    + (op != INDEX_DELETE ? sizeof(int64_t) : 0);
+            ++d_index_records;
+        }
+    }
+
+    if (d_index_records > 2 * d_index.size() + INDEX_LOG_SLACK)
+        m_write_index();
+    else
+        m_write_size();
+}
+
+/** Write the size of the cache at the front of the cache info file. */
+void DAPCache3::m_write_size()
+{
+    if (pwrite(d_cache_info_fd, &d_index_size, sizeof(d_index_size), 0) != sizeof(d_index_size))
+        throw InternalErr(__FILE__, __LINE__, "Could not write size info to the cache info file!");
+}
+
+/** Apply one index record to the in-memory index. */
+void DAPCache3::m_apply_record(char op, const string &name, unsigned long long size, long long time)
+{
+    switch (op) {
+    case INDEX_ADD:
+        m_index_file(name, size, time);
+        d_policy->record_access(name);
+        break;
+
+    case INDEX_USE: {
+        CacheIndex::iterator i = d_index.find(name);
+        if (i == d_index.end())
+            break;
+
+        d_policy->record_access(name);
+        if (time > i->second.time) {
+            i->second.time = time;
+            m_push_candidate(name, i->second);
+        }
+        break;
+    }
+
+    case INDEX_DELETE:
+        m_unindex_file(name);
+        break;
+    }
+}
+
+/** Add the uses of files recorded by get_read_lock() to the index.
+ * @param records Value-result parameter; append the records here. */
+void DAPCache3::m_add_uses(string &records)
+{
+    for (vector<PendingUse>::iterator i = d_pending_uses.begin(); i != d_pending_uses.end(); ++i) {
+        if (d_index.find(i->first) != d_index.end()) {
+            m_apply_record(INDEX_USE, i->first, 0, i->second);
+            put_index_record(records, INDEX_USE, i->first, 0, i->second);
+        }
+    }
+
+    d_pending_uses.clear();
+}
+
+/** Add a file to the in-memory index or replace its entry. */
+void DAPCache3::m_index_file(const string &name, unsigned long long size, long long time)
+{
+    CacheIndex::iterator i = d_index.find(name);
+    if (i != d_index.end())
+        d_index_size -= min(d_index_size, i->second.size);
+
+    IndexEntry &entry = d_index[name];
+    entry.size = size;
+    entry.time = time;
+    d_index_size += size;
+
+    m_push_candidate(name, entry);
+}
+
+/** Add a file to the purge heap with its current priority. */
+void DAPCache3::m_push_candidate(const string &name, const IndexEntry &entry)
+{
+    // Drop the stale candidates once they outnumber the live ones
+    if (d_purge_heap.size() > 2 * d_index.size() + INDEX_LOG_SLACK) {
+        m_rebuild_heap();
+        return;
+    }
+
+    d_purge_heap.push_back(PurgeCandidate(d_policy->priority(entry.size, entry.time), name));
+    push_heap(d_purge_heap.begin(), d_purge_heap.end(), greater<PurgeCandidate>());
+}
+
+/** Build the purge heap from the index. */
+void DAPCache3::m_rebuild_heap()
+{
+    d_purge_heap.clear();
+    for (CacheIndex::iterator i = d_index.begin(); i != d_index.end(); ++i)
+        d_purge_heap.push_back(PurgeCandidate(d_policy->priority(i->second.size, i->second.time), i->first));
+    make_heap(d_purge_heap.begin(), d_purge_heap.end(), greater<PurgeCandidate>());
+}
+
+/** Remove a file from the in-memory index. Its heap entry becomes stale. */
+void DAPCache3::m_unindex_file(const string &name)
+{
+    CacheIndex::iterator i = d_index.find(name);
+    if (i == d_index.end())
+        return;
+
+    d_index_size -= min(d_index_size, i->second.size);
+    d_index.erase(i);
+}
+
+/** Take the file with the lowest priority off the purge heap.
+ * @param name Value-result parameter; the file's name.
+ * @return False if there are no more files. */
+bool DAPCache3::m_pop_oldest(string &name)
+{
+    while (!d_purge_heap.empty()) {
+        pop_heap(d_purge_heap.begin(), d_purge_heap.end(), greater<PurgeCandidate>());
+        PurgeCandidate candidate = d_purge_heap.back();
+        d_purge_heap.pop_back();
+
+        CacheIndex::iterator i = d_index.find(candidate.second);
+        if (i != d_index.end() && d_policy->priority(i->second.size, i->second.time) == candidate.first) {
+            name = candidate.second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Remove a file from the cache unless another process has it locked.
+ * Using fcntl(2) locking, this process' own locks don't stop it.
+ * @param name The file.
+ * @param records Value-result parameter; append the delete record here.
+ * @return True if the file was removed or was already gone. */
+bool DAPCache3::m_purge(const string &name, string &records)
+{
+    unsigned long long size = d_index.find(name) != d_index.end() ? d_index[name].size : 0;
+
+    int cfile_fd;
+    if (getExclusiveLockNB(name, cfile_fd)) {
+        DBG(cerr << "purge: " << name << " removed." << endl );
+
+        if (unlink(name.c_str()) != 0) {
+            unlock(cfile_fd);
+            throw InternalErr(__FILE__, __LINE__, "Unable to purge the file " + name + " from the cache: " + get_errno());
+        }
+
+        unlock(cfile_fd);
+        ++d_stats.purged;
+        d_stats.bytes_purged += size;
+    }
+    else if (access(name.c_str(), F_OK) == 0) {
+        return false;
+    }
+
+    // Removed here or by something other than this cache
+    m_unindex_file(name);
+    put_index_record(records, INDEX_DELETE, name);
+    return true;
+}
+
+//@} End of the cache index methods.
+
 static bool entry_op(cache_entry &e1, cache_entry &e2)
 {
     return e1.time < e2.time;
@@ -844,7 +1530,9 @@ unsigned long long DAPCache3::m_collect_cache_dir_info(CacheFiles &contents)
  *
  * Purge files, oldest to newest, if the current size of the cache exceeds the
  * size of the cache specified in the constructor. This method uses an exclusive
- * lock on the cache for the duration of the purge process.
+ * lock on the cache for the duration of the purge process. The files are
+ * taken from the index's heap, least recently used first, so the cache
+ * directory is not read.
  *
  * @param new_file The name of a file this process just added to the cache. Using
  * fcntl(2) locking there is no way this process can detect its own lock, so the
@@ -855,76 +1543,58 @@ void DAPCache3::update_and_purge(const string &new_file)
 {
     DBG(cerr << "purge - starting the purge" << endl);
 
+    lock_cache_write();
+
     try {
-        lock_cache_write();
+        m_load_index();
 
-        CacheFiles contents;
-        unsigned long long computed_size = m_collect_cache_dir_info(contents);
-#if 0
-        if (BESISDEBUG( "cache_contents" )) {
-            DBG(endl << "BEFORE Purge " << computed_size/BYTES_PER_MEG << endl );
-            CacheFiles::iterator ti = contents.begin();
-            CacheFiles::iterator te = contents.end();
-            for (; ti != te; ti++) {
-                DBG((*ti).time << ": " << (*ti).name << ": size " << (*ti).size/BYTES_PER_MEG << endl );
-            }
-        }
-#endif
-        DBG(cerr << "purge - current and target size (in MB) " << computed_size/BYTES_PER_MEG  << ", " << d_target_size/BYTES_PER_MEG << endl );
+        string records;
+        m_add_uses(records);
 
-        // This deletes files and updates computed_size
-        if (cache_too_big(computed_size)) {
+        DBG(cerr << "purge - current and target size (in MB) " << d_index_size/BYTES_PER_MEG  << ", " << d_target_size/BYTES_PER_MEG << endl );
 
-            // d_target_size is 80% of the maximum cache size.
-            // Grab the first which is the oldest in terms of access time.
-            CacheFiles::iterator i = contents.begin();
-            while (i != contents.end() && computed_size > d_target_size) {
-                // Grab an exclusive lock but do not block - if another process has the file locked
-                // just move on to the next file. Also test to see if the current file is the file
-                // this process just added to the cache - don't purge that!
-                int cfile_fd;
-                if (i->name != new_file && getExclusiveLockNB(i->name, cfile_fd)) {
-                    DBG(cerr << "purge: " << i->name << " removed." << endl );
-
-                    if (unlink(i->name.c_str()) != 0)
-                        throw InternalErr(__FILE__, __LINE__, "Unable to purge the file " + i->name + " from the cache: " + get_errno());
-
-                    unlock(cfile_fd);
-                    computed_size -= i->size;
+        if (cache_too_big(d_index_size)) {
+            // Ask the policy if the new file is worth more than the one it
+            // would push out. If not, it goes instead.
+            string victim;
+            if (!new_file.empty() && d_index.find(new_file) != d_index.end() && m_pop_oldest(victim)) {
+                m_push_candidate(victim, d_index[victim]);
+
+                if (victim != new_file && !d_policy->admit(new_file, victim)) {
+                    if (m_purge(new_file, records))
+                        ++d_stats.rejected;
                 }
-#if 0
                 else {
-                    // This information is useful when debugging... Might comment out for production
-                    DBG(cerr << "purge: " << i->name << " is in use." << endl );
+                    ++d_stats.admitted;
                 }
-#endif
-                ++i;
-
-                DBG(cerr << "purge - current and target size (in MB) " << computed_size/BYTES_PER_MEG << ", " << d_target_size/BYTES_PER_MEG << endl );
             }
-
         }
 
-        if (lseek(d_cache_info_fd, 0, SEEK_SET) == -1)
-            throw InternalErr(__FILE__, __LINE__, "Could not rewind to front of cache info file.");
+        if (cache_too_big(d_index_size)) {
+            // Files that are in use go back on the heap when we're done
+            vector<string> in_use;
 
-        if(write(d_cache_info_fd, &computed_size, sizeof(unsigned long long)) != sizeof(unsigned long long))
-            throw InternalErr(__FILE__, __LINE__, "Could not write size info to the cache info file!");
-#if 0
-        if (BESISDEBUG( "cache_contents" )) {
-            contents.clear();
-            computed_size = m_collect_cache_dir_info(contents);
-            DBG(endl << "AFTER Purge " << computed_size/BYTES_PER_MEG << endl );
-            CacheFiles::iterator ti = contents.begin();
-            CacheFiles::iterator te = contents.end();
-            for (; ti != te; ti++) {
-                DBG((*ti).time << ": " << (*ti).name << ": size " << (*ti).size/BYTES_PER_MEG << endl );
+            // d_target_size is 80% of the maximum cache size.
+            string name;
+            while (d_index_size > d_target_size && m_pop_oldest(name)) {
+                // Don't purge the file this process just added; another process
+                // with the file locked keeps it too.
+                if (name == new_file || !m_purge(name, records))
+                    in_use.push_back(name);
+
+                DBG(cerr << "purge - current and target size (in MB) " << d_index_size/BYTES_PER_MEG << ", " << d_target_size/BYTES_PER_MEG << endl );
             }
+
+            for (vector<string>::iterator i = in_use.begin(); i != in_use.end(); ++i)
+                m_push_candidate(*i, d_index[*i]);
         }
-#endif
+
+        m_append_index(records);
+
         unlock_cache();
     }
     catch(...) {
+        d_index_offset = 0;
         unlock_cache();
         throw;
     }
@@ -945,39 +1615,35 @@ void DAPCache3::purge_file(const string &file)
 {
     DBG(cerr << "purge_file - starting the purge" << endl);
 
+    lock_cache_write();
+
     try {
-        lock_cache_write();
+        m_load_index();
 
         // Grab an exclusive lock on the file
         int cfile_fd;
         if (getExclusiveLock(file, cfile_fd)) {
-            // Get the file's size
-            unsigned long long size = 0;
-            struct stat buf;
-            if (stat(file.c_str(), &buf) == 0) {
-                size = buf.st_size;
-            }
-
             DBG(cerr << "purge_file: " << file << " removed." << endl );
 
-            if (unlink(file.c_str()) != 0)
+            if (unlink(file.c_str()) != 0) {
+                unlock(cfile_fd);
                 throw InternalErr(__FILE__, __LINE__,
                         "Unable to purge the file " + file + " from the cache: " + get_errno());
+            }
 
             unlock(cfile_fd);
 
-            unsigned long long cache_size = get_cache_size() - size;
-
-            if (lseek(d_cache_info_fd, 0, SEEK_SET) == -1)
-                throw InternalErr(__FILE__, __LINE__, "Could not rewind to front of cache info file.");
-
-            if (write(d_cache_info_fd, &cache_size, sizeof(unsigned long long)) != sizeof(unsigned long long))
-                throw InternalErr(__FILE__, __LINE__, "Could not write size info to the cache info file!");
+            string records;
+            m_add_uses(records);
+            m_unindex_file(file);
+            put_index_record(records, INDEX_DELETE, file);
+            m_append_index(records);
         }
 
         unlock_cache();
     }
     catch (...) {
+        d_index_offset = 0;
         unlock_cache();
         throw;
     }
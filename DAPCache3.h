@@ -31,11 +31,17 @@
 
 // #include <algorithm>
 #include <map>
+#include <set>
 #include <string>
 #include <list>
+#include <vector>
 // #include <sstream>
 
+#include <sys/types.h>
+#include <pthread.h>
+
 #include "DapObj.h"
+#include "DAPCachePolicy.h"
 
 #if 0
 #include "BESObj.h"
@@ -47,7 +53,7 @@ class BESKeys;
 namespace libdap {
 
 // These typedefs are used to record information about the files in the cache.
-// See DAPCache3.cc and look at the purge() method.
+// See DAPCache3.cc; the cache directory is read only to rebuild the index.
 typedef struct {
     string name;
     unsigned long long size;
@@ -56,6 +62,18 @@ typedef struct {
 
 typedef std::list<cache_entry> CacheFiles;
 
+/** Makes the contents of a new cache file; see DAPCache3::get_or_create(). */
+class DAPCacheProducer {
+public:
+    virtual ~DAPCacheProducer() {}
+
+    /** Write the new file.
+     * @param target The name of the file.
+     * @param fd Open for writing and exclusively locked.
+     * @exception Throw any exception to abandon the file; it's removed. */
+    virtual void produce(const string &target, int fd) = 0;
+};
+
 /** @brief Implementation of a caching mechanism for compressed data.
  * This cache uses simple advisory locking found on most modern unix file systems.
  * Compressed files are decompressed and stored in a cache where they can be
@@ -78,6 +96,28 @@ typedef std::list<cache_entry> CacheFiles;
  * used to control access to the whole cache - with the open + lock and
  * close + unlock operations performed atomically. Other methods that operate
  * on the cache info file must only be called when the lock has been obtained.
+ *
+ * The cache info file holds the size of the cache followed by an index of
+ * the cached files (name, size and last use time). The index is a log of
+ * records: each change to the cache appends a record, and each process
+ * reads the records the others have appended when it next locks the cache
+ * for writing. Purging uses a heap of the files ordered by the cache's
+ * DAPCachePolicy (least recently used first, by default), so it does not
+ * have to read the cache directory. When the log is much longer than the
+ * index, it's rewritten. The directory is scanned only if the index is
+ * missing or corrupt.
+ *
+ * Because fcntl(2) locks belong to a process, threads of one process are
+ * kept out of each other's way by a mutex held with the cache info lock.
+ * They still don't see each other's locks on cached files, so threaded
+ * programs should use get_or_create(). It makes sure one thread in one
+ * process makes a missing file while the others wait, the other threads
+ * of the process on a condition variable and other processes on the new
+ * file's lock.
+ *
+ * The policy can also refuse to keep a new file when the cache is full
+ * (see DAPCacheTinyLFUPolicy). Each instance counts its hits, misses and
+ * the bytes it read from the cache; see get_statistics().
  */
 class DAPCache3: public libdap::DapObj {
 
@@ -110,6 +150,65 @@ private:
 
     unsigned long long m_collect_cache_dir_info(CacheFiles &contents);
 
+    // The index of the files in the cache, read from the cache info file.
+    struct IndexEntry {
+        unsigned long long size;
+        long long time;     // last use, in microseconds
+    };
+    typedef std::map<string, IndexEntry> CacheIndex;
+    CacheIndex d_index;
+    unsigned long long d_index_size;    // total size of the indexed files
+
+    // Files ordered by the policy's priority, lowest first (a min-heap).
+    // Entries whose priority no longer matches the index are stale and are
+    // skipped.
+    typedef std::pair<double, string> PurgeCandidate;
+    std::vector<PurgeCandidate> d_purge_heap;
+
+    DAPCachePolicy *d_policy;
+
+    unsigned long long d_index_generation; // changed when the log is rewritten
+    off_t d_index_offset;               // bytes of the log read so far
+    unsigned long d_index_records;      // records in the log
+
+    // Uses of files (see get_read_lock()) not yet written to the log.
+    typedef std::pair<string, long long> PendingUse;
+    std::vector<PendingUse> d_pending_uses;
+
+    bool m_read_index();
+    void m_load_index();
+    void m_rebuild_index();
+    void m_write_index();
+    void m_append_index(const string &records);
+    void m_write_size();
+    void m_apply_record(char op, const string &name, unsigned long long size, long long time);
+    void m_add_uses(string &records);
+    void m_index_file(const string &name, unsigned long long size, long long time);
+    void m_unindex_file(const string &name);
+    void m_push_candidate(const string &name, const IndexEntry &entry);
+    void m_rebuild_heap();
+    bool m_pop_oldest(string &name);
+    bool m_purge(const string &name, string &records);
+
+public:
+    /** Statistics for one DAPCache3 instance (i.e., one process) since it
+     * was made or its policy was last set. */
+    struct Statistics {
+        string policy;
+        unsigned long hits;             // get_read_lock() found the file
+        unsigned long misses;
+        unsigned long long bytes_saved; // size of the files found
+        unsigned long admitted;         // new files kept when the cache was full
+        unsigned long rejected;         // ... and new files the policy refused
+        unsigned long purged;
+        unsigned long long bytes_purged;
+
+        double hit_ratio() const { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+private:
+    Statistics d_stats;
+
     /// Name of the file that tracks the size of the cache
     string d_cache_info;
     int d_cache_info_fd;
@@ -117,14 +216,30 @@ private:
     void m_record_descriptor(const string &file, int fd);
     int m_get_descriptor(const string &file);
 
-    // map that relates files to the descriptor used to obtain a lock
-    typedef std::map<string, int> FilesAndLockDescriptors;
+    // map that relates files to the descriptors used to obtain locks; several
+    // threads may read one file.
+    typedef std::multimap<string, int> FilesAndLockDescriptors;
     FilesAndLockDescriptors d_locks;
 
+    // Held with the lock on the cache info file; see lock_cache_write().
+    pthread_mutex_t d_cache_mutex;
+
+    // Files being made by get_or_create() in this process
+    std::set<string> d_in_flight;
+    pthread_mutex_t d_in_flight_lock;
+    pthread_cond_t d_in_flight_cond;
+
+    void m_record_read(const string &target, int fd);
+    bool m_wait_for_file(const string &target, int &fd);
+    void m_end_flight(const string &target);
+
     // Life-cycle control
-    virtual ~DAPCache3() { }
+    virtual ~DAPCache3();
     static void delete_instance();
 
+    friend class DAPCache3Test;
+    friend class DataResponseCacheTest;
+
 public:
     static DAPCache3 *get_instance(const string &cache_dir, const string &prefix, unsigned long long size);
     static DAPCache3 *get_instance();
@@ -135,6 +250,7 @@ public:
     virtual bool create_and_lock(const string &target, int &fd);
     virtual bool get_read_lock(const string &target, int &fd);
     virtual void exclusive_to_shared_lock(int fd);
+    virtual bool get_or_create(const string &target, DAPCacheProducer &producer, int &fd);
     virtual void unlock_and_close(const string &target);
     virtual void unlock_and_close(int fd);
 
@@ -148,6 +264,12 @@ public:
     virtual void update_and_purge(const string &new_file);
     virtual void purge_file(const string &file);
 
+    virtual void set_policy(DAPCachePolicy *policy);
+    virtual const DAPCachePolicy *get_policy() const { return d_policy; }
+
+    virtual Statistics get_statistics() const { return d_stats; }
+    virtual void reset_statistics();
+
 #if 0
     static BESCache3 *get_instance(BESKeys *keys, const string &cache_dir_key, const string &prefix_key, const string &size_key);
 #endif
@@ -0,0 +1,108 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <algorithm>
+#include <string>
+
+#include "DAPCachePolicy.h"
+
+using namespace std;
+
+namespace libdap {
+
+const double DAPCacheGDSPolicy::DEFAULT_SCALE = 1048576.0 * 3600.0 * 1000000.0;
+
+double DAPCacheGDSPolicy::priority(unsigned long long size, long long last_use) const
+{
+    return last_use + d_scale / max(size, 1ULL);
+}
+
+/** @param eviction Decides which file to purge; this object deletes it. If
+ * null, LRU is used.
+ * @param width Counters per row of the sketch. Use about as many as the
+ * number of files the cache usually holds. */
+DAPCacheTinyLFUPolicy::DAPCacheTinyLFUPolicy(DAPCachePolicy *eviction, unsigned int width) :
+    d_eviction(eviction ? eviction : new DAPCacheLRUPolicy), d_counters(ROWS * max(width, 1U), 0),
+    d_width(max(width, 1U)), d_accesses(0), d_sample_size(10UL * d_width)
+{
+}
+
+DAPCacheTinyLFUPolicy::~DAPCacheTinyLFUPolicy()
+{
+    delete d_eviction;
+}
+
+/** Which counter in row \c row holds the count for \c name? Each row uses
+ * FNV-1a with its own offset basis. */
+unsigned int DAPCacheTinyLFUPolicy::m_slot(const string &name, int row) const
+{
+    unsigned int hash = 2166136261U ^ (0x9e3779b9U * (row + 1));
+    for (string::const_iterator i = name.begin(); i != name.end(); ++i) {
+        hash ^= static_cast<unsigned char>(*i);
+        hash *= 16777619U;
+    }
+
+    return row * d_width + hash % d_width;
+}
+
+/** Halve every counter. */
+void DAPCacheTinyLFUPolicy::m_age()
+{
+    for (vector<unsigned char>::iterator i = d_counters.begin(); i != d_counters.end(); ++i)
+        *i >>= 1;
+
+    d_accesses /= 2;
+}
+
+void DAPCacheTinyLFUPolicy::record_access(const string &name)
+{
+    for (int row = 0; row < ROWS; ++row) {
+        unsigned char &counter = d_counters[m_slot(name, row)];
+        if (counter < MAX_COUNT)
+            ++counter;
+    }
+
+    if (++d_accesses >= d_sample_size)
+        m_age();
+}
+
+/** @return An estimate of how often \c name was used recently. It's never
+ * less than the true count (up to the counters' limit). */
+unsigned int DAPCacheTinyLFUPolicy::frequency(const string &name) const
+{
+    unsigned int count = MAX_COUNT;
+    for (int row = 0; row < ROWS; ++row)
+        count = min(count, static_cast<unsigned int>(d_counters[m_slot(name, row)]));
+
+    return count;
+}
+
+bool DAPCacheTinyLFUPolicy::admit(const string &candidate, const string &victim) const
+{
+    return frequency(candidate) > frequency(victim);
+}
+
+} // namespace libdap
@@ -0,0 +1,133 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _dap_cache_policy_h
+#define _dap_cache_policy_h
+
+#include <string>
+#include <vector>
+
+namespace libdap {
+
+/** Decide which files DAPCache3 purges first and whether a new file is
+ * worth keeping. Each process sharing a cache replays the same index log,
+ * so a policy that depends only on what it's told through these methods
+ * reaches the same decisions in every process.
+ *
+ * DAPCache3 keeps files on a heap ordered by priority(); the lowest is
+ * purged first. The priority of a file may change only when it's added or
+ * used, so it must depend on nothing but its arguments. */
+class DAPCachePolicy {
+public:
+    virtual ~DAPCachePolicy() {}
+
+    /** @return The policy's name, used in statistics and benchmarks. */
+    virtual std::string name() const = 0;
+
+    /** @param size Size of the file in bytes.
+     * @param last_use Time of the file's last use, in microseconds.
+     * @return The file's priority; files with lower values are purged first. */
+    virtual double priority(unsigned long long size, long long last_use) const = 0;
+
+    /** Called each time a file is added to the cache or read from it. */
+    virtual void record_access(const std::string &/*name*/) { }
+
+    /** When the cache is full, should a file just added be kept in place of
+     * the file that would be purged to make room for it?
+     * @param candidate The new file.
+     * @param victim The file with the lowest priority. */
+    virtual bool admit(const std::string &/*candidate*/, const std::string &/*victim*/) const { return true; }
+};
+
+/** Purge the least recently used files first. This is the default. */
+class DAPCacheLRUPolicy: public DAPCachePolicy {
+public:
+    virtual std::string name() const { return "lru"; }
+    virtual double priority(unsigned long long, long long last_use) const { return last_use; }
+};
+
+/** GreedyDual-Size with a cost of one for every file. A file's priority is
+ * its last use plus a credit inversely proportional to its size, so a large
+ * file read once is purged well before small files of the same age. Using
+ * the clock in place of GreedyDual's inflation value ages every file
+ * without keeping state that all processes would have to agree on. */
+class DAPCacheGDSPolicy: public DAPCachePolicy {
+    double d_scale;
+
+public:
+    /** A 1MB file gets an hour of credit by default. */
+    static const double DEFAULT_SCALE;
+
+    /** @param scale The credit, in byte-microseconds; a file of N bytes
+     * stays scale/N microseconds longer than LRU would keep it. */
+    DAPCacheGDSPolicy(double scale = DEFAULT_SCALE) : d_scale(scale) { }
+
+    virtual std::string name() const { return "gds"; }
+    virtual double priority(unsigned long long size, long long last_use) const;
+};
+
+/** TinyLFU admission: keep a new file only if it has been asked for more
+ * often than the file it would push out. Access counts are estimated with
+ * a count-min sketch of small saturating counters that are halved once
+ * enough accesses have been counted, so old popularity fades. Which file
+ * is purged is left to another policy.
+ *
+ * This stops one-off requests for large responses from flushing the
+ * popular ones out of the cache. */
+class DAPCacheTinyLFUPolicy: public DAPCachePolicy {
+    DAPCachePolicy *d_eviction;
+
+    static const int ROWS = 4;
+    static const unsigned char MAX_COUNT = 15;
+
+    std::vector<unsigned char> d_counters;  // ROWS rows of d_width counters
+    unsigned int d_width;
+    unsigned long d_accesses;           // since the counters were last halved
+    unsigned long d_sample_size;
+
+    unsigned int m_slot(const std::string &name, int row) const;
+    void m_age();
+
+    DAPCacheTinyLFUPolicy(const DAPCacheTinyLFUPolicy &);
+    DAPCacheTinyLFUPolicy &operator=(const DAPCacheTinyLFUPolicy &);
+
+public:
+    DAPCacheTinyLFUPolicy(DAPCachePolicy *eviction = 0, unsigned int width = 4096);
+    virtual ~DAPCacheTinyLFUPolicy();
+
+    virtual std::string name() const { return "tinylfu-" + d_eviction->name(); }
+    virtual double priority(unsigned long long size, long long last_use) const
+    {
+        return d_eviction->priority(size, last_use);
+    }
+
+    virtual void record_access(const std::string &name);
+    virtual bool admit(const std::string &candidate, const std::string &victim) const;
+
+    unsigned int frequency(const std::string &name) const;
+};
+
+} // namespace libdap
+
+#endif // _dap_cache_policy_h
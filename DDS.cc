@@ -605,6 +605,7 @@ void DDS::add_var(BaseType *bt) {
     }
     else {
         vars.push_back(btp);
+        d_var_index.add(btp);
     }
 }
 
@@ -628,6 +629,7 @@ DDS::add_var_nocopy(BaseType *bt)
     }
     else {
         vars.push_back(bt);
+        d_var_index.add(bt);
     }
 }
 
@@ -652,6 +654,7 @@ DDS::del_var(const string &n)
             BaseType *bt = *i ;
             vars.erase(i) ;
             delete bt ; bt = 0;
+            d_var_index.changed();
             return;
         }
     }
@@ -668,6 +671,7 @@ DDS::del_var(Vars_iter i)
         BaseType *bt = *i ;
         vars.erase(i) ;
         delete bt ; bt = 0;
+        d_var_index.changed();
     }
 }
 
@@ -685,6 +689,7 @@ DDS::del_var(Vars_iter i1, Vars_iter i2)
         delete bt ; bt = 0;
     }
     vars.erase(i1, i2) ;
+    d_var_index.changed();
 }
 
 /** Search for for variable <i>n</i> as above but record all
@@ -713,6 +718,10 @@ DDS::var(const string &n, BaseType::btp_stack &s)
     that are the same (say point.x and pair.x) you should use fully qualified
     names to get each of those variables.
 
+    @note The names are looked up in an index (see VarIndex) that is built
+    the first time this is called and again after variables are added,
+    removed or renamed.
+
     @param n The name of the variable to find.
     @param s If given, this value-result parameter holds the path to the
     returned BaseType. Thus, this method can return the FQN for the variable
@@ -737,6 +746,8 @@ DDS::leaf_match(const string &n, BaseType::btp_stack *s)
 {
     DBG(cerr << "DDS::leaf_match: Looking for " << n << endl);
 
+#if STRUCTURE_ARRAY_SYNTAX_OLD
+    // The index doesn't look inside arrays of constructors
     for (Vars_iter i = vars.begin(); i != vars.end(); i++) {
         BaseType *btp = *i;
         DBG(cerr << "DDS::leaf_match: Looking for " << n << " in: " << btp->d_name() << endl);
@@ -753,7 +764,7 @@ DDS::leaf_match(const string &n, BaseType::btp_stack *s)
                 return found;
             }
         }
-#if STRUCTURE_ARRAY_SYNTAX_OLD
+
         if (btp->is_vector_type() && btp->var()->is_constructor_type()) {
             s->push(btp);
             BaseType *found = btp->var()->var(n, false, s);
@@ -762,24 +773,30 @@ DDS::leaf_match(const string &n, BaseType::btp_stack *s)
                 return found;
             }
         }
-#endif
     }
 
     return 0;   // It is not here.
+#else
+    VarIndex::Path path;
+    BaseType *btp = d_var_index.find_leaf(vars, n, s ? &path : 0);
+    if (btp && s) {
+        // Push the constructors that hold btp innermost first, as the
+        // recursive search did
+        for (VarIndex::Path::reverse_iterator i = path.rbegin(); i != path.rend(); ++i)
+            s->push(*i);
+    }
+
+    return btp;
+#endif
 }
 
 BaseType *
 DDS::exact_match(const string &name, BaseType::btp_stack *s)
 {
-    for (Vars_iter i = vars.begin(); i != vars.end(); i++) {
-        BaseType *btp = *i;
-        DBG2(cerr << "Looking for " << d_name << " in: " << btp << endl);
-        // Look for the d_name in the current ctor type or the top level
-        if (btp->name() == name) {
-            DBG2(cerr << "Found " << d_name << " in: " << btp << endl);
-            return btp;
-        }
-    }
+    // Look for the name in the top level
+    BaseType *btp = d_var_index.find(vars, name);
+    if (btp)
+        return btp;
 
     string::size_type dot_pos = name.find(".");
     if (dot_pos != string::npos) {
@@ -854,7 +871,9 @@ DDS::insert_var(Vars_iter i, BaseType *ptr)
     if (ptr->is_dap4_only_type())
         throw InternalErr(__FILE__, __LINE__, "Attempt to add a DAP4 type to a DAP2 DDS.");
 #endif
-    vars.insert(i, ptr->ptr_duplicate());
+    BaseType *btp = ptr->ptr_duplicate();
+    vars.insert(i, btp);
+    d_var_index.add(btp);
 }
 
 /** Insert the BaseType before the position given.
@@ -872,6 +891,7 @@ DDS::insert_var_nocopy(Vars_iter i, BaseType *ptr)
         throw InternalErr(__FILE__, __LINE__, "Attempt to add a DAP4 type to a DAP2 DDS.");
 #endif
     vars.insert(i, ptr);
+    d_var_index.add(ptr);
 }
 
 /** @brief Returns the number of variables in the DDS. */
@@ -1064,7 +1084,9 @@ DDS::print_das(ostream &out)
 
     d_attr.print(out, "    ");
     for (Vars_citer i = vars.begin(); i != vars.end(); i++) {
-        (*i)->get_attr_table().print(out, "    ");
+        // Variables without attributes print nothing; don't make them a table
+        if ((*i)->has_attr_table())
+            (*i)->get_attr_table().print(out, "    ");
     }
 
     out << "}\n" ;
@@ -1166,9 +1188,10 @@ public:
 };
 
 /**
- * Print the DDX. This code uses the libxml2 'TextWriter' interface; something
- * that seems to be a good compromise between doing it by hand (although more
- * verbose it is also more reliable) and DOM.
+ * Print the DDX. This code uses XMLWriter, which follows the libxml2
+ * 'TextWriter' interface; something that seems to be a good compromise
+ * between doing it by hand (although more verbose it is also more reliable)
+ * and DOM.
  *
  * @note This code handles several different versions of DAP in a fairly
  * crude way. I've broken it up into three different responses: DAP2, DAP3.2
@@ -1184,76 +1207,76 @@ public:
 void
 DDS::print_xml_writer(ostream &out, bool constrained, const string &blob)
 {
-    XMLWriter xml("    ");
+    XMLWriter xml(out, "    ");
 
     // Stamp and repeat for these sections; trying to economize is makes it
     // even more confusing
     if (get_dap_major() >= 4) {
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Group") < 0)
+        if (xml.start_element("Group") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write Group element");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d_name.c_str()) < 0)
+        if (xml.write_attribute("name", d_name.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dapVersion", (const xmlChar*)get_dap_version().c_str()) < 0)
+        if (xml.write_attribute("dapVersion", get_dap_version().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
         if (!get_request_xml_base().empty()) {
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xml", (const xmlChar*)c_xml_namespace.c_str()) < 0)
+            if (xml.write_attribute("xmlns:xml", c_xml_namespace.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xml");
 
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xml:base", (const xmlChar*)get_request_xml_base().c_str()) < 0)
+            if (xml.write_attribute("xml:base", get_request_xml_base().c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xml:base");
         }
         if (!get_namespace().empty()) {
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns", (const xmlChar*)get_namespace().c_str()) < 0)
+            if (xml.write_attribute("xmlns", get_namespace().c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns");
         }
     }
     else if (get_dap_major() == 3 && get_dap_minor() >= 2) {
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Dataset") < 0)
+        if (xml.start_element("Dataset") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write Dataset element");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d_name.c_str()) < 0)
+        if (xml.write_attribute("name", d_name.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xsi", (const xmlChar*)"http://www.w3.org/2001/XMLSchema-instance") < 0)
+        if (xml.write_attribute("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xsi");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xsi:schemaLocation", (const xmlChar*)c_dap_32_n_sl.c_str()) < 0)
+        if (xml.write_attribute("xsi:schemaLocation", c_dap_32_n_sl.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:schemaLocation");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:grddl", (const xmlChar*)"http://www.w3.org/2003/g/data-view#") < 0)
+        if (xml.write_attribute("xmlns:grddl", "http://www.w3.org/2003/g/data-view#") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:grddl");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "grddl:transformation", (const xmlChar*)grddl_transformation_dap32.c_str()) < 0)
+        if (xml.write_attribute("grddl:transformation", grddl_transformation_dap32.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:transformation");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns", (const xmlChar*)c_dap32_namespace.c_str()) < 0)
+        if (xml.write_attribute("xmlns", c_dap32_namespace.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:dap", (const xmlChar*)c_dap32_namespace.c_str()) < 0)
+        if (xml.write_attribute("xmlns:dap", c_dap32_namespace.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:dap");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dapVersion", (const xmlChar*)"3.2") < 0)
+        if (xml.write_attribute("dapVersion", "3.2") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
         if (!get_request_xml_base().empty()) {
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xml", (const xmlChar*)c_xml_namespace.c_str()) < 0)
+            if (xml.write_attribute("xmlns:xml", c_xml_namespace.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xml");
 
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xml:base", (const xmlChar*)get_request_xml_base().c_str()) < 0)
+            if (xml.write_attribute("xml:base", get_request_xml_base().c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xml:base");
         }
     }
     else { // dap2
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Dataset") < 0)
+        if (xml.start_element("Dataset") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write Dataset element");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)d_name.c_str()) < 0)
+        if (xml.write_attribute("name", d_name.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for d_name");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xsi", (const xmlChar*)"http://www.w3.org/2001/XMLSchema-instance") < 0)
+        if (xml.write_attribute("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xsi");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns", (const xmlChar*)c_dap20_namespace.c_str()) < 0)
+        if (xml.write_attribute("xmlns", c_dap20_namespace.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns");
 
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xsi:schemaLocation", (const xmlChar*)c_dap_20_n_sl.c_str()) < 0)
+        if (xml.write_attribute("xsi:schemaLocation", c_dap_20_n_sl.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:schemaLocation");
     }
 
@@ -1269,37 +1292,37 @@ DDS::print_xml_writer(ostream &out, bool constrained, const string &blob)
     // given.
     if (get_dap_major() >= 4) {
         if (!blob.empty()) {
-            if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "blob") < 0)
+            if (xml.start_element("blob") < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write blob element");
             string cid = "cid:" + blob;
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "href", (const xmlChar*) cid.c_str()) < 0)
+            if (xml.write_attribute("href", cid.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for d_name");
-            if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+            if (xml.end_element() < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not end blob element");
         }
     }
     else if (get_dap_major() == 3 && get_dap_minor() >= 2) {
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "blob") < 0)
+        if (xml.start_element("blob") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write blob element");
         string cid = "cid:" + blob;
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "href", (const xmlChar*) cid.c_str()) < 0)
+        if (xml.write_attribute("href", cid.c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for d_name");
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end blob element");
     }
     else { // dap2
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "dataBLOB") < 0)
+        if (xml.start_element("dataBLOB") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write dataBLOB element");
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "href", (const xmlChar*) "") < 0)
+        if (xml.write_attribute("href", "") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for d_name");
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end dataBLOB element");
     }
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end Dataset element");
 
-    out << xml.get_doc();// << ends;// << endl;
+    xml.end_document();
 }
 
 /**
@@ -1320,42 +1343,36 @@ DDS::print_dmr(ostream &out, bool constrained)
     if (get_dap_major() < 4)
         throw InternalErr(__FILE__, __LINE__, "Tried to print a DMR with DAP major version less than 4");
 
-    XMLWriter xml("    ");
+    XMLWriter xml(out, "    ");
 
     // DAP4 wraps a dataset in a top-level Group element.
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Group") < 0)
+    if (xml.start_element("Group") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write Group element");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xml",
-            (const xmlChar*) c_xml_namespace.c_str()) < 0)
+    if (xml.write_attribute("xmlns:xml", c_xml_namespace.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xml");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xsi", (const xmlChar*) c_xml_xsi.c_str())
-            < 0)
+    if (xml.write_attribute("xmlns:xsi", c_xml_xsi.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xsi");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xsi:schemaLocation",
-            (const xmlChar*) c_dap_40_n_sl.c_str()) < 0)
+    if (xml.write_attribute("xsi:schemaLocation", c_dap_40_n_sl.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:schemaLocation");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns",
-            (const xmlChar*) get_namespace().c_str()) < 0)
+    if (xml.write_attribute("xmlns", get_namespace().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dapVersion",
-            (const xmlChar*) get_dap_version().c_str()) < 0)
+    if (xml.write_attribute("dapVersion", get_dap_version().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dmrVersion", (const xmlChar*) get_dmr_version().c_str()) < 0)
+    if (xml.write_attribute("dmrVersion", get_dmr_version().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
     if (!get_request_xml_base().empty()) {
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xml:base",
-                (const xmlChar*) get_request_xml_base().c_str()) < 0)
+        if (xml.write_attribute("xml:base", get_request_xml_base().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xml:base");
     }
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*) d_name.c_str()) < 0)
+    if (xml.write_attribute("name", d_name.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     // Print the global attributes
@@ -1371,21 +1388,21 @@ DDS::print_dmr(ostream &out, bool constrained)
     // given.
     if (get_dap_major() >= 4) {
         if (!blob.empty()) {
-            if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "blob") < 0)
+            if (xml.start_element("blob") < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write blob element");
             string cid = "cid:" + blob;
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "href", (const xmlChar*) cid.c_str()) < 0)
+            if (xml.write_attribute("href", cid.c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for d_name");
-            if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+            if (xml.end_element() < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not end blob element");
         }
     }
 #endif
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end the top-level Group element");
 
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 // Used by DDS::send() when returning data from a function call.
@@ -50,6 +50,10 @@
 #include "Constructor.h"
 #endif
 
+#ifndef _var_index_h
+#include "VarIndex.h"
+#endif
+
 #ifndef base_type_factory_h
 #include "BaseTypeFactory.h"
 #endif
@@ -197,6 +201,7 @@ private:
     AttrTable d_attr;           // Global attributes.
 
     vector<BaseType *> vars;    // Variables at the top level
+    VarIndex d_var_index;       // Names of vars and the variables they hold
 
     int d_timeout;              // alarm time in seconds. If greater than
                                 // zero, raise the alarm signal if more than
@@ -206,6 +211,7 @@ private:
     long d_max_response_size;   // In bytes...
 
     friend class DDSTest;
+    friend class ProjectionOverlay;
 
 protected:
     void duplicate(const DDS &dds);
@@ -1030,13 +1030,21 @@ void DDXParser::ddx_fatal_error(void * p, const char *msg, ...)
 
 //@}
 
-void DDXParser::cleanup_parse(xmlParserCtxtPtr & context)
+/** If a parse was started with begin_parse() but not ended, because
+    reading the document threw, free what it holds. */
+DDXParser::~DDXParser()
 {
-    bool wellFormed = context->wellFormed;
-    bool valid = context->valid;
+    if (ctxt)
+        free_parse();
+}
 
-    context->sax = NULL;
-    xmlFreeParserCtxt(context);
+// Free the parser context and the variables made by the parse that were
+// not added to the DDS.
+void DDXParser::free_parse()
+{
+    ctxt->sax = NULL;
+    xmlFreeParserCtxt(ctxt);
+    ctxt = 0;
 
     // If there's an error, there may still be items on the stack at the
     // end of the parse.
@@ -1044,6 +1052,15 @@ void DDXParser::cleanup_parse(xmlParserCtxtPtr & context)
         delete bt_stack.top();
         bt_stack.pop();
     }
+}
+
+void DDXParser::cleanup_parse(xmlParserCtxtPtr & context)
+{
+    bool wellFormed = context->wellFormed;
+    bool valid = context->valid;
+
+    free_parse();
+    context = 0;
 
     if (!wellFormed) {
         throw DDXParseFailed(string("The DDX is not a well formed XML document.\n") + error_msg);
@@ -1058,12 +1075,79 @@ void DDXParser::cleanup_parse(xmlParserCtxtPtr & context)
     }
 }
 
-/** Read a DDX from a C++ input stream and populate a DDS object.
+void DDXParser::init_sax_handler()
+{
+    memset( &ddx_sax_parser, 0, sizeof(xmlSAXHandler) );
+
+    ddx_sax_parser.getEntity = &DDXParser::ddx_get_entity;
+    ddx_sax_parser.startDocument = &DDXParser::ddx_start_document;
+    ddx_sax_parser.endDocument = &DDXParser::ddx_end_document;
+    ddx_sax_parser.characters = &DDXParser::ddx_get_characters;
+    ddx_sax_parser.ignorableWhitespace = &DDXParser::ddx_ignoreable_whitespace;
+    ddx_sax_parser.cdataBlock = &DDXParser::ddx_get_cdata;
+    ddx_sax_parser.warning = &DDXParser::ddx_fatal_error;
+    ddx_sax_parser.error = &DDXParser::ddx_fatal_error;
+    ddx_sax_parser.fatalError = &DDXParser::ddx_fatal_error;
+    ddx_sax_parser.initialized = XML_SAX2_MAGIC;
+    ddx_sax_parser.startElementNs = &DDXParser::ddx_sax2_start_element;
+    ddx_sax_parser.endElementNs = &DDXParser::ddx_sax2_end_element;
+}
+
+/** Start parsing a DDX that will be passed to the parser a piece at a
+    time, using parse_chunk(), as it is read. This makes it possible to
+    build the DDS while the rest of the response is still arriving. Call
+    end_parse() once the whole document has been passed to the parser.
+
+    @param dest_dds Value/result parameter; dumps the information to this
+    DDS instance.
+    @param cid Value/result parameter; puts the href which references the \c
+    CID.
+    @exception DDXParseFailed Thrown if the parser could not be made. */
+void DDXParser::begin_parse(DDS *dest_dds, string &cid)
+{
+    xmlParserCtxtPtr context = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, "stream");
+    if (!context)
+        throw DDXParseFailed("Error parsing DDX response: Input does not look like XML");
+
+    ctxt = context;         // need ctxt for error messages
+    dds = dest_dds;         // dump values here
+    blob_href = &cid;       // cid goes here
+
+    init_sax_handler();
+
+    context->sax = &ddx_sax_parser;
+    context->userData = this;
+    context->validate = true;
+}
+
+/** Parse the next part of a DDX. The document may be split anywhere.
+    @param buffer The text
+    @param size The number of bytes in \c buffer */
+void DDXParser::parse_chunk(const char *buffer, int size)
+{
+    xmlParseChunk(ctxt, buffer, size, 0);
+}
+
+/** Finish parsing a DDX started with begin_parse().
+    @exception DDXParseFailed Thrown if the XML document could not be
+    parsed. */
+void DDXParser::end_parse()
+{
+    // This call ends the parse: The fourth argument of xmlParseChunk is
+    // the bool 'terminate.'
+    xmlParseChunk(ctxt, NULL, 0, 1);
+
+    cleanup_parse(ctxt);
+}
+
+/** Read a DDX from a C++ input stream and populate a DDS object. Each
+ * line is passed to the parser as it is read.
  *
  * @param in
  * @param dds
  * @param cid
- * @param boundary
+ * @param boundary If not empty, stop reading when this MPM boundary is
+ * found.
  */
 void DDXParser::intern_stream(istream &in, DDS *dest_dds, string &cid, const string &boundary)
 {
@@ -1071,68 +1155,22 @@ void DDXParser::intern_stream(istream &in, DDS *dest_dds, string &cid, const str
     if (!in || in.eof())
         throw InternalErr(__FILE__, __LINE__, "Input stream not open or read error");
 
-    const int size = 1024;
-    char chars[size + 1];
-
-    // int res = fread(chars, 1, 4, in);
-    in.read(chars, 4);
-    int res = in.gcount();
-    if (res > 0) {
-        chars[4]='\0';
-        xmlParserCtxtPtr context = xmlCreatePushParserCtxt(NULL, NULL, chars, res, "stream");
-
-        if (!context)
-            throw DDXParseFailed("Error parsing DDX response: Input does not look like XML");
-
-        ctxt = context;         // need ctxt for error messages
-        dds = dest_dds;         // dump values here
-        blob_href = &cid; 	// cid goes here
-
-        xmlSAXHandler ddx_sax_parser;
-        memset( &ddx_sax_parser, 0, sizeof(xmlSAXHandler) );
-
-        ddx_sax_parser.getEntity = &DDXParser::ddx_get_entity;
-        ddx_sax_parser.startDocument = &DDXParser::ddx_start_document;
-        ddx_sax_parser.endDocument = &DDXParser::ddx_end_document;
-        ddx_sax_parser.characters = &DDXParser::ddx_get_characters;
-        ddx_sax_parser.ignorableWhitespace = &DDXParser::ddx_ignoreable_whitespace;
-        ddx_sax_parser.cdataBlock = &DDXParser::ddx_get_cdata;
-        ddx_sax_parser.warning = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.error = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.fatalError = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.initialized = XML_SAX2_MAGIC;
-        ddx_sax_parser.startElementNs = &DDXParser::ddx_sax2_start_element;
-        ddx_sax_parser.endElementNs = &DDXParser::ddx_sax2_end_element;
-
-        context->sax = &ddx_sax_parser;
-        context->userData = this;
-        context->validate = true;
-
-        in.getline(chars, size);	// chars has size+1 elements
-        res = in.gcount();
-        chars[res-1] = '\n';		// libxml needs the newline; w/o it the parse will fail
-        chars[res] = '\0';
-        while (res > 0 && !is_boundary(chars, boundary)) {
-        	DBG(cerr << "line (" << res << "): " << chars << endl);
-        	xmlParseChunk(ctxt, chars, res, 0);
-
-        	in.getline(chars, size);	// chars has size+1 elements
-        	res = in.gcount();
-        	if (res > 0) {
-        		chars[res-1] = '\n';
-        		chars[res] = '\0';
-        	}
-        }
+    string line;
+    if (!getline(in, line))
+        throw DDXParseFailed("Error parsing DDX response: Could not read from input stream.");
 
-        // This call ends the parse: The fourth argument of xmlParseChunk is
-        // the bool 'terminate.'
-        xmlParseChunk(ctxt, chars, 0, 1);
+    begin_parse(dest_dds, cid);
 
-        cleanup_parse(context);
-    }
-    else {
-        throw DDXParseFailed("Error parsing DDX response: Could not read from input stream.");
-    }
+    do {
+        if (is_boundary(line.c_str(), boundary))
+            break;
+
+        line.append("\n");       // libxml needs the newline; w/o it the parse will fail
+        DBG(cerr << "line (" << line.size() << "): " << line);
+        parse_chunk(line.data(), line.size());
+    } while (getline(in, line));
+
+    end_parse();
 }
 
 /** @brief Read the DDX from a stream instead of a file.
@@ -1146,54 +1184,26 @@ void DDXParser::intern_stream(FILE *in, DDS *dest_dds, string &cid, const string
     const int size = 1024;
     char chars[size];
 
-    int res = fread(chars, 1, 4, in);
-    if (res > 0) {
-        chars[4]='\0';
-        xmlParserCtxtPtr context = xmlCreatePushParserCtxt(NULL, NULL, chars, res, "stream");
-
-        if (!context)
-            throw DDXParseFailed("Error parsing DDX response: Input does not look like XML");
-
-        ctxt = context;         // need ctxt for error messages
-        dds = dest_dds;         // dump values here
-        blob_href = &cid; 	// cid goes here
-
-        xmlSAXHandler ddx_sax_parser;
-        memset( &ddx_sax_parser, 0, sizeof(xmlSAXHandler) );
-
-        ddx_sax_parser.getEntity = &DDXParser::ddx_get_entity;
-        ddx_sax_parser.startDocument = &DDXParser::ddx_start_document;
-        ddx_sax_parser.endDocument = &DDXParser::ddx_end_document;
-        ddx_sax_parser.characters = &DDXParser::ddx_get_characters;
-        ddx_sax_parser.ignorableWhitespace = &DDXParser::ddx_ignoreable_whitespace;
-        ddx_sax_parser.cdataBlock = &DDXParser::ddx_get_cdata;
-        ddx_sax_parser.warning = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.error = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.fatalError = &DDXParser::ddx_fatal_error;
-        ddx_sax_parser.initialized = XML_SAX2_MAGIC;
-        ddx_sax_parser.startElementNs = &DDXParser::ddx_sax2_start_element;
-        ddx_sax_parser.endElementNs = &DDXParser::ddx_sax2_end_element;
-
-        context->sax = &ddx_sax_parser;
-        context->userData = this;
-        context->validate = true;
-
-
-        while ((fgets(chars, size, in) != 0) && !is_boundary(chars, boundary)) {
-            DBG(cerr << "line (" << strlen(chars) << "): " << chars << endl);
-            xmlParseChunk(ctxt, chars, strlen(chars), 0);
-        }
-        // This call ends the parse: The fourth argument of xmlParseChunk is
-        // the bool 'terminate.'
-        xmlParseChunk(ctxt, chars, 0, 1);
-
-        cleanup_parse(context);
-    }
-    else {
+    if (!fgets(chars, size, in))
         throw DDXParseFailed("Error parsing DDX response: Could not read from input file.");
-    }
-}
 
+    begin_parse(dest_dds, cid);
+
+    // A line longer than 'chars' is read in pieces; only the first piece
+    // can be the boundary.
+    bool line_start = true;
+    do {
+        if (line_start && is_boundary(chars, boundary))
+            break;
+
+        int len = strlen(chars);
+        DBG(cerr << "line (" << len << "): " << chars << endl);
+        parse_chunk(chars, len);
+        line_start = chars[len - 1] == '\n';
+    } while (fgets(chars, size, in) != 0);
+
+    end_parse();
+}
 
 /** Parse a DDX document stored in a file. The XML in the document is parsed
     and a binary DDX is built. This implementation stores the result in a DDS
@@ -1226,21 +1236,7 @@ void DDXParser::intern(const string & document, DDS * dest_dds, string &cid)
     blob_href = &cid;
     ctxt = context;             // need ctxt for error messages
 
-    xmlSAXHandler ddx_sax_parser;
-    memset( &ddx_sax_parser, 0, sizeof(xmlSAXHandler) );
-
-    ddx_sax_parser.getEntity = &DDXParser::ddx_get_entity;
-    ddx_sax_parser.startDocument = &DDXParser::ddx_start_document;
-    ddx_sax_parser.endDocument = &DDXParser::ddx_end_document;
-    ddx_sax_parser.characters = &DDXParser::ddx_get_characters;
-    ddx_sax_parser.ignorableWhitespace = &DDXParser::ddx_ignoreable_whitespace;
-    ddx_sax_parser.cdataBlock = &DDXParser::ddx_get_cdata;
-    ddx_sax_parser.warning = &DDXParser::ddx_fatal_error;
-    ddx_sax_parser.error = &DDXParser::ddx_fatal_error;
-    ddx_sax_parser.fatalError = &DDXParser::ddx_fatal_error;
-    ddx_sax_parser.initialized = XML_SAX2_MAGIC;
-    ddx_sax_parser.startElementNs = &DDXParser::ddx_sax2_start_element;
-    ddx_sax_parser.endElementNs = &DDXParser::ddx_sax2_end_element;
+    init_sax_handler();
 
     context->sax = &ddx_sax_parser;
     context->userData = this;
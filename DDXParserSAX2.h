@@ -194,8 +194,13 @@ private:
     // Glue for the BaseTypeFactory class.
     BaseType *factory(Type t, const string &name);
 
+    // The callbacks; a member so that a parse can span calls to parse_chunk()
+    xmlSAXHandler ddx_sax_parser;
+    void init_sax_handler();
+
     // Common cleanup code for intern() and intern_stream()
     void cleanup_parse(xmlParserCtxtPtr &context);
+    void free_parse();
 
     /** @name Parser Actions
 
@@ -238,10 +243,16 @@ public:
         char_data(""), root_ns("")
     {}
 
+    ~DDXParser();
+
     void intern(const string &document, DDS *dest_dds, string &cid);
     void intern_stream(FILE *in, DDS *dds, string &cid, const string &boundary = "");
     void intern_stream(istream &in, DDS *dds, string &cid, const string &boundary = "");
 
+    void begin_parse(DDS *dest_dds, string &cid);
+    void parse_chunk(const char *buffer, int size);
+    void end_parse();
+
     static void ddx_start_document(void *parser);
     static void ddx_end_document(void *parser);
 
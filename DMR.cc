@@ -313,45 +313,41 @@ DMR::request_size(bool constrained)
 void
 DMR::print_dap4(XMLWriter &xml, bool constrained)
 {
-    if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Dataset") < 0)
+    if (xml.start_element("Dataset") < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write Dataset element");
 
 #if 0
     // Reintroduce these if they are really useful. jhrg 4/15/13
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xml",
-            (const xmlChar*) c_xml_namespace.c_str()) < 0)
+    if (xml.write_attribute("xmlns:xml", c_xml_namespace.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xml");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns:xsi", (const xmlChar*) c_xml_xsi.c_str())
-            < 0)
+    if (xml.write_attribute("xmlns:xsi", c_xml_xsi.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:xsi");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xsi:schemaLocation",
-            (const xmlChar*) c_dap_40_n_sl.c_str()) < 0)
+    if (xml.write_attribute("xsi:schemaLocation", c_dap_40_n_sl.c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns:schemaLocation");
 #endif
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xmlns", (const xmlChar*) get_namespace().c_str()) < 0)
+    if (xml.write_attribute("xmlns", get_namespace().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xmlns");
 
     if (!request_xml_base().empty()) {
-        if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "xml:base",
-                (const xmlChar*)request_xml_base().c_str()) < 0)
+        if (xml.write_attribute("xml:base", request_xml_base().c_str()) < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write attribute for xml:base");
     }
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dapVersion",  (const xmlChar*)dap_version().c_str()) < 0)
+    if (xml.write_attribute("dapVersion",  dap_version().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "dmrVersion", (const xmlChar*)dmr_version().c_str()) < 0)
+    if (xml.write_attribute("dmrVersion", dmr_version().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for dapVersion");
 
-    if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+    if (xml.write_attribute("name", name().c_str()) < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
     root()->print_dap4(xml, constrained);
 
-    if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+    if (xml.end_element() < 0)
         throw InternalErr(__FILE__, __LINE__, "Could not end the top-level Group element");
 }
 
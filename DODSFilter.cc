@@ -73,6 +73,9 @@
 #include "escaping.h"
 #include "DODSFilter.h"
 #include "XDRStreamMarshaller.h"
+#include "DataResponseCache.h"
+#include "SlabCache.h"
+#include "Array.h"
 #include "InternalErr.h"
 
 #ifndef WIN32
@@ -211,6 +214,8 @@ DODSFilter::initialize()
     d_url = "";
     d_program_name = "Unknown";
     d_timeout = 0;
+    d_response_cache = 0;
+    d_slab_cache = 0;
 
 #ifdef WIN32
     //  We want serving from win32 to behave in a manner
@@ -596,6 +601,50 @@ DODSFilter::get_cache_dir() const
     return d_cache_dir;
 }
 
+/** Get the cache used for data responses.
+    @return The cache, or null if data responses are not cached. */
+DataResponseCache *
+DODSFilter::get_response_cache() const
+{
+    return d_response_cache;
+}
+
+/** Cache the data responses send_data() makes. Later requests for the same
+    dataset and constraint expression are sent from the cache until the
+    dataset changes; see DataResponseCache. The MIME headers are never
+    cached.
+
+    @brief Set the data response cache.
+    @param cache Use this cache; null turns caching off. This object does
+    not delete it. */
+void
+DODSFilter::set_response_cache(DataResponseCache *cache)
+{
+    d_response_cache = cache;
+}
+
+/** Get the cache used for array values.
+    @return The cache, or null if array values are not cached. */
+SlabCache *
+DODSFilter::get_slab_cache() const
+{
+    return d_slab_cache;
+}
+
+/** Keep the values of the arrays read for data responses. A later request
+    for values inside a cached hyperslab of the same array is answered
+    from the cache without reading the dataset; see SlabCache. Only arrays
+    at the top level of the dataset are cached.
+
+    @brief Set the array value cache.
+    @param cache Use this cache; null turns caching off. This object does
+    not delete it. */
+void
+DODSFilter::set_slab_cache(SlabCache *cache)
+{
+    d_slab_cache = cache;
+}
+
 /** Set the server's timeout value. A value of zero (the default) means no
     timeout.
 
@@ -876,10 +925,24 @@ DODSFilter::dataset_constraint(DDS & dds, ConstraintEvaluator & eval,
     // Grab a stream that encodes using XDR.
     XDRStreamMarshaller m( out ) ;
 
+    time_t lmt = d_slab_cache ? get_data_last_modified_time(d_anc_dir) : 0;
+
     try {
         // Send all variables in the current projection (send_p())
         for (DDS::Vars_iter i = dds.var_begin(); i != dds.var_end(); i++)
             if ((*i)->send_p()) {
+                // Load arrays from the slab cache, or read them and cache
+                // their values, before they are serialized.
+                if (d_slab_cache && (*i)->type() == dods_array_c && !(*i)->read_p()
+                    && static_cast<Array*>(*i)->length() > 0) {
+                    Array *a = static_cast<Array*>(*i);
+                    if (!d_slab_cache->read(*a, d_dataset, lmt)) {
+                        a->read();
+                        a->set_read_p(true);
+                        d_slab_cache->add(*a, d_dataset, lmt);
+                    }
+                }
+
                 DBG(cerr << "Sending " << (*i)->name() << endl);
                 (*i)->serialize(eval, dds, m, ce_eval);
             }
@@ -930,6 +993,42 @@ DODSFilter::dataset_constraint_ddx(DDS & dds, ConstraintEvaluator & eval,
     }
 }
 
+/** Writes the body of a DAP2 data response for DataResponseCache. This is
+    send_data() less the MIME headers. */
+class DataDDSWriter: public DataResponseWriter {
+    const DODSFilter &d_filter;
+    DDS &d_dds;
+    ConstraintEvaluator &d_eval;
+    const string &d_ce;
+
+public:
+    DataDDSWriter(const DODSFilter &filter, DDS &dds, ConstraintEvaluator &eval, const string &ce) :
+        d_filter(filter), d_dds(dds), d_eval(eval), d_ce(ce)
+    {
+    }
+
+    virtual void write(ostream &out)
+    {
+        d_eval.parse_constraint(d_ce, d_dds);
+        d_dds.tag_nested_sequences();
+
+        if (d_eval.function_clauses()) {
+            DDS *fdds = d_eval.eval_function_clauses(d_dds);
+            try {
+                d_filter.dataset_constraint(*fdds, d_eval, out, false);
+            }
+            catch (...) {
+                delete fdds;
+                throw;
+            }
+            delete fdds;
+        }
+        else {
+            d_filter.dataset_constraint(d_dds, d_eval, out);
+        }
+    }
+};
+
 /** Send the data in the DDS object back to the client program. The data is
     encoded using a Marshaller, and enclosed in a MIME document which is all sent
     to \c data_stream. If this is being called from a CGI, \c data_stream is
@@ -962,6 +1061,11 @@ DODSFilter::send_data(DDS & dds, ConstraintEvaluator & eval,
     probably \c stdout and writing to it has the effect of sending the
     response back to the client.
 
+    If a response cache has been set (see set_response_cache()), the
+    response is sent from it and is only made (and cached) when the cache
+    has no copy for this dataset, constraint and last modified time. On a
+    hit, \c dds and \c eval are not used.
+
     @brief Transmit data.
     @param dds A DDS object containing the data to be sent.
     @param eval A reference to the ConstraintEvaluator to use.
@@ -991,6 +1095,30 @@ DODSFilter::send_data(DDS & dds, ConstraintEvaluator & eval,
     establish_timeout(data_stream);
     dds.set_timeout(d_timeout);
 
+    // Send the response from the cache, making it first if needed. Any
+    // errors are thrown before the headers are written.
+    if (d_response_cache) {
+        DataDDSWriter writer(*this, dds, eval, d_dap2ce);
+        int fd;
+        off_t offset;
+        if (d_response_cache->get_response("dods", d_dataset, d_dap2ce, data_lmt, writer, fd, offset)) {
+            try {
+                if (with_mime_headers)
+                    set_mime_binary(data_stream, dods_data, d_cgi_ver, x_plain, data_lmt);
+
+                d_response_cache->send_response(data_stream, fd, offset);
+            }
+            catch (...) {
+                d_response_cache->release(fd);
+                throw;
+            }
+
+            d_response_cache->release(fd);
+            data_stream << flush;
+            return;
+        }
+    }
+
     eval.parse_constraint(d_dap2ce, dds);   // Throws Error if the ce doesn't
 					// parse.
 
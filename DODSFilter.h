@@ -49,6 +49,9 @@
 namespace libdap
 {
 
+class DataResponseCache;
+class SlabCache;
+
 /** When a DODS server receives a request from a DODS client, the
     server CGI script dispatches the request to one of several
     ``filter'' programs.  Each filter is responsible for returning a
@@ -109,6 +112,9 @@ protected:
 
     int d_timeout;  // Server timeout after N seconds
 
+    DataResponseCache *d_response_cache; // Cache data responses here; not owned
+    SlabCache *d_slab_cache; // Cache array values here; not owned
+
     time_t d_anc_das_lmt; // Last modified time of the anc. DAS.
     time_t d_anc_dds_lmt; // Last modified time of the anc. DDS.
     time_t d_if_modified_since; // Time from a conditional request.
@@ -166,6 +172,12 @@ public:
 
     virtual string get_cache_dir() const;
 
+    virtual DataResponseCache *get_response_cache() const;
+    virtual void set_response_cache(DataResponseCache *cache);
+
+    virtual SlabCache *get_slab_cache() const;
+    virtual void set_slab_cache(SlabCache *cache);
+
     void set_timeout(int timeout = 0);
 
     int get_timeout() const;
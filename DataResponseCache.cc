@@ -0,0 +1,261 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DataResponseCache.h"
+#include "DAPCache3.h"
+#include "fdiostream.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+// The first line of each cached response. The key and the dataset's last
+// modified time follow, then the response.
+static const string MAGIC = "DAP response cache 1\n";
+
+// Give up on caching a response (and send it directly) after this many
+// tries to make an entry that matches.
+static const int MAX_TRIES = 3;
+
+/** The cached file's header; MAGIC, the length of the key, the key and
+ * the last modified time. */
+static string make_header(const string &key, time_t lmt)
+{
+    ostringstream oss;
+    oss << MAGIC << key.length() << '\n' << key << '\n' << static_cast<long long>(lmt) << '\n';
+    return oss.str();
+}
+
+/** Build the key for a response. Newlines can't appear in the response
+ * kind or the dataset pathname, but they can in a quoted CE string; the
+ * header holds the key's length so that doesn't matter. */
+static string make_key(const string &response, const string &dataset, const string &ce)
+{
+    return response + '\n' + dataset + '\n' + DataResponseCache::normalize_ce(ce);
+}
+
+/** Writes the header and then the response to a new cache file. */
+class ResponseProducer: public DAPCacheProducer {
+    const string &d_header;
+    DataResponseWriter &d_writer;
+
+public:
+    ResponseProducer(const string &header, DataResponseWriter &writer) : d_header(header), d_writer(writer) { }
+
+    virtual void produce(const string &target, int fd)
+    {
+        fdostream out(fd);
+        out << d_header;
+        d_writer.write(out);
+        out << flush;
+
+        if (!out)
+            throw InternalErr(__FILE__, __LINE__, "Could not write the cached response " + target);
+    }
+};
+
+/** Put a constraint expression into a canonical form, so that requests
+ * which differ only in spacing share a cache entry. Spaces outside of quoted
+ * strings are removed; nothing else changes. The CE is not decoded here: it
+ * should be the one the server parses (DODSFilter decodes all but %20), and
+ * decoding it again would turn an escaped name such as a%20b into a space
+ * that is then removed, giving the key of another variable. The order of the
+ * clauses is kept; it can change the response.
+ *
+ * @param ce The constraint expression, as it will be parsed.
+ * @return The normalized constraint expression. */
+string DataResponseCache::normalize_ce(const string &ce)
+{
+    string normalized;
+    normalized.reserve(ce.length());
+
+    bool quoted = false;
+    for (string::size_type i = 0; i < ce.length(); ++i) {
+        char c = ce[i];
+        if (quoted) {
+            normalized += c;
+            if (c == '\\' && i + 1 < ce.length())
+                normalized += ce[++i];
+            else if (c == '"')
+                quoted = false;
+        }
+        else if (c == '"') {
+            normalized += c;
+            quoted = true;
+        }
+        else if (!isspace(static_cast<unsigned char>(c))) {
+            normalized += c;
+        }
+    }
+
+    return normalized;
+}
+
+/** Get the name of the cache file for a response. The name is a hash of
+ * the key, so two keys might share a file; the key in the file's header
+ * tells them apart.
+ *
+ * @param response The kind of response, "dods" or "dap".
+ * @param dataset The dataset pathname.
+ * @param ce The constraint expression; it's normalized here.
+ * @return The pathname of the file. */
+string DataResponseCache::get_cache_file_name(const string &response, const string &dataset, const string &ce) const
+{
+    string key = make_key(response, dataset, ce);
+
+    // FNV-1a, 64 bits
+    unsigned long long hash = 14695981039346656037ULL;
+    for (string::const_iterator i = key.begin(); i != key.end(); ++i) {
+        hash ^= static_cast<unsigned char>(*i);
+        hash *= 1099511628211ULL;
+    }
+
+    char name[17];
+    snprintf(name, sizeof name, "%016llx", hash);
+
+    return d_cache->get_cache_file_name(response + "_" + name, false);
+}
+
+/** Private. Does the file open on \c fd hold the response for \c key made
+ * at \c lmt?
+ * @param offset Value-result; set to the start of the response. */
+bool DataResponseCache::m_read_header(int fd, const string &key, time_t lmt, off_t &offset) const
+{
+    string header = make_header(key, lmt);
+
+    vector<char> buf(header.length());
+    size_t got = 0;
+    while (got < buf.size()) {
+        ssize_t n = pread(fd, &buf[got], buf.size() - got, got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+
+    if (header.compare(0, string::npos, &buf[0], buf.size()) != 0)
+        return false;
+
+    offset = header.length();
+    return true;
+}
+
+/** @brief Find a response in the cache or make it.
+ *
+ * If the cache holds the response and it was made from the current version
+ * of the dataset, open it. Otherwise use \c writer to make it; only one
+ * process or thread does this while the others wait for it. An entry made
+ * from an older version of the dataset is purged.
+ *
+ * @param response The kind of response, "dods" or "dap".
+ * @param dataset The dataset pathname.
+ * @param ce The constraint expression, as the server will parse it (see
+ * normalize_ce()).
+ * @param lmt The dataset's last modified time.
+ * @param writer Writes the response if it's not cached.
+ * @param fd Value-result; open and read-locked. Pass it to send_response()
+ * and then release().
+ * @param offset Value-result; where the response starts in \c fd.
+ * @return True if the response is ready to send, false if it could not be
+ * cached. In the latter case, the caller should write the response itself.
+ * @exception Whatever \c writer throws. */
+bool DataResponseCache::get_response(const string &response, const string &dataset, const string &ce, time_t lmt,
+        DataResponseWriter &writer, int &fd, off_t &offset)
+{
+    string key = make_key(response, dataset, ce);
+    string header = make_header(key, lmt);
+    string target = get_cache_file_name(response, dataset, ce);
+
+    ResponseProducer producer(header, writer);
+
+    for (int tries = 0; tries < MAX_TRIES; ++tries) {
+        d_cache->get_or_create(target, producer, fd);
+
+        if (m_read_header(fd, key, lmt, offset))
+            return true;
+
+        // Made from an older version of the dataset (or, rarely, a different
+        // key with the same hash). Purge it and try again.
+        DBG(cerr << "DataResponseCache: purging stale response " << target << endl);
+        d_cache->unlock_and_close(fd);
+        d_cache->purge_file(target);
+    }
+
+    return false;
+}
+
+/** Send a response found by get_response(). If \c out is an fdostream, the
+ * file is sent without copying it through the stream's buffer.
+ *
+ * @param out Write the response here.
+ * @param fd The file descriptor get_response() returned.
+ * @param offset The offset get_response() returned. */
+void DataResponseCache::send_response(ostream &out, int fd, off_t offset) const
+{
+    fdostream *fdout = dynamic_cast<fdostream*>(&out);
+    if (fdout) {
+        fdout->send_file(fd, offset);
+    }
+    else {
+        vector<char> buf(16384);
+        for (;;) {
+            ssize_t n = pread(fd, &buf[0], buf.size(), offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw InternalErr(__FILE__, __LINE__, "Could not read a cached response.");
+            if (n == 0)
+                break;
+
+            out.write(&buf[0], n);
+            offset += n;
+        }
+    }
+
+    if (!out)
+        throw InternalErr(__FILE__, __LINE__, "Could not send a cached response.");
+}
+
+/** Unlock and close a file returned by get_response(). */
+void DataResponseCache::release(int fd)
+{
+    d_cache->unlock_and_close(fd);
+}
+
+} // namespace libdap
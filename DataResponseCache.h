@@ -0,0 +1,92 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _data_response_cache_h
+#define _data_response_cache_h
+
+#include <sys/types.h>
+
+#include <ctime>
+#include <ostream>
+#include <string>
+
+namespace libdap {
+
+class DAPCache3;
+
+/** Writes the body of a data response; see DataResponseCache. */
+class DataResponseWriter {
+public:
+    virtual ~DataResponseWriter() {}
+
+    /** Write the encoded response, without its MIME headers, to \c out.
+     * @exception Throw any exception to abandon the response; nothing is
+     * cached. */
+    virtual void write(std::ostream &out) = 0;
+};
+
+/** Keep encoded data responses in a DAPCache3 so that repeated requests
+ * for the same dataset and constraint are sent from a file, without reading
+ * or encoding the data again.
+ *
+ * An entry is found using the kind of response ("dods" or "dap"), the
+ * dataset and the normalized constraint expression. Each cached file starts
+ * with a short header holding that key and the dataset's last modified
+ * time; the encoded bytes (the DAP2 DDS and XDR data or the DAP4 chunked
+ * DMR and data, CRCs included) follow. When the dataset's time no longer
+ * matches, the entry is purged and made again.
+ *
+ * Use get_response() to find or make an entry, write any MIME headers,
+ * then send_response() and release(). DODSFilter::send_data() does this
+ * when it has been given a cache with DODSFilter::set_response_cache().
+ */
+class DataResponseCache {
+    DAPCache3 *d_cache;
+
+    bool m_read_header(int fd, const std::string &key, time_t lmt, off_t &offset) const;
+
+    DataResponseCache(const DataResponseCache &);
+    DataResponseCache &operator=(const DataResponseCache &);
+
+public:
+    /** @param cache Store responses here. Not deleted by this object. */
+    DataResponseCache(DAPCache3 *cache) : d_cache(cache) { }
+    virtual ~DataResponseCache() { }
+
+    DAPCache3 *get_cache() const { return d_cache; }
+
+    static std::string normalize_ce(const std::string &ce);
+
+    virtual std::string get_cache_file_name(const std::string &response, const std::string &dataset,
+            const std::string &ce) const;
+
+    virtual bool get_response(const std::string &response, const std::string &dataset, const std::string &ce,
+            time_t lmt, DataResponseWriter &writer, int &fd, off_t &offset);
+    virtual void send_response(std::ostream &out, int fd, off_t offset) const;
+    virtual void release(int fd);
+};
+
+} // namespace libdap
+
+#endif // _data_response_cache_h
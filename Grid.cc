@@ -55,6 +55,7 @@
 #include "D4Group.h"
 #include "D4Maps.h"
 #include "D4Attributes.h"
+#include "AttrValues.h"
 
 using namespace std;
 
@@ -263,6 +264,7 @@ Grid::add_var(BaseType *bt, Part part)
     }
     break;
   }
+  VarIndex::vars_changed(this);
 }
 
 /** Add an array or map to the Grid.
@@ -325,6 +327,7 @@ Grid::add_var_nocopy(BaseType *bt, Part part)
     }
     break;
   }
+  VarIndex::vars_changed(this);
 }
 
 /**
@@ -370,6 +373,7 @@ void Grid::set_array(Array* p_new_arr)
 	}
 
 	d_is_array_set = true;
+	VarIndex::vars_changed(this);
 #if 0
 	// store the array pointer locally
 	d_array_var = p_new_arr;
@@ -417,6 +421,7 @@ Grid::add_map(Array* p_new_map, bool add_as_copy)
   p_new_map->set_parent(this);
 
   d_vars.push_back(p_new_map);
+  VarIndex::vars_changed(this);
 
   // return the one that got put into the Grid.
   return p_new_map;
@@ -444,6 +449,7 @@ Grid::prepend_map(Array* p_new_map, bool add_copy)
 
   p_new_map->set_parent(this);
   d_vars.insert(map_begin(), p_new_map);
+  VarIndex::vars_changed(this);
 
   return p_new_map;
 }
@@ -580,7 +586,7 @@ void Grid::transfer_attributes(AttrTable *at_container)
 				if (at->get_attr_type(at_p) == Attr_container)
 					get_attr_table().append_container(new AttrTable(*at->get_attr_table(at_p)), at->get_name(at_p));
 				else
-					get_attr_table().append_attr(at->get_name(at_p), at->get_type(at_p), at->get_attr_vector(at_p));
+					get_attr_table().append_attr(at->get_name(at_p), *at->get_attr_values(at_p));
 			}
 
 			at_p++;
@@ -726,9 +732,9 @@ Grid::print_decl(ostream &out, string space, bool print_semi,
 void
 Grid::print_xml(FILE *out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    fwrite(xml.get_doc(), sizeof(char), xml.get_doc_size(), out);
+    xml.end_document();
 }
 
 /**
@@ -737,9 +743,9 @@ Grid::print_xml(FILE *out, string space, bool constrained)
 void
 Grid::print_xml(ostream &out, string space, bool constrained)
 {
-    XMLWriter xml(space);
+    XMLWriter xml(out, space);
     print_xml_writer(xml, constrained);
-    out << xml.get_doc();
+    xml.end_document();
 }
 
 
@@ -769,41 +775,43 @@ Grid::print_xml_writer(XMLWriter &xml, bool constrained)
         return;
 
     if (constrained && !projection_yields_grid()) {
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"Structure") < 0)
+        if (xml.start_element("Structure") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write Structure element");
 
         if (!name().empty())
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+            if (xml.write_attribute("name", name().c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-        get_attr_table().print_xml_writer(xml);
+        if (has_attr_table())
+            get_attr_table().print_xml_writer(xml);
 
         get_array()->print_xml_writer(xml, constrained);
 
         for_each(map_begin(), map_end(),
                  PrintGridFieldXMLWriter(xml, constrained, "Array"));
 
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end Structure element");
     }
     else {
         // The number of elements in the (projected) Grid must be such that
         // we have a valid Grid object; send it as such.
-        if (xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*)"Grid") < 0)
+        if (xml.start_element("Grid") < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not write Grid element");
 
         if (!name().empty())
-            if (xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*)name().c_str()) < 0)
+            if (xml.write_attribute("name", name().c_str()) < 0)
                 throw InternalErr(__FILE__, __LINE__, "Could not write attribute for name");
 
-        get_attr_table().print_xml_writer(xml);
+        if (has_attr_table())
+            get_attr_table().print_xml_writer(xml);
 
         get_array()->print_xml_writer(xml, constrained);
 
         for_each(map_begin(), map_end(),
                  PrintGridFieldXMLWriter(xml, constrained, "Map"));
 
-        if (xmlTextWriterEndElement(xml.get_writer()) < 0)
+        if (xml.end_element() < 0)
             throw InternalErr(__FILE__, __LINE__, "Could not end Grid element");
     }
 }
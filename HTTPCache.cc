@@ -32,6 +32,7 @@
 #include <pthread.h>
 #include <limits.h>
 #include <unistd.h>   // for stat
+#include <fcntl.h>
 #include <sys/types.h>  // for stat and mkdir
 #include <sys/stat.h>
 
@@ -78,8 +79,6 @@ static pthread_once_t once_block = PTHREAD_ONCE_INIT;
 
 #define NO_LM_EXPIRATION 24*3600 // 24 hours
 
-#define DUMP_FREQUENCY 10 // Dump index every x loads
-
 #define MEGA 0x100000L
 #define CACHE_TOTAL_SIZE 20 // Default cache size is 20M
 #define CACHE_FOLDER_PCT 10 // 10% of cache size for metainfo etc.
@@ -87,6 +86,15 @@ static pthread_once_t once_block = PTHREAD_ONCE_INIT;
 #define MIN_CACHE_TOTAL_SIZE 5 // 5M Min cache size
 #define MAX_CACHE_ENTRY_SIZE 3 // 3M Max size of single cached entry
 
+// The hot tier holds small responses in memory. Memory-backed responses
+// are made using fmemopen(); without it, the hot tier is off.
+#ifdef HAVE_FMEMOPEN
+#define HOT_TIER_SIZE 0x400000L // 4M
+#else
+#define HOT_TIER_SIZE 0
+#endif
+#define HOT_TIER_ENTRY_SIZE 0x10000L // 64K Max size of a hot response
+
 static void
 once_init_routine()
 {
@@ -104,9 +112,8 @@ once_init_routine()
     as part of the initialization. If the cache has already been initialized,
     this method returns a pointer to that instance. Note HTTPCache uses the
     singleton pattern; A process may have only one instance of this object.
-    Also note that HTTPCache is MT-safe. However, if the \c force parameter
-    is set to true, it may be possible for two or more processes to access
-    the persistent store at the same time resulting in undefined behavior.
+    Also note that HTTPCache is MT-safe and that several processes may use
+    the same persistent store at once.
 
     Default values: is_cache_enabled(): true, is_cache_protected(): false,
     is_expire_ignored(): false, the total size of the cache is 20M, 2M of that
@@ -118,10 +125,8 @@ once_init_routine()
 
     @param cache_root The fully qualified pathname of the directory which
     will hold the cache data (i.e., the persistent store).
-    @param force Force access to the persistent store if true. By default
-    false. Use this only if you're sure no one else is using the same cache
-    root! This is included so that programs may use a cache that was
-    left in an inconsistent state.
+    @param force Not used. Older versions of the library used this to
+    force access to a cache that was locked by another process.
     @return A pointer to the HTTPCache object.
     @exception Error thrown if the cache root cannot set. */
 
@@ -220,13 +225,13 @@ HTTPCache::delete_instance()
     @note This assumes that the cache directory structure should be created!
     @param cache_root The fully qualified pathname of the directory which
     will hold the cache data.
-    @param force Force access to the persistent store!
-    @exception Error Thrown if the single user/process lock for the
-    persistent store cannot be obtained.
+    @param force Not used; see get_cache_root_lock().
+    @exception Error Thrown if the lock for the persistent store cannot be
+    obtained.
     @see cache_index_read */
 
 HTTPCache::HTTPCache(string cache_root, bool force) :
-        d_locked_open_file(0),
+        d_lock_fd(-1),
         d_cache_enabled(false),
         d_cache_protected(false),
 
@@ -234,6 +239,7 @@ HTTPCache::HTTPCache(string cache_root, bool force) :
 
         d_expire_ignored(false),
         d_always_validate(false),
+        d_stale_while_revalidate(0),
         d_total_size(CACHE_TOTAL_SIZE * MEGA),
         d_folder_size(CACHE_TOTAL_SIZE / CACHE_FOLDER_PCT),
         d_gc_buffer(CACHE_TOTAL_SIZE / CACHE_GC_PCT),
@@ -242,6 +248,9 @@ HTTPCache::HTTPCache(string cache_root, bool force) :
         d_max_age(-1),
         d_max_stale(-1),
         d_min_fresh(-1),
+        d_gc_thread_running(false),
+        d_gc_stop(false),
+        d_gc_requested(false),
         d_http_cache_table(0)
 {
     DBG(cerr << "Entering the constructor for " << this << "... ");
@@ -250,23 +259,28 @@ HTTPCache::HTTPCache(string cache_root, bool force) :
 	if (status != 0)
 		throw InternalErr(__FILE__, __LINE__, "Could not initialize the HTTP Cache mutex. Exiting.");
 #endif
-	INIT(&d_cache_mutex);
+	RW_INIT(&d_cache_lock);
+	INIT(&d_open_files_lock);
+	INIT(&d_gc_lock);
+	pthread_cond_init(&d_gc_cond, 0);
+	INIT(&d_revalidation_lock);
+	pthread_cond_init(&d_revalidation_cond, 0);
 
 	// This used to throw an Error object if we could not get the
-	// single user lock. However, that results in an invalid object. It's
+	// cache root lock. However, that results in an invalid object. It's
 	// better to have an instance that has default values. If we cannot get
 	// the lock, make sure to set the cache as *disabled*. 03/12/03 jhrg
 	//
 	// I fixed this block so that the cache root is set before we try to get
-	// the single user lock. That was the fix for bug #661. To make that
+	// the cache root lock. That was the fix for bug #661. To make that
 	// work, I had to move the call to create_cache_root out of
 	// set_cache_root(). 09/08/03 jhrg
 
 	set_cache_root(cache_root);
 	int block_size;
 
-	if (!get_single_user_lock(force))
-	    throw Error(internal_error, "Could not get single user lock for the cache");
+	if (!get_cache_root_lock(force))
+	    throw Error(internal_error, "Could not lock the cache");
 
 #ifdef WIN32
 	//  Windows is unable to provide us this information.  4096 appears
@@ -281,7 +295,8 @@ HTTPCache::HTTPCache(string cache_root, bool force) :
 	else
 		throw Error(internal_error, "Could not set file system block size.");
 #endif
-	d_http_cache_table = new HTTPCacheTable(d_cache_root, block_size);
+	d_http_cache_table = new HTTPCacheTable(d_cache_root, block_size, d_lock_fd);
+	d_http_cache_table->set_hot_tier_size(HOT_TIER_SIZE, HOT_TIER_ENTRY_SIZE);
 	d_cache_enabled = true;
 
 	DBGN(cerr << "exiting" << endl);
@@ -303,7 +318,17 @@ HTTPCache::~HTTPCache()
 {
     DBG(cerr << "Entering the destructor for " << this << "... ");
 
+    // Background revalidations use the cache; wait for them to finish. A
+    // destructor must not throw, so don't use LOCK/UNLOCK and ignore the
+    // return codes, as the cleanup below does.
+    pthread_mutex_lock(&d_revalidation_lock);
+    while (!d_revalidating.empty())
+        pthread_cond_wait(&d_revalidation_cond, &d_revalidation_lock);
+    pthread_mutex_unlock(&d_revalidation_lock);
+
     try {
+        set_background_gc(false);
+
         if (startGC())
             perform_garbage_collection();
 
@@ -319,10 +344,15 @@ HTTPCache::~HTTPCache()
 
     delete d_http_cache_table;
 
-    release_single_user_lock();
+    release_cache_root_lock();
 
     DBGN(cerr << "exiting destructor." << endl);
-    DESTROY(&d_cache_mutex);
+    DESTROY(&d_open_files_lock);
+    DESTROY(&d_gc_lock);
+    pthread_cond_destroy(&d_gc_cond);
+    DESTROY(&d_revalidation_lock);
+    pthread_cond_destroy(&d_revalidation_cond);
+    RW_DESTROY(&d_cache_lock);
 }
 
 
@@ -341,8 +371,7 @@ HTTPCache::stopGC() const
 
 /** Is there too much in the cache. A private method.
 
-    @todo Modify this method so that it does not count locked entries. See
-    the note for hits_gc().
+    @note Locked entries are counted, but lru_gc() never removes them.
     @return True if garbage collection should be performed. */
 
 bool
@@ -354,17 +383,20 @@ HTTPCache::startGC() const
 
 /** Perform garbage collection on the cache. First, all expired responses are
     removed. Then, if the size of the cache is still too large, the cache is
-    scanned for responses larger than the max_entry_size property. At the
-    same time, responses are removed based on the number of cache hits. This
-    process continues until the size of the cache has been reduced to 90% of
-    the max_size property value. Once the garbage collection is complete,
-    update the index file. Note that locked entries are not removed!
+    scanned for responses larger than the max_entry_size property. Last, the
+    least recently used responses are removed until the size of the cache
+    has been reduced to 90% of the max_size property value. Note that locked
+    entries are not removed!
+
+    The first two steps scan the whole cache table, so this is only used
+    when the cache's parameters change and when it is closed. When a new
+    response needs room, cache_response() uses lru_gc().
 
     A private method.
 
     @see stopGC
     @see expired_gc
-    @see hits_gc */
+    @see lru_gc */
 
 void
 HTTPCache::perform_garbage_collection()
@@ -377,9 +409,8 @@ HTTPCache::perform_garbage_collection()
     // Remove entries larger than max_entry_size.
     too_big_gc();
 
-    // Remove entries starting with zero hits, 1, ..., until stopGC()
-    // returns true.
-    hits_gc();
+    // Remove the least recently used entries until stopGC() returns true.
+    lru_gc();
 }
 
 /** Scan the current cache table and remove anything that has expired. Don't
@@ -395,33 +426,19 @@ HTTPCache::expired_gc()
     }
 }
 
-/** Scan the cache for entires that are larger than max_entry_size. Also
-    start removing entires with low hit counts. Start looking for entries
-    with zero hits, then one, and so on. Stop when the method stopGC returns
-    true. Locked entries are never removed.
-
-    @note Potential infinite loop. What if more than 80% of the cache holds
-    entries that are locked? One solution is to modify startGC() so that it
-    does not count locked entries.
-
-    @todo Change this method to that it looks at the oldest entries first,
-    using the CacheEntry::date to determine entry age. Using the current
-    algorithm it's possible to remove the latest entry which is probably not
-    what we want.
+/** Remove the least recently used entries until the method stopGC would
+    return true. Locked entries are never removed. This does not scan the
+    cache table; the time it takes depends on the number of entries removed.
 
     A private method. */
 
 void
-HTTPCache::hits_gc()
+HTTPCache::lru_gc()
 {
-    int hits = 0;
-
     if (startGC()) {
-		while (!stopGC()) {
-			d_http_cache_table->delete_by_hits(hits);
-			hits++;
-		}
-	}
+        unsigned long reserved = d_folder_size + d_gc_buffer;
+        d_http_cache_table->evict_lru(d_total_size > reserved ? d_total_size - reserved : 0);
+    }
 }
 
 /** Scan the current cache table and remove anything that has is too big.
@@ -433,77 +450,110 @@ void HTTPCache::too_big_gc() {
 		d_http_cache_table->delete_by_size(d_max_entry_size);
 }
 
+/** The body of the garbage collection thread. It waits until
+    cache_response() asks for room and then runs lru_gc(). */
+void *
+HTTPCache::gc_thread(void *arg)
+{
+    HTTPCache *cache = static_cast<HTTPCache*>(arg);
+
+    pthread_mutex_lock(&cache->d_gc_lock);
+    while (!cache->d_gc_stop) {
+        if (!cache->d_gc_requested) {
+            pthread_cond_wait(&cache->d_gc_cond, &cache->d_gc_lock);
+            continue;
+        }
+
+        cache->d_gc_requested = false;
+        pthread_mutex_unlock(&cache->d_gc_lock);
+
+        try {
+            cache->read_lock_cache_interface();
+            try {
+                cache->lru_gc();
+            }
+            catch (...) {
+                cache->unlock_cache_interface();
+                throw;
+            }
+            cache->unlock_cache_interface();
+        }
+        catch (Error &e) {
+            DBG(cerr << "Garbage collection thread: " << e.get_error_message() << endl);
+        }
+
+        pthread_mutex_lock(&cache->d_gc_lock);
+    }
+    pthread_mutex_unlock(&cache->d_gc_lock);
+
+    return 0;
+}
+
 //@} End of the garbage collection methods.
 
-/** Lock the persistent store part of the cache. Return true if the cache lock
-    was acquired, false otherwise. This is a single user cache, so it
-    requires locking at the process level.
+/** Open the cache's lock file and lock the cache root for shared use. Any
+    number of processes may use the cache at once; they hold shared locks on
+    the first byte of the lock file, and purge_cache() needs an exclusive
+    lock. The other bytes of the file are used by HTTPCacheTable to
+    coordinate changes to the index and to the entries. The lock file is
+    not removed when the cache is closed.
 
     A private method.
 
-    @param force If True force access to the persistent store. False by
-    default.
+    @param force Not used; the locks are released by the OS when a process
+    exits, so a program that crashes no longer leaves the cache locked.
     @return True if the cache was locked for our use, False otherwise. */
 
-bool HTTPCache::get_single_user_lock(bool force) 
+bool HTTPCache::get_cache_root_lock(bool /*force*/)
 {
-    if (!d_locked_open_file) {
-	FILE * fp = NULL;
-
-	try {
-	    // It's OK to call create_cache_root if the directory already
-	    // exists.
-	    create_cache_root(d_cache_root);
-	}
-	catch (Error &e) {
-	    // We need to catch and return false because this method is
-	    // called from a ctor and throwing at this point will result in a
-	    // partially constructed object. 01/22/04 jhrg
-	    DBG(cerr << "Failure to create the cache root" << endl);
-	    return false;
-	}
+    if (d_lock_fd >= 0) {
+        DBG(cerr << "The cache root is already locked" << endl);
+        return false;
+    }
 
-	// Try to read the lock file. If we can open for reading, it exists.
-	string lock = d_cache_root + CACHE_LOCK;
-	if ((fp = fopen(lock.c_str(), "r")) != NULL) {
-	    int res = fclose(fp);
-	    if (res) {
-		DBG(cerr << "Failed to close " << (void *)fp << endl);
-	    }
-	    if (force)
-		REMOVE(lock.c_str());
-	    else
-		return false;
-	}
+    try {
+        // It's OK to call create_cache_root if the directory already
+        // exists.
+        create_cache_root(d_cache_root);
+    }
+    catch (Error &e) {
+        // We need to catch and return false because this method is
+        // called from a ctor and throwing at this point will result in a
+        // partially constructed object. 01/22/04 jhrg
+        DBG(cerr << "Failure to create the cache root" << endl);
+        return false;
+    }
 
-	if ((fp = fopen(lock.c_str(), "w")) == NULL) {
-	    DBG(cerr << "Could not open for write access" << endl);
-	    return false;
-	}
+    string lock = d_cache_root + CACHE_LOCK;
+    int fd = open(lock.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        DBG(cerr << "Could not open the lock file" << endl);
+        return false;
+    }
 
-	d_locked_open_file = fp;
-	return true;
+    // Wait if another process is purging the cache
+    if (!HTTPCacheTable::lock_file_byte(fd, F_RDLCK, 0, true)) {
+        DBG(cerr << "Could not lock the lock file" << endl);
+        close(fd);
+        return false;
     }
 
-    DBG(cerr << "locked_open_file is true" << endl);
-    return false;
+    d_lock_fd = fd;
+    return true;
 }
 
-/** Release the single user (process) lock. A private method. */
+/** Release the cache root lock. A private method. */
 
 void
-HTTPCache::release_single_user_lock()
+HTTPCache::release_cache_root_lock()
 {
-    if (d_locked_open_file) {
-        int res = fclose(d_locked_open_file);
-        if (res) {
-            DBG(cerr << "Failed to close " << (void *)d_locked_open_file << endl) ;
+    if (d_lock_fd >= 0) {
+        // Closing the file releases all of this process' locks on it
+        if (close(d_lock_fd)) {
+            DBG(cerr << "Failed to close " << d_lock_fd << endl) ;
         }
-        d_locked_open_file = 0;
+        d_lock_fd = -1;
     }
-
-    string lock = d_cache_root + CACHE_LOCK;
-    REMOVE(lock.c_str());
 }
 
 /** @name Accessors and Mutators for various properties. */
@@ -852,6 +902,30 @@ HTTPCache::get_always_validate() const
     return d_always_validate;
 }
 
+/** Use stale responses while they are revalidated? When this is set, a
+    response that is no more than \c max_staleness seconds past its
+    expiration time can be returned right away while a conditional request
+    is made in the background (see HTTPConnect). Responses marked
+    must-revalidate are always validated first.
+
+    @param max_staleness The most time, in seconds, a response can be past
+    its expiration time and still be used. Zero turns this off. */
+
+void
+HTTPCache::set_stale_while_revalidate(time_t max_staleness)
+{
+    d_stale_while_revalidate = max_staleness > 0 ? max_staleness : 0;
+}
+
+/** How long can a stale response be used while it is revalidated?
+    @return The time in seconds; zero if this is off. */
+
+time_t
+HTTPCache::get_stale_while_revalidate() const
+{
+    return d_stale_while_revalidate;
+}
+
 /** Set the request Cache-Control headers. If a request must be satisfied
     using HTTP, these headers should be included in request since they might
     be pertinent to a proxy cache.
@@ -922,6 +996,93 @@ HTTPCache::get_cache_control()
     return d_cache_control;
 }
 
+/** Use a separate thread to make room in the cache. When this is on,
+    cache_response() only signals the thread when the cache is full, so the
+    eviction work is not done by the thread that is caching the response.
+    Off by default.
+
+    @param mode True to start the thread, false to stop it. */
+
+void
+HTTPCache::set_background_gc(bool mode)
+{
+    LOCK(&d_gc_lock);
+
+    if (mode && !d_gc_thread_running) {
+        d_gc_stop = false;
+        d_gc_requested = false;
+        int status = pthread_create(&d_gc_thread, 0, gc_thread, this);
+        if (status != 0) {
+            UNLOCK(&d_gc_lock);
+            throw InternalErr(__FILE__, __LINE__, string("Could not start the garbage collection thread: ") + strerror(status));
+        }
+        d_gc_thread_running = true;
+    }
+    else if (!mode && d_gc_thread_running) {
+        d_gc_stop = true;
+        pthread_cond_signal(&d_gc_cond);
+        UNLOCK(&d_gc_lock);
+
+        // The thread needs d_gc_lock to stop
+        pthread_join(d_gc_thread, 0);
+
+        LOCK(&d_gc_lock);
+        d_gc_thread_running = false;
+        d_gc_stop = false;
+    }
+
+    UNLOCK(&d_gc_lock);
+}
+
+/** Set the size of the in-memory hot tier. Small responses that are used
+    more than once are held in memory and returned without reading the
+    disk cache. By default the hot tier uses at most 4M and holds responses
+    up to 64K.
+
+    This method locks the class' interface.
+
+    @param size The most memory, in bytes, the hot tier may use. Zero turns
+    it off.
+    @param max_entry_size The largest response body held in memory. */
+
+void
+HTTPCache::set_hot_tier_size(unsigned long size, unsigned long max_entry_size)
+{
+    lock_cache_interface();
+
+    try {
+        d_http_cache_table->set_hot_tier_size(size, max_entry_size);
+    }
+    catch (...) {
+        unlock_cache_interface();
+        throw;
+    }
+
+    unlock_cache_interface();
+}
+
+/** How well is the hot tier working? The statistics count the responses
+    returned from memory (hits) and from disk (misses) and the number of
+    responses added to and dropped from memory. */
+
+HTTPCacheTable::HotTierStatistics
+HTTPCache::get_hot_tier_statistics()
+{
+    return d_http_cache_table->get_hot_tier_statistics();
+}
+
+/** Is garbage collection done by a separate thread? */
+
+bool
+HTTPCache::is_background_gc()
+{
+    LOCK(&d_gc_lock);
+    bool running = d_gc_thread_running;
+    UNLOCK(&d_gc_lock);
+
+    return running;
+}
+
 //@}
 
 /** Look in the cache for the given \c url. Is it in the cache table?
@@ -937,6 +1098,8 @@ HTTPCache::is_url_in_cache(const string &url)
 {
     DBG(cerr << "Is this url in the cache? (" << url << ")" << endl);
 
+    d_http_cache_table->sync_index();
+
     HTTPCacheTable::CacheEntry *entry = d_http_cache_table->get_locked_entry_from_cache_table(url);
     bool status = entry != 0;
     if (entry) {
@@ -945,6 +1108,29 @@ HTTPCache::is_url_in_cache(const string &url)
     return  status;
 }
 
+/** Hold the lock for a URL's entry in a cache shared with other processes
+    (see HTTPCacheTable::lock_url()) until the end of a block. */
+class URLLock {
+    HTTPCacheTable *d_table;
+    string d_url;
+    bool d_locked;
+
+public:
+    URLLock(HTTPCacheTable *table, const string &url) : d_table(table), d_url(url), d_locked(false)
+    {
+        d_locked = d_table->lock_url(d_url);
+    }
+
+    /** False if other processes could not be kept from changing the
+        entry; don't change it then. */
+    bool locked() const { return d_locked; }
+
+    ~URLLock()
+    {
+        d_table->unlock_url(d_url);
+    }
+};
+
 /** Is the header a hop by hop header? If so, we're not supposed to store it
     in the cache. See RFC 2616, Section 13.5.1.
 
@@ -961,8 +1147,34 @@ is_hop_by_hop_header(const string &header)
            || header.find("Upgrade") != string::npos;
 }
 
-/** Dump the headers out to the meta data file. The file is truncated if it
-    already exists.
+/** Record that \c name is being written so the interrupt handler can remove
+    it. Several threads may be writing responses at once.
+
+    A private method. */
+void
+HTTPCache::add_open_file(const string &name)
+{
+    LOCK(&d_open_files_lock);
+    d_open_files.push_back(name);
+    UNLOCK(&d_open_files_lock);
+}
+
+/** The file \c name has been written and closed.
+
+    A private method. */
+void
+HTTPCache::remove_open_file(const string &name)
+{
+    LOCK(&d_open_files_lock);
+    vector<string>::reverse_iterator i = find(d_open_files.rbegin(), d_open_files.rend(), name);
+    if (i != d_open_files.rend())
+        d_open_files.erase(--(i.base()));
+    UNLOCK(&d_open_files_lock);
+}
+
+/** Dump the headers out to the meta data file. The headers are written to
+    a temporary file which then replaces the meta data file, so another
+    process never reads part of the headers.
 
     @todo This code could be replaced with STL/iostream stuff.
 
@@ -976,9 +1188,10 @@ void
 HTTPCache::write_metadata(const string &cachename, const vector<string> &headers)
 {
     string fname = cachename + CACHE_META;
-    d_open_files.push_back(fname);
+    string tmp = fname + CACHE_TMP;
+    add_open_file(tmp);
 
-    FILE *dest = fopen(fname.c_str(), "w");
+    FILE *dest = fopen(tmp.c_str(), "w");
     if (!dest) {
         throw InternalErr(__FILE__, __LINE__,
                           "Could not open named cache entry file.");
@@ -990,11 +1203,13 @@ HTTPCache::write_metadata(const string &cachename, const vector<string> &headers
             int s = fwrite((*i).c_str(), (*i).size(), 1, dest);
             if (s != 1) {
                 fclose(dest);
+                unlink(tmp.c_str());
             	throw InternalErr(__FILE__, __LINE__, "could not write header: '" + (*i) + "' " + long_to_string(s));
             }
             s = fwrite("\n", 1, 1, dest);
             if (s != 1) {
                 fclose(dest);
+                unlink(tmp.c_str());
             	throw InternalErr(__FILE__, __LINE__, "could not write header: " + long_to_string(s));
             }
         }
@@ -1006,7 +1221,13 @@ HTTPCache::write_metadata(const string &cachename, const vector<string> &headers
             << dest << endl);
     }
 
-    d_open_files.pop_back();
+    // Other processes may be reading the headers; replace them all at once
+    if (rename(tmp.c_str(), fname.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw InternalErr(__FILE__, __LINE__, "Could not write the cache entry's headers.");
+    }
+
+    remove_open_file(tmp);
 }
 
 /** Read headers from a .meta.
@@ -1041,7 +1262,9 @@ HTTPCache::read_metadata(const string &cachename, vector<string> &headers)
     }
 }
 
-/** Write the body of the HTTP response to the cache.
+/** Write the body of the HTTP response to the cache. The body is written to
+    a temporary file which is renamed once it's complete, so a body file
+    found in the cache is never partly written.
 
     This method used to throw ResponseTooBig if any response was larger than
     max_entry_size. I've disabled that since perform_garbage_collection will
@@ -1065,9 +1288,10 @@ HTTPCache::read_metadata(const string &cachename, vector<string> &headers)
 int
 HTTPCache::write_body(const string &cachename, const FILE *src)
 {
-    d_open_files.push_back(cachename);
+    string tmp = cachename + CACHE_TMP;
+    add_open_file(tmp);
 
-    FILE *dest = fopen(cachename.c_str(), "wb");
+    FILE *dest = fopen(tmp.c_str(), "wb");
     if (!dest) {
         throw InternalErr(__FILE__, __LINE__,
                           "Could not open named cache entry file.");
@@ -1085,7 +1309,7 @@ HTTPCache::write_body(const string &cachename, const FILE *src)
 
     if (ferror(const_cast<FILE *>(src)) || ferror(dest)) {
         int res = fclose(dest);
-        res = res & unlink(cachename.c_str());
+        res = res & unlink(tmp.c_str());
         if (res) {
             DBG(cerr << "HTTPCache::write_body - Failed to close/unlink "
                 << dest << endl);
@@ -1102,7 +1326,12 @@ HTTPCache::write_body(const string &cachename, const FILE *src)
             << dest << endl);
     }
 
-    d_open_files.pop_back();
+    if (rename(tmp.c_str(), cachename.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw InternalErr(__FILE__, __LINE__, "Could not write the cache entry's body.");
+    }
+
+    remove_open_file(tmp);
 
     return total;
 }
@@ -1127,6 +1356,56 @@ HTTPCache::open_body(const string &cachename)
     return src;
 }
 
+/** Read a whole response body from the cache. Used to load small responses
+    into the hot tier.
+
+    @param cachename The name of the cache file.
+    @param body Value-result parameter; the body.
+    @exception InternalErr Thrown if the file cannot be read. */
+
+void
+HTTPCache::read_body(const string &cachename, string &body)
+{
+    FILE *src = open_body(cachename);
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), src)) > 0)
+        body.append(buf, n);
+
+    bool error = ferror(src);
+    fclose(src);
+    if (error)
+        throw InternalErr(__FILE__, __LINE__, "Could not read cache file.");
+}
+
+/** Make a FILE * that reads a response body held in memory. The stream
+    has its own copy of the body, which is freed when the stream is closed.
+
+    @param body The response body.
+    @return The stream or null if it could not be made. */
+
+FILE *
+HTTPCache::open_memory_body(const string &body)
+{
+#ifdef HAVE_FMEMOPEN
+    // Leave room for the null that fmemopen() writes after the data
+    FILE *src = fmemopen(0, body.size() + 1, "w+");
+    if (!src)
+        return 0;
+
+    if (!body.empty() && fwrite(body.data(), body.size(), 1, src) != 1) {
+        fclose(src);
+        return 0;
+    }
+
+    rewind(src);
+    return src;
+#else
+    return 0;
+#endif
+}
+
 /** Add a new response to the cache, or replace an existing cached response
     with new data. This method returns True if the information for \c url was
     added to the cache. A response might not be cache-able; in that case this
@@ -1140,7 +1419,7 @@ HTTPCache::open_body(const string &cachename)
     replaced by the new headers and body. To update a response in the cache
     with new meta data, use update_response().
 
-    This method locks the class' interface.
+    This method locks the class' interface for reading.
 
     @param url A string which holds the request URL.
     @param request_time The time when the request was made, in seconds since
@@ -1156,7 +1435,7 @@ bool
 HTTPCache::cache_response(const string &url, time_t request_time,
                           const vector<string> &headers, const FILE *body)
 {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     DBG(cerr << "Caching url: " << url << "." << endl);
 
@@ -1168,10 +1447,17 @@ HTTPCache::cache_response(const string &url, time_t request_time,
             return false;
         }
 
-        // This does nothing if url is not already in the cache. It's
-        // more efficient to do this than to first check and see if the entry
-        // exists. 10/10/02 jhrg
-        d_http_cache_table->remove_entry_from_cache_table(url);
+        // Keep other processes from caching this URL at the same time, then
+        // bring in the changes they've made so that any response they've
+        // cached for it is the one replaced.
+        URLLock url_lock(d_http_cache_table, url);
+        if (!url_lock.locked()) {
+            DBG(cerr << "Could not lock the entry for " << url << "; not caching it." << endl);
+            unlock_cache_interface();
+            return false;
+        }
+
+        d_http_cache_table->sync_index();
 
         HTTPCacheTable::CacheEntry *entry = new HTTPCacheTable::CacheEntry(url);
         entry->lock_write_response();
@@ -1183,6 +1469,8 @@ HTTPCache::cache_response(const string &url, time_t request_time,
                     << "(" << url << ")" << endl);
                 entry->unlock_write_response();
                 delete entry; entry = 0;
+                // This does nothing if url is not already in the cache.
+                d_http_cache_table->remove_entry_from_cache_table(url);
                 unlock_cache_interface();
                 return false;
             }
@@ -1194,7 +1482,8 @@ HTTPCache::cache_response(const string &url, time_t request_time,
             // move these write function to cache table
             entry->set_size(write_body(entry->get_cachename(), body));
             write_metadata(entry->get_cachename(), headers);
-            d_http_cache_table->add_entry_to_cache_table(entry);
+            // Replaces the entry for url if there is one.
+            d_http_cache_table->add_entry_to_cache_table(entry, true);
             entry->unlock_write_response();
         }
         catch (ResponseTooBigErr &e) {
@@ -1206,16 +1495,10 @@ HTTPCache::cache_response(const string &url, time_t request_time,
                 << ")" << endl);
             entry->unlock_write_response();
             delete entry; entry = 0;
+            d_http_cache_table->remove_entry_from_cache_table(url);
             unlock_cache_interface();
             return false;
         }
-
-        if (d_http_cache_table->get_new_entries() > DUMP_FREQUENCY) {
-            if (startGC())
-                perform_garbage_collection();
-
-            d_http_cache_table->cache_index_write(); // resets new_entries
-        }
     }
     catch (...) {
         unlock_cache_interface();
@@ -1224,6 +1507,30 @@ HTTPCache::cache_response(const string &url, time_t request_time,
 
     unlock_cache_interface();
 
+    // Make room for the new response. This removes the least recently used
+    // entries; it does not scan the cache table.
+    if (startGC()) {
+        LOCK(&d_gc_lock);
+        bool background = d_gc_thread_running;
+        if (background) {
+            d_gc_requested = true;
+            pthread_cond_signal(&d_gc_cond);
+        }
+        UNLOCK(&d_gc_lock);
+
+        if (!background) {
+            read_lock_cache_interface();
+            try {
+                lru_gc();
+            }
+            catch (...) {
+                unlock_cache_interface();
+                throw;
+            }
+            unlock_cache_interface();
+        }
+    }
+
     return true;
 }
 
@@ -1239,7 +1546,7 @@ HTTPCache::cache_response(const string &url, time_t request_time,
     Cache-Control max-age or Expires header(s). Note that a 'Cache-Control:
     max-age' header overrides an Expires header (Sec 14.9.3).
 
-    This method locks the cache interface and the cache entry.
+    This method locks the cache interface for reading and the cache entry.
 
     @param url Get the HTTPCacheTable::CacheEntry for this URL.
     @return A vector of strings, one request header per string.
@@ -1248,7 +1555,7 @@ HTTPCache::cache_response(const string &url, time_t request_time,
 vector<string>
 HTTPCache::get_conditional_request_headers(const string &url)
 {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     HTTPCacheTable::CacheEntry *entry = 0;
     vector<string> headers;
@@ -1304,9 +1611,11 @@ struct HeaderLess: binary_function<const string&, const string&, bool>
 
 /** Update the meta data for a response already in the cache. This method
     provides a way to merge response headers returned from a conditional GET
-    request, for the given URL, with those already present.
+    request, for the given URL, with those already present. If the cache is
+    shared and the entry cannot be locked against other processes, the
+    entry is left as it is.
 
-    This method locks the class' interface and the cache entry.
+    This method locks the class' interface for reading and the cache entry.
 
     @param url Update the meta data for this cache entry.
     @param request_time The time (Unix time, seconds since 1 Jan 1970) that
@@ -1319,12 +1628,23 @@ void
 HTTPCache::update_response(const string &url, time_t request_time,
                            const vector<string> &headers)
 {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     HTTPCacheTable::CacheEntry *entry = 0;
     DBG(cerr << "Updating the response headers for: " << url << endl);
 
     try {
+        // If other processes can't be kept out, leave the entry as it is;
+        // the response will be validated again the next time it's used.
+        URLLock url_lock(d_http_cache_table, url);
+        if (!url_lock.locked()) {
+            DBG(cerr << "Could not lock the entry for " << url << "; not updating it." << endl);
+            unlock_cache_interface();
+            return;
+        }
+
+        d_http_cache_table->sync_index();
+
         entry = d_http_cache_table->get_write_locked_entry_from_cache_table(url);
         if (!entry)
             throw Error(internal_error, "There is no cache entry for the URL: " + url);
@@ -1335,6 +1655,11 @@ HTTPCache::update_response(const string &url, time_t request_time,
         // Update corrected_initial_age, freshness_lifetime, response_time.
         d_http_cache_table->calculate_time(entry, d_default_expiration, request_time);
 
+        d_http_cache_table->update_index_entry(entry);
+
+        // The copy of the headers in memory is now out of date
+        d_http_cache_table->demote_entry(entry);
+
         // Merge the new headers with those in the persistent store. How:
         // Load the new headers into a set, then merge the old headers. Since
         // set<> ignores duplicates, old headers with the same name as a new
@@ -1377,7 +1702,7 @@ HTTPCache::update_response(const string &url, time_t request_time,
     response. This method should be used to determine if a cached response
     requires validation.
 
-    This method locks the class' interface and the cache entry.
+    This method locks the class' interface for reading and the cache entry.
 
     @param url Find the cached response associated with this URL.
     @return True indicates that the response can be used, False indicates
@@ -1387,7 +1712,7 @@ HTTPCache::update_response(const string &url, time_t request_time,
 bool
 HTTPCache::is_url_valid(const string &url)
 {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     bool freshness;
     HTTPCacheTable::CacheEntry *entry = 0;
@@ -1450,6 +1775,90 @@ HTTPCache::is_url_valid(const string &url)
     return freshness;
 }
 
+/** Can a stale cached response be used while it is revalidated? This is
+    true when stale-while-revalidate is on (see
+    set_stale_while_revalidate()) and the response is not more than the
+    maximum staleness past its expiration time. A response marked
+    must-revalidate, or one older than the max-age given in the request's
+    Cache-Control header, cannot be used this way. Call this only after
+    is_url_valid() has returned false.
+
+    This method locks the class' interface for reading and the cache entry.
+
+    @param url Find the cached response associated with this URL.
+    @return True if the stale response can be used.
+    @exception Error Thrown if the URL's response is not in the cache. */
+
+bool
+HTTPCache::is_url_usable_while_revalidating(const string &url)
+{
+    if (d_stale_while_revalidate == 0 || d_always_validate)
+        return false;
+
+    read_lock_cache_interface();
+
+    HTTPCacheTable::CacheEntry *entry = 0;
+    bool usable;
+
+    try {
+        entry = d_http_cache_table->get_locked_entry_from_cache_table(url);
+        if (!entry)
+            throw Error(internal_error, "There is no cache entry for the URL: " + url);
+
+        time_t resident_time = time(NULL) - entry->get_response_time();
+        time_t current_age = entry->get_corrected_initial_age() + resident_time;
+
+        usable = !entry->get_must_revalidate()
+            && !(d_max_age >= 0 && current_age > d_max_age)
+            && entry->get_freshness_lifetime() + d_stale_while_revalidate >= current_age;
+
+        entry->unlock_read_response();
+        unlock_cache_interface();
+    }
+    catch (...) {
+        if (entry) {
+            entry->unlock_read_response();
+        }
+        unlock_cache_interface();
+        throw;
+    }
+
+    DBG(cerr << "Is this stale URL usable? (" << url << "): " << usable << endl);
+
+    return usable;
+}
+
+/** Note that a response is being revalidated in the background. Only one
+    revalidation of a given URL runs at a time.
+
+    @param url The URL of the response.
+    @return True if the caller should revalidate the response, false if it
+    is already being revalidated. */
+
+bool
+HTTPCache::start_revalidation(const string &url)
+{
+    LOCK(&d_revalidation_lock);
+    bool started = d_revalidating.insert(url).second;
+    UNLOCK(&d_revalidation_lock);
+
+    return started;
+}
+
+/** Note that a background revalidation started with start_revalidation()
+    is done.
+
+    @param url The URL of the response. */
+
+void
+HTTPCache::end_revalidation(const string &url)
+{
+    LOCK(&d_revalidation_lock);
+    d_revalidating.erase(url);
+    pthread_cond_broadcast(&d_revalidation_cond);
+    UNLOCK(&d_revalidation_lock);
+}
+
 /** Get information from the cache. For a given URL, get the headers, cache
     object name and body
     stored in the cache. Note that this method increments the hit counter for
@@ -1461,7 +1870,7 @@ HTTPCache::is_url_valid(const string &url)
     system will not reclaim locked entries (but works fine when some entries
     are locked).
 
-    This method locks the class' interface.
+    This method locks the class' interface for reading.
 
     This method does \e not check to see that the response is valid, just
     that it is in the cache. To see if a cached response is valid, use
@@ -1479,7 +1888,7 @@ HTTPCache::is_url_valid(const string &url)
 
 FILE * HTTPCache::get_cached_response(const string &url,
 		vector<string> &headers, string &cacheName) {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     FILE *body = 0;
     HTTPCacheTable::CacheEntry *entry = 0;
@@ -1487,20 +1896,54 @@ FILE * HTTPCache::get_cached_response(const string &url,
     DBG(cerr << "Getting the cached response for " << url << endl);
 
     try {
+        d_http_cache_table->sync_index();
+
         entry = d_http_cache_table->get_locked_entry_from_cache_table(url);
         if (!entry) {
         	unlock_cache_interface();
         	return 0;
         }
 
+        // Another process may have removed the response and not yet
+        // recorded that in the index.
+        if (access(entry->get_cachename().c_str(), F_OK) != 0) {
+            entry->unlock_read_response();
+            unlock_cache_interface();
+            return 0;
+        }
+
         cacheName = entry->get_cachename();
-        read_metadata(entry->get_cachename(), headers);
+
+        // Small, hot responses are read from memory. A small response
+        // that's been used before is loaded into memory.
+        HTTPCacheTable::HotResponse *hot = d_http_cache_table->get_hot_response(entry);
+        if (hot) {
+            body = open_memory_body(hot->body);
+            if (body)
+                headers.insert(headers.end(), hot->headers.begin(), hot->headers.end());
+            d_http_cache_table->release_hot_response(hot);
+        }
+        else if (d_http_cache_table->is_hot_candidate(entry)) {
+            vector<string> hot_headers;
+            string hot_body;
+            read_metadata(entry->get_cachename(), hot_headers);
+            read_body(entry->get_cachename(), hot_body);
+
+            body = open_memory_body(hot_body);
+            if (body) {
+                d_http_cache_table->promote_entry(entry, hot_headers, hot_body);
+                headers.insert(headers.end(), hot_headers.begin(), hot_headers.end());
+            }
+        }
+
+        if (!body) {
+            read_metadata(entry->get_cachename(), headers);
+            body = open_body(entry->get_cachename());
+        }
 
         DBG(cerr << "Headers just read from cache: " << endl);
         DBGN(copy(headers.begin(), headers.end(), ostream_iterator<string>(cerr, "\n")));
 
-        body = open_body(entry->get_cachename());
-
         DBG(cerr << "Returning: " << url << " from the cache." << endl);
 
         d_http_cache_table->bind_entry_to_data(entry, body);
@@ -1560,7 +2003,7 @@ HTTPCache::get_cached_response(const string &url)
     is locked so that updates and removal (e.g., by the garbage collector)
     are not possible. Calling this method frees that lock.
 
-    This method locks the class' interface.
+    This method locks the class' interface for reading.
 
     @param body Release the lock on the response information associated with
     this FILE *.
@@ -1570,7 +2013,7 @@ HTTPCache::get_cached_response(const string &url)
 void
 HTTPCache::release_cached_response(FILE *body)
 {
-    lock_cache_interface();
+    read_lock_cache_interface();
 
     try {
     	// fclose(body); This results in a seg fault on linux jhrg 8/27/13
@@ -1588,30 +2031,44 @@ HTTPCache::release_cached_response(FILE *body)
     disk. This method deletes every entry in the persistent store but leaves
     the structure intact. The client of HTTPCache is responsible for making
     sure that all threads have released any responses they pulled from the
-    cache. If this method is called when a response is still in use, it will
-    throw an Error object and not purge the cache.
+    cache. If this method is called when a response is still in use, or when
+    another program is using the cache, it will throw an Error object and
+    not purge the cache.
 
     This method locks the class' interface.
 
     @exception Error Thrown if an attempt is made to purge the cache when
-    an entry is still in use. */
+    an entry is still in use or the cache is shared. */
 
 void
 HTTPCache::purge_cache()
 {
     lock_cache_interface();
 
+    bool exclusive = false;
     try {
         if (d_http_cache_table->is_locked_read_responses())
             throw Error(internal_error, "Attempt to purge the cache with entries in use.");
 
+        // Other processes must not be using the cache
+        if (d_lock_fd >= 0) {
+            if (!HTTPCacheTable::lock_file_byte(d_lock_fd, F_WRLCK, 0, false))
+                throw Error(internal_error, "Attempt to purge the cache while it is in use by another program.");
+            exclusive = true;
+        }
+
         d_http_cache_table->delete_all_entries();
     }
     catch (...) {
+        if (exclusive)
+            HTTPCacheTable::lock_file_byte(d_lock_fd, F_RDLCK, 0, true);
         unlock_cache_interface();
         throw;
     }
 
+    if (exclusive)
+        HTTPCacheTable::lock_file_byte(d_lock_fd, F_RDLCK, 0, true);
+
     unlock_cache_interface();
 }
 
@@ -35,6 +35,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 
 #include "HTTPCacheTable.h" // included for macros
 
@@ -72,7 +73,19 @@ bool is_hop_by_hop_header(const string &header);
     MT software, having several threads change values of cache's properties
     will lead to odd behavior on the part of the cache. Many of the public
     methods lock access to the class' interface. This is noted in the
-    documentation for those methods.
+    documentation for those methods. The methods that work with a single
+    response (get_cached_response(), release_cached_response(),
+    is_url_valid(), cache_response(), ...) only lock the interface for
+    reading, so several threads can use them at once; the cache table's
+    per-bucket locks keep those threads from interfering with one another.
+
+    Several processes may share one cache root. They coordinate using
+    fcntl(2) locks on the cache's \c .lock file: each keeps its own cache
+    table in step with the others' changes using the shared index journal,
+    only one at a time may cache or update the response for a given URL,
+    and response bodies and headers are written to temporary files that are
+    renamed into place. purge_cache() fails if another process is using the
+    cache. See HTTPCacheTable for the details.
 
     Even though the public interface to the cache is typically locked when
     accessed, an extra locking mechanism is in place for `entries' which are
@@ -104,13 +117,14 @@ class HTTPCache
 {
 private:
     string d_cache_root;
-    FILE *d_locked_open_file; // Lock for single process use.
+    int d_lock_fd; // The cache's lock file; see get_cache_root_lock()
 
     bool d_cache_enabled;
     bool d_cache_protected;
     CacheDisconnectedMode d_cache_disconnected;
     bool d_expire_ignored;
     bool d_always_validate;
+    time_t d_stale_while_revalidate; // 0: off, >0 max staleness.
 
     unsigned long d_total_size; // How much can we store?
     unsigned long d_folder_size; // How much of that is meta data?
@@ -127,8 +141,29 @@ private:
     time_t d_max_stale;  // -1: not set, 0:any response, >0 max time.
     time_t d_min_fresh;
 
-    // Lock non-const methods (also ones that use the STL).
-    pthread_mutex_t d_cache_mutex;
+    // Lock non-const methods (also ones that use the STL). Methods that
+    // work on one URL (get_cached_response(), is_url_valid(), ...) lock this
+    // for reading and rely on HTTPCacheTable's per-bucket locks; methods
+    // that change the cache's parameters or work on every entry (garbage
+    // collection, purge_cache()) lock it for writing.
+    pthread_rwlock_t d_cache_lock;
+
+    // Protects d_open_files
+    pthread_mutex_t d_open_files_lock;
+
+    // The optional garbage collection thread. d_gc_lock protects these.
+    bool d_gc_thread_running;
+    bool d_gc_stop;
+    bool d_gc_requested;
+    pthread_t d_gc_thread;
+    pthread_mutex_t d_gc_lock;
+    pthread_cond_t d_gc_cond;
+
+    // URLs being revalidated in the background; protected by
+    // d_revalidation_lock.
+    set<string> d_revalidating;
+    pthread_mutex_t d_revalidation_lock;
+    pthread_cond_t d_revalidation_cond;
     
     HTTPCacheTable *d_http_cache_table;
 
@@ -154,18 +189,22 @@ private:
     void set_cache_root(const string &root = "");
     void create_cache_root(const string &cache_root);
     
-    // These will go away when the cache can be used by multiple processes.
-    bool get_single_user_lock(bool force = false);
-    void release_single_user_lock();
+    bool get_cache_root_lock(bool force = false);
+    void release_cache_root_lock();
     
     bool is_url_in_cache(const string &url);
 
+    void add_open_file(const string &name);
+    void remove_open_file(const string &name);
+
     // I made these four methods so they could be tested by HTTPCacheTest.
     // Otherwise they would be static functions. jhrg 10/01/02
     void write_metadata(const string &cachename, const vector<string> &headers);
     void read_metadata(const string &cachename, vector<string> &headers);
     int write_body(const string &cachename, const FILE *src);
     FILE *open_body(const string &cachename);
+    void read_body(const string &cachename, string &body);
+    FILE *open_memory_body(const string &body);
 
     bool stopGC() const;
     bool startGC() const;
@@ -173,7 +212,9 @@ private:
     void perform_garbage_collection();
     void too_big_gc();
     void expired_gc();
-    void hits_gc();
+    void lru_gc();
+
+    static void *gc_thread(void *cache);
 
 public:
     static HTTPCache *instance(const string &cache_root, bool force = false);
@@ -205,14 +246,28 @@ public:
     void set_cache_control(const vector<string> &cc);
     vector<string> get_cache_control();
 
+    void set_background_gc(bool mode);
+    bool is_background_gc();
+
+    void set_stale_while_revalidate(time_t max_staleness);
+    time_t get_stale_while_revalidate() const;
+
+    void set_hot_tier_size(unsigned long size, unsigned long max_entry_size);
+    HTTPCacheTable::HotTierStatistics get_hot_tier_statistics();
+
     void lock_cache_interface() {
     	DBG(cerr << "Locking interface... ");
-    	LOCK(&d_cache_mutex);
+    	WRITE_LOCK(&d_cache_lock);
     	DBGN(cerr << "Done" << endl);
     }    	
+    void read_lock_cache_interface() {
+    	DBG(cerr << "Locking interface for reading... ");
+    	READ_LOCK(&d_cache_lock);
+    	DBGN(cerr << "Done" << endl);
+    }
     void unlock_cache_interface() {
     	DBG(cerr << "Unlocking interface... " );
-    	UNLOCK(&d_cache_mutex);
+    	RW_UNLOCK(&d_cache_lock);
     	DBGN(cerr << "Done" << endl);
     }
     
@@ -226,6 +281,12 @@ public:
     // cache entry just needs a header update. That is best left to the HTTP
     // Connection code.
     bool is_url_valid(const string &url);
+
+    // Stale-while-revalidate: use a stale response while another thread
+    // validates it.
+    bool is_url_usable_while_revalidating(const string &url);
+    bool start_revalidation(const string &url);
+    void end_revalidation(const string &url);
     
     // Lock these for reading
     vector<string> get_conditional_request_headers(const string &url);
@@ -65,6 +65,7 @@
 #define CACHE_INDEX ".index"
 #define CACHE_LOCK ".lock"
 #define CACHE_META ".meta"
+#define CACHE_TMP ".tmp"
 #define CACHE_EMPTY_ETAG "@cache@"
 
 
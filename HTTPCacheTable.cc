@@ -31,7 +31,9 @@
 
 #include <pthread.h>
 #include <limits.h>
+#include <stdint.h>
 #include <unistd.h>   // for stat
+#include <fcntl.h>
 #include <sys/types.h>  // for stat and mkdir
 #include <sys/stat.h>
 
@@ -81,6 +83,12 @@
 #define CACHE_INDEX ".index"
 #define CACHE_EMPTY_ETAG "@cache@"
 
+// The binary index is named by adding these to the (ASCII) index name
+#define CACHE_INDEX_SNAPSHOT ".bin"
+#define CACHE_INDEX_JOURNAL ".journal"
+#define CACHE_INDEX_OLD ".old"
+#define CACHE_INDEX_TMP ".tmp"
+
 #define NO_LM_EXPIRATION 24*3600 // 24 hours
 #define MAX_LM_EXPIRATION 48*3600 // Max expiration from LM
 
@@ -92,6 +100,32 @@
 
 const int CACHE_TABLE_SIZE = 1499;
 
+// Write a new index snapshot once the journal holds this many records.
+const unsigned long JOURNAL_COMPACT_RECORDS = 10000;
+
+const uint32_t INDEX_VERSION = 1;
+const uint32_t JOURNAL_VERSION = 2;     // delete records name the cache file
+const char INDEX_SNAPSHOT_MAGIC[8] = "HCINDEX";
+const char INDEX_JOURNAL_MAGIC[8] = "HCJRNL";
+
+// Buffer hit records until this many bytes are waiting.
+const string::size_type JOURNAL_BUFFER_SIZE = 4096;
+
+// Journal record types
+const int JOURNAL_ADD = 'A';
+const int JOURNAL_REMOVE = 'D';
+const int JOURNAL_HITS = 'H';
+
+// Longer strings mean the file is corrupt.
+const uint32_t MAX_INDEX_STRING = 64 * 1024;
+
+// Bytes of the lock file used when processes share the cache. Byte 0 is
+// used by HTTPCache (see HTTPCache::get_cache_root_lock()).
+const off_t JOURNAL_LOCK_BYTE = 1;
+const off_t INDEX_LOCK_BYTE = 2;
+const off_t URL_LOCK_BYTE = 16;
+const off_t URL_LOCK_RANGE = 1 << 30;
+
 using namespace std;
 
 namespace libdap {
@@ -110,16 +144,54 @@ get_hash(const string &url)
     return hash;
 }
 
-HTTPCacheTable::HTTPCacheTable(const string &cache_root, int block_size) :
-    d_cache_root(cache_root), d_block_size(block_size), d_current_size(0), d_new_entries(0)
+/** compute real disk space for an entry. */
+static inline int
+entry_disk_space(int size, unsigned int block_size)
+{
+    unsigned int num_of_blocks = (size + block_size) / block_size;
+    
+    DBG(cerr << "size: " << size << ", block_size: " << block_size
+        << ", num_of_blocks: " << num_of_blocks << endl);
+
+    return num_of_blocks * block_size;
+}
+
+/** Build the table and read the cache's index.
+
+    @param cache_root The cache's top directory.
+    @param block_size The file system's block size.
+    @param lock_fd The cache's lock file if other processes may share the
+    cache, otherwise -1 (the default). The caller owns it and must keep it
+    open until the table is deleted. */
+HTTPCacheTable::HTTPCacheTable(const string &cache_root, int block_size, int lock_fd) :
+    d_cache_root(cache_root), d_block_size(block_size), d_current_size(0), d_new_entries(0),
+    d_journal_fd(-1), d_journal_records(0), d_journal_compact_records(JOURNAL_COMPACT_RECORDS),
+    d_journal_failed(false), d_lock_fd(lock_fd), d_journal_offset(0), d_journal_rotated(false),
+    d_compacting(false), d_compaction_started(false), d_lru_head(0), d_lru_tail(0),
+    d_hot_max_size(0), d_hot_max_entry_size(0), d_hot_min_hits(1)
 {
     d_cache_index = cache_root + CACHE_INDEX;
 
     d_cache_table = new CacheEntries*[CACHE_TABLE_SIZE];
+    d_bucket_locks = new pthread_rwlock_t[CACHE_TABLE_SIZE];
 
     // Initialize the cache table.
-    for (int i = 0; i < CACHE_TABLE_SIZE; ++i)
+    for (int i = 0; i < CACHE_TABLE_SIZE; ++i) {
 	d_cache_table[i] = 0;
+	RW_INIT(&d_bucket_locks[i]);
+    }
+
+    INIT(&d_table_lock);
+    INIT(&d_journal_lock);
+    INIT(&d_index_write_lock);
+    INIT(&d_lru_lock);
+    INIT(&d_evict_lock);
+    INIT(&d_hot_lock);
+    INIT(&d_sync_lock);
+    INIT(&d_url_lock);
+    pthread_cond_init(&d_url_cond, 0);
+
+    memset(&d_hot_stats, 0, sizeof(d_hot_stats));
 
     cache_index_read();
 }
@@ -136,6 +208,25 @@ delete_cache_entry(HTTPCacheTable::CacheEntry *e)
 
 HTTPCacheTable::~HTTPCacheTable()
 {
+    // The compaction thread reads the table, so wait for it first.
+    if (d_compaction_started)
+        pthread_join(d_compaction_thread, 0);
+
+    // Write any buffered hit records
+    pthread_mutex_lock(&d_journal_lock);
+    if (d_lock_fd >= 0)
+        lock_file_byte(d_lock_fd, F_WRLCK, JOURNAL_LOCK_BYTE, true);
+    flush_journal();
+    if (d_lock_fd >= 0)
+        lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+    close_journal();
+    pthread_mutex_unlock(&d_journal_lock);
+
+    for_each(d_retired.begin(), d_retired.end(), delete_cache_entry);
+
+    for (list<CacheEntry *>::iterator i = d_hot_entries.begin(); i != d_hot_entries.end(); ++i)
+        delete (*i)->hot;
+
     for (int i = 0; i < CACHE_TABLE_SIZE; ++i) {
         HTTPCacheTable::CacheEntries *cp = get_cache_table()[i];
         if (cp) {
@@ -149,6 +240,20 @@ HTTPCacheTable::~HTTPCacheTable()
     }
 
     delete[] d_cache_table;
+
+    for (int i = 0; i < CACHE_TABLE_SIZE; ++i)
+        RW_DESTROY(&d_bucket_locks[i]);
+    delete[] d_bucket_locks;
+
+    DESTROY(&d_table_lock);
+    DESTROY(&d_journal_lock);
+    DESTROY(&d_index_write_lock);
+    DESTROY(&d_lru_lock);
+    DESTROY(&d_evict_lock);
+    DESTROY(&d_hot_lock);
+    DESTROY(&d_sync_lock);
+    DESTROY(&d_url_lock);
+    pthread_cond_destroy(&d_url_cond);
 }
 
 /** Functor which deletes and nulls a single CacheEntry if it has expired.
@@ -183,20 +288,26 @@ public:
 void HTTPCacheTable::delete_expired_entries(time_t time) {
 	// Walk through and delete all the expired entries.
 	for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
-		HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
-		if (slot) {
-			for_each(slot->begin(), slot->end(), DeleteExpired(*this, time));
-			slot->erase(remove(slot->begin(), slot->end(),
-					static_cast<HTTPCacheTable::CacheEntry *>(0)), slot->end());
+		WRITE_LOCK(&d_bucket_locks[cnt]);
+		try {
+			HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
+			if (slot) {
+				for_each(slot->begin(), slot->end(), DeleteExpired(*this, time));
+				slot->erase(remove(slot->begin(), slot->end(),
+						static_cast<HTTPCacheTable::CacheEntry *>(0)), slot->end());
+			}
+		}
+		catch (...) {
+			RW_UNLOCK(&d_bucket_locks[cnt]);
+			throw;
 		}
+		RW_UNLOCK(&d_bucket_locks[cnt]);
 	}
 }
 
 /** Functor which deletes and nulls a single CacheEntry which has less than
     or equal to \c hits hits or if it is larger than the cache's
-    max_entry_size property.
-
-    @see hits_gc. */
+    max_entry_size property. */
 
 class DeleteByHits : public unary_function<HTTPCacheTable::CacheEntry *&, void> {
 	HTTPCacheTable &d_table;
@@ -219,20 +330,28 @@ public:
 void 
 HTTPCacheTable::delete_by_hits(int hits) {
     for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
-        if (get_cache_table()[cnt]) {
-            HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
-            for_each(slot->begin(), slot->end(), DeleteByHits(*this, hits));
-            slot->erase(remove(slot->begin(), slot->end(),
-                               static_cast<HTTPCacheTable::CacheEntry*>(0)),
-                        slot->end());
+        WRITE_LOCK(&d_bucket_locks[cnt]);
+        try {
+            if (get_cache_table()[cnt]) {
+                HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
+                for_each(slot->begin(), slot->end(), DeleteByHits(*this, hits));
+                slot->erase(remove(slot->begin(), slot->end(),
+                                   static_cast<HTTPCacheTable::CacheEntry*>(0)),
+                            slot->end());
 
+            }
+        }
+        catch (...) {
+            RW_UNLOCK(&d_bucket_locks[cnt]);
+            throw;
         }
+        RW_UNLOCK(&d_bucket_locks[cnt]);
     }
 }
 
 /** Functor which deletes and nulls a single CacheEntry which is larger than 
     a given size.
-    @see hits_gc. */
+    @see HTTPCache::too_big_gc. */
 
 class DeleteBySize : public unary_function<HTTPCacheTable::CacheEntry *&, void> {
 	HTTPCacheTable &d_table;
@@ -254,41 +373,586 @@ public:
 
 void HTTPCacheTable::delete_by_size(unsigned int size) {
     for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
-        if (get_cache_table()[cnt]) {
-            HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
-            for_each(slot->begin(), slot->end(), DeleteBySize(*this, size));
-            slot->erase(remove(slot->begin(), slot->end(),
-                               static_cast<HTTPCacheTable::CacheEntry*>(0)),
-                        slot->end());
+        WRITE_LOCK(&d_bucket_locks[cnt]);
+        try {
+            if (get_cache_table()[cnt]) {
+                HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
+                for_each(slot->begin(), slot->end(), DeleteBySize(*this, size));
+                slot->erase(remove(slot->begin(), slot->end(),
+                                   static_cast<HTTPCacheTable::CacheEntry*>(0)),
+                            slot->end());
 
+            }
+        }
+        catch (...) {
+            RW_UNLOCK(&d_bucket_locks[cnt]);
+            throw;
         }
+        RW_UNLOCK(&d_bucket_locks[cnt]);
     }
 }
 
 /** @name Cache Index
 
-    These methods manage the cache's index file. Each cache holds an index
-    file named \c .index which stores the cache's state information. */
+    These methods manage the cache's index. The index is a snapshot file
+    named \c .index.bin and a journal named \c .index.journal that holds the
+    changes made since the snapshot was written. Both files start with a
+    header that names the file type, its version and the size of the
+    fixed-length part of each record. An entry is stored as an IndexRecord
+    followed by the entry's URL, cache name and ETag. A journal record is a
+    one byte type code followed by:
+    <ul>
+    <li>'A' (add or replace): An entry stored as in the snapshot.</li>
+    <li>'D' (delete): The length of the URL, the URL, the length of the
+    entry's cache name and the cache name.</li>
+    <li>'H' (hits): The hit count, the length of the URL and the URL.</li>
+    </ul>
+    Replaying a journal record more than once has the same result as
+    replaying it once, so a journal may safely overlap a snapshot. The
+    files use the host's byte order; they are not meant to be moved to
+    another kind of computer.
+
+    When the cache is shared by several processes, each appends its
+    records to the journal with one write(2) while holding the journal's
+    lock, and reads the records the others have appended in
+    sync_index(). A delete record names the entry's cache name so that a
+    process with an out of date table cannot remove an entry another
+    process has just replaced.
+
+    The ASCII index file \c .index used by older versions of the library is
+    read when there is no snapshot and is removed once a snapshot has been
+    written. */
 
 //@{
 
-/** Remove the cache index file.
+/** The header of the index snapshot and journal files. */
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+/** The fixed-length part of one entry in the index snapshot or journal. */
+struct IndexRecord {
+    int64_t lm;
+    int64_t expires;
+    int64_t size;
+    int64_t freshness_lifetime;
+    int64_t response_time;
+    int64_t corrected_initial_age;
+    int32_t hits;
+    uint32_t url_len;
+    uint32_t cachename_len;
+    uint32_t etag_len;
+    uint8_t range;
+    uint8_t must_revalidate;
+    uint8_t pad[6];
+};
+
+static void
+put_bytes(string &buf, const void *src, size_t n)
+{
+    buf.append(static_cast<const char *>(src), n);
+}
+
+static void
+put_string(string &buf, const string &s)
+{
+    uint32_t len = s.size();
+    put_bytes(buf, &len, sizeof(len));
+    buf.append(s);
+}
+
+static bool
+get_bytes(const string &buf, string::size_type &pos, void *dest, size_t n)
+{
+    if (buf.size() - pos < n)
+        return false;
+
+    memcpy(dest, buf.data() + pos, n);
+    pos += n;
+    return true;
+}
+
+static bool
+get_string(const string &buf, string::size_type &pos, uint32_t len, string &s)
+{
+    if (len > MAX_INDEX_STRING || buf.size() - pos < len)
+        return false;
+
+    s.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+static bool
+get_string(const string &buf, string::size_type &pos, string &s)
+{
+    uint32_t len;
+    return get_bytes(buf, pos, &len, sizeof(len)) && get_string(buf, pos, len, s);
+}
+
+static void
+encode_index_header(string &buf, const char *magic, uint32_t version)
+{
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = version;
+    header.record_size = sizeof(IndexRecord);
+
+    put_bytes(buf, &header, sizeof(header));
+}
+
+static bool
+check_index_header(const string &buf, const char *magic, uint32_t version)
+{
+    IndexHeader header;
+    string::size_type pos = 0;
+    if (!get_bytes(buf, pos, &header, sizeof(header)))
+        return false;
+
+    return memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.version == version
+        && header.record_size == sizeof(IndexRecord);
+}
+
+static bool
+write_index_header(FILE *fp, const char *magic, uint32_t version)
+{
+    string buf;
+    encode_index_header(buf, magic, version);
+
+    return fwrite(buf.data(), buf.size(), 1, fp) == 1;
+}
+
+static bool
+read_index_header(FILE *fp, const char *magic, uint32_t version)
+{
+    string buf(sizeof(IndexHeader), '\0');
+    if (fread(&buf[0], buf.size(), 1, fp) != 1)
+        return false;
+
+    return check_index_header(buf, magic, version);
+}
+
+/** Read a whole file.
+    @return False if the file could not be opened or read. */
+static bool
+read_file(const string &name, string &data)
+{
+    FILE *fp = fopen(name.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.append(buf, n);
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+
+    return ok;
+}
+
+/** Lock or unlock one byte of a file using fcntl(2). These locks are held
+    by the process, so threads must not use the same byte at the same time.
+
+    @param fd The file.
+    @param type F_RDLCK, F_WRLCK or F_UNLCK.
+    @param offset The byte.
+    @param wait If true, wait for the lock; otherwise return false if
+    another process holds it.
+    @return True if the lock was set. */
+bool
+HTTPCacheTable::lock_file_byte(int fd, short type, off_t offset, bool wait)
+{
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = offset;
+    lock.l_len = 1;
+
+    int status;
+    while ((status = fcntl(fd, wait ? F_SETLKW : F_SETLK, &lock)) == -1 && errno == EINTR)
+        ;
+
+    return status == 0;
+}
+
+/** Add one entry, as stored in the index, to \c buf. */
+void
+HTTPCacheTable::encode_index_record(string &buf, CacheEntry *entry)
+{
+    IndexRecord r;
+    memset(&r, 0, sizeof(r));
+    r.lm = entry->lm;
+    r.expires = entry->expires;
+    r.size = entry->size;
+    r.freshness_lifetime = entry->freshness_lifetime;
+    r.response_time = entry->response_time;
+    r.corrected_initial_age = entry->corrected_initial_age;
+    r.hits = entry->hits;
+    r.url_len = entry->url.size();
+    r.cachename_len = entry->cachename.size();
+    r.etag_len = entry->etag.size();
+    r.range = entry->range;
+    r.must_revalidate = entry->must_revalidate;
+
+    put_bytes(buf, &r, sizeof(r));
+    buf.append(entry->url);
+    buf.append(entry->cachename);
+    buf.append(entry->etag);
+}
+
+/** Read one entry, as stored in the index, from \c buf.
+
+    @param buf The bytes of an index file.
+    @param pos Value-result parameter; where the entry starts. On return,
+    where the next one starts.
+    @return A new CacheEntry or null if the record is truncated or
+    corrupt. */
+HTTPCacheTable::CacheEntry *
+HTTPCacheTable::decode_index_record(const string &buf, string::size_type &pos)
+{
+    IndexRecord r;
+    string url, cachename, etag;
+    if (!get_bytes(buf, pos, &r, sizeof(r)) || !get_string(buf, pos, r.url_len, url)
+        || !get_string(buf, pos, r.cachename_len, cachename) || !get_string(buf, pos, r.etag_len, etag)
+        || url.empty())
+        return 0;
+
+    CacheEntry *entry = new CacheEntry(url);
+    entry->cachename = cachename;
+    entry->etag = etag;
+    entry->lm = r.lm;
+    entry->expires = r.expires;
+    entry->size = r.size;
+    entry->range = r.range;
+    entry->hits = r.hits;
+    entry->freshness_lifetime = r.freshness_lifetime;
+    entry->response_time = r.response_time;
+    entry->corrected_initial_age = r.corrected_initial_age;
+    entry->must_revalidate = r.must_revalidate;
+
+    return entry;
+}
+
+/** Write one entry to the index snapshot.
+
+    @param fp Write to this file.
+    @param entry The entry to write.
+    @exception Error Thrown if the entry cannot be written. */
+void
+HTTPCacheTable::write_index_record(FILE *fp, CacheEntry *entry)
+{
+    string buf;
+    encode_index_record(buf, entry);
+
+    if (fwrite(buf.data(), buf.size(), 1, fp) != 1)
+        throw Error(internal_error, "Cache Index. Error writing cache index\n");
+}
+
+/** Read one entry from the index snapshot.
+
+    @param fp Read from this file.
+    @return A new CacheEntry or null if the file is at its end or the record
+    is truncated or corrupt. */
+HTTPCacheTable::CacheEntry *
+HTTPCacheTable::read_index_record(FILE *fp)
+{
+    string buf(sizeof(IndexRecord), '\0');
+    if (fread(&buf[0], buf.size(), 1, fp) != 1)
+        return 0;
+
+    IndexRecord r;
+    memcpy(&r, buf.data(), sizeof(r));
+    if (r.url_len > MAX_INDEX_STRING || r.cachename_len > MAX_INDEX_STRING || r.etag_len > MAX_INDEX_STRING)
+        return 0;
+
+    size_t len = r.url_len + r.cachename_len + r.etag_len;
+    buf.resize(sizeof(r) + len);
+    if (len > 0 && fread(&buf[sizeof(r)], len, 1, fp) != 1)
+        return 0;
+
+    string::size_type pos = 0;
+    return decode_index_record(buf, pos);
+}
+
+/** Remove the cache index files.
 
     A private method.
 
-    @return True if the file was deleted, otherwise false. */
+    @return True if the index was deleted, otherwise false. */
 
 bool
 HTTPCacheTable::cache_index_delete()
 {
-	d_new_entries = 0;
-	
-    return (REMOVE_BOOL(d_cache_index.c_str()) == 0);
+    LOCK(&d_journal_lock);
+    close_journal();
+    d_journal_name = "";
+    d_journal_records = 0;
+    d_journal_failed = false;
+    d_journal_buffer.clear();
+    UNLOCK(&d_journal_lock);
+
+    d_new_entries = 0;
+
+    string journal = d_cache_index + CACHE_INDEX_JOURNAL;
+    REMOVE(journal.c_str());
+    REMOVE(string(journal + CACHE_INDEX_OLD).c_str());
+
+    bool snapshot = (REMOVE_BOOL(string(d_cache_index + CACHE_INDEX_SNAPSHOT).c_str()) == 0);
+    bool ascii = (REMOVE_BOOL(d_cache_index.c_str()) == 0);
+
+    return snapshot || ascii;
+}
+
+/** Add an entry to a set of entries read from the index (see
+    reload_index()), replacing any entry for the same URL. */
+static void
+add_index_entry(map<string, HTTPCacheTable::CacheEntry *> &entries, const string &url,
+    HTTPCacheTable::CacheEntry *entry)
+{
+    HTTPCacheTable::CacheEntry *&e = entries[url];
+    delete e;
+    e = entry;
+}
+
+/** Load the entries in an index snapshot.
+
+    @param name The snapshot's pathname.
+    @param entries If not null, add the entries to this set instead of the
+    table.
+    @return True if the snapshot was found and read, otherwise false. */
+bool
+HTTPCacheTable::read_index_snapshot(const string &name, map<string, CacheEntry *> *entries)
+{
+    FILE *fp = fopen(name.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    if (!read_index_header(fp, INDEX_SNAPSHOT_MAGIC, INDEX_VERSION)) {
+        DBG(cerr << "Cache Index. Ignoring snapshot with a bad header: " << name << endl);
+        fclose(fp);
+        return false;
+    }
+
+    try {
+        CacheEntry *entry;
+        while ((entry = read_index_record(fp)) != 0) {
+            if (entries)
+                add_index_entry(*entries, entry->url, entry);
+            else
+                add_entry_to_bucket(entry, false, false);
+        }
+    }
+    catch (...) {
+        fclose(fp);
+        throw;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/** Apply journal records to the in-memory table. The entries' files are
+    not touched; they were written or removed when the change was
+    journaled. Replay stops at a truncated or corrupt record (e.g., one
+    that was being written when a program crashed).
+
+    @param buf The records.
+    @param entries If not null, apply the records to this set of entries
+    instead of the table.
+    @param length If not null, set to the length of the records before the
+    first truncated or corrupt one.
+    @return False if a truncated or corrupt record was found. */
+bool
+HTTPCacheTable::replay_journal_records(const string &buf, map<string, CacheEntry *> *entries,
+    string::size_type *length)
+{
+    string::size_type pos = 0;
+    string::size_type record = 0;
+    bool ok = true;
+    while (ok && pos < buf.size()) {
+        record = pos;
+        switch (buf[pos++]) {
+        case JOURNAL_ADD: {
+            CacheEntry *entry = decode_index_record(buf, pos);
+            if ((ok = (entry != 0))) {
+                if (entries)
+                    add_index_entry(*entries, entry->url, entry);
+                else
+                    drop_entry_from_bucket(entry->url, "", entry);
+            }
+            break;
+        }
+
+        case JOURNAL_REMOVE: {
+            string url, cachename;
+            if ((ok = get_string(buf, pos, url) && get_string(buf, pos, cachename))) {
+                if (entries) {
+                    map<string, CacheEntry *>::iterator i = entries->find(url);
+                    if (i != entries->end() && (cachename.empty() || i->second->cachename == cachename)) {
+                        delete i->second;
+                        entries->erase(i);
+                    }
+                }
+                else {
+                    drop_entry_from_bucket(url, cachename);
+                }
+            }
+            break;
+        }
+
+        case JOURNAL_HITS: {
+            int32_t hits;
+            string url;
+            ok = get_bytes(buf, pos, &hits, sizeof(hits)) && get_string(buf, pos, url);
+            if (ok && entries) {
+                map<string, CacheEntry *>::iterator i = entries->find(url);
+                if (i != entries->end())
+                    i->second->hits = max(i->second->hits, static_cast<int>(hits));
+            }
+            else if (ok) {
+                // Hits may be journaled out of order by different threads;
+                // the largest count is the newest. Replaying hits also
+                // restores the order of the LRU list.
+                int hash = get_hash(url);
+                READ_LOCK(&d_bucket_locks[hash]);
+                try {
+                    CacheEntries *cp = d_cache_table[hash];
+                    if (cp)
+                        for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i)
+                            if (*i && (*i)->url == url) {
+                                LOCK(&d_table_lock);
+                                (*i)->hits = max((*i)->hits, static_cast<int>(hits));
+                                UNLOCK(&d_table_lock);
+                                lru_touch(*i);
+                            }
+                }
+                catch (...) {
+                    RW_UNLOCK(&d_bucket_locks[hash]);
+                    throw;
+                }
+                RW_UNLOCK(&d_bucket_locks[hash]);
+            }
+            break;
+        }
+
+        default:
+            ok = false;
+            break;
+        }
+    }
+
+    DBG(if (!ok) cerr << "Cache Index. Stopped replaying a corrupt journal" << endl);
+
+    if (length)
+        *length = ok ? pos : record;
+
+    return ok;
+}
+
+/** Replay the records in a journal file.
+
+    @param name The journal's pathname.
+    @param entries If not null, apply the records to this set of entries
+    instead of the table.
+    @return True if the journal was found and replayed, otherwise false. */
+bool
+HTTPCacheTable::replay_journal(const string &name, map<string, CacheEntry *> *entries)
+{
+    string buf;
+    if (!read_file(name, buf))
+        return false;
+
+    if (!check_index_header(buf, INDEX_JOURNAL_MAGIC, JOURNAL_VERSION)) {
+        DBG(cerr << "Cache Index. Ignoring journal with a bad header: " << name << endl);
+        return false;
+    }
+
+    replay_journal_records(buf.substr(sizeof(IndexHeader)), entries);
+    return true;
+}
+
+/** Read the snapshot and the journals. If the cache is shared, the
+    journal is read using d_journal_fd so that sync_index() can later read
+    the records appended after this. Call with the index lock byte locked
+    (if the cache is shared).
+
+    @param entries If not null, add the entries to this set instead of the
+    table.
+    @return True when a cache index was found and read, false otherwise. */
+bool
+HTTPCacheTable::load_index(map<string, CacheEntry *> *entries)
+{
+    bool found = read_index_snapshot(d_cache_index + CACHE_INDEX_SNAPSHOT, entries);
+
+    if (!found) {
+        FILE *fp = fopen(d_cache_index.c_str(), "r");
+        // If the cache index can't be opened that's OK; start with an empty
+        // cache. 09/05/02 jhrg
+        if (fp) {
+            char line[1024];
+            while (!feof(fp) && fgets(line, 1024, fp)) {
+                CacheEntry *entry = cache_index_parse_line(line);
+                if (entries)
+                    add_index_entry(*entries, entry->url, entry);
+                else
+                    add_entry_to_bucket(entry, false, false);
+                DBG2(cerr << line << endl);
+            }
+
+            int res = fclose(fp) ;
+            if (res) {
+                DBG(cerr << "HTTPCache::cache_index_read - Failed to close " << (void *)fp << endl);
+            }
+
+            found = true;
+        }
+    }
+
+    string journal = d_cache_index + CACHE_INDEX_JOURNAL;
+    found = replay_journal(journal + CACHE_INDEX_OLD, entries) || found;
+
+    if (d_lock_fd < 0)
+        return replay_journal(journal, entries) || found;
+
+    // Read the journal up to its current end; sync_index() reads the rest
+    string records;
+    LOCK(&d_journal_lock);
+    lock_file_byte(d_lock_fd, F_WRLCK, JOURNAL_LOCK_BYTE, true);
+    try {
+        close_journal();
+        if (open_journal()) {
+            found = d_journal_offset > static_cast<off_t>(sizeof(IndexHeader)) || found;
+            d_journal_offset = sizeof(IndexHeader);
+            read_journal(records);
+        }
+    }
+    catch (...) {
+        lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+        UNLOCK(&d_journal_lock);
+        throw;
+    }
+    lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+    UNLOCK(&d_journal_lock);
+
+    replay_journal_records(records, entries);
+
+    return found;
 }
 
 /** Read the saved set of cached entries from disk. Consistency between the
     in-memory cache and the index is maintained by only reading the index
-    file when the HTTPCache object is created!
+    when the HTTPCache object is created! (When the cache is shared, the
+    changes other processes make are read by sync_index().)
+
+    The index snapshot is loaded if there is one, otherwise the ASCII index
+    file is imported. Then the journal left by an interrupted compaction
+    and the current journal are replayed.
 
     A private method.
 
@@ -297,30 +961,179 @@ HTTPCacheTable::cache_index_delete()
 bool
 HTTPCacheTable::cache_index_read()
 {
-    FILE *fp = fopen(d_cache_index.c_str(), "r");
-    // If the cache index can't be opened that's OK; start with an empty
-    // cache. 09/05/02 jhrg
-    if (!fp) {
-        return false;
+    // Wait if another process is writing a snapshot
+    if (d_lock_fd >= 0)
+        lock_file_byte(d_lock_fd, F_RDLCK, INDEX_LOCK_BYTE, true);
+
+    bool found;
+    try {
+        found = load_index(0);
     }
+    catch (...) {
+        if (d_lock_fd >= 0)
+            lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+        throw;
+    }
+
+    if (d_lock_fd >= 0)
+        lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+
+    d_new_entries = 0;
+
+    return found;
+}
 
-    char line[1024];
-    while (!feof(fp) && fgets(line, 1024, fp)) {
-    	add_entry_to_cache_table(cache_index_parse_line(line));
-        DBG2(cerr << line << endl);
+/** Another process wrote a new snapshot and started a new journal, so
+    read them and bring the table up to date. Entries that match those in
+    the index are kept (and their information updated). Entries whose
+    files have been removed are dropped and entries in the index that are
+    not in the table are added. Call with d_sync_lock locked. */
+void
+HTTPCacheTable::reload_index()
+{
+    DBG(cerr << "Cache Index. Reloading the index" << endl);
+
+    map<string, CacheEntry *> entries;
+
+    LOCK(&d_index_write_lock);
+    lock_file_byte(d_lock_fd, F_RDLCK, INDEX_LOCK_BYTE, true);
+    try {
+        load_index(&entries);
+    }
+    catch (...) {
+        lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+        UNLOCK(&d_index_write_lock);
+        for (map<string, CacheEntry *>::iterator i = entries.begin(); i != entries.end(); ++i)
+            delete i->second;
+        throw;
     }
+    lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+    UNLOCK(&d_index_write_lock);
 
-    int res = fclose(fp) ;
-    if (res) {
-        DBG(cerr << "HTTPCache::cache_index_read - Failed to close " << (void *)fp << endl);
+    for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
+        WRITE_LOCK(&d_bucket_locks[cnt]);
+        try {
+            CacheEntries *cp = d_cache_table[cnt];
+            for (CacheEntriesIter i = cp ? cp->begin() : CacheEntriesIter(); cp && i != cp->end(); ++i) {
+                CacheEntry *e = *i;
+                if (!e)
+                    continue;
+
+                map<string, CacheEntry *>::iterator f = entries.find(e->url);
+                if (f != entries.end() && f->second->cachename == e->cachename) {
+                    // The same response; it may have been updated or hit
+                    CacheEntry *n = f->second;
+                    LOCK(&d_table_lock);
+                    unsigned long eds = entry_disk_space(e->size, d_block_size);
+                    d_current_size = (eds > d_current_size) ? 0 : d_current_size - eds;
+                    d_current_size += entry_disk_space(n->size, d_block_size);
+                    e->hits = max(e->hits, n->hits);
+                    UNLOCK(&d_table_lock);
+
+                    e->etag = n->etag;
+                    e->lm = n->lm;
+                    e->expires = n->expires;
+                    e->size = n->size;
+                    e->freshness_lifetime = n->freshness_lifetime;
+                    e->response_time = n->response_time;
+                    e->corrected_initial_age = n->corrected_initial_age;
+                    e->must_revalidate = n->must_revalidate;
+
+                    delete n;
+                    entries.erase(f);
+                }
+                else if (access(e->cachename.c_str(), F_OK) != 0) {
+                    // Removed or replaced by another process
+                    unsigned long eds = entry_disk_space(e->size, d_block_size);
+                    LOCK(&d_table_lock);
+                    d_current_size = (eds > d_current_size) ? 0 : d_current_size - eds;
+                    UNLOCK(&d_table_lock);
+
+                    lru_unlink(e);
+                    demote_entry(e);
+                    retire_entry(e);
+                    *i = 0;
+                }
+                else if (f != entries.end()) {
+                    // This process replaced it after the index was read
+                    delete f->second;
+                    entries.erase(f);
+                }
+            }
+
+            if (cp)
+                cp->erase(remove(cp->begin(), cp->end(), static_cast<CacheEntry *>(0)), cp->end());
+        }
+        catch (...) {
+            RW_UNLOCK(&d_bucket_locks[cnt]);
+            for (map<string, CacheEntry *>::iterator i = entries.begin(); i != entries.end(); ++i)
+                delete i->second;
+            throw;
+        }
+        RW_UNLOCK(&d_bucket_locks[cnt]);
     }
 
-    d_new_entries = 0;
-    
-    return true;
+    // What's left are responses that were added by other processes
+    for (map<string, CacheEntry *>::iterator i = entries.begin(); i != entries.end(); ++i)
+        drop_entry_from_bucket(i->first, "", i->second);
+}
+
+/** Bring the table up to date with the changes other processes have made
+    to the cache. This reads the records they have appended to the journal
+    since it was last called. If one of them wrote a new snapshot, the
+    whole index is read again. This does nothing if the cache is not
+    shared.
+
+    HTTPCache calls this before it looks up or changes a URL's entry. */
+void
+HTTPCacheTable::sync_index()
+{
+    if (d_lock_fd < 0)
+        return;
+
+    LOCK(&d_sync_lock);
+    try {
+        sync_index_locked();
+    }
+    catch (...) {
+        UNLOCK(&d_sync_lock);
+        throw;
+    }
+    UNLOCK(&d_sync_lock);
 }
 
-/** Parse one line of the index file.
+/** Do the work of sync_index(). Call with d_sync_lock locked. */
+void
+HTTPCacheTable::sync_index_locked()
+{
+    string records;
+    bool rotated;
+
+    LOCK(&d_journal_lock);
+    lock_file_byte(d_lock_fd, F_RDLCK, JOURNAL_LOCK_BYTE, true);
+    try {
+        read_journal(records);
+    }
+    catch (...) {
+        lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+        UNLOCK(&d_journal_lock);
+        throw;
+    }
+    lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+    rotated = d_journal_rotated;
+    d_journal_rotated = false;
+    UNLOCK(&d_journal_lock);
+
+    // A new snapshot holds everything in the old journal
+    if (rotated)
+        reload_index();
+    else if (!records.empty())
+        replay_journal_records(records);
+
+    free_retired_entries();
+}
+
+/** Parse one line of the ASCII index file.
 
     A private method.
 
@@ -356,42 +1169,19 @@ HTTPCacheTable::cache_index_parse_line(const char *line)
     return entry;
 }
 
-/** Functor which writes a single CacheEntry to the \c .index file. */
-
-class WriteOneCacheEntry :
-	public unary_function<HTTPCacheTable::CacheEntry *, void>
-{
-
-    FILE *d_fp;
-
-public:
-    WriteOneCacheEntry(FILE *fp) : d_fp(fp)
-    {}
-
-    void operator()(HTTPCacheTable::CacheEntry *e)
-    {
-        if (e && fprintf(d_fp,
-                         "%s %s %s %ld %ld %ld %c %d %d %ld %ld %ld %c\r\n",
-                         e->url.c_str(),
-                         e->cachename.c_str(),
-                         e->etag == "" ? CACHE_EMPTY_ETAG : e->etag.c_str(),
-                         (long)(e->lm),
-                         (long)(e->expires),
-                         e->size,
-                         e->range ? '1' : '0', // not used. 10/02/02 jhrg
-                         e->hash,
-                         e->hits,
-                         (long)(e->freshness_lifetime),
-                         (long)(e->response_time),
-                         (long)(e->corrected_initial_age),
-                         e->must_revalidate ? '1' : '0') < 0)
-            throw Error(internal_error, "Cache Index. Error writing cache index\n");
-    }
-};
+/** Walk through the list of cached objects and write the index snapshot to
+    disk. The snapshot is written to a temporary file which then replaces
+    the old snapshot, so a crash never leaves a partial snapshot. The
+    current journal is set aside first and removed once the snapshot is in
+    place; changes made while the snapshot is written go to a new journal.
+    As a side effect, zero the new_entries counter.
 
-/** Walk through the list of cached objects and write the cache index file to
-    disk. If the file does not exist, it is created. If the file does exist,
-    it is overwritten. As a side effect, zero the new_entries counter.
+    This is run in a background thread once the journal is large, but it
+    may also be called directly; only one snapshot is written at a time.
+    When the cache is shared, the table is first brought up to date and
+    other processes are kept from appending to the journal while it is set
+    aside. If another process is reading or writing the index, no snapshot
+    is written; the journal keeps growing until the next try.
 
     A private method.
 
@@ -403,30 +1193,522 @@ HTTPCacheTable::cache_index_write()
 {
     DBG(cerr << "Cache Index. Writing index " << d_cache_index << endl);
 
-    // Open the file for writing.
+    bool shared = d_lock_fd >= 0;
+
+    LOCK(&d_sync_lock);
+    try {
+        if (shared)
+            sync_index_locked();
+    }
+    catch (...) {
+        UNLOCK(&d_sync_lock);
+        throw;
+    }
+
+    LOCK(&d_index_write_lock);
+
+    if (shared && !lock_file_byte(d_lock_fd, F_WRLCK, INDEX_LOCK_BYTE, false)) {
+        DBG(cerr << "Cache Index. Another process is using the index; not writing it" << endl);
+        UNLOCK(&d_index_write_lock);
+        UNLOCK(&d_sync_lock);
+        return;
+    }
+
+    // Set the journal aside; the next change starts a new one. Records
+    // other processes appended since the table was brought up to date are
+    // applied before the snapshot is written.
+    string records;
+    LOCK(&d_journal_lock);
+    if (shared)
+        lock_file_byte(d_lock_fd, F_WRLCK, JOURNAL_LOCK_BYTE, true);
+    flush_journal();
+    if (shared)
+        read_journal(records);
+    close_journal();
+    string journal = d_journal_name.empty() ? d_cache_index + CACHE_INDEX_JOURNAL : d_journal_name;
+    string old_journal = journal + CACHE_INDEX_OLD;
+    set_journal_aside(journal, old_journal);
+    d_journal_name = "";
+    d_journal_records = 0;
+    d_journal_failed = false;
+    if (shared)
+        lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+    UNLOCK(&d_journal_lock);
+
+    string snapshot = d_cache_index + CACHE_INDEX_SNAPSHOT;
+    string tmp = snapshot + CACHE_INDEX_TMP;
+
     FILE * fp = NULL;
-    if ((fp = fopen(d_cache_index.c_str(), "wb")) == NULL) {
-        throw Error(string("Cache Index. Can't open `") + d_cache_index
-                    + string("' for writing"));
+    try {
+        replay_journal_records(records);
+
+        // Open the file for writing.
+        if ((fp = fopen(tmp.c_str(), "wb")) == NULL)
+            throw Error(string("Cache Index. Can't open `") + tmp + string("' for writing"));
+
+        if (!write_index_header(fp, INDEX_SNAPSHOT_MAGIC, INDEX_VERSION))
+            throw Error(internal_error, "Cache Index. Error writing cache index\n");
+
+        for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
+            READ_LOCK(&d_bucket_locks[cnt]);
+            try {
+                HTTPCacheTable::CacheEntries *cp = get_cache_table()[cnt];
+                if (cp)
+                    for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i)
+                        if (*i)
+                            write_index_record(fp, *i);
+            }
+            catch (...) {
+                RW_UNLOCK(&d_bucket_locks[cnt]);
+                throw;
+            }
+            RW_UNLOCK(&d_bucket_locks[cnt]);
+        }
+
+        /* Done writing */
+        if (fclose(fp) != 0) {
+            fp = 0;
+            throw Error(internal_error, "Cache Index. Error writing cache index\n");
+        }
+        fp = 0;
+
+        if (rename(tmp.c_str(), snapshot.c_str()) != 0)
+            throw Error(string("Cache Index. Can't replace `") + snapshot + string("'"));
+    }
+    catch (...) {
+        if (fp)
+            fclose(fp);
+        REMOVE(tmp.c_str());
+        if (shared)
+            lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+        UNLOCK(&d_index_write_lock);
+        UNLOCK(&d_sync_lock);
+        throw;
+    }
+
+    // The snapshot holds everything in the old journal and the ASCII index
+    REMOVE(old_journal.c_str());
+    REMOVE(d_cache_index.c_str());
+
+    if (shared)
+        lock_file_byte(d_lock_fd, F_UNLCK, INDEX_LOCK_BYTE, true);
+    UNLOCK(&d_index_write_lock);
+    UNLOCK(&d_sync_lock);
+
+    LOCK(&d_table_lock);
+    d_new_entries = 0;
+    UNLOCK(&d_table_lock);
+}
+
+/** Move the journal to \c old_journal, where it stays until a snapshot
+    holds its records. If a compaction that failed left an old journal
+    there, its records have not been written to a snapshot either; the
+    journal's records are added to it, after the last one that can be
+    replayed. If that can't be done the journal is left where it is and
+    new records are appended to it; a journal may overlap a snapshot.
+    Call with d_journal_lock locked and the journal closed. */
+void
+HTTPCacheTable::set_journal_aside(const string &journal, const string &old_journal)
+{
+    string old_buf;
+    if (!read_file(old_journal, old_buf) || !check_index_header(old_buf, INDEX_JOURNAL_MAGIC, JOURNAL_VERSION)) {
+        (void) rename(journal.c_str(), old_journal.c_str());
+        return;
+    }
+
+    string buf;
+    if (!read_file(journal, buf))
+        return;     // no journal
+
+    // Find the end of the old journal's good records without changing the
+    // table
+    map<string, CacheEntry *> scratch;
+    string::size_type length;
+    replay_journal_records(old_buf.substr(sizeof(IndexHeader)), &scratch, &length);
+    for (map<string, CacheEntry *>::iterator i = scratch.begin(); i != scratch.end(); ++i)
+        delete i->second;
+
+    old_buf.resize(sizeof(IndexHeader) + length);
+    if (check_index_header(buf, INDEX_JOURNAL_MAGIC, JOURNAL_VERSION))
+        old_buf.append(buf, sizeof(IndexHeader), string::npos);
+
+    string tmp = old_journal + CACHE_INDEX_TMP;
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    bool ok = fp && fwrite(old_buf.data(), old_buf.size(), 1, fp) == 1;
+    if (fp && fclose(fp) != 0)
+        ok = false;
+
+    if (ok && rename(tmp.c_str(), old_journal.c_str()) == 0) {
+        REMOVE(journal.c_str());
+    }
+    else {
+        DBG(cerr << "Cache Index. Could not add the journal to " << old_journal << endl);
+        REMOVE(tmp.c_str());
+    }
+}
+
+/** Run by the compaction thread. */
+void *
+HTTPCacheTable::index_compaction_thread(void *arg)
+{
+    HTTPCacheTable *table = static_cast<HTTPCacheTable*>(arg);
+
+    try {
+        table->cache_index_write();
+    }
+    catch (Error &e) {
+        DBG(cerr << "Cache Index. Compaction failed: " << e.get_error_message() << endl);
+    }
+
+    pthread_mutex_lock(&table->d_journal_lock);
+    table->d_compacting = false;
+    pthread_mutex_unlock(&table->d_journal_lock);
+
+    return 0;
+}
+
+/** Start a thread that writes a new index snapshot, unless one is already
+    running. Call with d_journal_lock locked. If the thread cannot be
+    started the journal simply grows until the next try. */
+void
+HTTPCacheTable::start_index_compaction()
+{
+    if (d_compacting)
+        return;
+
+    // A finished thread must still be joined
+    if (d_compaction_started) {
+        pthread_join(d_compaction_thread, 0);
+        d_compaction_started = false;
+    }
+
+    d_compacting = true;
+    if (pthread_create(&d_compaction_thread, 0, index_compaction_thread, this) != 0) {
+        DBG(cerr << "Cache Index. Could not start the compaction thread" << endl);
+        d_compacting = false;
+        return;
+    }
+
+    d_compaction_started = true;
+}
+
+/** Open the journal for appending if it is not already open. A new journal
+    gets a header. Call with d_journal_lock locked and, if the cache is
+    shared, the journal lock byte locked for writing.
+
+    @return True if the journal is open. */
+bool
+HTTPCacheTable::open_journal()
+{
+    if (d_journal_fd >= 0)
+        return true;
+
+    if (d_journal_failed)
+        return false;
+
+    d_journal_name = d_cache_index + CACHE_INDEX_JOURNAL;
+    d_journal_fd = open(d_journal_name.c_str(), O_RDWR | O_APPEND | O_CREAT, 0666);
+    if (d_journal_fd < 0) {
+        d_journal_failed = true;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(d_journal_fd, &st) != 0) {
+        close_journal();
+        d_journal_failed = true;
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        string header;
+        encode_index_header(header, INDEX_JOURNAL_MAGIC, JOURNAL_VERSION);
+        if (write(d_journal_fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+            close_journal();
+            d_journal_failed = true;
+            return false;
+        }
+    }
+
+    // The records already in the journal are in the table
+    d_journal_offset = max(static_cast<off_t>(sizeof(IndexHeader)), static_cast<off_t>(st.st_size));
+    d_own_records.clear();
+
+    return true;
+}
+
+/** Close the journal. Call with d_journal_lock locked. */
+void
+HTTPCacheTable::close_journal()
+{
+    if (d_journal_fd >= 0)
+        close(d_journal_fd);
+
+    d_journal_fd = -1;
+    d_own_records.clear();
+}
+
+/** Has another process set the journal aside (to write a new snapshot)
+    since it was opened? Call with d_journal_lock locked and the journal
+    open. */
+bool
+HTTPCacheTable::is_journal_rotated()
+{
+    struct stat open_st, named_st;
+    if (fstat(d_journal_fd, &open_st) != 0)
+        return true;
+
+    return stat(d_journal_name.c_str(), &named_st) != 0 || open_st.st_ino != named_st.st_ino
+        || open_st.st_dev != named_st.st_dev;
+}
+
+/** Read the records other processes have appended to the journal since it
+    was last read, skipping the ones this process wrote. If the journal was
+    set aside, it's closed and d_journal_rotated is set. Call with
+    d_journal_lock and the journal lock byte locked.
+
+    @param data Value-result parameter; the records are appended to this. */
+void
+HTTPCacheTable::read_journal(string &data)
+{
+    if (d_journal_fd < 0 && !open_journal())
+        return;
+
+    if (is_journal_rotated()) {
+        d_journal_rotated = true;
+        close_journal();
+        return;
+    }
+
+    struct stat st;
+    if (fstat(d_journal_fd, &st) != 0)
+        return;
+
+    off_t pos = d_journal_offset;
+    while (pos < st.st_size) {
+        map<off_t, off_t>::iterator own = d_own_records.lower_bound(pos);
+        off_t end = (own != d_own_records.end() && own->first < st.st_size) ? own->first : st.st_size;
+
+        while (pos < end) {
+            char buf[4096];
+            ssize_t n = pread(d_journal_fd, buf, min(static_cast<off_t>(sizeof(buf)), end - pos), pos);
+            if (n <= 0) {
+                d_journal_offset = pos;
+                return;
+            }
+            data.append(buf, n);
+            pos += n;
+        }
+
+        if (own != d_own_records.end() && own->first == pos) {
+            pos += own->second;
+            d_own_records.erase(own);
+        }
+    }
+
+    d_own_records.erase(d_own_records.begin(), d_own_records.lower_bound(pos));
+    d_journal_offset = pos;
+}
+
+/** Write the buffered records to the journal using one write(2). If the
+    records could not be written, the journal is closed and nothing more
+    is journaled until the next snapshot is written, since a partly
+    written record ends the journal's replay. The in-memory table is still
+    correct and it is written when the cache is closed. Call with
+    d_journal_lock locked and, if the cache is shared, the journal lock
+    byte locked for writing.
+
+    @return True if the records were written. */
+bool
+HTTPCacheTable::flush_journal()
+{
+    if (d_journal_buffer.empty())
+        return true;
+
+    // Another process started a new journal; this process reloads the
+    // index the next time it syncs.
+    if (d_lock_fd >= 0 && d_journal_fd >= 0 && is_journal_rotated()) {
+        d_journal_rotated = true;
+        close_journal();
+    }
+
+    bool ok = open_journal();
+    if (ok) {
+        ok = write(d_journal_fd, d_journal_buffer.data(), d_journal_buffer.size())
+            == static_cast<ssize_t>(d_journal_buffer.size());
+
+        // Other processes read these; this one already has them
+        if (ok && d_lock_fd >= 0) {
+            off_t end = lseek(d_journal_fd, 0, SEEK_CUR);
+            d_own_records[end - d_journal_buffer.size()] = d_journal_buffer.size();
+        }
+    }
+
+    d_journal_buffer.clear();
+
+    if (!ok && d_journal_fd >= 0) {
+        DBG(cerr << "Cache Index. Could not write to the journal " << d_journal_name << endl);
+        close_journal();
+        d_journal_failed = true;
+    }
+
+    return ok;
+}
+
+/** Add a record to the journal. Call with d_journal_lock locked. Records
+    are buffered; unless \c flush is true they are written once the buffer
+    is full or when the next flushed record is added.
+
+    @param record The record.
+    @param flush True if the record should be written now. */
+void
+HTTPCacheTable::journal_append(const string &record, bool flush)
+{
+    if (d_journal_failed)
+        return;
+
+    d_journal_buffer.append(record);
+
+    if (flush || d_journal_buffer.size() >= JOURNAL_BUFFER_SIZE) {
+        if (d_lock_fd >= 0)
+            lock_file_byte(d_lock_fd, F_WRLCK, JOURNAL_LOCK_BYTE, true);
+        bool ok = flush_journal();
+        if (d_lock_fd >= 0)
+            lock_file_byte(d_lock_fd, F_UNLCK, JOURNAL_LOCK_BYTE, true);
+        if (!ok)
+            return;
+    }
+
+    if (++d_journal_records >= d_journal_compact_records)
+        start_index_compaction();
+}
+
+/** Record an entry that was added or changed. Call with the entry's bucket
+    locked, or the entry locked, so that it cannot be deleted. */
+void
+HTTPCacheTable::journal_add(CacheEntry *entry)
+{
+    string record(1, static_cast<char>(JOURNAL_ADD));
+    encode_index_record(record, entry);
+
+    LOCK(&d_journal_lock);
+    journal_append(record, true);
+    UNLOCK(&d_journal_lock);
+}
+
+/** Record the removal of an entry. */
+void
+HTTPCacheTable::journal_remove(CacheEntry *entry)
+{
+    string record(1, static_cast<char>(JOURNAL_REMOVE));
+    put_string(record, entry->url);
+    put_string(record, entry->cachename);
+
+    LOCK(&d_journal_lock);
+    journal_append(record, true);
+    UNLOCK(&d_journal_lock);
+}
+
+/** Record the new hit count for \c url. Hit counts are only used to pick
+    entries for garbage collection, so these records are not written right
+    away; they go to disk with the next add or remove, or when the cache is
+    closed. */
+void
+HTTPCacheTable::journal_hits(const string &url, int hits)
+{
+    string record(1, static_cast<char>(JOURNAL_HITS));
+    int32_t h = hits;
+    put_bytes(record, &h, sizeof(h));
+    put_string(record, url);
+
+    LOCK(&d_journal_lock);
+    journal_append(record, false);
+    UNLOCK(&d_journal_lock);
+}
+
+/** The byte of the lock file used to lock a URL's entry. */
+static off_t
+url_lock_byte(const string &url)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::const_iterator i = url.begin(); i != url.end(); ++i) {
+        hash ^= static_cast<unsigned char>(*i);
+        hash *= 1099511628211ULL;
     }
 
-    // Walk through the list and write it out. The format is really
-    // simple as we keep it all in ASCII.
+    return URL_LOCK_BYTE + static_cast<off_t>(hash % URL_LOCK_RANGE);
+}
+
+/** Lock the entry for \c url so that other processes cannot change it.
+    HTTPCache holds this lock while it adds, replaces or updates a URL's
+    response, so that two processes cannot both write a response for the
+    same URL. Threads in one process are kept apart by the entries' own
+    locks, so threads that lock the same URL share this lock. This does
+    nothing if the cache is not shared.
 
-    for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
-        HTTPCacheTable::CacheEntries *cp = get_cache_table()[cnt];
-        if (cp)
-            for_each(cp->begin(), cp->end(), WriteOneCacheEntry(fp));
+    A thread must hold only one URL lock at a time.
+
+    @param url The URL.
+    @return True if the entry is locked, or the cache is not shared; false
+    if the lock could not be set (which fcntl(2) only does when it finds a
+    deadlock). The caller must still call unlock_url(), but should not
+    change the entry since other processes are not kept out. */
+bool
+HTTPCacheTable::lock_url(const string &url)
+{
+    if (d_lock_fd < 0)
+        return true;
+
+    off_t byte = url_lock_byte(url);
+
+    LOCK(&d_url_lock);
+    if (d_url_locks[byte]++ > 0) {
+        // Another thread has it or is waiting for it
+        while (d_url_locks_held.find(byte) == d_url_locks_held.end())
+            pthread_cond_wait(&d_url_cond, &d_url_lock);
+        bool locked = d_url_locks_failed.find(byte) == d_url_locks_failed.end();
+        UNLOCK(&d_url_lock);
+        return locked;
     }
+    UNLOCK(&d_url_lock);
 
-    /* Done writing */
-    int res = fclose(fp);
-    if (res) {
-        DBG(cerr << "HTTPCache::cache_index_write - Failed to close "
-            << (void *)fp << endl);
+    // Wait for other processes without holding d_url_lock.
+    bool locked = lock_file_byte(d_lock_fd, F_WRLCK, byte, true);
+    if (!locked) {
+        DBG(cerr << "Could not lock the cache entry for " << url << endl);
     }
 
-    d_new_entries = 0;
+    // Wake the threads waiting for this byte even if it could not be
+    // locked; they find that out from d_url_locks_failed.
+    LOCK(&d_url_lock);
+    d_url_locks_held.insert(byte);
+    if (!locked)
+        d_url_locks_failed.insert(byte);
+    pthread_cond_broadcast(&d_url_cond);
+    UNLOCK(&d_url_lock);
+
+    return locked;
+}
+
+/** Release the lock made by lock_url(). This does not throw. */
+void
+HTTPCacheTable::unlock_url(const string &url)
+{
+    if (d_lock_fd < 0)
+        return;
+
+    off_t byte = url_lock_byte(url);
+
+    pthread_mutex_lock(&d_url_lock);
+    map<off_t, int>::iterator i = d_url_locks.find(byte);
+    if (i != d_url_locks.end() && --i->second == 0) {
+        d_url_locks.erase(i);
+        d_url_locks_held.erase(byte);
+        if (d_url_locks_failed.erase(byte) == 0)
+            lock_file_byte(d_lock_fd, F_UNLCK, byte, true);
+    }
+    pthread_mutex_unlock(&d_url_lock);
 }
 
 //@} End of the cache index methods.
@@ -537,39 +1819,89 @@ HTTPCacheTable::create_location(HTTPCacheTable::CacheEntry *entry)
 }
 
 
-/** compute real disk space for an entry. */
-static inline int
-entry_disk_space(int size, unsigned int block_size)
-{
-    unsigned int num_of_blocks = (size + block_size) / block_size;
-    
-    DBG(cerr << "size: " << size << ", block_size: " << block_size
-        << ", num_of_blocks: " << num_of_blocks << endl);
-
-    return num_of_blocks * block_size;
-}
-
 /** @name Methods to manipulate instances of CacheEntry. */
 
 //@{
 
+/** Functor which deletes and nulls a CacheEntry if the given entry matches
+    the url. */
+class DeleteCacheEntry: public unary_function<HTTPCacheTable::CacheEntry *&, void>
+{
+    string d_url;
+    HTTPCacheTable *d_cache_table;
+
+public:
+    DeleteCacheEntry(HTTPCacheTable *c, const string &url)
+            : d_url(url), d_cache_table(c)
+    {}
+
+    void operator()(HTTPCacheTable::CacheEntry *&e)
+    {
+        if (e && e->url == d_url) {
+        	e->lock_write_response();
+            d_cache_table->remove_cache_entry(e);
+        	e->unlock_write_response();
+            delete e; e = 0;
+        }
+    }
+};
+
 /** Add a CacheEntry to the cache table. As each entry is read, load it into
     the in-memory cache table and update the HTTPCache's current_size. The
-    later is used by the garbage collection method.
+    later is used by the garbage collection method. The new entry is
+    recorded in the index journal.
+
+    @param entry The CacheEntry instance to add.
+    @param replace If true, first remove any entry for the same URL (once
+    its readers have released it) while holding the bucket's lock, so two
+    threads caching the same URL cannot both add an entry. False by
+    default. */
+void
+HTTPCacheTable::add_entry_to_cache_table(CacheEntry *entry, bool replace)
+{
+    add_entry_to_bucket(entry, replace, true);
+}
 
-    @param entry The CacheEntry instance to add. */
+/** Add a CacheEntry to its bucket.
+
+    @param entry The CacheEntry instance to add.
+    @param replace If true, first remove any entry for the same URL.
+    @param journal If true, record the new entry in the journal. This is
+    false when the entry is read from the index. */
 void
-HTTPCacheTable::add_entry_to_cache_table(CacheEntry *entry)
+HTTPCacheTable::add_entry_to_bucket(CacheEntry *entry, bool replace, bool journal)
 {
     int hash = entry->hash;
     if (hash > CACHE_TABLE_SIZE-1 || hash < 0)
         throw InternalErr(__FILE__, __LINE__, "Hash value too large!");
 
-    if (!d_cache_table[hash])
-        d_cache_table[hash] = new CacheEntries;
+    WRITE_LOCK(&d_bucket_locks[hash]);
+    try {
+        if (!d_cache_table[hash])
+            d_cache_table[hash] = new CacheEntries;
+
+        CacheEntries *cp = d_cache_table[hash];
+        if (replace) {
+            for_each(cp->begin(), cp->end(), DeleteCacheEntry(this, entry->url));
+            cp->erase(remove(cp->begin(), cp->end(), static_cast<HTTPCacheTable::CacheEntry*>(0)), cp->end());
+        }
+
+        cp->push_back(entry);
+        lru_link(entry);
+
+        // Journal while the bucket is locked so the entry cannot be removed
+        // (and its removal journaled) first.
+        if (journal)
+            journal_add(entry);
+    }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
+    }
+    RW_UNLOCK(&d_bucket_locks[hash]);
+
+    LOCK(&d_table_lock);
 
-    d_cache_table[hash]->push_back(entry);
-    
     DBG(cerr << "add_entry_to_cache_table, current_size: " << d_current_size
         << ", entry->size: " << entry->size << ", block size: " << d_block_size 
         << endl);
@@ -578,7 +1910,104 @@ HTTPCacheTable::add_entry_to_cache_table(CacheEntry *entry)
 
     DBG(cerr << "add_entry_to_cache_table, current_size: " << d_current_size << endl);
     
-    increment_new_entries();
+    ++d_new_entries;
+
+    UNLOCK(&d_table_lock);
+}
+
+/** Remove the in-memory entries for \c url without touching their files
+    and, optionally, add a new entry in their place. Used when replaying the
+    journal. Entries that are in use are retired (see retire_entry()).
+
+    @param url Remove this URL's entries.
+    @param cachename If not empty, remove only the entry with this cache
+    file.
+    @param replacement If not null, add this entry to the bucket (once any
+    entries have been removed). */
+void
+HTTPCacheTable::drop_entry_from_bucket(const string &url, const string &cachename, CacheEntry *replacement)
+{
+    int hash = get_hash(url);
+
+    WRITE_LOCK(&d_bucket_locks[hash]);
+    try {
+        if (!d_cache_table[hash])
+            d_cache_table[hash] = new CacheEntries;
+
+        CacheEntries *cp = d_cache_table[hash];
+        for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i) {
+            if (*i && (*i)->url == url && (cachename.empty() || (*i)->cachename == cachename)) {
+                unsigned int eds = entry_disk_space((*i)->size, d_block_size);
+                LOCK(&d_table_lock);
+                d_current_size = (eds > d_current_size) ? 0 : d_current_size - eds;
+                UNLOCK(&d_table_lock);
+
+                lru_unlink(*i);
+                demote_entry(*i);
+                retire_entry(*i);
+                *i = 0;
+            }
+        }
+        cp->erase(remove(cp->begin(), cp->end(), static_cast<HTTPCacheTable::CacheEntry*>(0)), cp->end());
+
+        if (replacement) {
+            cp->push_back(replacement);
+            lru_link(replacement);
+
+            LOCK(&d_table_lock);
+            d_current_size += entry_disk_space(replacement->size, d_block_size);
+            UNLOCK(&d_table_lock);
+        }
+    }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
+    }
+    RW_UNLOCK(&d_bucket_locks[hash]);
+}
+
+/** Free an entry that has been taken out of the table. If it's locked (by
+    a thread reading its response, for example), keep it until
+    free_retired_entries() finds it unlocked. Since it's no longer in the
+    table, no new locks can be made on it.
+
+    @param entry The entry. */
+void
+HTTPCacheTable::retire_entry(CacheEntry *entry)
+{
+    if (!entry->is_in_use()) {
+        delete entry;
+        return;
+    }
+
+    LOCK(&d_table_lock);
+    d_retired.push_back(entry);
+    UNLOCK(&d_table_lock);
+}
+
+/** Free the retired entries that are no longer in use. */
+void
+HTTPCacheTable::free_retired_entries()
+{
+    LOCK(&d_table_lock);
+    for (vector<CacheEntry *>::iterator i = d_retired.begin(); i != d_retired.end(); ++i) {
+        if (!(*i)->is_in_use()) {
+            delete *i;
+            *i = 0;
+        }
+    }
+    d_retired.erase(remove(d_retired.begin(), d_retired.end(), static_cast<CacheEntry*>(0)), d_retired.end());
+    UNLOCK(&d_table_lock);
+}
+
+/** Record a change to an entry's information (e.g., after a conditional
+    GET) in the index journal. Call with the entry locked.
+
+    @param entry The changed entry. */
+void
+HTTPCacheTable::update_index_entry(CacheEntry *entry)
+{
+    journal_add(entry);
 }
 
 /** Get a pointer to a CacheEntry from the cache table.
@@ -602,19 +2031,32 @@ HTTPCacheTable::get_locked_entry_from_cache_table(int hash, const string &url) /
 {
     DBG(cerr << "url: " << url << "; hash: " << hash << endl);
     DBG(cerr << "d_cache_table: " << hex << d_cache_table << dec << endl);
-    if (d_cache_table[hash]) {
-	CacheEntries *cp = d_cache_table[hash];
-	for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i) {
-	    // Must test *i because perform_garbage_collection may have
-	    // removed this entry; the CacheEntry will then be null.
-	    if ((*i) && (*i)->url == url) {
-		(*i)->lock_read_response(); // Lock the response
-		return *i;
-	    }
-	}
+
+    // Hold the bucket's read lock until the entry is locked so that it
+    // cannot be removed out from under us.
+    CacheEntry *entry = 0;
+    READ_LOCK(&d_bucket_locks[hash]);
+    try {
+        if (d_cache_table[hash]) {
+            CacheEntries *cp = d_cache_table[hash];
+            for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i) {
+                // Must test *i because perform_garbage_collection may have
+                // removed this entry; the CacheEntry will then be null.
+                if ((*i) && (*i)->url == url) {
+                    (*i)->lock_read_response(); // Lock the response
+                    entry = *i;
+                    break;
+                }
+            }
+        }
+    }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
     }
+    RW_UNLOCK(&d_bucket_locks[hash]);
 
-    return 0;
+    return entry;
 }
 
 /** Get a pointer to a CacheEntry from the cache table. Providing a way to
@@ -627,25 +2069,36 @@ HTTPCacheTable::CacheEntry *
 HTTPCacheTable::get_write_locked_entry_from_cache_table(const string &url)
 {
 	int hash = get_hash(url);
-    if (d_cache_table[hash]) {
-        CacheEntries *cp = d_cache_table[hash];
-        for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i) {
-            // Must test *i because perform_garbage_collection may have
-            // removed this entry; the CacheEntry will then be null.
-            if ((*i) && (*i)->url == url) {
-            	(*i)->lock_write_response();	// Lock the response
-            	return *i;
+
+    CacheEntry *entry = 0;
+    READ_LOCK(&d_bucket_locks[hash]);
+    try {
+        if (d_cache_table[hash]) {
+            CacheEntries *cp = d_cache_table[hash];
+            for (CacheEntriesIter i = cp->begin(); i != cp->end(); ++i) {
+                // Must test *i because perform_garbage_collection may have
+                // removed this entry; the CacheEntry will then be null.
+                if ((*i) && (*i)->url == url) {
+                    (*i)->lock_write_response();	// Lock the response
+                    entry = *i;
+                    break;
+                }
             }
         }
     }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
+    }
+    RW_UNLOCK(&d_bucket_locks[hash]);
 
-    return 0;
+    return entry;
 }
 
 /** Remove a CacheEntry. This means delete the entry's files on disk and free
     the CacheEntry object. The caller should null the entry's pointer in the
     cache_table. The total size of the cache is decremented once the entry is
-    deleted.
+    deleted and the removal is recorded in the index journal.
 
     @param entry The CacheEntry to delete.
     @exception InternalErr Thrown if \c entry is in use. */
@@ -660,37 +2113,20 @@ HTTPCacheTable::remove_cache_entry(HTTPCacheTable::CacheEntry *entry)
     REMOVE(entry->cachename.c_str());
     REMOVE(string(entry->cachename + CACHE_META).c_str());
 
+    journal_remove(entry);
+    lru_unlink(entry);
+    demote_entry(entry);
+
     DBG(cerr << "remove_cache_entry, current_size: " << get_current_size() << endl);
 
     unsigned int eds = entry_disk_space(entry->size, get_block_size());
-    set_current_size((eds > get_current_size()) ? 0 : get_current_size() - eds);
+    LOCK(&d_table_lock);
+    d_current_size = (eds > d_current_size) ? 0 : d_current_size - eds;
+    UNLOCK(&d_table_lock);
     
     DBG(cerr << "remove_cache_entry, current_size: " << get_current_size() << endl);
 }
 
-/** Functor which deletes and nulls a CacheEntry if the given entry matches
-    the url. */
-class DeleteCacheEntry: public unary_function<HTTPCacheTable::CacheEntry *&, void>
-{
-    string d_url;
-    HTTPCacheTable *d_cache_table;
-
-public:
-    DeleteCacheEntry(HTTPCacheTable *c, const string &url)
-            : d_url(url), d_cache_table(c)
-    {}
-
-    void operator()(HTTPCacheTable::CacheEntry *&e)
-    {
-        if (e && e->url == d_url) {
-        	e->lock_write_response();
-            d_cache_table->remove_cache_entry(e);
-        	e->unlock_write_response();
-            delete e; e = 0;
-        }
-    }
-};
-
 /** Find the CacheEntry for the given url and remove both its information in
     the persistent store and the entry in d_cache_table. If \c url is not in
     the cache, this method does nothing.
@@ -701,12 +2137,21 @@ void
 HTTPCacheTable::remove_entry_from_cache_table(const string &url)
 {
     int hash = get_hash(url);
-    if (d_cache_table[hash]) {
-        CacheEntries *cp = d_cache_table[hash];
-        for_each(cp->begin(), cp->end(), DeleteCacheEntry(this, url));
-        cp->erase(remove(cp->begin(), cp->end(), static_cast<HTTPCacheTable::CacheEntry*>(0)),
-                  cp->end());
+
+    WRITE_LOCK(&d_bucket_locks[hash]);
+    try {
+        if (d_cache_table[hash]) {
+            CacheEntries *cp = d_cache_table[hash];
+            for_each(cp->begin(), cp->end(), DeleteCacheEntry(this, url));
+            cp->erase(remove(cp->begin(), cp->end(), static_cast<HTTPCacheTable::CacheEntry*>(0)),
+                      cp->end());
+        }
+    }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
     }
+    RW_UNLOCK(&d_bucket_locks[hash]);
 }
 
 /** Functor to delete and null all unlocked HTTPCacheTable::CacheEntry objects. */
@@ -734,16 +2179,360 @@ void HTTPCacheTable::delete_all_entries()
     // Walk through the cache table and, for every entry in the cache, delete
     // it on disk and in the cache table.
     for (int cnt = 0; cnt < CACHE_TABLE_SIZE; cnt++) {
-	HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
-	if (slot) {
-	    for_each(slot->begin(), slot->end(), DeleteUnlockedCacheEntry(*this));
-	    slot->erase(remove(slot->begin(), slot->end(), static_cast<HTTPCacheTable::CacheEntry *> (0)), slot->end());
+	WRITE_LOCK(&d_bucket_locks[cnt]);
+	try {
+	    HTTPCacheTable::CacheEntries *slot = get_cache_table()[cnt];
+	    if (slot) {
+		for_each(slot->begin(), slot->end(), DeleteUnlockedCacheEntry(*this));
+		slot->erase(remove(slot->begin(), slot->end(), static_cast<HTTPCacheTable::CacheEntry *> (0)), slot->end());
+	    }
+	}
+	catch (...) {
+	    RW_UNLOCK(&d_bucket_locks[cnt]);
+	    throw;
 	}
+	RW_UNLOCK(&d_bucket_locks[cnt]);
     }
 
     cache_index_delete();
 }
 
+/** @name LRU list
+
+    The cache entries are kept on a doubly linked list in the order they
+    were last added or hit, most recent first. Garbage collection removes
+    entries from the end of this list until the cache is small enough; the
+    work done is proportional to the number of entries removed, not the
+    number in the cache. */
+
+//@{
+
+/** Add an entry to the head of the LRU list. Call with the entry's bucket
+    locked for writing. */
+void
+HTTPCacheTable::lru_link(CacheEntry *entry)
+{
+    LOCK(&d_lru_lock);
+    entry->lru_prev = 0;
+    entry->lru_next = d_lru_head;
+    if (d_lru_head)
+        d_lru_head->lru_prev = entry;
+    d_lru_head = entry;
+    if (!d_lru_tail)
+        d_lru_tail = entry;
+    UNLOCK(&d_lru_lock);
+}
+
+/** Remove an entry from the LRU list. Call with the entry's bucket locked
+    for writing. */
+void
+HTTPCacheTable::lru_unlink(CacheEntry *entry)
+{
+    LOCK(&d_lru_lock);
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else if (d_lru_head == entry)
+        d_lru_head = entry->lru_next;
+
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else if (d_lru_tail == entry)
+        d_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = 0;
+    UNLOCK(&d_lru_lock);
+}
+
+/** Move an entry to the head of the LRU list. Call with the entry locked
+    or its bucket locked so that it cannot be removed. */
+void
+HTTPCacheTable::lru_touch(CacheEntry *entry)
+{
+    LOCK(&d_lru_lock);
+    if (d_lru_head != entry && (entry->lru_prev || entry->lru_next)) {
+        // unlink...
+        entry->lru_prev->lru_next = entry->lru_next;
+        if (entry->lru_next)
+            entry->lru_next->lru_prev = entry->lru_prev;
+        else
+            d_lru_tail = entry->lru_prev;
+
+        // ...and link at the head
+        entry->lru_prev = 0;
+        entry->lru_next = d_lru_head;
+        d_lru_head->lru_prev = entry;
+        d_lru_head = entry;
+    }
+    UNLOCK(&d_lru_lock);
+}
+
+/** Remove one entry picked by evict_lru(). The entry was chosen with only
+    the LRU list locked, so it may have been removed or locked since then.
+
+    @param entry The entry to remove; it is only dereferenced once it has
+    been found in its bucket.
+    @param hash The entry's hash value.
+    @return True if the entry was removed. */
+bool
+HTTPCacheTable::evict_entry(CacheEntry *entry, int hash)
+{
+    bool removed = false;
+
+    WRITE_LOCK(&d_bucket_locks[hash]);
+    try {
+        CacheEntries *cp = d_cache_table[hash];
+        CacheEntriesIter i = cp ? find(cp->begin(), cp->end(), entry) : CacheEntriesIter();
+        if (cp && i != cp->end()) {
+            if (entry->readers == 0) {
+                DBG(cerr << "Evicting cache entry: " << entry->url << endl);
+                remove_cache_entry(entry);
+                delete entry;
+                cp->erase(i);
+                removed = true;
+            }
+            else {
+                // It's in use again, so it's not the least recently used
+                lru_touch(entry);
+            }
+        }
+    }
+    catch (...) {
+        RW_UNLOCK(&d_bucket_locks[hash]);
+        throw;
+    }
+    RW_UNLOCK(&d_bucket_locks[hash]);
+
+    return removed;
+}
+
+/** Remove the least recently used entries until the size of the cache is
+    no more than \c size. Entries that are in use are skipped. If another
+    thread is already evicting entries, this returns right away.
+
+    @param size The target size of the cache, in bytes.
+    @return The number of entries removed. */
+int
+HTTPCacheTable::evict_lru(unsigned long size)
+{
+    if (TRYLOCK(&d_evict_lock) != 0)
+        return 0;
+
+    int evicted = 0;
+    try {
+        while (get_current_size() > size) {
+            LOCK(&d_lru_lock);
+            CacheEntry *entry = d_lru_tail;
+            while (entry && entry->readers > 0)
+                entry = entry->lru_prev;
+            int hash = entry ? entry->hash : 0;
+            UNLOCK(&d_lru_lock);
+
+            // Nothing left that can be removed
+            if (!entry)
+                break;
+
+            if (evict_entry(entry, hash))
+                ++evicted;
+        }
+    }
+    catch (...) {
+        UNLOCK(&d_evict_lock);
+        throw;
+    }
+
+    UNLOCK(&d_evict_lock);
+
+    DBG(cerr << "evict_lru: removed " << evicted << " entries, current_size: " << get_current_size() << endl);
+
+    return evicted;
+}
+
+//@} End of the LRU list methods.
+
+/** @name Hot tier
+
+    Small responses that have been used more than once are held in memory.
+    These methods manage that set of responses. The hot tier has a size
+    limit; when a new response will not fit, the least recently used
+    responses are demoted. Demoting a response only frees the memory; the
+    response is still in the disk cache. */
+
+//@{
+
+/** How much memory does a response in the hot tier use? */
+unsigned long
+HTTPCacheTable::hot_response_size(const HotResponse *hot)
+{
+    unsigned long size = hot->body.size();
+    for (vector<string>::const_iterator i = hot->headers.begin(); i != hot->headers.end(); ++i)
+        size += i->size();
+
+    return size;
+}
+
+/** Drop an entry's response from memory. Call with d_hot_lock locked and
+    only for entries in the hot tier. */
+void
+HTTPCacheTable::demote_hot_entry(CacheEntry *entry)
+{
+    HotResponse *hot = entry->hot;
+
+    d_hot_entries.erase(entry->hot_pos);
+    entry->hot = 0;
+
+    d_hot_stats.size -= hot_response_size(hot);
+    --d_hot_stats.entries;
+    ++d_hot_stats.demotions;
+
+    // A reader may still be using it
+    if (--hot->refs == 0)
+        delete hot;
+}
+
+/** Set the size of the hot tier. If it holds more than \c size bytes, the
+    least recently used responses are demoted.
+
+    @param size The most memory, in bytes, to use; zero turns the hot tier
+    off.
+    @param max_entry_size Only responses with bodies no larger than this
+    are held in memory. */
+void
+HTTPCacheTable::set_hot_tier_size(unsigned long size, unsigned long max_entry_size)
+{
+    LOCK(&d_hot_lock);
+
+    d_hot_max_size = size;
+    d_hot_max_entry_size = max_entry_size;
+
+    while (d_hot_stats.size > d_hot_max_size && !d_hot_entries.empty())
+        demote_hot_entry(d_hot_entries.back());
+
+    UNLOCK(&d_hot_lock);
+}
+
+/** Get an entry's response from the hot tier. This also counts the hits
+    and misses. Release the response using release_hot_response().
+
+    @param entry A locked entry.
+    @return The response or null if it is not in the hot tier. */
+HTTPCacheTable::HotResponse *
+HTTPCacheTable::get_hot_response(CacheEntry *entry)
+{
+    LOCK(&d_hot_lock);
+
+    HotResponse *hot = 0;
+    if (d_hot_max_size > 0) {
+        hot = entry->hot;
+        if (hot) {
+            ++hot->refs;
+            // Now the most recently used
+            d_hot_entries.splice(d_hot_entries.begin(), d_hot_entries, entry->hot_pos);
+            ++d_hot_stats.hits;
+        }
+        else {
+            ++d_hot_stats.misses;
+        }
+    }
+
+    UNLOCK(&d_hot_lock);
+
+    return hot;
+}
+
+/** Release a response returned by get_hot_response(). */
+void
+HTTPCacheTable::release_hot_response(HotResponse *hot)
+{
+    LOCK(&d_hot_lock);
+    bool unused = (--hot->refs == 0);
+    UNLOCK(&d_hot_lock);
+
+    if (unused)
+        delete hot;
+}
+
+/** Should this entry's response be held in memory? It should if it's small
+    and has been used before.
+
+    @param entry A locked entry that is not in the hot tier. */
+bool
+HTTPCacheTable::is_hot_candidate(CacheEntry *entry)
+{
+    LOCK(&d_hot_lock);
+    bool candidate = d_hot_max_size > 0 && !entry->hot && entry->size <= d_hot_max_entry_size
+        && entry->hits >= d_hot_min_hits;
+    UNLOCK(&d_hot_lock);
+
+    return candidate;
+}
+
+/** Add an entry's response to the hot tier, demoting other responses to
+    make room if needed.
+
+    @param entry A locked entry.
+    @param headers The response's headers.
+    @param body The response's body. */
+void
+HTTPCacheTable::promote_entry(CacheEntry *entry, const vector<string> &headers, const string &body)
+{
+    HotResponse *hot = new HotResponse;
+    hot->headers = headers;
+    hot->body = body;
+    hot->refs = 1; // The hot tier's reference
+    unsigned long size = hot_response_size(hot);
+
+    LOCK(&d_hot_lock);
+
+    // Another thread may have promoted it first
+    if (entry->hot || size > d_hot_max_size) {
+        UNLOCK(&d_hot_lock);
+        delete hot;
+        return;
+    }
+
+    while (d_hot_stats.size + size > d_hot_max_size && !d_hot_entries.empty())
+        demote_hot_entry(d_hot_entries.back());
+
+    d_hot_entries.push_front(entry);
+    entry->hot_pos = d_hot_entries.begin();
+    entry->hot = hot;
+
+    d_hot_stats.size += size;
+    ++d_hot_stats.entries;
+    ++d_hot_stats.promotions;
+
+    UNLOCK(&d_hot_lock);
+
+    DBG(cerr << "Promoted to the hot tier: " << entry->url << endl);
+}
+
+/** Drop an entry's response from memory. This does nothing if the entry is
+    not in the hot tier. Entries are demoted when they are removed from the
+    cache and when their headers change.
+
+    @param entry The entry. */
+void
+HTTPCacheTable::demote_entry(CacheEntry *entry)
+{
+    LOCK(&d_hot_lock);
+    if (entry->hot)
+        demote_hot_entry(entry);
+    UNLOCK(&d_hot_lock);
+}
+
+/** Get the hot tier's statistics. */
+HTTPCacheTable::HotTierStatistics
+HTTPCacheTable::get_hot_tier_statistics()
+{
+    LOCK(&d_hot_lock);
+    HotTierStatistics stats = d_hot_stats;
+    UNLOCK(&d_hot_lock);
+
+    return stats;
+}
+
+//@} End of the hot tier methods.
+
 /** Calculate the corrected_initial_age of the object. We use the time when
     this function is called as the response_time as this is when we have
     received the complete response. This may cause a delay if the response
@@ -863,25 +2652,44 @@ void HTTPCacheTable::parse_headers(HTTPCacheTable::CacheEntry *entry, unsigned l
 
 // @TODO Change name to record locked response
 void HTTPCacheTable::bind_entry_to_data(HTTPCacheTable::CacheEntry *entry, FILE *body) {
-	entry->hits++;  // Mark hit
+    LOCK(&d_table_lock);
+	int hits = ++entry->hits;  // Mark hit
     d_locked_entries[body] = entry; // record lock, see release_cached_r...
+    UNLOCK(&d_table_lock);
+
+    // The entry is locked for reading, so it cannot be removed.
+    lru_touch(entry);
+    journal_hits(entry->url, hits);
 }
 
 void HTTPCacheTable::uncouple_entry_from_data(FILE *body) {
 
-    HTTPCacheTable::CacheEntry *entry = d_locked_entries[body];
-    if (!entry)
+    LOCK(&d_table_lock);
+    map<FILE *, HTTPCacheTable::CacheEntry *>::iterator i = d_locked_entries.find(body);
+    if (i == d_locked_entries.end()) {
+        UNLOCK(&d_table_lock);
         throw InternalErr("There is no cache entry for the response given.");
+    }
+
+    HTTPCacheTable::CacheEntry *entry = i->second;
+    d_locked_entries.erase(i);
+    UNLOCK(&d_table_lock);
+
+    // Test first; once unlocked, a retired entry may be freed.
+    bool unlocked = entry->readers <= 0;
 
-    d_locked_entries.erase(body);
     entry->unlock_read_response();
 
-    if (entry->readers < 0)
+    if (unlocked)
         throw InternalErr("An unlocked entry was released");
 }
 
 bool HTTPCacheTable::is_locked_read_responses() {
-	return !d_locked_entries.empty();
+    LOCK(&d_table_lock);
+	bool locked = !d_locked_entries.empty();
+    UNLOCK(&d_table_lock);
+
+    return locked;
 }
 
 } // namespace libdap
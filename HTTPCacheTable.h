@@ -28,6 +28,8 @@
 //#define DODS_DEBUG
 
 #include <pthread.h>
+#include <sys/types.h>
+#include <cstdio>
 
 #ifdef WIN32
 #include <io.h>   // stat for win32? 09/05/02 jhrg
@@ -37,7 +39,9 @@
 
 #include <string>
 #include <vector>
+#include <list>
 #include <map>
+#include <set>
 
 #ifndef _http_cache_h
 #include "HTTPCache.h"
@@ -77,6 +81,28 @@
 #define INIT(m) pthread_mutex_init((m), 0)
 #define DESTROY(m) pthread_mutex_destroy((m))
 
+// Read/write locks used for the cache interface and the cache table buckets
+#define READ_LOCK(m) do { \
+	int code = pthread_rwlock_rdlock((m)); \
+	if (code != 0) \
+		throw InternalErr(__FILE__, __LINE__, string("Read lock: ") + strerror(code)); \
+    } while(0);
+
+#define WRITE_LOCK(m) do { \
+	int code = pthread_rwlock_wrlock((m)); \
+	if (code != 0) \
+		throw InternalErr(__FILE__, __LINE__, string("Write lock: ") + strerror(code)); \
+    } while(0);
+
+#define RW_UNLOCK(m) do { \
+	int code = pthread_rwlock_unlock((m)); \
+	if (code != 0) \
+		throw InternalErr(__FILE__, __LINE__, string("Read/write unlock: ") + strerror(code)); \
+    } while(0);
+
+#define RW_INIT(m) pthread_rwlock_init((m), 0)
+#define RW_DESTROY(m) pthread_rwlock_destroy((m))
+
 //using namespace std;
 
 namespace libdap {
@@ -97,9 +123,66 @@ int get_hash(const string &url);
  has been removed - its now the responsibility of the caller. This change
  was made because it's likely the caller will need to lock all of the methods
  that operate on a CacheEntry anyway, so the CacheEntry-specific lock was
- redundant. */
+ redundant.
+
+ @note Each bucket of the table has its own read/write lock. Looking up an
+ entry takes the bucket's lock for reading and adding or removing entries
+ takes it for writing, so threads that use different URLs (or only read
+ the same URL) do not block one another. The methods that walk the whole
+ table (garbage collection, writing the index) lock one bucket at a time.
+
+ @note The index is stored in binary form: a snapshot file (\c .index.bin)
+ made of fixed-size records, each followed by the entry's URL, cache name
+ and ETag, plus an append-only journal (\c .index.journal) of the entries
+ added, removed and hit since the snapshot was written. Opening the cache
+ loads the snapshot and replays the journal; once the journal grows large
+ a background thread writes a new snapshot and starts a new journal. The
+ older ASCII \c .index file is imported when there is no snapshot.
+
+ @note The entries are also kept on a list ordered by when they were last
+ added or hit. Garbage collection evicts entries from the least recently
+ used end of the list (see evict_lru()), so it does not have to scan the
+ table to find what to remove.
+
+ @note Small responses that are used often are also held in memory (the
+ 'hot tier'), headers and body both, so they can be returned without
+ reading any files. The hot tier has its own size limit; when it is full
+ the least recently used responses are demoted (dropped from memory; they
+ are still in the disk cache).
+
+ @note Several processes may share one cache. Each keeps its own table and
+ appends its changes to the shared journal; sync_index() applies the
+ changes other processes have made since it was last called. Journal
+ appends, loading the index and writing a new snapshot are serialized
+ using fcntl(2) locks on bytes of the cache's lock file, as is changing
+ the entry for a given URL (see lock_url()). An entry another process
+ removes or replaces while this process is reading it is taken out of the
+ table but freed only once it's released. If another process writes a
+ new snapshot, the table is reloaded from it. */
 class HTTPCacheTable {
 public:
+    struct CacheEntry;
+
+    /** The headers and body of a response held in the hot tier. Once made,
+     these are not changed. A reader may still be copying the response
+     when its entry is demoted, so the response is reference counted; the
+     hot tier holds one reference. */
+    struct HotResponse {
+        vector<string> headers;
+        string body;
+        int refs; // protected by HTTPCacheTable's d_hot_lock
+    };
+
+    /** Counts of what the hot tier has done. */
+    struct HotTierStatistics {
+        unsigned long hits;       // responses returned from memory
+        unsigned long misses;     // responses read from disk
+        unsigned long promotions; // responses added to memory
+        unsigned long demotions;  // responses dropped from memory
+        unsigned long entries;    // responses in memory now
+        unsigned long size;       // bytes in memory now
+    };
+
     /** A struct used to store information about responses in the
      cache's volatile memory.
 
@@ -136,6 +219,17 @@ public:
         bool no_cache; // This field is not saved in the index.
 
         int readers;
+        pthread_mutex_t d_readers_lock; // protects 'readers'
+
+        // Links in the table's LRU list (protected by its d_lru_lock)
+        CacheEntry *lru_prev; // more recently used
+        CacheEntry *lru_next; // less recently used
+
+        // Non-null if the response is in the hot tier (these are protected
+        // by the table's d_hot_lock)
+        HotResponse *hot;
+        list<CacheEntry *>::iterator hot_pos;
+
         pthread_mutex_t d_response_lock; // set if being read
         pthread_mutex_t d_response_write_lock; // set if being written
 
@@ -145,7 +239,6 @@ public:
 
         // Allow access by the functors used in HTTPCacheTable
         friend class DeleteCacheEntry;
-        friend class WriteOneCacheEntry;
         friend class DeleteExpired;
         friend class DeleteByHits;
         friend class DeleteBySize;
@@ -200,9 +293,13 @@ public:
             return no_cache;
         }
 
+        // Several threads may lock the same entry for reading at once (they
+        // only hold a read lock on the entry's bucket), so the readers
+        // count is protected by its own mutex.
         void lock_read_response()
         {
             DBG(cerr << "Try locking read response... (" << hex << &d_response_lock << dec << ") ");
+            LOCK(&d_readers_lock);
             int status = TRYLOCK(&d_response_lock);
             if (status != 0 /*&& status == EBUSY*/) {
                 // If locked, wait for any writers
@@ -211,6 +308,7 @@ public:
             }
 
             readers++; // Record number of readers
+            UNLOCK(&d_readers_lock);
 
             DBGN(cerr << "Done" << endl);
 
@@ -218,11 +316,13 @@ public:
 
         void unlock_read_response()
         {
+            LOCK(&d_readers_lock);
             readers--;
             if (readers == 0) {
                 DBG(cerr << "Unlocking read response... (" << hex << &d_response_lock << dec << ") ");
                 UNLOCK(&d_response_lock); DBGN(cerr << "Done" << endl);
             }
+            UNLOCK(&d_readers_lock);
         }
 
         void lock_write_response()
@@ -239,23 +339,43 @@ public:
             UNLOCK(&d_response_lock); DBGN(cerr << "Done" << endl);
         }
 
+        // Is the entry locked for reading or writing?
+        bool is_in_use()
+        {
+            LOCK(&d_readers_lock);
+            bool in_use = readers > 0 || TRYLOCK(&d_response_lock) != 0;
+            if (readers == 0 && !in_use)
+                UNLOCK(&d_response_lock);
+            UNLOCK(&d_readers_lock);
+
+            return in_use;
+        }
+
         CacheEntry() :
             url(""), hash(-1), hits(0), cachename(""), etag(""), lm(-1), expires(-1), date(-1), age(-1), max_age(-1), size(
                 0), range(false), freshness_lifetime(0), response_time(0), corrected_initial_age(0), must_revalidate(
-                false), no_cache(false), readers(0)
+                false), no_cache(false), readers(0), lru_prev(0), lru_next(0), hot(0)
         {
+            INIT(&d_readers_lock);
             INIT(&d_response_lock);
             INIT(&d_response_write_lock);
         }
         CacheEntry(const string &u) :
             url(u), hash(-1), hits(0), cachename(""), etag(""), lm(-1), expires(-1), date(-1), age(-1), max_age(-1), size(
                 0), range(false), freshness_lifetime(0), response_time(0), corrected_initial_age(0), must_revalidate(
-                false), no_cache(false), readers(0)
+                false), no_cache(false), readers(0), lru_prev(0), lru_next(0), hot(0)
         {
+            INIT(&d_readers_lock);
             INIT(&d_response_lock);
             INIT(&d_response_write_lock);
             hash = get_hash(url);
         }
+        ~CacheEntry()
+        {
+            DESTROY(&d_readers_lock);
+            DESTROY(&d_response_lock);
+            DESTROY(&d_response_write_lock);
+        }
     };
 
     // Typedefs for CacheTable. A CacheTable is a vector of vectors of
@@ -282,6 +402,74 @@ private:
 
     map<FILE *, HTTPCacheTable::CacheEntry *> d_locked_entries;
 
+    // One read/write lock for each bucket of d_cache_table. Lookups take the
+    // bucket's lock for reading, adding or removing entries take it for
+    // writing. Threads using different buckets do not block each other.
+    pthread_rwlock_t *d_bucket_locks;
+
+    // Protects d_current_size, d_new_entries, d_locked_entries and the
+    // entries' hit counts. Mutable so the const getters can lock it.
+    mutable pthread_mutex_t d_table_lock;
+
+    // The journal of changes made since the index snapshot was written.
+    // d_journal_lock protects these fields and the compaction state.
+    string d_journal_name;
+    int d_journal_fd;
+    string d_journal_buffer;        // records not yet written
+    unsigned long d_journal_records;
+    unsigned long d_journal_compact_records; // compact when this is reached
+    bool d_journal_failed;
+    pthread_mutex_t d_journal_lock;
+
+    // Sharing the cache with other processes. d_lock_fd is the cache's
+    // lock file (opened by HTTPCache); it's -1 if the cache is not shared.
+    // The journal fields are protected by d_journal_lock.
+    int d_lock_fd;
+    off_t d_journal_offset;         // journal bytes read (or written) so far
+    map<off_t, off_t> d_own_records; // records we appended past the offset
+    bool d_journal_rotated;         // another process wrote a snapshot
+
+    // Only one thread at a time applies other processes' changes.
+    pthread_mutex_t d_sync_lock;
+
+    // Entries other processes removed or replaced while they were in use
+    // here; protected by d_table_lock.
+    vector<CacheEntry *> d_retired;
+
+    // How many threads in this process hold or wait for each URL lock,
+    // which of the locks are held and which could not be set; fcntl(2)
+    // locks are held by a process, not a thread. Protected by d_url_lock.
+    map<off_t, int> d_url_locks;
+    set<off_t> d_url_locks_held;
+    set<off_t> d_url_locks_failed;
+    pthread_mutex_t d_url_lock;
+    pthread_cond_t d_url_cond;
+
+    bool d_compacting;              // a compaction thread is running
+    bool d_compaction_started;      // ... and has not been joined
+    pthread_t d_compaction_thread;
+
+    // Only one thread at a time writes the index snapshot.
+    pthread_mutex_t d_index_write_lock;
+
+    // The LRU list; the head is the most recently used entry. Linking and
+    // unlinking happen with the entry's bucket locked for writing.
+    CacheEntry *d_lru_head;
+    CacheEntry *d_lru_tail;
+    pthread_mutex_t d_lru_lock;
+
+    // Only one thread at a time evicts entries.
+    pthread_mutex_t d_evict_lock;
+
+    // The hot tier, most recently used first. d_hot_lock protects these
+    // and the entries' hot fields.
+    list<CacheEntry *> d_hot_entries;
+    unsigned long d_hot_max_size;       // bytes; 0 turns the hot tier off
+    unsigned long d_hot_max_entry_size; // largest body held in memory
+    int d_hot_min_hits;                 // promote entries with this many hits
+    HotTierStatistics d_hot_stats;
+    pthread_mutex_t d_hot_lock;
+
     // Make these private to prevent use
     HTTPCacheTable(const HTTPCacheTable &);
     HTTPCacheTable &operator=(const HTTPCacheTable &);
@@ -294,18 +482,64 @@ private:
 
     CacheEntry *get_locked_entry_from_cache_table(int hash, const string &url); /*const*/
 
+    void add_entry_to_bucket(CacheEntry *entry, bool replace, bool journal);
+    void drop_entry_from_bucket(const string &url, const string &cachename = "",
+        CacheEntry *replacement = 0);
+    void retire_entry(CacheEntry *entry);
+    void free_retired_entries();
+
+    static void write_index_record(FILE *fp, CacheEntry *entry);
+    static CacheEntry *read_index_record(FILE *fp);
+    static void encode_index_record(string &buf, CacheEntry *entry);
+    static CacheEntry *decode_index_record(const string &buf, string::size_type &pos);
+    bool read_index_snapshot(const string &name, map<string, CacheEntry *> *entries = 0);
+    bool replay_journal(const string &name, map<string, CacheEntry *> *entries = 0);
+    bool replay_journal_records(const string &buf, map<string, CacheEntry *> *entries = 0,
+        string::size_type *length = 0);
+    bool load_index(map<string, CacheEntry *> *entries);
+    void reload_index();
+    void sync_index_locked();
+
+    bool open_journal();
+    void close_journal();
+    bool is_journal_rotated();
+    void read_journal(string &data);
+    bool flush_journal();
+    void set_journal_aside(const string &journal, const string &old_journal);
+    void journal_append(const string &record, bool flush);
+    void journal_add(CacheEntry *entry);
+    void journal_remove(CacheEntry *entry);
+    void journal_hits(const string &url, int hits);
+    void start_index_compaction();
+    static void *index_compaction_thread(void *table);
+
+    void lru_link(CacheEntry *entry);
+    void lru_unlink(CacheEntry *entry);
+    void lru_touch(CacheEntry *entry);
+    bool evict_entry(CacheEntry *entry, int hash);
+
+    void demote_hot_entry(CacheEntry *entry);
+    static unsigned long hot_response_size(const HotResponse *hot);
+
 public:
-    HTTPCacheTable(const string &cache_root, int block_size);
+    HTTPCacheTable(const string &cache_root, int block_size, int lock_fd = -1);
     ~HTTPCacheTable();
 
+    static bool lock_file_byte(int fd, short type, off_t offset, bool wait);
+
     //@{ @name Accessors/Mutators
     unsigned long get_current_size() const
     {
-        return d_current_size;
+        LOCK(&d_table_lock);
+        unsigned long size = d_current_size;
+        UNLOCK(&d_table_lock);
+        return size;
     }
     void set_current_size(unsigned long sz)
     {
+        LOCK(&d_table_lock);
         d_current_size = sz;
+        UNLOCK(&d_table_lock);
     }
 
     unsigned int get_block_size() const
@@ -319,11 +553,16 @@ public:
 
     int get_new_entries() const
     {
-        return d_new_entries;
+        LOCK(&d_table_lock);
+        int n = d_new_entries;
+        UNLOCK(&d_table_lock);
+        return n;
     }
     void increment_new_entries()
     {
+        LOCK(&d_table_lock);
         ++d_new_entries;
+        UNLOCK(&d_table_lock);
     }
 
     string get_cache_root()
@@ -340,17 +579,23 @@ public:
     void delete_by_hits(int hits);
     void delete_by_size(unsigned int size);
     void delete_all_entries();
+    int evict_lru(unsigned long size);
 
     bool cache_index_delete();
     bool cache_index_read();
     CacheEntry *cache_index_parse_line(const char *line);
     void cache_index_write();
+    void sync_index();
+
+    bool lock_url(const string &url);
+    void unlock_url(const string &url);
 
     string create_hash_directory(int hash);
     void create_location(CacheEntry *entry);
 
-    void add_entry_to_cache_table(CacheEntry *entry);
+    void add_entry_to_cache_table(CacheEntry *entry, bool replace = false);
     void remove_cache_entry(HTTPCacheTable::CacheEntry *entry);
+    void update_index_entry(CacheEntry *entry);
 
     void remove_entry_from_cache_table(const string &url);
     CacheEntry *get_locked_entry_from_cache_table(const string &url);
@@ -359,6 +604,14 @@ public:
     void calculate_time(HTTPCacheTable::CacheEntry *entry, int default_expiration, time_t request_time);
     void parse_headers(HTTPCacheTable::CacheEntry *entry, unsigned long max_entry_size, const vector<string> &headers);
 
+    void set_hot_tier_size(unsigned long size, unsigned long max_entry_size);
+    HotResponse *get_hot_response(CacheEntry *entry);
+    void release_hot_response(HotResponse *hot);
+    bool is_hot_candidate(CacheEntry *entry);
+    void promote_entry(CacheEntry *entry, const vector<string> &headers, const string &body);
+    void demote_entry(CacheEntry *entry);
+    HotTierStatistics get_hot_tier_statistics();
+
     // These should move back to HTTPCache
     void bind_entry_to_data(CacheEntry *entry, FILE *body);
     void uncouple_entry_from_data(FILE *body);
@@ -60,6 +60,7 @@
 #include "GNURegex.h"
 #include "HTTPCache.h"
 #include "HTTPConnect.h"
+#include "HTTPConnectionPool.h"
 #include "RCReader.h"
 #include "HTTPResponse.h"
 #include "HTTPCacheResponse.h"
@@ -307,15 +308,17 @@ curl_debug(CURL *, curl_infotype info, char *msg, size_t size, void  *)
     return 0;
 }
 
-/** Initialize libcurl. Create a libcurl handle that can be used for all of
-    the HTTP requests made through this instance. */
+/** Initialize libcurl. Get a libcurl handle that can be used for all of
+    the HTTP requests made through this instance. The handle comes from the
+    process-wide connection pool so that connections, DNS lookups and TLS
+    sessions can be reused by other HTTPConnect objects.
+
+    @see HTTPConnectionPool */
 
 void
 HTTPConnect::www_lib_init()
 {
-    d_curl = curl_easy_init();
-    if (!d_curl)
-        throw InternalErr(__FILE__, __LINE__, "Could not initialize libcurl.");
+    d_curl = HTTPConnectionPool::instance()->get_handle(); // throws InternalErr
 
     // Now set options that will remain constant for the duration of this
     // CURL object.
@@ -577,6 +580,8 @@ HTTPConnect::HTTPConnect(RCReader *rcr, bool use_cpp) : d_username(""), d_passwo
         d_http_cache->set_max_entry_size(d_rcr->get_max_cached_obj());
         d_http_cache->set_default_expiration(d_rcr->get_default_expires());
         d_http_cache->set_always_validate(d_rcr->get_always_validate() != 0);
+        d_http_cache->set_background_gc(d_rcr->get_cache_gc_thread() != 0);
+        d_http_cache->set_stale_while_revalidate(d_rcr->get_stale_while_revalidate());
     }
 
     d_cookie_jar = rcr->get_cookie_jar();
@@ -588,7 +593,9 @@ HTTPConnect::~HTTPConnect()
 {
     DBG2(cerr << "Entering the HTTPConnect dtor" << endl);
 
-    curl_easy_cleanup(d_curl);
+    // Handles that used a cookie jar hold cookies that should not be sent
+    // by some other HTTPConnect, so don't reuse those.
+    HTTPConnectionPool::instance()->release_handle(d_curl, d_cookie_jar.empty());
 
     DBG2(cerr << "Leaving the HTTPConnect dtor" << endl);
 }
@@ -864,6 +871,14 @@ HTTPConnect::caching_fetch_url(const string &url)
             HTTPCacheResponse *crs = new HTTPCacheResponse(s, 200, headers, file_name, d_http_cache);
             return crs;
         }
+        else if (d_http_cache->is_url_usable_while_revalidating(url)) {
+            // url in cache, not valid but not too stale; use it and validate
+            // it in the background
+            DBGN(cerr << "but it's stale; using it while revalidating." << endl);
+            revalidate_in_background(url);
+            HTTPCacheResponse *crs = new HTTPCacheResponse(s, 200, headers, file_name, d_http_cache);
+            return crs;
+        }
         else { // url in cache but not valid; validate
             DBGN(cerr << "but it's not valid; validating... ");
 
@@ -930,6 +945,132 @@ HTTPConnect::caching_fetch_url(const string &url)
     throw InternalErr(__FILE__, __LINE__, "Should never get here");
 }
 
+/** Validate a cached response and update the cache. This makes a
+    conditional request for \c url; if the server returns a new response, it
+    is cached, and if it returns 304, the cached response's headers are
+    updated. Other responses leave the cache as is.
+
+    A private method.
+
+    @note This method assumes that d_http_cache is not null!
+    @param url The URL to validate.
+    @exception Error Thrown if the URL could not be dereferenced. */
+
+void
+HTTPConnect::revalidate(const string &url)
+{
+    DBG(cerr << "Revalidating: " << url << endl);
+
+    vector<string> cond_hdrs = d_http_cache->get_conditional_request_headers(url);
+    vector<string> headers;
+    FILE *body = 0;
+    string dods_temp = get_temp_file(body);
+    time_t now = time(0); // When was the request made (now).
+
+    try {
+        long http_status = read_url(url, body, &headers, &cond_hdrs);
+        rewind(body);
+
+        switch (http_status) {
+            case 200:
+                d_http_cache->cache_response(url, now, headers, body);
+                break;
+
+            case 304:
+                d_http_cache->update_response(url, now, headers);
+                break;
+
+            default:
+                DBG(cerr << "Could not revalidate " << url << ": " << http_status << endl);
+                break;
+        }
+    }
+    catch (...) {
+        close_temp(body, dods_temp);
+        throw;
+    }
+
+    close_temp(body, dods_temp);
+}
+
+// Passed to revalidation_thread()
+struct Revalidation {
+    HTTPConnect *connect;
+    string url;
+};
+
+/** Validate a cached response using a new thread. The thread uses its own
+    HTTPConnect with this object's credentials and request headers. If the
+    response is already being validated (by any HTTPConnect), this does
+    nothing. The HTTPCache destructor waits for these threads to finish.
+
+    A private method.
+
+    @param url The URL to validate. */
+
+void
+HTTPConnect::revalidate_in_background(const string &url)
+{
+    if (!d_http_cache->start_revalidation(url))
+        return;
+
+    Revalidation *args = 0;
+    try {
+        args = new Revalidation;
+        args->url = url;
+        args->connect = new HTTPConnect(d_rcr, d_use_cpp_streams);
+        args->connect->copy_request_settings(*this);
+    }
+    catch (...) {
+        if (args)
+            delete args->connect;
+        delete args;
+        d_http_cache->end_revalidation(url);
+        throw;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int status = pthread_create(&thread, &attr, revalidation_thread, args);
+    pthread_attr_destroy(&attr);
+
+    // If there's no thread, the next request for the URL will validate it
+    if (status != 0) {
+        DBG(cerr << "Could not start a revalidation thread: " << status << endl);
+        delete args->connect;
+        delete args;
+        d_http_cache->end_revalidation(url);
+    }
+}
+
+/** The background revalidation thread. Errors are ignored; the response is
+    still stale, so it will be validated again when it's next used. */
+void *
+HTTPConnect::revalidation_thread(void *arg)
+{
+    Revalidation *args = static_cast<Revalidation *>(arg);
+    HTTPCache *cache = args->connect->d_http_cache;
+
+    try {
+        args->connect->revalidate(args->url);
+    }
+    catch (Error &e) {
+        DBG(cerr << "Revalidation of " << args->url << " failed: " << e.get_error_message() << endl);
+    }
+    catch (...) {
+        DBG(cerr << "Revalidation of " << args->url << " failed." << endl);
+    }
+
+    delete args->connect;
+    cache->end_revalidation(args->url);
+    delete args;
+
+    return 0;
+}
+
 /** Dereference a URL and load its body into a temporary file. This
     method ignores the HTTP cache.
 
@@ -1073,4 +1214,43 @@ HTTPConnect::set_credentials(const string &u, const string &p)
     d_upstring = u + ":" + p;
 }
 
+/** Copy the per-request settings of another HTTPConnect: the credentials,
+    the cookie jar, the request headers (Accept-Encoding, XDAP-Accept) and
+    the type of stream used for responses. Use this to make a second
+    instance that makes requests the same way as \c from, for example to
+    issue several requests at once from different threads.
+
+    @param from Copy the settings of this instance. */
+void
+HTTPConnect::copy_request_settings(const HTTPConnect &from)
+{
+    d_accept_deflate = from.d_accept_deflate;
+
+    d_username = from.d_username;
+    d_password = from.d_password;
+    d_upstring = from.d_upstring;
+
+    // www_lib_init() has already passed this instance's cookie jar to
+    // curl, so tell curl about the new one.
+    if (d_cookie_jar != from.d_cookie_jar) {
+        d_cookie_jar = from.d_cookie_jar;
+        if (!d_cookie_jar.empty()) {
+            curl_easy_setopt(d_curl, CURLOPT_COOKIEFILE, d_cookie_jar.c_str());
+            curl_easy_setopt(d_curl, CURLOPT_COOKIEJAR, d_cookie_jar.c_str());
+            curl_easy_setopt(d_curl, CURLOPT_COOKIESESSION, 1);
+        }
+        else {
+            curl_easy_setopt(d_curl, CURLOPT_COOKIELIST, "ALL");
+            curl_easy_setopt(d_curl, CURLOPT_COOKIEJAR, static_cast<char*>(0));
+        }
+    }
+
+    d_request_headers = from.d_request_headers;
+
+    d_dap_client_protocol_major = from.d_dap_client_protocol_major;
+    d_dap_client_protocol_minor = from.d_dap_client_protocol_minor;
+
+    d_use_cpp_streams = from.d_use_cpp_streams;
+}
+
 } // namespace libdap
@@ -101,6 +101,10 @@ private:
     HTTPResponse *plain_fetch_url(const string &url);
     HTTPResponse *caching_fetch_url(const string &url);
 
+    void revalidate(const string &url);
+    void revalidate_in_background(const string &url);
+    static void *revalidation_thread(void *arg);
+
     bool url_uses_proxy_for(const string &url);
     bool url_uses_no_proxy_for(const string &url) throw();
 
@@ -131,6 +135,8 @@ public:
     void set_accept_deflate(bool defalte);
     void set_xdap_protocol(int major, int minor);
 
+    void copy_request_settings(const HTTPConnect &from);
+
     bool use_cpp_streams() const { return d_use_cpp_streams; }
     void set_use_cpp_streams(bool use_cpp_streams) { d_use_cpp_streams = use_cpp_streams; }
 
@@ -0,0 +1,273 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <string>
+#include <vector>
+
+//#define DODS_DEBUG
+
+#include "HTTPConnectionPool.h"
+#include "RCReader.h"
+#include "InternalErr.h"
+#include "HTTPCache.h" // for the LOCK/UNLOCK/INIT/DESTROY macros
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+HTTPConnectionPool *HTTPConnectionPool::_instance = 0;
+
+// See RCReader.cc for an explanation. 08/07/02 jhrg
+static pthread_once_t instance_control = PTHREAD_ONCE_INIT;
+
+/** Callback used by libcurl to lock part of the shared data. These are
+    called from within libcurl, so don't use LOCK() since it can throw. */
+void
+HTTPConnectionPool::share_lock(CURL *, curl_lock_data data, curl_lock_access, void *pool)
+{
+    pthread_mutex_lock(&static_cast<HTTPConnectionPool*>(pool)->d_share_locks[data]);
+}
+
+/** Callback used by libcurl to unlock part of the shared data. */
+void
+HTTPConnectionPool::share_unlock(CURL *, curl_lock_data data, void *pool)
+{
+    pthread_mutex_unlock(&static_cast<HTTPConnectionPool*>(pool)->d_share_locks[data]);
+}
+
+/** Build the pool. If \c max_idle is zero, the share is not made and the
+    pool is disabled.
+
+    @param max_idle Hold at most this many unused handles.
+    @param idle_timeout Free unused handles after this many seconds.
+    @exception InternalErr Thrown if libcurl could not be initialized. */
+HTTPConnectionPool::HTTPConnectionPool(unsigned int max_idle, long idle_timeout) :
+    d_share(0), d_max_idle(max_idle), d_idle_timeout(idle_timeout), d_in_use(0)
+{
+    // curl_global_init() is not thread safe, but this is run by pthread_once().
+    if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK)
+        throw InternalErr(__FILE__, __LINE__, "Could not initialize libcurl.");
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+        INIT(&d_share_locks[i]);
+    INIT(&d_pool_lock);
+
+    if (!is_enabled())
+        return;
+
+    d_share = curl_share_init();
+    if (!d_share)
+        throw InternalErr(__FILE__, __LINE__, "Could not initialize the libcurl connection pool.");
+
+    curl_share_setopt(d_share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(d_share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(d_share, CURLSHOPT_USERDATA, this);
+
+    curl_share_setopt(d_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(d_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // Sharing the connection cache was added in libcurl 7.57.0
+    curl_share_setopt(d_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+HTTPConnectionPool::~HTTPConnectionPool()
+{
+    vector<IdleHandle>::iterator i;
+    for (i = d_idle.begin(); i != d_idle.end(); ++i)
+        curl_easy_cleanup(i->curl);
+    d_idle.clear();
+
+    if (d_share)
+        curl_share_cleanup(d_share);
+
+    DESTROY(&d_pool_lock);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+        DESTROY(&d_share_locks[i]);
+}
+
+/** Static void private method. Read the pool parameters from the .dodsrc
+    file. */
+void
+HTTPConnectionPool::initialize_instance()
+{
+    RCReader *rcr = RCReader::instance();
+
+    _instance = new HTTPConnectionPool(rcr->get_connection_pool_size(), rcr->get_connection_idle_timeout());
+    atexit(HTTPConnectionPool::delete_instance);
+}
+
+/** Static void private method. Run by atexit(). Handles still held by an
+    HTTPConnect refer to the share, so if any are still out, free only the
+    idle handles and leave the rest to the OS. */
+void
+HTTPConnectionPool::delete_instance()
+{
+    if (!_instance)
+        return;
+
+    LOCK(&_instance->d_pool_lock);
+    if (_instance->d_in_use > 0) {
+        _instance->expire_idle_handles(0);
+        UNLOCK(&_instance->d_pool_lock);
+        return;
+    }
+    UNLOCK(&_instance->d_pool_lock);
+
+    delete _instance;
+    _instance = 0;
+}
+
+/** Get the connection pool for this process. The first call reads the
+    pool parameters from the .dodsrc file (using RCReader).
+
+    @return A pointer to the pool. */
+HTTPConnectionPool *
+HTTPConnectionPool::instance()
+{
+    pthread_once(&instance_control, initialize_instance);
+
+    return _instance;
+}
+
+/** Free idle handles that were released before <tt>now -
+    d_idle_timeout</tt>. If \c now is zero, free every idle handle. The
+    idle list is ordered by release time, oldest first. */
+void
+HTTPConnectionPool::expire_idle_handles(time_t now)
+{
+    vector<IdleHandle>::iterator i = d_idle.begin();
+    while (i != d_idle.end() && (now == 0 || now - i->released > d_idle_timeout)) {
+        DBG(cerr << "Freeing idle curl handle: " << i->curl << endl);
+        curl_easy_cleanup(i->curl);
+        ++i;
+    }
+
+    d_idle.erase(d_idle.begin(), i);
+}
+
+/** Get a libcurl easy handle. If the pool holds an idle handle, the most
+    recently released one is returned since it is the most likely to still
+    have a live connection. Otherwise a new handle is made and attached to
+    the pool's share. Handles are returned with all options set to their
+    defaults (except for the share).
+
+    @return A libcurl easy handle; give it back using release_handle().
+    @exception InternalErr Thrown if a new handle could not be made. */
+CURL *
+HTTPConnectionPool::get_handle()
+{
+    CURL *curl = 0;
+
+    LOCK(&d_pool_lock);
+
+    expire_idle_handles(time(0));
+
+    if (!d_idle.empty()) {
+        curl = d_idle.back().curl;
+        d_idle.pop_back();
+    }
+
+    ++d_in_use;
+
+    UNLOCK(&d_pool_lock);
+
+    if (!curl) {
+        curl = curl_easy_init();
+        if (!curl) {
+            LOCK(&d_pool_lock);
+            --d_in_use;
+            UNLOCK(&d_pool_lock);
+            throw InternalErr(__FILE__, __LINE__, "Could not initialize libcurl.");
+        }
+
+        if (d_share)
+            curl_easy_setopt(curl, CURLOPT_SHARE, d_share);
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x074100
+    // Don't reuse a connection that's been idle longer than the pool's timeout.
+    // CURLOPT_MAXAGE_CONN was added in libcurl 7.65.0
+    if (is_enabled())
+        curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, d_idle_timeout);
+#endif
+
+    return curl;
+}
+
+/** Give a handle back to the pool. The handle is reset and added to the idle
+    list unless the pool is full, disabled or the caller says the handle
+    should not be reused, in which case it is freed.
+
+    @param curl A handle returned by get_handle().
+    @param reusable False if the handle holds state that should not be
+    passed on to another HTTPConnect (e.g., cookies). True by default. */
+void
+HTTPConnectionPool::release_handle(CURL *curl, bool reusable)
+{
+    if (!curl)
+        return;
+
+    LOCK(&d_pool_lock);
+
+    --d_in_use;
+
+    if (reusable && is_enabled() && d_idle.size() < d_max_idle) {
+        curl_easy_reset(curl);
+
+        IdleHandle idle;
+        idle.curl = curl;
+        idle.released = time(0);
+        d_idle.push_back(idle);
+
+        UNLOCK(&d_pool_lock);
+        return;
+    }
+
+    UNLOCK(&d_pool_lock);
+
+    curl_easy_cleanup(curl);
+}
+
+/** How many handles are waiting to be reused? */
+unsigned int
+HTTPConnectionPool::get_idle_handle_count()
+{
+    LOCK(&d_pool_lock);
+    unsigned int count = d_idle.size();
+    UNLOCK(&d_pool_lock);
+
+    return count;
+}
+
+} // namespace libdap
@@ -0,0 +1,119 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _http_connection_pool_h
+#define _http_connection_pool_h
+
+#include <pthread.h>
+
+#include <ctime>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace libdap
+{
+
+/** A process-wide pool of libcurl easy handles that all share one libcurl
+    'share' object. The share holds the DNS cache, the TLS session cache
+    and (for libcurl 7.57 and later) the connection cache, so an
+    HTTPConnect made for a server we have already talked to can reuse the
+    open TCP connection and skip the TLS handshake.
+
+    HTTPConnect borrows a handle using get_handle() when it is built and
+    gives it back using release_handle() when it is destroyed. Released
+    handles are reset (see curl_easy_reset()) and kept on an idle list so
+    the next HTTPConnect does not have to make a new one. The number of idle
+    handles and how long they may sit unused are set using the
+    CONNECTION_POOL_SIZE and CONNECTION_IDLE_TIMEOUT parameters in the
+    .dodsrc file. A pool size of zero turns the pool off; in that case
+    get_handle() returns a plain handle that does not use the share.
+
+    This class is MT-safe. Like RCReader and HTTPCache it is a singleton;
+    use instance() to get the pool.
+
+    @see RCReader */
+class HTTPConnectionPool
+{
+private:
+    struct IdleHandle {
+        CURL *curl;
+        time_t released;    // When was this handle returned to the pool?
+    };
+
+    CURLSH *d_share;
+
+    // libcurl calls share_lock() and share_unlock() with one of the
+    // curl_lock_data values; use a mutex for each one.
+    pthread_mutex_t d_share_locks[CURL_LOCK_DATA_LAST];
+
+    // Protects d_idle and d_in_use
+    pthread_mutex_t d_pool_lock;
+
+    unsigned int d_max_idle;
+    long d_idle_timeout;
+
+    std::vector<IdleHandle> d_idle;
+    unsigned int d_in_use;
+
+    static HTTPConnectionPool *_instance;
+
+    HTTPConnectionPool(unsigned int max_idle, long idle_timeout);
+    ~HTTPConnectionPool();
+
+    HTTPConnectionPool(const HTTPConnectionPool &);
+    HTTPConnectionPool &operator=(const HTTPConnectionPool &);
+
+    static void initialize_instance();
+    static void delete_instance();
+
+    static void share_lock(CURL *, curl_lock_data data, curl_lock_access, void *pool);
+    static void share_unlock(CURL *, curl_lock_data data, void *pool);
+
+    void expire_idle_handles(time_t now);
+
+    friend class HTTPConnectTest;
+
+public:
+    static HTTPConnectionPool *instance();
+
+    CURL *get_handle();
+    void release_handle(CURL *curl, bool reusable = true);
+
+    /** Is the pool in use? When false, get_handle() returns a new handle
+        for every call and release_handle() frees it. */
+    bool is_enabled() const { return d_max_idle > 0; }
+
+    /** The maximum number of unused handles the pool will hold. */
+    unsigned int get_max_idle_handles() const { return d_max_idle; }
+
+    /** Idle handles older than this many seconds are freed. */
+    long get_idle_timeout() const { return d_idle_timeout; }
+
+    unsigned int get_idle_handle_count();
+};
+
+} // namespace libdap
+
+#endif // _http_connection_pool_h
@@ -0,0 +1,285 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Hyperslab.h"
+#include "Array.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+// Don't start threads to copy fewer elements than this.
+static const unsigned long MIN_THREADED_ELEMENTS = 1UL << 18;
+
+/** Get the hyperslab of an array.
+ * @param array The array.
+ * @param constrained If true, the part selected by the array's current
+ * constraint, otherwise the whole array. */
+Hyperslab::Hyperslab(Array &array, bool constrained)
+{
+    for (Array::Dim_iter d = array.dim_begin(); d != array.dim_end(); ++d) {
+        if (constrained)
+            // The stop is the last index selected, which may be less than
+            // the CE's stop
+            append(array.dimension_start(d, true), array.dimension_stride(d, true),
+                    array.dimension_start(d, true)
+                            + (array.dimension_size(d, true) - 1) * array.dimension_stride(d, true));
+        else
+            append(0, 1, array.dimension_size(d, false) - 1);
+    }
+}
+
+/** Add an inner dimension. */
+void Hyperslab::append(int first, int step, int last)
+{
+    start.push_back(first);
+    stride.push_back(step);
+    stop.push_back(last);
+}
+
+/** @return The number of elements in the hyperslab. */
+unsigned long Hyperslab::elements() const
+{
+    unsigned long n = 1;
+    for (unsigned int d = 0; d < dimensions(); ++d)
+        n *= count(d);
+
+    return n;
+}
+
+/** Does this hyperslab hold every element of \c slab? */
+bool Hyperslab::contains(const Hyperslab &slab) const
+{
+    if (slab.dimensions() != dimensions())
+        return false;
+
+    for (unsigned int d = 0; d < dimensions(); ++d) {
+        if (slab.start[d] < start[d] || slab.stop[d] > stop[d])
+            return false;
+        if ((slab.start[d] - start[d]) % stride[d] != 0)
+            return false;
+        if (slab.count(d) > 1 && slab.stride[d] % stride[d] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+// How extract() walks the source. Dimensions that select one index are
+// dropped, and inner dimensions that are contiguous in the source are
+// merged, so most copies are one memcpy() per run of the innermost
+// remaining dimension.
+struct CopyPlan {
+    unsigned int width;
+    const char *src;                // first element to copy
+    vector<unsigned long> count;    // outer dimensions, outermost first
+    vector<unsigned long> step;     // source bytes between their indices
+    unsigned long inner_count;      // elements in each innermost run
+    unsigned long inner_step;       // source elements between them
+};
+
+// Copy count elements of N bytes that are step elements apart. Fixed-size
+// memcpy() calls become single moves that the compiler can vectorize.
+template<unsigned int N>
+static void gather(const char *src, unsigned long step, unsigned long count, char *dest)
+{
+    for (unsigned long i = 0; i < count; ++i)
+        memcpy(dest + i * N, src + i * step * N, N);
+}
+
+static char *copy_run(const CopyPlan &plan, const char *src, char *dest)
+{
+    unsigned long n = plan.inner_count;
+    if (plan.inner_step == 1) {
+        memcpy(dest, src, n * plan.width);
+    }
+    else {
+        switch (plan.width) {
+            case 1: gather<1>(src, plan.inner_step, n, dest); break;
+            case 2: gather<2>(src, plan.inner_step, n, dest); break;
+            case 4: gather<4>(src, plan.inner_step, n, dest); break;
+            case 8: gather<8>(src, plan.inner_step, n, dest); break;
+            default:
+                for (unsigned long i = 0; i < n; ++i)
+                    memcpy(dest + i * plan.width, src + i * plan.inner_step * plan.width, plan.width);
+                break;
+        }
+    }
+
+    return dest + n * plan.width;
+}
+
+// Copy indices [first, last) of the outermost dimension of the plan.
+static void copy_block(const CopyPlan &plan, unsigned long first, unsigned long last, char *dest)
+{
+    unsigned int dims = plan.count.size();
+    if (dims == 0) {
+        copy_run(plan, plan.src, dest);
+        return;
+    }
+
+    vector<unsigned long> index(dims, 0);
+    index[0] = first;
+    const char *src = plan.src + first * plan.step[0];
+
+    while (index[0] < last) {
+        dest = copy_run(plan, src, dest);
+
+        // Advance like an odometer
+        int d = dims - 1;
+        for (;;) {
+            src += plan.step[d];
+            if (++index[d] < plan.count[d] || d == 0)
+                break;
+            src -= index[d] * plan.step[d];
+            index[d--] = 0;
+        }
+    }
+}
+
+struct CopyTask {
+    const CopyPlan *plan;
+    unsigned long first, last;
+    char *dest;
+};
+
+static void *copy_task(void *arg)
+{
+    CopyTask *task = static_cast<CopyTask*>(arg);
+    copy_block(*task->plan, task->first, task->last, task->dest);
+    return 0;
+}
+
+/** @brief Copy the values of one hyperslab out of a buffer holding another.
+ *
+ * Both buffers are in row-major order. Runs that are contiguous in \c values
+ * are copied with memcpy(), even when they span several dimensions. Strided
+ * runs of 1, 2, 4 and 8 byte elements are gathered with fixed-size copies the
+ * compiler can vectorize. Large copies can be split across threads by the
+ * outermost dimension.
+ *
+ * @param from The hyperslab held in \c values; often the whole array.
+ * @param values The values of \c from.
+ * @param width The size of an element in bytes.
+ * @param to The hyperslab to copy; \c from must contain it.
+ * @param dest Write the to.elements() values of \c to here.
+ * @param threads Use up to this many threads.
+ * @exception InternalErr if \c from does not contain \c to. */
+void Hyperslab::extract(const Hyperslab &from, const void *values, unsigned int width, const Hyperslab &to,
+        void *dest, unsigned int threads)
+{
+    if (!from.contains(to))
+        throw InternalErr(__FILE__, __LINE__, "The source hyperslab does not contain the requested values.");
+
+    unsigned int dims = to.dimensions();
+
+    CopyPlan plan;
+    plan.width = width;
+    plan.src = static_cast<const char*>(values);
+    plan.inner_count = 1;
+    plan.inner_step = 1;
+
+    // Walk from the innermost dimension out, merging those that continue
+    // a contiguous run.
+    unsigned long element_step = 1;    // elements between indices of 'from'
+    bool contiguous = true;             // is the run so far contiguous?
+    vector<unsigned long> count, step;
+    for (int d = dims - 1; d >= 0; --d) {
+        unsigned long n = to.count(d);
+        unsigned long s = (to.stride[d] / from.stride[d]) * element_step;
+
+        plan.src += (to.start[d] - from.start[d]) / from.stride[d] * element_step * width;
+        element_step *= from.count(d);
+
+        if (n == 1)
+            continue;
+
+        if (count.empty() && plan.inner_count == 1) {
+            plan.inner_count = n;
+            plan.inner_step = s;
+            contiguous = s == 1;
+        }
+        else if (count.empty() && contiguous && s == plan.inner_count) {
+            plan.inner_count *= n;
+        }
+        else {
+            count.push_back(n);
+            step.push_back(s * width);
+            contiguous = false;
+        }
+    }
+
+    plan.count.assign(count.rbegin(), count.rend());
+    plan.step.assign(step.rbegin(), step.rend());
+
+    char *out = static_cast<char*>(dest);
+
+    unsigned long outer = plan.count.empty() ? 1 : plan.count[0];
+    threads = min<unsigned long>(max(threads, 1U), outer);
+    if (threads == 1 || to.elements() < MIN_THREADED_ELEMENTS) {
+        copy_block(plan, 0, outer, out);
+        return;
+    }
+
+    // Each index of the outermost dimension writes this many bytes
+    unsigned long block = to.elements() / outer * width;
+
+    vector<CopyTask> tasks(threads);
+    vector<pthread_t> ids(threads);
+    unsigned long first = 0;
+    for (unsigned int t = 0; t < threads; ++t) {
+        unsigned long last = first + (outer - first) / (threads - t);
+        tasks[t].plan = &plan;
+        tasks[t].first = first;
+        tasks[t].last = last;
+        tasks[t].dest = out + first * block;
+        first = last;
+    }
+
+    // Run the first block here; if a thread can't start, do its work here too
+    vector<bool> started(threads, false);
+    for (unsigned int t = 1; t < threads; ++t)
+        started[t] = pthread_create(&ids[t], 0, copy_task, &tasks[t]) == 0;
+
+    copy_task(&tasks[0]);
+
+    for (unsigned int t = 1; t < threads; ++t) {
+        if (started[t])
+            pthread_join(ids[t], 0);
+        else
+            copy_task(&tasks[t]);
+    }
+}
+
+} // namespace libdap
@@ -0,0 +1,67 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _hyperslab_h
+#define _hyperslab_h
+
+#include <vector>
+
+namespace libdap {
+
+class Array;
+
+/** The part of an array selected by a constraint: the start, stop and
+ * stride of each dimension, outermost first. The stop is the last index
+ * selected, so count(d) elements are selected from dimension d.
+ *
+ * A Hyperslab also describes the values held in a row-major buffer; the
+ * whole array is the hyperslab that starts at zero with a stride of one.
+ * extract() copies the values of one hyperslab out of a buffer holding
+ * another that contains it. Handlers that read a whole array, or a block
+ * of it, can use that in place of their own start/stride/stop loops; see
+ * Array::set_value_slice().
+ */
+struct Hyperslab {
+    std::vector<int> start;
+    std::vector<int> stop;
+    std::vector<int> stride;
+
+    Hyperslab() { }
+    Hyperslab(Array &array, bool constrained = true);
+
+    void append(int start, int stride, int stop);
+
+    unsigned int dimensions() const { return start.size(); }
+    int count(unsigned int d) const { return (stop[d] - start[d]) / stride[d] + 1; }
+    unsigned long elements() const;
+
+    bool contains(const Hyperslab &slab) const;
+
+    static void extract(const Hyperslab &from, const void *values, unsigned int width, const Hyperslab &to,
+            void *dest, unsigned int threads = 1);
+};
+
+} // namespace libdap
+
+#endif // _hyperslab_h
@@ -0,0 +1,139 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <map>
+#include <string>
+
+#include "InternedString.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Made on first use and never deleted, so that BaseTypes destroyed while
+// the program exits can still release their strings.
+static map<string, unsigned long> *table = 0;
+
+class TableLock {
+public:
+    TableLock() { pthread_mutex_lock(&table_mutex); }
+    ~TableLock() { pthread_mutex_unlock(&table_mutex); }
+};
+
+// The counts are changed atomically. A count only goes from one to zero
+// while table_mutex is held, and the entry is erased then, so an entry
+// found in the table (with the mutex held) is never about to be erased
+// and an InternedString being copied always holds a count of at least one.
+
+InternedString::Table::value_type *
+InternedString::m_acquire(const string &s)
+{
+    if (s.empty())
+        return 0;
+
+    TableLock lock;
+    if (!table)
+        table = new Table;
+
+    Table::iterator i = table->insert(make_pair(s, 0UL)).first;
+    __sync_add_and_fetch(&i->second, 1);
+
+    return &*i;
+}
+
+void InternedString::m_acquire(Table::value_type *entry)
+{
+    if (!entry)
+        return;
+
+    __sync_add_and_fetch(&entry->second, 1);
+}
+
+void InternedString::m_release(Table::value_type *entry)
+{
+    if (!entry)
+        return;
+
+    // If this is not the last reference, drop it without the lock. Start
+    // from a guess; when it's wrong the compare-and-swap returns the count.
+    unsigned long count = 2;
+    while (count > 1) {
+        unsigned long seen = __sync_val_compare_and_swap(&entry->second, count, count - 1);
+        if (seen == count)
+            return;
+        count = seen;
+    }
+
+    // It may be the last; another thread could make a new reference from
+    // the table until the lock is held.
+    TableLock lock;
+    if (__sync_sub_and_fetch(&entry->second, 1) == 0)
+        table->erase(table->find(entry->first));
+}
+
+InternedString &
+InternedString::operator=(const InternedString &rhs)
+{
+    if (d_entry != rhs.d_entry) {
+        m_acquire(rhs.d_entry);
+        m_release(d_entry);
+        d_entry = rhs.d_entry;
+    }
+
+    return *this;
+}
+
+InternedString &
+InternedString::operator=(const string &s)
+{
+    Table::value_type *entry = m_acquire(s);
+    m_release(d_entry);
+    d_entry = entry;
+
+    return *this;
+}
+
+/** @return The text. */
+const string &
+InternedString::str() const
+{
+    static const string empty_string;
+    return d_entry ? d_entry->first : empty_string;
+}
+
+/** @return The number of different strings in the table. */
+unsigned long InternedString::size()
+{
+    TableLock lock;
+    return table ? table->size() : 0;
+}
+
+} // namespace libdap
@@ -0,0 +1,75 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _interned_string_h
+#define _interned_string_h
+
+#include <map>
+#include <string>
+
+namespace libdap {
+
+/** A string held in a table shared by the whole process, so that objects
+ * holding the same text share one copy of it. BaseType uses this for the
+ * names of variables and for the dataset name, which is the same for every
+ * variable read from a dataset.
+ *
+ * An InternedString is the size of a pointer. Copying one doesn't copy the
+ * text; it increments a count of the objects using the text, which is
+ * removed from the table when the last of them is destroyed. The count is
+ * changed with atomic operations, so copying, assigning and destroying
+ * InternedStrings don't lock anything. Only making one from a std::string
+ * and destroying the last one for a given text use the table, which is
+ * guarded by a mutex. InternedStrings can be made, copied and destroyed
+ * by any thread; an empty string doesn't use the table at all.
+ */
+class InternedString {
+    typedef std::map<std::string, unsigned long> Table;
+
+    // The text and its count, in the table; null for the empty string
+    Table::value_type *d_entry;
+
+    static Table::value_type *m_acquire(const std::string &s);
+    static void m_acquire(Table::value_type *entry);
+    static void m_release(Table::value_type *entry);
+
+public:
+    InternedString() : d_entry(0) { }
+    InternedString(const std::string &s) : d_entry(m_acquire(s)) { }
+    InternedString(const InternedString &rhs) : d_entry(rhs.d_entry) { m_acquire(d_entry); }
+    ~InternedString() { m_release(d_entry); }
+
+    InternedString &operator=(const InternedString &rhs);
+    InternedString &operator=(const std::string &s);
+
+    const std::string &str() const;
+
+    bool empty() const { return d_entry == 0; }
+
+    static unsigned long size();
+};
+
+} // namespace libdap
+
+#endif // _interned_string_h
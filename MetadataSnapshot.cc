@@ -0,0 +1,929 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include "config.h"
+
+#include <cstring>
+
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MetadataSnapshot.h"
+#include "BaseType.h"
+#include "BaseTypeFactory.h"
+#include "D4BaseTypeFactory.h"
+#include "Array.h"
+#include "Grid.h"
+#include "Constructor.h"
+#include "D4Enum.h"
+#include "D4EnumDefs.h"
+#include "D4Dimensions.h"
+#include "D4Maps.h"
+#include "D4Group.h"
+#include "D4Attributes.h"
+#include "AttrTable.h"
+#include "AttrValues.h"
+#include "DDS.h"
+#include "DMR.h"
+#include "Error.h"
+#include "InternalErr.h"
+#include "util.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+static const char magic[] = "DAP-SNAPSHOT";
+static const size_t magic_size = sizeof(magic) - 1;
+
+static const char dmr_kind = '4';
+static const char dds_kind = '2';
+
+// How AttrValues are stored
+static const unsigned char values_as_text = 0;
+static const unsigned char values_as_binary = 1;
+
+// Flags for the entries of an AttrTable
+static const unsigned char entry_is_alias = 1;
+static const unsigned char entry_is_global = 2;
+
+/** Build the body of a snapshot, then write it after the header and the
+ * table of names. */
+class MetadataSnapshot::Encoder {
+    string d_body;
+
+    // The names, in the order they were first used
+    map<string, unsigned long> d_names;
+    vector<const string*> d_name_order;
+
+    // The AttrTables and AttrValues written so far, so aliases can refer
+    // to them
+    map<const void*, unsigned long> d_attr_ids;
+
+public:
+    void byte(unsigned char c) { d_body.push_back(c); }
+
+    void number(unsigned long long n) {
+        while (n >= 0x80) {
+            d_body.push_back(static_cast<char>((n & 0x7f) | 0x80));
+            n >>= 7;
+        }
+        d_body.push_back(static_cast<char>(n));
+    }
+
+    void signed_number(long long n) {
+        // zig-zag, so that small negative numbers are short too
+        number((static_cast<unsigned long long>(n) << 1) ^ static_cast<unsigned long long>(n >> 63));
+    }
+
+    void text(const string &s) {
+        number(s.size());
+        d_body.append(s);
+    }
+
+    void name(const string &s) {
+        map<string, unsigned long>::iterator i = d_names.find(s);
+        if (i == d_names.end()) {
+            i = d_names.insert(make_pair(s, d_name_order.size())).first;
+            d_name_order.push_back(&i->first);
+        }
+        number(i->second);
+    }
+
+    void values(AttrValues &values);
+    void table(AttrTable &at);
+    void attributes(D4Attributes *attrs);
+
+    void var(BaseType *btp);
+    void declarations(D4Group *grp);
+    void variables(D4Group *grp);
+
+    void write(ostream &out, char kind);
+};
+
+/** Read a snapshot held in memory. */
+class MetadataSnapshot::Decoder {
+    const char *d_pos;
+    const char *d_end;
+
+    vector<string> d_names;
+    vector<void*> d_attr_ids;
+
+    // Maps are added once all the variables they might name are loaded
+    struct PendingMap {
+        Array *array;
+        D4Group *grp;
+        string name;
+
+        PendingMap(Array *a, D4Group *g, const string &n) : array(a), grp(g), name(n) {}
+    };
+    vector<PendingMap> d_maps;
+
+    D4BaseTypeFactory *d_d4_factory;
+    BaseTypeFactory *d_factory;
+    D4Group *d_root;
+
+    void m_need(unsigned long long n) const {
+        if (static_cast<unsigned long long>(d_end - d_pos) < n)
+            throw Error("The metadata snapshot is truncated.");
+    }
+
+public:
+    Decoder(const char *buf, size_t size, char kind);
+
+    unsigned char byte() {
+        m_need(1);
+        return static_cast<unsigned char>(*d_pos++);
+    }
+
+    unsigned long long number() {
+        unsigned long long n = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            unsigned char c = byte();
+            n |= static_cast<unsigned long long>(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return n;
+        }
+        throw Error("The metadata snapshot is corrupt.");
+    }
+
+    // A count of things that each take at least item_size bytes; check it
+    // before it's used to size anything.
+    unsigned long long count(size_t item_size) {
+        unsigned long long n = number();
+        if (n > static_cast<unsigned long long>(d_end - d_pos) / item_size)
+            throw Error("The metadata snapshot is truncated.");
+        return n;
+    }
+
+    long long signed_number() {
+        unsigned long long n = number();
+        return static_cast<long long>(n >> 1) ^ -static_cast<long long>(n & 1);
+    }
+
+    string text() {
+        unsigned long long n = number();
+        m_need(n);
+        string s(d_pos, n);
+        d_pos += n;
+        return s;
+    }
+
+    const string &name() {
+        unsigned long long i = number();
+        if (i >= d_names.size())
+            throw Error("The metadata snapshot is corrupt.");
+        return d_names[i];
+    }
+
+    void values(AttrValues &values);
+    void table(AttrTable &at);
+    void attributes(BaseType *btp);
+    void attributes(D4Attributes *attrs);
+
+    BaseType *dap2_var();
+    BaseType *dap4_var(D4Group *grp);
+    void declarations(D4Group *grp);
+    void variables(D4Group *grp);
+    void maps();
+
+    void load(DMR &dmr);
+    void load(DDS &dds);
+};
+
+// Binary values are copied so the buffer needn't be aligned for T
+template<typename T>
+static void append_binary(AttrValues &values, const char *p, unsigned long n)
+{
+    vector<T> v(n);
+    if (n > 0) {
+        memcpy(&v[0], p, n * sizeof(T));
+        values.append(&v[0], n);
+    }
+}
+
+template<typename T>
+static const char *binary_data(AttrValues &values)
+{
+    return reinterpret_cast<const char*>(values.data<T>());
+}
+
+void MetadataSnapshot::Encoder::values(AttrValues &values)
+{
+    d_attr_ids.insert(make_pair(&values, d_attr_ids.size()));
+
+    // Values that have text are saved as text, so they print the same way
+    if (values.is_binary() && !values.has_text()) {
+        byte(values_as_binary);
+        number(values.size());
+
+        const char *data = 0;
+        switch (values.type()) {
+        case Attr_byte: data = binary_data<dods_byte>(values); break;
+        case Attr_int16: data = binary_data<dods_int16>(values); break;
+        case Attr_uint16: data = binary_data<dods_uint16>(values); break;
+        case Attr_int32: data = binary_data<dods_int32>(values); break;
+        case Attr_uint32: data = binary_data<dods_uint32>(values); break;
+        case Attr_float32: data = binary_data<dods_float32>(values); break;
+        case Attr_float64: data = binary_data<dods_float64>(values); break;
+        default:
+            throw InternalErr(__FILE__, __LINE__, "Binary attribute values of type " + AttrType_to_String(values.type()));
+        }
+
+        if (data)
+            d_body.append(data, values.size() * AttrValues::width(values.type()));
+    }
+    else {
+        const vector<string> &text_values = static_cast<const AttrValues&>(values).text();
+
+        byte(values_as_text);
+        number(text_values.size());
+        for (vector<string>::const_iterator i = text_values.begin(), e = text_values.end(); i != e; ++i)
+            text(*i);
+    }
+}
+
+void MetadataSnapshot::Decoder::values(AttrValues &values)
+{
+    d_attr_ids.push_back(&values);
+
+    unsigned char form = byte();
+
+    if (form == values_as_binary) {
+        size_t width = AttrValues::width(values.type());
+        if (width == 0)
+            throw Error("The metadata snapshot is corrupt.");
+
+        unsigned long long n = count(width);
+        size_t size = n * width;
+
+        switch (values.type()) {
+        case Attr_byte: append_binary<dods_byte>(values, d_pos, n); break;
+        case Attr_int16: append_binary<dods_int16>(values, d_pos, n); break;
+        case Attr_uint16: append_binary<dods_uint16>(values, d_pos, n); break;
+        case Attr_int32: append_binary<dods_int32>(values, d_pos, n); break;
+        case Attr_uint32: append_binary<dods_uint32>(values, d_pos, n); break;
+        case Attr_float32: append_binary<dods_float32>(values, d_pos, n); break;
+        case Attr_float64: append_binary<dods_float64>(values, d_pos, n); break;
+        default:
+            throw Error("The metadata snapshot is corrupt.");
+        }
+
+        d_pos += size;
+    }
+    else {
+        // Each value has at least its length
+        unsigned long long n = count(1);
+        vector<string> text_values;
+        text_values.reserve(n);
+        for (unsigned long long i = 0; i < n; ++i)
+            text_values.push_back(text());
+
+        values.assign(text_values);
+    }
+}
+
+void MetadataSnapshot::Encoder::table(AttrTable &at)
+{
+    d_attr_ids.insert(make_pair(&at, d_attr_ids.size()));
+
+    name(at.get_name());
+    byte(at.is_global_attribute());
+    number(at.get_size());
+
+    for (AttrTable::Attr_iter i = at.attr_begin(), e = at.attr_end(); i != e; ++i) {
+        AttrTable::entry *entry = *i;
+
+        name(entry->name);
+        byte(entry->type);
+        byte((entry->is_alias ? entry_is_alias : 0) | (entry->is_global ? entry_is_global : 0));
+
+        if (entry->is_alias) {
+            // An alias shares the table or values of an attribute saved
+            // before it
+            const void *target = entry->type == Attr_container ?
+                    static_cast<const void*>(entry->attributes) : static_cast<const void*>(entry->attr);
+            map<const void*, unsigned long>::iterator t = d_attr_ids.find(target);
+            if (t == d_attr_ids.end())
+                throw InternalErr(__FILE__, __LINE__, "The attribute aliased by '" + entry->name + "' was not found.");
+
+            text(entry->aliased_to);
+            number(t->second);
+        }
+        else if (entry->type == Attr_container) {
+            table(*entry->attributes);
+        }
+        else {
+            values(*entry->attr);
+        }
+    }
+}
+
+void MetadataSnapshot::Decoder::table(AttrTable &at)
+{
+    d_attr_ids.push_back(&at);
+
+    m_set_name(at, name());
+    at.set_is_global_attribute(byte());
+
+    // Each entry has at least a name, a type and its flags
+    unsigned long long n = count(3);
+    for (unsigned long long i = 0; i < n; ++i) {
+        AttrTable::entry *entry = new AttrTable::entry;
+        try {
+            entry->name = name();
+            entry->type = static_cast<AttrType>(byte());
+            unsigned char flags = byte();
+            entry->is_global = flags & entry_is_global;
+
+            if (flags & entry_is_alias) {
+                entry->aliased_to = text();
+                unsigned long long id = number();
+                if (id >= d_attr_ids.size())
+                    throw Error("The metadata snapshot is corrupt.");
+
+                if (entry->type == Attr_container)
+                    entry->attributes = static_cast<AttrTable*>(d_attr_ids[id]);
+                else
+                    entry->attr = static_cast<AttrValues*>(d_attr_ids[id]);
+                entry->is_alias = true;
+            }
+            else if (entry->type == Attr_container) {
+                entry->attributes = new AttrTable;
+                table(*entry->attributes);
+            }
+            else {
+                entry->attr = new AttrValues(entry->type);
+                values(*entry->attr);
+            }
+        }
+        catch (...) {
+            delete entry;
+            throw;
+        }
+
+        m_add_entry(at, entry);
+    }
+}
+
+void MetadataSnapshot::Encoder::attributes(D4Attributes *attrs)
+{
+    number(attrs->attribute_end() - attrs->attribute_begin());
+
+    for (D4Attributes::D4AttributesIter i = attrs->attribute_begin(), e = attrs->attribute_end(); i != e; ++i) {
+        D4Attribute *attr = *i;
+
+        name(attr->name());
+        byte(attr->type());
+        if (attr->type() == attr_container_c)
+            attributes(attr->attributes());
+        else
+            values(attr->values());
+    }
+}
+
+void MetadataSnapshot::Decoder::attributes(D4Attributes *attrs)
+{
+    // Each attribute has at least a name and a type
+    unsigned long long n = count(2);
+    for (unsigned long long i = 0; i < n; ++i) {
+        string attr_name = name();
+        D4Attribute *attr = new D4Attribute(attr_name, static_cast<D4AttributeType>(byte()));
+        attrs->add_attribute_nocopy(attr);
+
+        if (attr->type() == attr_container_c)
+            attributes(attr->attributes());
+        else
+            values(attr->values());
+    }
+}
+
+// The parser gives every variable a D4Attributes object; only make one for
+// variables that have attributes.
+void MetadataSnapshot::Decoder::attributes(BaseType *btp)
+{
+    const char *start = d_pos;
+    if (number() == 0)
+        return;
+
+    d_pos = start;
+    attributes(btp->attributes());
+}
+
+void MetadataSnapshot::Encoder::var(BaseType *btp)
+{
+    byte(btp->type());
+    name(btp->name());
+
+    if (btp->is_dap4()) {
+        attributes(btp->attributes());
+    }
+    else {
+        byte(btp->has_attr_table());
+        if (btp->has_attr_table())
+            table(btp->get_attr_table());
+    }
+
+    switch (btp->type()) {
+    case dods_enum_c: {
+        D4EnumDef *enum_def = static_cast<D4Enum*>(btp)->enumeration();
+        if (!enum_def)
+            throw InternalErr(__FILE__, __LINE__, "The Enum '" + btp->name() + "' has no definition.");
+
+        // The path, as D4Enum::print_dap4() writes it
+        string path = enum_def->name();
+        if (enum_def->parent())
+            path = static_cast<D4Group*>(enum_def->parent()->parent())->FQN() + path;
+        name(path);
+        break;
+    }
+
+    case dods_array_c: {
+        Array *a = static_cast<Array*>(btp);
+        var(a->prototype());
+
+        number(a->dimensions());
+        for (Array::Dim_iter i = a->dim_begin(), e = a->dim_end(); i != e; ++i) {
+            byte((*i).dim != 0);
+            if ((*i).dim) {
+                name((*i).dim->fully_qualified_name());
+            }
+            else {
+                number((*i).size);
+                name((*i).name);
+            }
+        }
+
+        if (btp->is_dap4()) {
+            D4Maps *maps = a->maps();
+            number(maps->size());
+            for (D4Maps::D4MapsIter i = maps->map_begin(), e = maps->map_end(); i != e; ++i)
+                name((*i)->name());
+        }
+        break;
+    }
+
+    case dods_grid_c: {
+        Grid *g = static_cast<Grid*>(btp);
+        var(g->get_array());
+
+        number(g->map_end() - g->map_begin());
+        for (Grid::Map_iter i = g->map_begin(), e = g->map_end(); i != e; ++i)
+            var(*i);
+        break;
+    }
+
+    case dods_structure_c:
+    case dods_sequence_c: {
+        Constructor *c = static_cast<Constructor*>(btp);
+        number(c->element_count());
+        for (Constructor::Vars_iter i = c->var_begin(), e = c->var_end(); i != e; ++i)
+            var(*i);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+BaseType *MetadataSnapshot::Decoder::dap2_var()
+{
+    Type type = static_cast<Type>(byte());
+    string var_name = name();
+
+    BaseType *btp = d_factory->NewVariable(type, var_name);
+    try {
+        if (byte())
+            table(btp->get_attr_table());
+
+        switch (type) {
+        case dods_array_c: {
+            Array *a = static_cast<Array*>(btp);
+            a->add_var_nocopy(dap2_var());
+
+            unsigned long long n = number();
+            for (unsigned long long i = 0; i < n; ++i) {
+                if (byte())
+                    throw Error("The metadata snapshot is corrupt.");
+                int size = number();
+                a->append_dim(size, name());
+            }
+            break;
+        }
+
+        case dods_grid_c: {
+            Grid *g = static_cast<Grid*>(btp);
+            g->add_var_nocopy(dap2_var(), libdap::array);
+
+            unsigned long long n = number();
+            for (unsigned long long i = 0; i < n; ++i)
+                g->add_var_nocopy(dap2_var(), libdap::maps);
+            break;
+        }
+
+        case dods_structure_c:
+        case dods_sequence_c: {
+            unsigned long long n = number();
+            for (unsigned long long i = 0; i < n; ++i)
+                btp->add_var_nocopy(dap2_var());
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    catch (...) {
+        delete btp;
+        throw;
+    }
+
+    return btp;
+}
+
+// Build the variables the way D4ParserSax2 does, so the loaded DMR is the
+// same as a parsed one.
+BaseType *MetadataSnapshot::Decoder::dap4_var(D4Group *grp)
+{
+    Type type = static_cast<Type>(byte());
+    string var_name = name();
+
+    BaseType *btp = d_d4_factory->NewVariable(type, var_name);
+    if (!btp)
+        throw Error("Could not instantiate the variable '" + var_name + "'.");
+
+    try {
+        btp->set_is_dap4(true);
+        attributes(btp);
+
+        switch (type) {
+        case dods_enum_c: {
+            string path = name();
+            D4EnumDef *enum_def = path[0] == '/' ? d_root->find_enum_def(path) : grp->find_enum_def(path);
+            if (!enum_def)
+                throw Error("Could not find the Enumeration definition '" + path + "'.");
+
+            static_cast<D4Enum*>(btp)->set_enumeration(enum_def);
+            break;
+        }
+
+        case dods_array_c: {
+            Array *a = static_cast<Array*>(btp);
+            a->add_var_nocopy(dap4_var(grp));
+
+            unsigned long long n = number();
+            for (unsigned long long i = 0; i < n; ++i) {
+                if (byte()) {
+                    string path = name();
+                    D4Dimension *dim = path[0] == '/' ? d_root->find_dim(path) : grp->find_dim(path);
+                    if (!dim)
+                        throw Error("The dimension '" + path + "' was not found while loading the variable '" + var_name + "'.");
+                    a->append_dim(dim);
+                }
+                else {
+                    int size = number();
+                    a->append_dim(size, name());
+                }
+            }
+
+            n = number();
+            for (unsigned long long i = 0; i < n; ++i)
+                d_maps.push_back(PendingMap(a, grp, name()));
+            break;
+        }
+
+        case dods_structure_c:
+        case dods_sequence_c: {
+            unsigned long long n = number();
+            for (unsigned long long i = 0; i < n; ++i)
+                btp->add_var_nocopy(dap4_var(grp));
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    catch (...) {
+        delete btp;
+        throw;
+    }
+
+    return btp;
+}
+
+// The Groups, with their dimensions and enumerations, are saved before any
+// of the variables, which may use those of a Group that follows them.
+void MetadataSnapshot::Encoder::declarations(D4Group *grp)
+{
+    attributes(grp->attributes());
+
+    D4Dimensions *dims = grp->dims();
+    number(dims->dim_end() - dims->dim_begin());
+    for (D4Dimensions::D4DimensionsIter i = dims->dim_begin(), e = dims->dim_end(); i != e; ++i) {
+        name((*i)->name());
+        number((*i)->size());
+    }
+
+    D4EnumDefs *enum_defs = grp->enum_defs();
+    number(enum_defs->enum_end() - enum_defs->enum_begin());
+    for (D4EnumDefs::D4EnumDefIter i = enum_defs->enum_begin(), e = enum_defs->enum_end(); i != e; ++i) {
+        D4EnumDef *enum_def = *i;
+        name(enum_def->name());
+        byte(enum_def->type());
+
+        number(enum_def->value_end() - enum_def->value_begin());
+        for (D4EnumDef::D4EnumValueIter v = enum_def->value_begin(), ve = enum_def->value_end(); v != ve; ++v) {
+            name(enum_def->label(v));
+            signed_number(enum_def->value(v));
+        }
+    }
+
+    number(grp->grp_end() - grp->grp_begin());
+    for (D4Group::groupsIter i = grp->grp_begin(), e = grp->grp_end(); i != e; ++i) {
+        name((*i)->name());
+        declarations(*i);
+    }
+}
+
+void MetadataSnapshot::Encoder::variables(D4Group *grp)
+{
+    number(grp->element_count());
+    for (Constructor::Vars_iter i = grp->var_begin(), e = grp->var_end(); i != e; ++i)
+        var(*i);
+
+    for (D4Group::groupsIter i = grp->grp_begin(), e = grp->grp_end(); i != e; ++i)
+        variables(*i);
+}
+
+// The Group has been added to its parent, so paths to its dimensions and
+// enumerations can be found from the root Group.
+void MetadataSnapshot::Decoder::declarations(D4Group *grp)
+{
+    attributes(grp);
+
+    unsigned long long n = number();
+    for (unsigned long long i = 0; i < n; ++i) {
+        string dim_name = name();
+        grp->dims()->add_dim_nocopy(new D4Dimension(dim_name, number()));
+    }
+
+    n = number();
+    for (unsigned long long i = 0; i < n; ++i) {
+        string enum_name = name();
+        D4EnumDef *enum_def = new D4EnumDef(enum_name, static_cast<Type>(byte()));
+        grp->enum_defs()->add_enum_nocopy(enum_def);
+
+        unsigned long long values = number();
+        for (unsigned long long v = 0; v < values; ++v) {
+            string label = name();
+            enum_def->add_value(label, signed_number());
+        }
+    }
+
+    n = number();
+    for (unsigned long long i = 0; i < n; ++i) {
+        D4Group *child = static_cast<D4Group*>(d_d4_factory->NewVariable(dods_group_c, name()));
+        child->set_is_dap4(true);
+        child->set_parent(grp);
+        grp->add_group_nocopy(child);
+
+        declarations(child);
+    }
+}
+
+void MetadataSnapshot::Decoder::variables(D4Group *grp)
+{
+    unsigned long long n = number();
+    for (unsigned long long i = 0; i < n; ++i)
+        grp->add_var_nocopy(dap4_var(grp));
+
+    for (D4Group::groupsIter i = grp->grp_begin(), e = grp->grp_end(); i != e; ++i)
+        variables(*i);
+}
+
+void MetadataSnapshot::Decoder::maps()
+{
+    for (vector<PendingMap>::iterator i = d_maps.begin(), e = d_maps.end(); i != e; ++i) {
+        Array *map_source = i->name[0] == '/' ? d_root->find_map_source(i->name) : i->grp->find_map_source(i->name);
+        i->array->maps()->add_map(new D4Map(i->name, map_source));
+    }
+}
+
+void MetadataSnapshot::Encoder::write(ostream &out, char kind)
+{
+    out.write(magic, magic_size);
+
+    // The header and the names go before the body
+    string body;
+    d_body.swap(body);
+
+    number(format_version);
+    byte(kind);
+    byte(is_host_big_endian());
+
+    number(d_name_order.size());
+    for (vector<const string*>::iterator i = d_name_order.begin(), e = d_name_order.end(); i != e; ++i)
+        text(**i);
+
+    out.write(d_body.data(), d_body.size());
+    out.write(body.data(), body.size());
+
+    if (!out)
+        throw InternalErr(__FILE__, __LINE__, "Could not write the metadata snapshot.");
+}
+
+MetadataSnapshot::Decoder::Decoder(const char *buf, size_t size, char kind) :
+    d_pos(buf), d_end(buf + size), d_d4_factory(0), d_factory(0), d_root(0)
+{
+    if (size < magic_size || memcmp(buf, magic, magic_size) != 0)
+        throw Error("This is not a metadata snapshot.");
+    d_pos += magic_size;
+
+    if (number() != format_version)
+        throw Error("The metadata snapshot was made by a different version of libdap.");
+    if (byte() != static_cast<unsigned char>(kind))
+        throw Error(kind == dmr_kind ? "The metadata snapshot does not hold a DMR." : "The metadata snapshot does not hold a DDS.");
+    if (byte() != is_host_big_endian())
+        throw Error("The metadata snapshot was made on a machine with a different byte order.");
+
+    unsigned long long n = count(1);
+    d_names.reserve(n);
+    for (unsigned long long i = 0; i < n; ++i)
+        d_names.push_back(text());
+}
+
+void MetadataSnapshot::Decoder::load(DMR &dmr)
+{
+    d_d4_factory = dmr.factory();
+    if (!d_d4_factory)
+        throw InternalErr(__FILE__, __LINE__, "The DMR has no factory.");
+
+    dmr.set_name(name());
+    dmr.set_filename(text());
+    dmr.set_dap_version(text());
+    dmr.set_dmr_version(text());
+    dmr.set_request_xml_base(text());
+    dmr.set_namespace(text());
+
+    d_root = dmr.root();
+    declarations(d_root);
+    variables(d_root);
+    maps();
+}
+
+void MetadataSnapshot::Decoder::load(DDS &dds)
+{
+    d_factory = dds.get_factory();
+    if (!d_factory)
+        throw InternalErr(__FILE__, __LINE__, "The DDS has no factory.");
+
+    dds.set_dataset_name(name());
+    dds.filename(text());
+    dds.set_dap_version(text());
+    dds.set_request_xml_base(text());
+    dds.set_namespace(text());
+
+    table(dds.get_attr_table());
+
+    unsigned long long n = number();
+    for (unsigned long long i = 0; i < n; ++i)
+        dds.add_var_nocopy(dap2_var());
+}
+
+void MetadataSnapshot::m_add_entry(AttrTable &at, AttrTable::entry *e)
+{
+    at.m_add_entry(e);
+    if (e->type == Attr_container && !e->is_alias)
+        e->attributes->d_parent = &at;
+}
+
+void MetadataSnapshot::m_set_name(AttrTable &at, const string &name)
+{
+    at.d_name = name;
+}
+
+/** Save a DMR.
+ * @param dmr The DMR
+ * @param out Write the snapshot here
+ * @exception InternalErr if the snapshot could not be written. */
+void MetadataSnapshot::save(DMR &dmr, ostream &out)
+{
+    Encoder encoder;
+
+    encoder.name(dmr.name());
+    encoder.text(dmr.filename());
+    encoder.text(dmr.dap_version());
+    encoder.text(dmr.dmr_version());
+    encoder.text(dmr.request_xml_base());
+    encoder.text(dmr.get_namespace());
+
+    encoder.declarations(dmr.root());
+    encoder.variables(dmr.root());
+
+    encoder.write(out, dmr_kind);
+}
+
+/** Save a DDS with its attributes.
+ * @param dds The DDS
+ * @param out Write the snapshot here
+ * @exception InternalErr if the snapshot could not be written. */
+void MetadataSnapshot::save(DDS &dds, ostream &out)
+{
+    Encoder encoder;
+
+    encoder.name(dds.get_dataset_name());
+    encoder.text(dds.filename());
+    encoder.text(dds.get_dap_version());
+    encoder.text(dds.get_request_xml_base());
+    encoder.text(dds.get_namespace());
+
+    encoder.table(dds.get_attr_table());
+
+    encoder.number(dds.num_var());
+    for (DDS::Vars_iter i = dds.var_begin(), e = dds.var_end(); i != e; ++i)
+        encoder.var(*i);
+
+    encoder.write(out, dds_kind);
+}
+
+/** Load a DMR from a snapshot held in memory.
+ * @param buf The snapshot
+ * @param size Its size in bytes
+ * @param dmr An empty DMR; its factory is used to make the variables.
+ * @exception Error if \c buf does not hold a DMR snapshot made by this
+ * version of the format on a machine with the same byte order, or if it is
+ * truncated or corrupt. */
+void MetadataSnapshot::load(const char *buf, size_t size, DMR &dmr)
+{
+    Decoder decoder(buf, size, dmr_kind);
+    decoder.load(dmr);
+}
+
+/** Load a DDS, with its attributes, from a snapshot held in memory.
+ * @param buf The snapshot
+ * @param size Its size in bytes
+ * @param dds An empty DDS; its factory is used to make the variables.
+ * @exception Error if \c buf does not hold a DDS snapshot that can be read. */
+void MetadataSnapshot::load(const char *buf, size_t size, DDS &dds)
+{
+    Decoder decoder(buf, size, dds_kind);
+    decoder.load(dds);
+}
+
+static string read_all(istream &in)
+{
+    string buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (in.bad())
+        throw Error("Could not read the metadata snapshot.");
+
+    return buf;
+}
+
+/** Load a DMR from a snapshot.
+ * @param in Read the snapshot from here; it is read to the end.
+ * @param dmr An empty DMR
+ * @see load(const char *, size_t, DMR &) */
+void MetadataSnapshot::load(istream &in, DMR &dmr)
+{
+    string buf = read_all(in);
+    load(buf.data(), buf.size(), dmr);
+}
+
+/** Load a DDS from a snapshot.
+ * @param in Read the snapshot from here; it is read to the end.
+ * @param dds An empty DDS
+ * @see load(const char *, size_t, DDS &) */
+void MetadataSnapshot::load(istream &in, DDS &dds)
+{
+    string buf = read_all(in);
+    load(buf.data(), buf.size(), dds);
+}
+
+} // namespace libdap
@@ -0,0 +1,105 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#ifndef _metadata_snapshot_h
+#define _metadata_snapshot_h
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifndef _attrtable_h
+#include "AttrTable.h"
+#endif
+
+namespace libdap {
+
+class DDS;
+class DMR;
+
+/** Save a DMR or a DDS, with its attributes, in a binary form that can be
+ * loaded much faster than the DMR or DDX it was built from can be parsed.
+ *
+ * A snapshot starts with a header: the text "DAP-SNAPSHOT", the version
+ * of the format, whether it holds a DMR or a DDS and the byte order of
+ * the machine that made it. The names used in the snapshot are stored
+ * once each, in a table that follows the header, and referred to by
+ * number; integers are stored in as few bytes as they need. Attribute
+ * values are stored as the text they had, so they print exactly as they
+ * were read, or, if they are held only in binary form (see AttrValues),
+ * as those bytes.
+ *
+ * Loading reads the whole snapshot into one buffer and builds the
+ * variables from it using the factory of the DMR or DDS, so the types a
+ * handler makes with its own factory are kept. A loaded DMR or DDS prints
+ * the same DMR, DDX and DAS as the one that was saved. A snapshot made by
+ * a different version of this code, or on a machine with a different byte
+ * order, can't be loaded; load() throws Error and the caller should build
+ * the metadata the usual way (and may save a new snapshot).
+ *
+ * Servers can keep snapshots in a DataResponseCache, which stores them
+ * with DAPCache3. Use a response name such as "dmr-snapshot" and a
+ * DataResponseWriter whose write() calls save(); the cached entry is
+ * remade when the dataset's last modified time changes:
+ *
+ * @code
+ * int fd; off_t offset;
+ * ostringstream snapshot;
+ * if (cache.get_response("dmr-snapshot", dataset, "", lmt, writer, fd, offset)) {
+ *     cache.send_response(snapshot, fd, offset);
+ *     cache.release(fd);
+ * }
+ * else {
+ *     writer.write(snapshot);    // not cached; make it here
+ * }
+ * string buf = snapshot.str();
+ * MetadataSnapshot::load(buf.data(), buf.size(), dmr);
+ * @endcode
+ */
+class MetadataSnapshot {
+    class Encoder;
+    class Decoder;
+
+    // These use the private parts of AttrTable
+    static void m_add_entry(AttrTable &at, AttrTable::entry *e);
+    static void m_set_name(AttrTable &at, const std::string &name);
+
+public:
+    /// The version of the format written by save()
+    static const unsigned int format_version = 1;
+
+    static void save(DMR &dmr, std::ostream &out);
+    static void save(DDS &dds, std::ostream &out);
+
+    static void load(std::istream &in, DMR &dmr);
+    static void load(std::istream &in, DDS &dds);
+
+    static void load(const char *buf, size_t size, DMR &dmr);
+    static void load(const char *buf, size_t size, DDS &dds);
+};
+
+} // namespace libdap
+
+#endif // _metadata_snapshot_h
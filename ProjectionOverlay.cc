@@ -0,0 +1,259 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <map>
+#include <vector>
+
+#include "ProjectionOverlay.h"
+#include "BaseType.h"
+#include "Constructor.h"
+#include "Vector.h"
+#include "DDS.h"
+#include "DMR.h"
+#include "D4Group.h"
+#include "D4Dimensions.h"
+#include "D4Attributes.h"
+#include "D4RValue.h"
+#include "D4FilterClause.h"
+#include "AttrTable.h"
+#include "AttrValues.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static int key_status = 0;
+
+// Don't throw from here; pthread_once() can't pass an exception on.
+static void make_key()
+{
+    key_status = pthread_key_create(&key, 0);
+}
+
+ProjectionOverlay::Scope::Scope(ProjectionOverlay &overlay)
+{
+    d_previous = current();
+    pthread_setspecific(key, &overlay);
+}
+
+ProjectionOverlay::Scope::~Scope()
+{
+    pthread_setspecific(key, d_previous);
+}
+
+ProjectionOverlay::~ProjectionOverlay()
+{
+    clear();
+}
+
+/** @return The overlay in use by the current thread, or null if the
+ * variables hold their own projection.
+ * @exception InternalErr if the thread-specific key could not be made */
+ProjectionOverlay *
+ProjectionOverlay::current()
+{
+    pthread_once(&key_once, make_key);
+    if (key_status != 0)
+        throw InternalErr(__FILE__, __LINE__, "Could not make the key for the projection overlays.");
+
+    return static_cast<ProjectionOverlay*>(pthread_getspecific(key));
+}
+
+/** @return The overlay that holds the projection of \c v: the current
+ * thread's if \c v is shared, otherwise null. */
+ProjectionOverlay *
+ProjectionOverlay::current(const BaseType *v)
+{
+    return v->is_shared() ? current() : 0;
+}
+
+/** @return The overlay that holds the constraint of \c d: the current
+ * thread's if \c d is shared, otherwise null. */
+ProjectionOverlay *
+ProjectionOverlay::current(const D4Dimension *d)
+{
+    return d->is_shared() ? current() : 0;
+}
+
+/** @return The state of \c v in the overlay that holds its projection, or
+ * null if there is no such overlay or it has none for \c v. */
+ProjectionOverlay::Variable *
+ProjectionOverlay::lookup(const BaseType *v)
+{
+    ProjectionOverlay *overlay = current(v);
+    return overlay ? overlay->find(v) : 0;
+}
+
+/** @return The constraint of \c d in the overlay that holds it, or null
+ * if there is no such overlay or it has none for \c d. */
+ProjectionOverlay::Dimension *
+ProjectionOverlay::lookup(const D4Dimension *d)
+{
+    ProjectionOverlay *overlay = current(d);
+    return overlay ? overlay->find(d) : 0;
+}
+
+/** @return The state of \c v, or null if none has been set. */
+ProjectionOverlay::Variable *
+ProjectionOverlay::find(const BaseType *v)
+{
+    map<const BaseType *, Variable>::iterator i = d_vars.find(v);
+    return i == d_vars.end() ? 0 : &i->second;
+}
+
+/** @return The state of \c v, added if none has been set. */
+ProjectionOverlay::Variable &
+ProjectionOverlay::variable(const BaseType *v)
+{
+    return d_vars[v];
+}
+
+/** @return The constraint of \c d, or null if none has been set. */
+ProjectionOverlay::Dimension *
+ProjectionOverlay::find(const D4Dimension *d)
+{
+    map<const D4Dimension *, Dimension>::iterator i = d_dims.find(d);
+    return i == d_dims.end() ? 0 : &i->second;
+}
+
+/** @return The constraint of \c d; when first used, a copy of the one
+ * held by \c d. */
+ProjectionOverlay::Dimension &
+ProjectionOverlay::dimension(const D4Dimension *d)
+{
+    map<const D4Dimension *, Dimension>::iterator i = d_dims.find(d);
+    if (i != d_dims.end())
+        return i->second;
+
+    // Since d isn't in d_dims yet, these read its own values
+    Dimension dim;
+    dim.constrained = d->constrained();
+    dim.start = d->c_start();
+    dim.stride = d->c_stride();
+    dim.stop = d->c_stop();
+    dim.used_by_projected_var = d->used_by_projected_var();
+
+    return d_dims.insert(make_pair(d, dim)).first->second;
+}
+
+/** Drop all the state, so that the variables' own is used again. */
+void ProjectionOverlay::clear()
+{
+    for (map<const BaseType *, Variable>::iterator i = d_vars.begin(), e = d_vars.end(); i != e; ++i)
+        delete i->second.clauses;
+
+    d_vars.clear();
+    d_dims.clear();
+}
+
+// Make the parts of an attribute table that are made when first read.
+static void share_attributes(AttrTable &at)
+{
+    for (AttrTable::Attr_iter i = at.attr_begin(), e = at.attr_end(); i != e; ++i) {
+        if (at.is_container(i))
+            share_attributes(*at.get_attr_table(i));
+        else
+            static_cast<const AttrValues *>(at.get_attr_values(i))->text();
+    }
+}
+
+static void share_attributes(D4Attributes &attrs)
+{
+    for (D4Attributes::D4AttributesIter i = attrs.attribute_begin(), e = attrs.attribute_end(); i != e; ++i) {
+        if ((*i)->type() == attr_container_c)
+            share_attributes(*(*i)->attributes());
+        else
+            static_cast<const D4Attribute *>(*i)->values().text();
+    }
+}
+
+void ProjectionOverlay::m_share(BaseType *btp)
+{
+    btp->d_is_shared = true;
+
+    // Variables without DAP2 attributes don't get a table; the readers of a
+    // shared tree test has_attr_table() first.
+    if (btp->is_dap4())
+        share_attributes(*btp->attributes());
+    else if (btp->has_attr_table())
+        share_attributes(btp->get_attr_table());
+
+    if (btp->is_constructor_type()) {
+        Constructor *c = static_cast<Constructor*>(btp);
+        c->d_var_index.freeze(c->d_vars);
+        for (Constructor::Vars_iter i = c->var_begin(), e = c->var_end(); i != e; ++i)
+            m_share(*i);
+    }
+    else if (btp->is_vector_type()) {
+        if (btp->type() == dods_array_c && btp->is_dap4())
+            static_cast<Array*>(btp)->maps();
+
+        if (btp->var())
+            m_share(btp->var());
+    }
+}
+
+void ProjectionOverlay::m_share_group(D4Group *grp)
+{
+    m_share(grp);
+
+    for (D4Dimensions::D4DimensionsIter i = grp->dims()->dim_begin(), e = grp->dims()->dim_end(); i != e; ++i)
+        (*i)->d_is_shared = true;
+
+    grp->enum_defs();
+
+    for (D4Group::groupsIter i = grp->grp_begin(), e = grp->grp_end(); i != e; ++i)
+        m_share_group(*i);
+}
+
+/** Make the parts of a DDS that are made when first read, such as empty
+ * attribute tables and the indexes used by DDS::var(), so that reading it
+ * doesn't change it and more than one thread can read it at once.
+ * @param dds Must not be changed after this is called. */
+void ProjectionOverlay::share(DDS &dds)
+{
+    share_attributes(dds.get_attr_table());
+
+    dds.d_var_index.freeze(dds.vars);
+    for (DDS::Vars_iter i = dds.var_begin(), e = dds.var_end(); i != e; ++i)
+        m_share(*i);
+}
+
+/** Make the parts of a DMR that are made when first read, so that more
+ * than one thread can read it at once.
+ * @param dmr Must not be changed after this is called. */
+void ProjectionOverlay::share(DMR &dmr)
+{
+    m_share_group(dmr.root());
+}
+
+} // namespace libdap
@@ -0,0 +1,156 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _projection_overlay_h
+#define _projection_overlay_h
+
+#include <map>
+#include <vector>
+
+#ifndef _array_h
+#include "Array.h"
+#endif
+
+namespace libdap {
+
+class BaseType;
+class D4Dimension;
+class D4Group;
+class D4FilterClauseList;
+class DDS;
+class DMR;
+
+/** The per-request part of a DDS or DMR: which variables are projected,
+ * read and used in the selection, how Arrays and shared dimensions are
+ * sliced, and the filters of D4Sequences.
+ *
+ * Normally these are held by the variables, so a server that keeps the
+ * metadata for a dataset has to copy the whole tree (ptr_duplicate())
+ * before it can evaluate a constraint. An overlay holds that state for
+ * one request instead. While a ProjectionOverlay::Scope is in effect on a
+ * thread, BaseType::set_send_p(), Array::add_constraint(),
+ * D4Dimension::set_constraint(), D4Sequence::clauses() and the methods
+ * that read those properties use the overlay for the variables and
+ * dimensions of a shared tree and leave them alone; other threads, with
+ * their own overlays, see the same tree differently.
+ *
+ * A tree is shared by passing it to share(). After that it must not be
+ * changed, nor may values be read into its variables: a data response
+ * still reads values into its own copy of the variables it sends, and a
+ * copy holds the projection the overlay had for the variable it was made
+ * from. Other variables, such as those made by server functions, are not
+ * affected by the overlay. A metadata response (DDS, DDX, DAS, DMR) needs
+ * only the overlay.
+ *
+ * @code
+ * ProjectionOverlay overlay;
+ * ProjectionOverlay::Scope scope(overlay);
+ * eval.parse_constraint(ce, *shared_dds);
+ * shared_dds->print_xml_writer(out, true, "");
+ * @endcode
+ */
+class ProjectionOverlay {
+public:
+    /** The properties of one variable. Those not set here are read from
+     * the variable. */
+    struct Variable {
+        bool has_send, send;
+        bool has_read, read;
+        bool has_selection, in_selection;
+
+        bool has_length;
+        int length;
+
+        bool has_shape;
+        std::vector<Array::dimension> shape;
+
+        D4FilterClauseList *clauses;
+
+        Variable() : has_send(false), send(false), has_read(false), read(false), has_selection(false),
+            in_selection(false), has_length(false), length(-1), has_shape(false), clauses(0) { }
+    };
+
+    /** The constraint of one shared dimension; a copy of the dimension's
+     * own when first set. */
+    struct Dimension {
+        bool constrained;
+        unsigned long long start, stride, stop;
+        bool used_by_projected_var;
+
+        Dimension() : constrained(false), start(0), stride(0), stop(0), used_by_projected_var(false) { }
+    };
+
+    /** Makes an overlay the one used by the current thread for the life of
+     * the Scope. Scopes may be nested. */
+    class Scope {
+        ProjectionOverlay *d_previous;
+
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+
+    public:
+        Scope(ProjectionOverlay &overlay);
+        ~Scope();
+    };
+
+private:
+    std::map<const BaseType *, Variable> d_vars;
+    std::map<const D4Dimension *, Dimension> d_dims;
+
+    // The overlay owns the filter clause lists
+    ProjectionOverlay(const ProjectionOverlay &);
+    ProjectionOverlay &operator=(const ProjectionOverlay &);
+
+    static void m_share(BaseType *btp);
+    static void m_share_group(D4Group *grp);
+
+public:
+    ProjectionOverlay() { }
+    ~ProjectionOverlay();
+
+    static ProjectionOverlay *current();
+    static ProjectionOverlay *current(const BaseType *v);
+    static ProjectionOverlay *current(const D4Dimension *d);
+
+    static Variable *lookup(const BaseType *v);
+    static Dimension *lookup(const D4Dimension *d);
+
+    Variable *find(const BaseType *v);
+    Variable &variable(const BaseType *v);
+
+    Dimension *find(const D4Dimension *d);
+    Dimension &dimension(const D4Dimension *d);
+
+    /** @return The number of variables and dimensions with state in the
+     * overlay. */
+    unsigned int size() const { return d_vars.size() + d_dims.size(); }
+    void clear();
+
+    static void share(DDS &dds);
+    static void share(DMR &dmr);
+};
+
+} // namespace libdap
+
+#endif // _projection_overlay_h
@@ -99,6 +99,12 @@ bool RCReader::write_rc_file(const string &pathname)
         fpo << "CACHE_ROOT=" << d_cache_root << endl;
         fpo << "DEFAULT_EXPIRES=" << _dods_default_expires << endl;
         fpo << "ALWAYS_VALIDATE=" << _dods_always_validate << endl;
+        fpo << "# Make room in the cache using a separate thread?" << endl;
+        fpo << "# 1 (yes) or 0 (no)." << endl;
+        fpo << "CACHE_GC_THREAD=" << d_cache_gc_thread << endl;
+        fpo << "# Use a stale response for up to this many seconds while it's" << endl;
+        fpo << "# revalidated in the background; 0 turns this off." << endl;
+        fpo << "STALE_WHILE_REVALIDATE=" << d_stale_while_revalidate << endl;
         fpo << "# Request servers compress responses if possible?" << endl;
         fpo << "# 1 (yes) or 0 (false)." << endl;
         fpo << "DEFLATE=" << _dods_deflate << endl;
@@ -122,6 +128,13 @@ bool RCReader::write_rc_file(const string &pathname)
             fpo << "NO_PROXY_FOR=" << d_dods_no_proxy_for_host << endl;
         }
 
+        fpo << "# Connections to servers are shared by all the requests" << endl;
+        fpo << "# made by a client. CONNECTION_POOL_SIZE is the number of" << endl;
+        fpo << "# unused connections kept open; 0 turns off sharing." << endl;
+        fpo << "# CONNECTION_IDLE_TIMEOUT is in seconds." << endl;
+        fpo << "CONNECTION_POOL_SIZE=" << d_connection_pool_size << endl;
+        fpo << "CONNECTION_IDLE_TIMEOUT=" << d_connection_idle_timeout << endl;
+
         fpo << "# AIS_DATABASE=<file or url>" << endl;
 
         fpo << "# COOKIE_JAR=.dods_cookies" << endl;
@@ -188,9 +201,23 @@ bool RCReader::read_rc_file(const string &pathname)
             else if ((strncmp(&tempstr[0], "ALWAYS_VALIDATE", 15) == 0) && tokenlength == 15) {
                 _dods_always_validate = atoi(value);
             }
+            else if ((strncmp(&tempstr[0], "CACHE_GC_THREAD", 15) == 0) && tokenlength == 15) {
+                d_cache_gc_thread = atoi(value);
+            }
+            else if ((strncmp(&tempstr[0], "STALE_WHILE_REVALIDATE", 22) == 0) && tokenlength == 22) {
+                int seconds = atoi(value);
+                d_stale_while_revalidate = seconds < 0 ? 0 : seconds;
+            }
             else if ((strncmp(&tempstr[0], "VALIDATE_SSL", 12) == 0) && tokenlength == 12) {
                 d_validate_ssl = atoi(value);
             }
+            else if ((strncmp(&tempstr[0], "CONNECTION_POOL_SIZE", 20) == 0) && tokenlength == 20) {
+                int size = atoi(value);
+                d_connection_pool_size = size < 0 ? 0 : size;
+            }
+            else if ((strncmp(&tempstr[0], "CONNECTION_IDLE_TIMEOUT", 23) == 0) && tokenlength == 23) {
+                d_connection_idle_timeout = atol(value);
+            }
             else if (strncmp(&tempstr[0], "AIS_DATABASE", 12) == 0 && tokenlength == 12) {
                 d_ais_database = value;
             }
@@ -363,6 +390,8 @@ RCReader::RCReader() // throw (Error) jhrg 7/2/15
     _dods_ign_expires = 0;
     _dods_default_expires = 86400;
     _dods_always_validate = 0;
+    d_cache_gc_thread = 0;
+    d_stale_while_revalidate = 0;
 
     _dods_deflate = 0;
     d_validate_ssl = 1;
@@ -395,6 +424,9 @@ RCReader::RCReader() // throw (Error) jhrg 7/2/15
 
     d_cookie_jar = "";
 
+    d_connection_pool_size = 8;
+    d_connection_idle_timeout = 60;
+
 #ifdef WIN32
     string homedir = string("C:") + string(DIR_SEP_STRING) + string("Dods");
     d_rc_file_path = check_string(homedir);
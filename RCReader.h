@@ -78,6 +78,8 @@ private:
 
     int _dods_default_expires; // 24 hours in seconds
     int _dods_always_validate; // Let libwww decide by default so set to 0
+    int d_cache_gc_thread; // 1- Use a thread for cache gc, 0- don't
+    int d_stale_while_revalidate; // Max seconds a stale response is used while revalidating; 0- off
 
     // flags for PROXY_SERVER=<protocol>,<host url>
     string d_dods_proxy_server_protocol;
@@ -109,6 +111,10 @@ private:
 
     string d_cookie_jar;
 
+    // Parameters for the process-wide libcurl connection pool
+    unsigned int d_connection_pool_size; // Max idle handles; 0 disables
+    long d_connection_idle_timeout; // Seconds
+
     static RCReader* _instance;
 
     RCReader();
@@ -162,6 +168,14 @@ public:
     {
         return _dods_always_validate;
     }
+    int get_cache_gc_thread() const throw()
+    {
+        return d_cache_gc_thread;
+    }
+    int get_stale_while_revalidate() const throw()
+    {
+        return d_stale_while_revalidate;
+    }
     int get_validate_ssl() const throw()
     {
         return d_validate_ssl;
@@ -262,6 +276,17 @@ public:
 	return d_cookie_jar;
     }
 
+    /// How many unused libcurl handles should the connection pool keep?
+    unsigned int get_connection_pool_size() const throw()
+    {
+        return d_connection_pool_size;
+    }
+    /// How long, in seconds, can a pooled connection sit unused?
+    long get_connection_idle_timeout() const throw()
+    {
+        return d_connection_idle_timeout;
+    }
+
     // SET METHODS
     void set_use_cache(bool b) throw()
     {
@@ -283,6 +308,14 @@ public:
     {
         _dods_default_expires = i;
     }
+    void set_cache_gc_thread(int i) throw()
+    {
+        d_cache_gc_thread = i;
+    }
+    void set_stale_while_revalidate(int i) throw()
+    {
+        d_stale_while_revalidate = i;
+    }
     void set_always_validate(int i) throw()
     {
         _dods_always_validate = i;
@@ -355,6 +388,15 @@ public:
     {
         d_ais_database = db;
     }
+
+    void set_connection_pool_size(unsigned int size) throw()
+    {
+        d_connection_pool_size = size;
+    }
+    void set_connection_idle_timeout(long t) throw()
+    {
+        d_connection_idle_timeout = t;
+    }
 };
 
 } // namespace libdap
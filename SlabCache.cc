@@ -0,0 +1,284 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "SlabCache.h"
+#include "Array.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+/** @param max_size Keep at most this many bytes of values. */
+SlabCache::SlabCache(unsigned long long max_size) :
+    d_max_size(max_size), d_size(0), d_hits(0), d_misses(0)
+{
+    pthread_mutex_init(&d_mutex, 0);
+}
+
+SlabCache::~SlabCache()
+{
+    pthread_mutex_destroy(&d_mutex);
+}
+
+/** Private. Are the array's values in a buffer of fixed-width elements? */
+bool SlabCache::m_cacheable(Array &array)
+{
+    BaseType *proto = array.var();
+    if (!proto || array.dimensions() == 0 || array.length() <= 0)
+        return false;
+
+    switch (proto->type()) {
+        case dods_byte_c:
+        case dods_char_c:
+        case dods_int8_c:
+        case dods_uint8_c:
+        case dods_int16_c:
+        case dods_uint16_c:
+        case dods_int32_c:
+        case dods_uint32_c:
+        case dods_int64_c:
+        case dods_uint64_c:
+        case dods_enum_c:
+        case dods_float32_c:
+        case dods_float64_c:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/** Private. Slabs are kept for each variable of each dataset. */
+string SlabCache::m_key(Array &array, const string &dataset)
+{
+    return dataset + '\n' + array.FQN();
+}
+
+// Used to search a variable's slabs, which are sorted by their first start
+template<class Slab_iter>
+static bool starts_before(int start, const Slab_iter &slab)
+{
+    return start < slab->slab.start[0];
+}
+
+/** Private. Find a slab of \c variable that contains \c slab.
+ * @return The slab, or d_slabs.end(). */
+SlabCache::Slabs::iterator SlabCache::m_find(Variable &variable, const Hyperslab &slab)
+{
+    // The slabs are sorted by the start of their first dimension. A slab
+    // that contains this one starts at or before it, and no earlier than
+    // the largest extent before its end.
+    int start = slab.start[0];
+    int lowest = slab.stop[0] - variable.max_extent;
+
+    vector<Slabs::iterator>::iterator i = upper_bound(variable.slabs.begin(), variable.slabs.end(), start,
+            starts_before<Slabs::iterator>);
+    while (i != variable.slabs.begin()) {
+        --i;
+        const Hyperslab &candidate = (*i)->slab;
+        if (candidate.start[0] < lowest)
+            break;
+        if (candidate.contains(slab))
+            return *i;
+    }
+
+    return d_slabs.end();
+}
+
+/** Private. Remove a slab. */
+void SlabCache::m_remove(Slabs::iterator i)
+{
+    Variables::iterator v = d_variables.find(i->variable);
+    if (v != d_variables.end()) {
+        Variable &variable = v->second;
+        variable.slabs.erase(find(variable.slabs.begin(), variable.slabs.end(), i));
+
+        if (variable.slabs.empty()) {
+            d_variables.erase(v);
+        }
+        else {
+            variable.max_extent = 0;
+            for (vector<Slabs::iterator>::iterator s = variable.slabs.begin(); s != variable.slabs.end(); ++s)
+                variable.max_extent = max(variable.max_extent, (*s)->slab.stop[0] - (*s)->slab.start[0]);
+        }
+    }
+
+    d_size -= i->values.size();
+    d_slabs.erase(i);
+}
+
+/** Private. Remove the least recently used slabs until the cache fits. */
+void SlabCache::m_purge()
+{
+    while (d_size > d_max_size && !d_slabs.empty())
+        m_remove(--d_slabs.end());
+}
+
+/** @brief Load an array's values from the cache.
+ *
+ * If a cached slab of this variable contains the array's current
+ * constraint, copy the selected values into the array and mark it read.
+ *
+ * @param array Load values into this array.
+ * @param dataset The dataset that holds the array.
+ * @param lmt The dataset's last modified time. Slabs read from an older
+ * version of the dataset are dropped.
+ * @return True if the values were loaded, false if the array must be read. */
+bool SlabCache::read(Array &array, const string &dataset, time_t lmt)
+{
+    if (!m_cacheable(array))
+        return false;
+
+    Hyperslab slab(array);
+    unsigned int width = array.var()->width();
+
+    pthread_mutex_lock(&d_mutex);
+
+    Slabs::iterator found = d_slabs.end();
+    Variables::iterator v = d_variables.find(m_key(array, dataset));
+    if (v != d_variables.end()) {
+        if (v->second.lmt != lmt) {
+            vector<Slabs::iterator> stale = v->second.slabs;
+            for (vector<Slabs::iterator>::iterator i = stale.begin(); i != stale.end(); ++i)
+                m_remove(*i);
+        }
+        else {
+            found = m_find(v->second, slab);
+        }
+    }
+
+    if (found == d_slabs.end() || found->width != width) {
+        ++d_misses;
+        pthread_mutex_unlock(&d_mutex);
+        return false;
+    }
+
+    ++d_hits;
+    d_slabs.splice(d_slabs.begin(), d_slabs, found);
+
+    try {
+        array.set_value_slice(&found->values[0], found->slab);
+    }
+    catch (...) {
+        pthread_mutex_unlock(&d_mutex);
+        throw;
+    }
+
+    pthread_mutex_unlock(&d_mutex);
+
+    DBG(cerr << "SlabCache: read " << array.name() << " from the cache" << endl);
+
+    array.set_read_p(true);
+
+    return true;
+}
+
+/** @brief Add an array's values to the cache.
+ *
+ * Call this after the array has been read. Nothing is added if a cached
+ * slab already contains the array's values; cached slabs of the variable
+ * that the new one contains are replaced by it.
+ *
+ * @param array The array, read with its current constraint.
+ * @param dataset The dataset that holds the array.
+ * @param lmt The dataset's last modified time. */
+void SlabCache::add(Array &array, const string &dataset, time_t lmt)
+{
+    if (!array.read_p() || !m_cacheable(array) || !array.get_buf())
+        return;
+
+    string key = m_key(array, dataset);
+    Hyperslab slab(array);
+    unsigned int width = array.var()->width();
+
+    unsigned long long bytes = slab.elements() * width;
+    if (bytes == 0 || bytes > d_max_size || bytes != array.width(true))
+        return;
+
+    pthread_mutex_lock(&d_mutex);
+
+    Variables::iterator v = d_variables.find(key);
+    if (v != d_variables.end()) {
+        vector<Slabs::iterator> remove;
+        for (vector<Slabs::iterator>::iterator i = v->second.slabs.begin(); i != v->second.slabs.end(); ++i) {
+            if (v->second.lmt != lmt || (*i)->width != width || slab.contains((*i)->slab)) {
+                remove.push_back(*i);
+            }
+            else if ((*i)->slab.contains(slab)) {
+                d_slabs.splice(d_slabs.begin(), d_slabs, *i);
+                pthread_mutex_unlock(&d_mutex);
+                return;
+            }
+        }
+
+        for (vector<Slabs::iterator>::iterator i = remove.begin(); i != remove.end(); ++i)
+            m_remove(*i);
+    }
+
+    d_slabs.push_front(Slab());
+    Slabs::iterator added = d_slabs.begin();
+    added->variable = key;
+    added->slab = slab;
+    added->width = width;
+    added->values.assign(array.get_buf(), array.get_buf() + bytes);
+    d_size += bytes;
+
+    Variable &variable = d_variables[key];
+    if (variable.slabs.empty()) {
+        variable.lmt = lmt;
+        variable.max_extent = 0;
+    }
+
+    vector<Slabs::iterator>::iterator pos = variable.slabs.begin();
+    while (pos != variable.slabs.end() && (*pos)->slab.start[0] <= slab.start[0])
+        ++pos;
+    variable.slabs.insert(pos, added);
+    variable.max_extent = max(variable.max_extent, slab.stop[0] - slab.start[0]);
+
+    m_purge();
+
+    pthread_mutex_unlock(&d_mutex);
+}
+
+/** Remove every slab. */
+void SlabCache::clear()
+{
+    pthread_mutex_lock(&d_mutex);
+
+    d_slabs.clear();
+    d_variables.clear();
+    d_size = 0;
+
+    pthread_mutex_unlock(&d_mutex);
+}
+
+} // namespace libdap
@@ -0,0 +1,124 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _slab_cache_h
+#define _slab_cache_h
+
+#include <pthread.h>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Hyperslab.h"
+
+namespace libdap {
+
+class Array;
+
+/** Keep the values of array variables read by a server, so that a later
+ * request for the same values, or for a part of them, is answered without
+ * reading the dataset again. Map clients asking for overlapping tiles of
+ * the same arrays are the common case.
+ *
+ * Each cached slab holds the values of one variable within one hyperslab.
+ * A request can use it if the slab contains the request's hyperslab: each
+ * dimension of the request starts and stops inside the slab's and selects
+ * only indices the slab holds. The values are then copied out of the slab.
+ *
+ * The slabs of a variable are kept sorted by the start of their first
+ * dimension, with the largest extent of that dimension, so a lookup only
+ * looks at slabs that might contain the request. Slabs are dropped when
+ * the dataset's last modified time changes, and the least recently used
+ * slabs are dropped to keep the cache under its size.
+ *
+ * Only arrays of cardinal types (numbers and enums) are cached. An
+ * instance can be shared by threads.
+ *
+ * DODSFilter::dataset_constraint() uses a SlabCache set with
+ * DODSFilter::set_slab_cache().
+ */
+class SlabCache {
+    struct Slab {
+        std::string variable;   // key in d_variables
+        Hyperslab slab;
+        unsigned int width;     // bytes per element
+        std::vector<char> values;
+    };
+
+    typedef std::list<Slab> Slabs;  // most recently used first
+
+    // The slabs of one variable of one dataset
+    struct Variable {
+        time_t lmt;
+        std::vector<Slabs::iterator> slabs; // sorted by slab.start[0]
+        int max_extent;                     // largest stop[0] - start[0]
+    };
+
+    typedef std::map<std::string, Variable> Variables;
+
+    Slabs d_slabs;
+    Variables d_variables;
+
+    unsigned long long d_max_size;
+    unsigned long long d_size;
+
+    unsigned long d_hits;
+    unsigned long d_misses;
+
+    pthread_mutex_t d_mutex;
+
+    static bool m_cacheable(Array &array);
+    static std::string m_key(Array &array, const std::string &dataset);
+
+    Slabs::iterator m_find(Variable &variable, const Hyperslab &slab);
+    void m_remove(Slabs::iterator i);
+    void m_purge();
+
+    SlabCache(const SlabCache &);
+    SlabCache &operator=(const SlabCache &);
+
+public:
+    /** By default, keep 64MB of values. */
+    static const unsigned long long DEFAULT_SIZE = 64ULL * 1024 * 1024;
+
+    SlabCache(unsigned long long max_size = DEFAULT_SIZE);
+    virtual ~SlabCache();
+
+    virtual bool read(Array &array, const std::string &dataset, time_t lmt);
+    virtual void add(Array &array, const std::string &dataset, time_t lmt);
+    virtual void clear();
+
+    unsigned long long get_size() const { return d_size; }
+    unsigned long long get_max_size() const { return d_max_size; }
+    unsigned long get_slab_count() const { return d_slabs.size(); }
+    unsigned long get_hits() const { return d_hits; }
+    unsigned long get_misses() const { return d_misses; }
+};
+
+} // namespace libdap
+
+#endif // _slab_cache_h
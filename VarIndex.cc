@@ -0,0 +1,172 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "VarIndex.h"
+#include "BaseType.h"
+#include "Constructor.h"
+#include "debug.h"
+
+using namespace std;
+
+namespace libdap {
+
+// Add the variables from i to e, and those they contain, in the order the
+// linear search visited them. Only the first variable with a name is kept.
+void VarIndex::m_add(Vars::const_iterator i, Vars::const_iterator e, Path &path)
+{
+    for (; i != e; ++i) {
+        BaseType *btp = *i;
+        if (d_leaves.find(btp->name()) == d_leaves.end()) {
+            Leaf &leaf = d_leaves[btp->name()];
+            leaf.var = btp;
+            leaf.path = path;
+        }
+
+        if (btp->is_constructor_type()) {
+            Constructor *c = static_cast<Constructor*>(btp);
+            path.push_back(btp);
+            m_add(c->var_begin(), c->var_end(), path);
+            path.pop_back();
+        }
+    }
+}
+
+void VarIndex::m_build(const Vars &vars)
+{
+    if (d_built)
+        return;
+
+    DBG(cerr << "VarIndex: indexing " << vars.size() << " variables" << endl);
+
+    clear();
+
+    for (Vars::const_iterator i = vars.begin(), e = vars.end(); i != e; ++i) {
+        // insert() keeps the first variable with a name
+        d_top.insert(make_pair((*i)->name(), *i));
+    }
+
+    Path path;
+    m_add(vars.begin(), vars.end(), path);
+
+    d_built = true;
+}
+
+/** Find a variable at the top level.
+ * @param vars The variables this index describes.
+ * @param name The name of the variable.
+ * @return The first variable in \c vars with that name, or null. */
+BaseType *
+VarIndex::find(const Vars &vars, const string &name)
+{
+    m_build(vars);
+
+    map<string, BaseType *>::const_iterator i = d_top.find(name);
+    return i == d_top.end() ? 0 : i->second;
+}
+
+/** Find a variable at any level.
+ * @param vars The variables this index describes.
+ * @param name The name of the variable.
+ * @param path If not null, set to the constructors that hold the variable,
+ * starting with the one in \c vars. Empty if the variable is in \c vars.
+ * @return The first variable with that name, or null. */
+BaseType *
+VarIndex::find_leaf(const Vars &vars, const string &name, Path *path)
+{
+    m_build(vars);
+
+    map<string, Leaf>::const_iterator i = d_leaves.find(name);
+    if (i == d_leaves.end())
+        return 0;
+
+    if (path)
+        *path = i->second.path;
+
+    return i->second.var;
+}
+
+/** Build the tables now and keep them until clear() is called, even if
+ * variables are changed.
+ * @param vars The variables this index describes; they must not change
+ * while the index is frozen. */
+void VarIndex::freeze(const Vars &vars)
+{
+    clear();
+    m_build(vars);
+    d_frozen = true;
+}
+
+/** Drop the tables; the next lookup builds them again. */
+void VarIndex::clear()
+{
+    d_top.clear();
+    d_leaves.clear();
+    d_built = false;
+    d_frozen = false;
+}
+
+/** Note that \c btp is at the top level of the variables this index
+ * describes, so that name_changed() marks this index. Used by DDS, whose
+ * variables have no parent.
+ * @param btp The variable; it must be deleted or removed from the DDS
+ * before the DDS is. */
+void VarIndex::add(BaseType *btp)
+{
+    btp->d_parent = 0;      // a variable at the top level has no parent
+    btp->d_dds_index = this;
+    changed();
+}
+
+/** Note that \c btp was renamed: mark the indexes that hold its name,
+ * those of the Constructors that hold it and of the DDS at the top.
+ * @param btp The variable */
+void VarIndex::name_changed(BaseType *btp)
+{
+    while (!btp->d_dds_index) {
+        btp = btp->d_parent;
+        if (!btp)
+            return;
+        if (btp->is_constructor_type())
+            static_cast<Constructor*>(btp)->d_var_index.changed();
+    }
+
+    btp->d_dds_index->changed();
+}
+
+/** Note that variables were added to or removed from \c c: mark its index
+ * and those that hold it.
+ * @param c The Constructor */
+void VarIndex::vars_changed(Constructor *c)
+{
+    c->d_var_index.changed();
+    name_changed(c);
+}
+
+} // namespace libdap
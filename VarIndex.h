@@ -0,0 +1,109 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef _var_index_h
+#define _var_index_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace libdap {
+
+class BaseType;
+class Constructor;
+
+/** Name lookup tables for the variables of a DDS or a Constructor, used by
+ * DDS::var() and Constructor::var() in place of scanning the variables and
+ * recursing into every constructor.
+ *
+ * find() returns the first variable at the top level with a given name.
+ * find_leaf() returns the first variable with a given name found by a
+ * depth-first search of all the variables, looking at each variable before
+ * the variables it contains; that is the variable the linear search
+ * returned when a leaf name is ambiguous. It also returns the constructors
+ * between the top level and the variable, so the callers can fill in the
+ * btp_stack as before.
+ *
+ * The tables are built the first time they are used and rebuilt on the
+ * first use after they are marked as changed. Each DDS and Constructor
+ * marks only the indexes that describe its variables: its own and those of
+ * the Constructors and DDS that hold it. vars_changed() does that for a
+ * Constructor whose variables were added or removed, name_changed() for a
+ * variable that was renamed; they find the enclosing indexes using
+ * BaseType::get_parent() and, for a variable at the top level of a DDS,
+ * the index the DDS registered with add(). Code that changes
+ * Constructor::d_vars directly must call vars_changed() too.
+ *
+ * Like the DDS and Constructor that use it, an index must not be used by
+ * more than one thread at a time, unless it has been frozen: a frozen
+ * index is not rebuilt after changed() and so lookups don't change it.
+ * ProjectionOverlay::share() freezes the indexes of a tree that won't be
+ * changed again.
+ */
+class VarIndex {
+public:
+    typedef std::vector<BaseType *> Vars;
+    typedef std::vector<BaseType *> Path;   // outermost constructor first
+
+private:
+    struct Leaf {
+        BaseType *var;
+        Path path;
+    };
+
+    std::map<std::string, BaseType *> d_top;
+    std::map<std::string, Leaf> d_leaves;
+
+    bool d_built;
+    bool d_frozen;
+
+    void m_build(const Vars &vars);
+    void m_add(Vars::const_iterator i, Vars::const_iterator e, Path &path);
+
+public:
+    VarIndex() : d_built(false), d_frozen(false) { }
+    // An index describes the variables of one object; copies start empty
+    VarIndex(const VarIndex &) : d_built(false), d_frozen(false) { }
+    VarIndex &operator=(const VarIndex &) { clear(); return *this; }
+
+    BaseType *find(const Vars &vars, const std::string &name);
+    BaseType *find_leaf(const Vars &vars, const std::string &name, Path *path = 0);
+
+    void freeze(const Vars &vars);
+    void clear();
+
+    /** Note that a variable this index describes was added, removed or
+     * renamed. A frozen index is kept. */
+    void changed() { if (!d_frozen) d_built = false; }
+
+    void add(BaseType *btp);
+
+    static void name_changed(BaseType *btp);
+    static void vars_changed(Constructor *c);
+};
+
+} // namespace libdap
+
+#endif // _var_index_h
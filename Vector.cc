@@ -64,6 +64,7 @@
 #include "util.h"
 #include "debug.h"
 #include "InternalErr.h"
+#include "ProjectionOverlay.h"
 
 #undef CLEAR_LOCAL_DATA
 
@@ -74,7 +75,7 @@ namespace libdap {
 
 void Vector::m_duplicate(const Vector & v)
 {
-    d_length = v.d_length;
+    d_length = v.Vector::length();
 
     // _var holds the type of the elements. That is, it holds a BaseType
     // which acts as a template for the type of each element.
@@ -556,14 +557,23 @@ unsigned int Vector::width(bool constrained) const
  @see Vector::append_dim */
 int Vector::length() const
 {
-    return d_length;
+    // The length of a shared Array constrained while an overlay is in use
+    ProjectionOverlay::Variable *v = ProjectionOverlay::lookup(this);
+    return v && v->has_length ? v->length : d_length;
 }
 
 /** Sets the length of the vector.  This function does not allocate
  any new space. */
 void Vector::set_length(int l)
 {
-    d_length = l;
+    if (ProjectionOverlay *overlay = ProjectionOverlay::current(this)) {
+        ProjectionOverlay::Variable &v = overlay->variable(this);
+        v.has_length = true;
+        v.length = l;
+    }
+    else {
+        d_length = l;
+    }
 }
 
 /** Resizes a Vector.  If the input length is greater than the
@@ -30,112 +30,594 @@
 
 #include "config.h"
 
-#include <libxml/encoding.h>
-#include <libxml/xmlwriter.h>
+#include <cstdio>
+#include <cstring>
+
+#include <iostream>
+#include <string>
 
 #include "XMLWriter.h"
 #include "InternalErr.h"
 
 const char *ENCODING = "ISO-8859-1";
-const int XML_BUF_SIZE = 2000000;
 
+// When the document is streamed, it is written in pieces of about this size
+const unsigned int XML_BUF_SIZE = 65536;
+
+using namespace std;
 using namespace libdap;
 
-XMLWriter::XMLWriter(const string &pad) {
-    LIBXML_TEST_VERSION;
+/** Build the document in memory; read it with get_doc().
+ * @param pad Indent each level of the document with this string. If it is
+ * empty, the document is written without line breaks. */
+XMLWriter::XMLWriter(const string &pad) : d_out(0), d_file(0), d_pad(pad)
+{
+    m_start_document();
+}
+
+/** Write the document to \c out as it is built. Call end_document() when
+ * it is complete.
+ * @param out Write to this stream
+ * @param pad Indent each level of the document with this string */
+XMLWriter::XMLWriter(ostream &out, const string &pad) : d_out(&out), d_file(0), d_pad(pad)
+{
+    m_start_document();
+}
+
+/** Write the document to \c out as it is built. Call end_document() when
+ * it is complete.
+ * @param out Write to this FILE
+ * @param pad Indent each level of the document with this string */
+XMLWriter::XMLWriter(FILE *out, const string &pad) : d_out(0), d_file(out), d_pad(pad)
+{
+    m_start_document();
+}
 
-    /* Create a new XML buffer, to which the XML document will be
-     * written */
+/** If the document is streamed, what has been written but not yet sent is
+ * sent; the document is not ended. */
+XMLWriter::~XMLWriter()
+{
     try {
-        if (!(d_doc_buf = xmlBufferCreateSize(XML_BUF_SIZE)))
-            throw InternalErr(__FILE__, __LINE__, "Error allocating the xml buffer");
+        if (d_writer)
+            xmlFreeTextWriter(d_writer);
+
+        if (d_out || d_file)
+            m_flush(true);
+    }
+    catch (...) {
+        // Destructors don't throw
+    }
+}
+
+void XMLWriter::m_start_document()
+{
+    d_depth = 0;
+    d_indent_end = true;
+    d_ended = false;
+    d_writer = 0;
+
+    if (d_out || d_file)
+        d_buf.reserve(XML_BUF_SIZE + XML_BUF_SIZE / 4);
+
+    d_buf.append("<?xml version=\"1.0\" encoding=\"").append(ENCODING).append("\"?>\n");
+}
+
+// Add a Node to the stack; the Nodes popped are kept to save allocating
+// their names again.
+XMLWriter::Node &XMLWriter::m_push(const char *name, State state)
+{
+    if (d_depth == d_nodes.size())
+        d_nodes.push_back(Node());
+
+    Node &node = d_nodes[d_depth++];
+    node.name = name;
+    node.state = state;
+    node.xmlns.clear();
+    node.xmlns_uri.clear();
+
+    return node;
+}
+
+// Close the start tag of the current element, writing the namespace it
+// declares, if any.
+int XMLWriter::m_close_start_tag(bool newline)
+{
+    Node &node = d_nodes[d_depth - 1];
+    if (!node.xmlns.empty() && m_write_attribute(node.xmlns.c_str(), node.xmlns_uri.c_str()) < 0)
+        return -1;
+
+    d_buf += '>';
+    if (newline && !d_pad.empty())
+        d_buf += '\n';
+
+    node.state = in_content;
+
+    return 0;
+}
+
+void XMLWriter::m_write_indent()
+{
+    for (unsigned int i = 1; i < d_depth; ++i)
+        d_buf.append(d_pad);
+}
+
+/* Add text to the document. The text is UTF-8 and the document ISO-8859-1,
+ * so characters after U+00FF are written as character references.
+ *
+ * @param escape 't' to escape text as element content, 'a' to escape it as
+ * an attribute value, or 0 to write it as it is.
+ * @return -1 if the text is not UTF-8. */
+int XMLWriter::m_write(const char *text, char escape)
+{
+    string::size_type size = d_buf.size();
 
-        xmlBufferSetAllocationScheme(d_doc_buf, XML_BUFFER_ALLOC_DOUBLEIT);
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text);
+    while (*p) {
+        // Copy the run of characters that need no escaping
+        const unsigned char *run = p;
+        while (*p >= 0x20 && *p < 0x80 && !(escape && (*p == '<' || *p == '>' || *p == '&' || *p == '"')))
+            ++p;
+        while (*p && *p < 0x20 && (!escape || (escape == 't' && *p != '\r')))
+            ++p;
+        if (p != run) {
+            d_buf.append(reinterpret_cast<const char *>(run), p - run);
+            continue;
+        }
 
-        /* Create a new XmlWriter for memory, with no compression.
-         * Remark: there is no compression for this kind of xmlTextWriter */
-        if (!(d_writer = xmlNewTextWriterMemory(d_doc_buf, 0)))
+        if (*p < 0x80) {
+            switch (*p++) {
+            case '<': d_buf.append("&lt;"); break;
+            case '>': d_buf.append("&gt;"); break;
+            case '&': d_buf.append("&amp;"); break;
+            case '"': d_buf.append("&quot;"); break;
+            case '\r': d_buf.append("&#13;"); break;
+            case '\n': d_buf.append("&#10;"); break;
+            case '\t': d_buf.append("&#9;"); break;
+            default: d_buf += static_cast<char>(p[-1]); break;
+            }
+            continue;
+        }
+
+        // A UTF-8 sequence
+        unsigned int c = *p++;
+        int trailing;
+        if (c < 0xC0) {
+            d_buf.resize(size);
+            return -1;
+        }
+        else if (c < 0xE0) {
+            c &= 0x1F;
+            trailing = 1;
+        }
+        else if (c < 0xF0) {
+            c &= 0x0F;
+            trailing = 2;
+        }
+        else if (c < 0xF8) {
+            c &= 0x07;
+            trailing = 3;
+        }
+        else {
+            d_buf.resize(size);
+            return -1;
+        }
+
+        for (; trailing > 0; --trailing, ++p) {
+            if ((*p & 0xC0) != 0x80) {
+                d_buf.resize(size);
+                return -1;
+            }
+            c = (c << 6) | (*p & 0x3F);
+        }
+
+        if (c < 0x100) {
+            d_buf += static_cast<char>(c);
+        }
+        else {
+            char ref[16];
+            snprintf(ref, sizeof ref, "&#%u;", c);
+            d_buf.append(ref);
+        }
+    }
+
+    return 0;
+}
+
+int XMLWriter::m_write_attribute(const char *name, const char *value)
+{
+    d_buf += ' ';
+    if (m_write(name, 0) < 0)
+        return -1;
+
+    d_buf.append("=\"");
+    if (m_write(value, 'a') < 0)
+        return -1;
+    d_buf += '"';
+
+    return 0;
+}
+
+/* If the document is streamed, send what has been written once there is
+ * enough of it (or \c all of it).
+ * @return -1 if the output failed. */
+int XMLWriter::m_flush(bool all)
+{
+    if (d_buf.empty() || (!all && d_buf.size() < XML_BUF_SIZE))
+        return 0;
+
+    if (d_out) {
+        d_out->write(d_buf.data(), d_buf.size());
+        d_buf.clear();
+        return d_out->fail() ? -1 : 0;
+    }
+    else if (d_file) {
+        size_t size = d_buf.size();
+        size_t written = fwrite(d_buf.data(), 1, size, d_file);
+        d_buf.clear();
+        return written != size ? -1 : 0;
+    }
+
+    return 0;
+}
+
+/* Send the text of the xmlTextWriter made by get_writer() to the document.
+ * @return -1 if it could not be added to the document. */
+int XMLWriter::m_writer_write(void *context, const char *buffer, int len)
+{
+    XMLWriter *xml = static_cast<XMLWriter *>(context);
+    xml->d_buf.append(buffer, len);
+
+    return xml->m_flush(false) < 0 ? -1 : len;
+}
+
+/* Before this writes anything, close the start tag of an element the
+ * xmlTextWriter has started, so that what follows goes in its content, and
+ * add what the xmlTextWriter holds to the document.
+ * @return -1 on error */
+int XMLWriter::m_sync()
+{
+    if (xmlTextWriterWriteString(d_writer, (const xmlChar *) "") < 0)
+        return -1;
+
+    return xmlTextWriterFlush(d_writer) < 0 ? -1 : 0;
+}
+
+xmlTextWriterPtr XMLWriter::m_get_writer()
+{
+    if (!d_writer) {
+        xmlOutputBufferPtr out = xmlOutputBufferCreateIO(m_writer_write, 0, this, xmlFindCharEncodingHandler(ENCODING));
+        if (!out)
+            throw InternalErr(__FILE__, __LINE__, "Error allocating the xml buffer");
+
+        d_writer = xmlNewTextWriter(out);
+        if (!d_writer) {
+            xmlOutputBufferClose(out);
             throw InternalErr(__FILE__, __LINE__, "Error allocating memory for xml writer");
+        }
 
-        if (xmlTextWriterSetIndent(d_writer, pad.length()) < 0)
-            throw InternalErr(__FILE__, __LINE__, "Error starting indentation for response document ");
+        if (!d_pad.empty()) {
+            if (xmlTextWriterSetIndent(d_writer, 1) < 0)
+                throw InternalErr(__FILE__, __LINE__, "Error starting indentation for response document ");
 
-        if (xmlTextWriterSetIndentString(d_writer, (const xmlChar*)pad.c_str()) < 0)
-            throw InternalErr(__FILE__, __LINE__, "Error setting indentation for response document ");
+            if (xmlTextWriterSetIndentString(d_writer, (const xmlChar *) d_pad.c_str()) < 0)
+                throw InternalErr(__FILE__, __LINE__, "Error setting indentation for response document ");
+        }
+    }
 
-        d_started = true;
-        d_ended = false;
+    // The elements it writes go in the content of the current element
+    if (d_depth > 0 && d_nodes[d_depth - 1].state == in_start_tag && m_close_start_tag(true) < 0)
+        throw InternalErr(__FILE__, __LINE__, "Error writing the response document");
 
-        /* Start the document with the xml default for the version,
-         * encoding ISO 8859-1 and the default for the standalone
-         * declaration. MY_ENCODING defined at top of this file*/
-        if (xmlTextWriterStartDocument(d_writer, NULL, ENCODING, NULL) < 0)
-            throw InternalErr(__FILE__, __LINE__, "Error starting xml response document");
+    return d_writer;
+}
+
+/** Get a libxml2 xmlTextWriter that writes into this document, for code
+ * written for the older XMLWriter, which wrapped one. Elements it starts
+ * go in the content of the element started last; their start tags are
+ * closed when an XMLWriter method is next used, so give them their
+ * attributes first. Call get_writer() again for each use, as that code
+ * did.
+ *
+ * @deprecated Use the methods of XMLWriter.
+ * @return The xmlTextWriter, owned by this XMLWriter */
+xmlTextWriterPtr XMLWriter::get_writer() const
+{
+    return const_cast<XMLWriter *>(this)->m_get_writer();
+}
+
+/** Start an element. Its attributes must be written before anything else.
+ * @return -1 on error */
+int XMLWriter::start_element(const char *name)
+{
+    if (d_ended)
+        return -1;
+
+    if (d_writer && m_sync() < 0)
+        return -1;
+
+    if (d_depth > 0) {
+        State state = d_nodes[d_depth - 1].state;
+        if (state == in_pi || state == in_pi_content)
+            return -1;
+        if (state == in_start_tag && m_close_start_tag(true) < 0)
+            return -1;
     }
-    catch (InternalErr &e) {
-        m_cleanup();
-        throw;
+
+    m_push(name, in_start_tag);
+
+    if (!d_pad.empty())
+        m_write_indent();
+
+    d_buf += '<';
+    if (m_write(name, 0) < 0)
+        return -1;
+
+    return m_flush(false);
+}
+
+/** Start an element that declares a namespace.
+ * @param prefix The element's namespace prefix; if null, \c uri is the
+ * default namespace
+ * @param name The element's name
+ * @param uri The namespace; if null, none is declared
+ * @return -1 on error */
+int XMLWriter::start_element_ns(const char *prefix, const char *name, const char *uri)
+{
+    string qname = prefix ? string(prefix) + ":" + name : string(name);
+    if (start_element(qname.c_str()) < 0)
+        return -1;
+
+    if (uri) {
+        Node &node = d_nodes[d_depth - 1];
+        node.xmlns = prefix ? string("xmlns:") + prefix : string("xmlns");
+        node.xmlns_uri = uri;
     }
 
+    return 0;
 }
 
-XMLWriter::~XMLWriter() {
-    m_cleanup();
+/** Add an attribute to the element just started.
+ * @return -1 on error */
+int XMLWriter::write_attribute(const char *name, const char *value)
+{
+    if (d_ended || d_depth == 0 || d_nodes[d_depth - 1].state != in_start_tag)
+        return -1;
+
+    if (m_write_attribute(name, value) < 0)
+        return -1;
+
+    return m_flush(false);
 }
 
-void XMLWriter::m_cleanup() {
-    // make sure the buffer and writer are all cleaned up
-    if (d_writer) {
-        xmlFreeTextWriter(d_writer); // This frees both d_writer and d_doc_buf
-        d_writer = 0;
-        // d_doc_buf = 0;
+/** Write text in the current element, escaping the characters that are
+ * markup. In a processing instruction, the text is not escaped.
+ * @return -1 on error */
+int XMLWriter::write_string(const char *text)
+{
+    if (d_ended)
+        return -1;
+
+    if (d_writer && m_sync() < 0)
+        return -1;
+
+    char escape = 0;
+    if (d_depth > 0) {
+        Node &node = d_nodes[d_depth - 1];
+        switch (node.state) {
+        case in_start_tag:
+            if (m_close_start_tag(false) < 0)
+                return -1;
+            escape = 't';
+            break;
+        case in_content:
+            escape = 't';
+            break;
+        case in_pi:
+            d_buf += ' ';
+            node.state = in_pi_content;
+            break;
+        case in_pi_content:
+            break;
+        }
     }
 
-    // We could be here because of an exception and d_writer might be zero
-    if (d_doc_buf) {
-        xmlBufferFree(d_doc_buf);
-        d_doc_buf = 0;
+    d_indent_end = false;
+
+    if (m_write(text, escape) < 0)
+        return -1;
+
+    return m_flush(false);
+}
+
+/** Write text in the current element as it is.
+ * @return -1 on error */
+int XMLWriter::write_raw(const char *text)
+{
+    if (d_ended)
+        return -1;
+
+    if (d_writer && m_sync() < 0)
+        return -1;
+
+    if (d_depth > 0) {
+        Node &node = d_nodes[d_depth - 1];
+        if (node.state == in_start_tag) {
+            if (m_close_start_tag(false) < 0)
+                return -1;
+        }
+        else if (node.state == in_pi) {
+            d_buf += ' ';
+            node.state = in_pi_content;
+        }
     }
 
-    d_started = false;
-    d_ended = false;
+    d_indent_end = false;
+
+    if (m_write(text, 0) < 0)
+        return -1;
+
+    return m_flush(false);
 }
 
-const char *XMLWriter::get_doc() {
-    if (d_writer && d_started) {
-        if (xmlTextWriterEndDocument(d_writer) < 0)
-            throw InternalErr(__FILE__, __LINE__, "Error ending the document");
+/** Write an element that holds only text.
+ * @param text The text; if null the element is empty
+ * @return -1 on error */
+int XMLWriter::write_element(const char *name, const char *text)
+{
+    if (start_element(name) < 0)
+        return -1;
+
+    if (text && write_string(text) < 0)
+        return -1;
+
+    return end_element();
+}
+
+/** End the current element.
+ * @return -1 on error */
+int XMLWriter::end_element()
+{
+    if (d_ended)
+        return -1;
+
+    if (d_writer && m_sync() < 0)
+        return -1;
+
+    if (d_depth == 0)
+        return -1;
 
-        d_ended = true;
+    Node &node = d_nodes[d_depth - 1];
+    switch (node.state) {
+    case in_start_tag:
+        if (!node.xmlns.empty() && m_write_attribute(node.xmlns.c_str(), node.xmlns_uri.c_str()) < 0)
+            return -1;
+        d_indent_end = true;
+        d_buf.append("/>");
+        break;
 
-        // must call this before getting the buffer content. Odd, but appears to be true.
-        // jhrg
-        xmlFreeTextWriter(d_writer);
-        d_writer = 0;
+    case in_content:
+        if (!d_pad.empty() && d_indent_end)
+            m_write_indent();
+        d_indent_end = true;
+        d_buf.append("</");
+        if (m_write(node.name.c_str(), 0) < 0)
+            return -1;
+        d_buf += '>';
+        break;
+
+    default:
+        return -1;
     }
 
-    if (!d_doc_buf->content)
-        throw InternalErr(__FILE__, __LINE__, "Error retrieving response document as string");
+    if (!d_pad.empty())
+        d_buf += '\n';
+
+    --d_depth;
 
-    return (const char *)d_doc_buf->content;
+    return m_flush(false);
 }
 
-unsigned int XMLWriter::get_doc_size() {
-    if (d_writer && d_started) {
-        if (xmlTextWriterEndDocument(d_writer) < 0)
-            throw InternalErr(__FILE__, __LINE__, "Error ending the document");
+/** Start a processing instruction. Its text is written using
+ * write_string().
+ * @return -1 on error */
+int XMLWriter::start_pi(const char *target)
+{
+    if (d_ended || strcasecmp(target, "xml") == 0)
+        return -1;
 
-        d_ended = true;
+    if (d_writer && m_sync() < 0)
+        return -1;
 
-        // must call this before getting the buffer content. Odd, but appears to be true.
-        // jhrg
-        xmlFreeTextWriter(d_writer);
-        d_writer = 0;
+    if (d_depth > 0) {
+        State state = d_nodes[d_depth - 1].state;
+        if (state == in_pi || state == in_pi_content)
+            return -1;
+        if (state == in_start_tag && m_close_start_tag(false) < 0)
+            return -1;
     }
 
-    if (!d_doc_buf->content)
-        throw InternalErr(__FILE__, __LINE__, "Error retrieving response document as string");
+    m_push(target, in_pi);
+
+    d_buf.append("<?");
+    if (m_write(target, 0) < 0)
+        return -1;
+
+    return m_flush(false);
+}
+
+/** End the current processing instruction.
+ * @return -1 on error */
+int XMLWriter::end_pi()
+{
+    if (d_ended)
+        return -1;
+
+    if (d_writer && m_sync() < 0)
+        return -1;
+
+    if (d_depth == 0)
+        return 0;
+
+    State state = d_nodes[d_depth - 1].state;
+    if (state != in_pi && state != in_pi_content)
+        return -1;
+
+    d_buf.append("?>");
+    if (!d_pad.empty())
+        d_buf += '\n';
+
+    --d_depth;
+
+    return m_flush(false);
+}
+
+/** End the elements still open and finish the document. If it is
+ * streamed, the last of it is written; the stream is not flushed. */
+void XMLWriter::end_document()
+{
+    if (d_ended)
+        return;
+
+    if (d_writer && m_sync() < 0)
+        throw InternalErr(__FILE__, __LINE__, "Error ending the document");
+
+    while (d_depth > 0) {
+        State state = d_nodes[d_depth - 1].state;
+        if ((state == in_pi || state == in_pi_content ? end_pi() : end_element()) < 0)
+            throw InternalErr(__FILE__, __LINE__, "Error ending the document");
+    }
+
+    if (d_pad.empty())
+        d_buf += '\n';
+
+    d_ended = true;
+
+    if (m_flush(true) < 0)
+        throw InternalErr(__FILE__, __LINE__, "Error ending the document");
+}
+
+/** End the document and return it.
+ * @return The document, owned by this XMLWriter
+ * @exception InternalErr if the document was streamed */
+const char *XMLWriter::get_doc()
+{
+    if (d_out || d_file)
+        throw InternalErr(__FILE__, __LINE__, "Error retrieving response document as string: it was streamed");
+
+    end_document();
+
+    return d_buf.c_str();
+}
+
+/** End the document and return its size.
+ * @return The size of the document in bytes
+ * @exception InternalErr if the document was streamed */
+unsigned int XMLWriter::get_doc_size()
+{
+    if (d_out || d_file)
+        throw InternalErr(__FILE__, __LINE__, "Error retrieving response document size: it was streamed");
+
+    end_document();
 
-    // how much of the buffer is in use?
-    return d_doc_buf->use;
+    return d_buf.size();
 }
@@ -32,27 +32,101 @@
 
 #include <libxml/xmlwriter.h>
 
+#include <cstdio>
+
+#include <iostream>
 #include <string>
+#include <vector>
 
 namespace libdap {
 
+/** Write an XML document. The document is either built in memory and read
+ * using get_doc(), or written to a stream or FILE as it is built; in the
+ * latter case nothing is held but a small buffer, so the first bytes go
+ * out before the document is finished and a large DMR or DDX is never
+ * held twice.
+ *
+ * The methods mirror those of libxml2's xmlTextWriter and write the same
+ * text: the same indentation, the same escaping and the same ISO-8859-1
+ * encoding of UTF-8 input, with characters outside that set written as
+ * character references. Like those functions, each returns -1 if it
+ * could not write its part of the document (it was called out of order,
+ * its text was not UTF-8 or the output failed) and the caller is
+ * expected to throw.
+ *
+ * @code
+ * XMLWriter xml(out);
+ * dmr.print_dap4(xml);
+ * xml.end_document();
+ * @endcode
+ *
+ * Code written for the older XMLWriter can still use the xmlTextWriter
+ * functions on get_writer(); what they write goes into this document.
+ */
 class XMLWriter {
 private:
-    // Various xml writer stuff
-    xmlTextWriterPtr d_writer;
-    xmlBufferPtr d_doc_buf;
-    bool d_started;
+    enum State { in_start_tag, in_content, in_pi, in_pi_content };
+
+    // An element or processing instruction that has been started
+    struct Node {
+        std::string name;
+        State state;
+        std::string xmlns;      // the namespace declared by the element,
+        std::string xmlns_uri;  // written when its start tag is closed
+    };
+
+    std::ostream *d_out;    // if neither is set, the document is built in d_buf
+    FILE *d_file;
+
+    std::string d_pad;
+    std::string d_buf;
+
+    std::vector<Node> d_nodes;
+    unsigned int d_depth;   // the number of Nodes in use; d_nodes is reused
+    bool d_indent_end;      // indent the next end tag
     bool d_ended;
 
-    std::string d_doc;
+    // Made by get_writer() for code that uses the xmlTextWriter functions
+    xmlTextWriterPtr d_writer;
+
+    XMLWriter(const XMLWriter &);
+    XMLWriter &operator=(const XMLWriter &);
+
+    void m_start_document();
+
+    Node &m_push(const char *name, State state);
+    int m_close_start_tag(bool newline);
+    void m_write_indent();
+
+    int m_write(const char *text, char escape);
+    int m_write_attribute(const char *name, const char *value);
+    int m_flush(bool all);
 
-    void m_cleanup() ;
+    int m_sync();
+    xmlTextWriterPtr m_get_writer();
+    static int m_writer_write(void *context, const char *buffer, int len);
 
 public:
     XMLWriter(const std::string &pad = "    ");
+    XMLWriter(std::ostream &out, const std::string &pad = "    ");
+    XMLWriter(FILE *out, const std::string &pad = "    ");
     virtual ~XMLWriter();
 
-    xmlTextWriterPtr get_writer() const { return d_writer; }
+    int start_element(const char *name);
+    int start_element_ns(const char *prefix, const char *name, const char *uri);
+    int write_attribute(const char *name, const char *value);
+    int write_string(const char *text);
+    int write_raw(const char *text);
+    int write_element(const char *name, const char *text);
+    int end_element();
+
+    int start_pi(const char *target);
+    int end_pi();
+
+    void end_document();
+
+    xmlTextWriterPtr get_writer() const;
+
     const char *get_doc();
     unsigned int get_doc_size();
 };
@@ -33,6 +33,7 @@
 
 #include <cstring>
 #include <vector>
+#include <algorithm>
 
 #include "chunked_stream.h"
 #include "chunked_istream.h"
@@ -93,6 +94,21 @@ chunked_inbuf::underflow()
 
 	// gptr() == egptr() so read more data from the underlying input source.
 
+	// If a chunk was started by read_next_chunk_header(), the rest of its
+	// data come first.
+	if (d_chunk_left > 0) {
+		d_is.read(d_buffer, std::min(d_chunk_left, d_buf_size));
+		uint32_t bytes_read = d_is.gcount();
+		if (d_is.bad() || bytes_read == 0) {
+			d_chunk_left = 0;
+			return traits_type::eof();
+		}
+
+		d_chunk_left -= bytes_read;
+		setg(d_buffer, d_buffer, d_buffer + bytes_read);
+		return traits_type::to_int_type(*gptr());
+	}
+
 	// To read data from the chunked stream, first read the header
 	uint32_t header;
 	d_is.read((char *) &header, 4);
@@ -206,6 +222,20 @@ chunked_inbuf::xsgetn(char* s, std::streamsize num)
 		bytes_left_to_read -= bytes_to_transfer;
 	}
 
+	// Then the rest of a chunk started by read_next_chunk_header(), read
+	// directly into 's'
+	if (d_chunk_left > 0) {
+		uint32_t bytes_to_transfer = std::min(d_chunk_left, bytes_left_to_read);
+		d_is.read(s, bytes_to_transfer);
+		if (d_is.bad()) return traits_type::eof();
+		d_chunk_left -= bytes_to_transfer;
+		s += bytes_to_transfer;
+		bytes_left_to_read -= bytes_to_transfer;
+
+		if (bytes_left_to_read == 0)
+			return traits_type::not_eof(num);
+	}
+
 	// We need to get more bytes from the underlying stream; at this
 	// point the internal buffer is empty.
 
@@ -340,6 +370,12 @@ chunked_inbuf::xsgetn(char* s, std::streamsize num)
 std::streambuf::int_type
 chunked_inbuf::read_next_chunk()
 {
+	// Skip what's left of a chunk started by read_next_chunk_header()
+	if (d_chunk_left > 0) {
+		d_is.ignore(d_chunk_left);
+		d_chunk_left = 0;
+	}
+
 	// To read data from the chunked stream, first read the header
 	uint32_t header;
 	d_is.read((char *) &header, 4);
@@ -411,4 +447,76 @@ chunked_inbuf::read_next_chunk()
 	return traits_type::eof();	// Can never get here; this quiets g++
 }
 
+
+/**
+ * @brief Start reading a chunk
+ * Like read_next_chunk(), but only the chunk's header is read. The chunk's
+ * data are left in the underlying stream and are read from there by the
+ * subsequent calls to read(), so a caller can process the first part of a
+ * large chunk while the rest of it is still arriving. A DAP4 data response
+ * uses this to parse the DMR, which is sent as one chunk, as it is read.
+ *
+ * @return The size of the chunk. Returns EOF on error or if the chunk is a
+ * zero-length END chunk.
+ */
+std::streambuf::int_type
+chunked_inbuf::read_next_chunk_header()
+{
+	// Skip what's left of a chunk started by an earlier call
+	if (d_chunk_left > 0) {
+		d_is.ignore(d_chunk_left);
+		d_chunk_left = 0;
+	}
+
+	// Drop any data in the buffer
+	setg(d_buffer, d_buffer, d_buffer);
+
+	uint32_t header;
+	d_is.read((char *) &header, 4);
+#if !BYTE_ORDER_PREFIX
+    ntohl(header);
+#endif
+
+	if (d_is.eof()) return traits_type::eof();
+#if BYTE_ORDER_PREFIX
+    if (d_twiddle_bytes) header = bswap_32(header);
+#else
+    // (header & CHUNK_LITTLE_ENDIAN) --> is the sender little endian
+    if (!d_set_twiddle) {
+        d_twiddle_bytes = (is_host_big_endian() == (header & CHUNK_LITTLE_ENDIAN));
+        d_set_twiddle = true;
+    }
+#endif
+
+	uint32_t chunk_size = header & CHUNK_SIZE_MASK;
+
+	DBG(cerr << "read_next_chunk_header: chunk size from header: " << chunk_size << endl);
+	DBG(cerr << "read_next_chunk_header: chunk type from header: " << hex << (header & CHUNK_TYPE_MASK) << endl);
+
+	switch (header & CHUNK_TYPE_MASK) {
+	case CHUNK_END:
+		if (chunk_size == 0) return traits_type::eof();
+		d_chunk_left = chunk_size;
+		return traits_type::not_eof(chunk_size);
+
+	case CHUNK_DATA:
+		d_chunk_left = chunk_size;
+		return traits_type::not_eof(chunk_size);
+
+	case CHUNK_ERR: {
+		// The chunk holds the error message text.
+		std::vector<char> message(chunk_size);
+		d_is.read(&message[0], chunk_size);
+		d_error = true;
+		d_error_message = string(&message[0], chunk_size);
+		return traits_type::eof();
+	}
+
+	default:
+		d_error = true;
+		d_error_message = "Failed to read known chunk header type.";
+		return traits_type::eof();
+	}
+}
+
 }
@@ -46,6 +46,10 @@ private:
 	uint32_t d_buf_size;	// Size of the data buffer
 	char *d_buffer;			// data buffer
 
+	// Bytes of the current chunk not yet read from d_is; see
+	// read_next_chunk_header()
+	uint32_t d_chunk_left;
+
 	// In the original implementation of this class, the byte order of the data stream
 	// was passed in via constructors. When BYTE_ORDER_PREFIX is defined that is the
 	// case. However, when it is not defined, the byte order is read from the chunk
@@ -97,7 +101,7 @@ public:
 	 */
 #if BYTE_ORDER_PREFIX
 	chunked_inbuf(std::istream &is, int size, bool twiddle_bytes = false)
-        : d_is(is), d_buf_size(size), d_buffer(0), d_twiddle_bytes(twiddle_bytes), d_error(false) {
+        : d_is(is), d_buf_size(size), d_buffer(0), d_chunk_left(0), d_twiddle_bytes(twiddle_bytes), d_error(false) {
 		if (d_buf_size & CHUNK_TYPE_MASK)
 			throw std::out_of_range("A chunked_outbuf (or chunked_ostream) was built using a buffer larger than 0x00ffffff");
 
@@ -105,7 +109,7 @@ public:
 	}
 #else
     chunked_inbuf(std::istream &is, int size)
-        : d_is(is), d_buf_size(size), d_buffer(0), d_twiddle_bytes(false), d_set_twiddle(false), d_error(false) {
+        : d_is(is), d_buf_size(size), d_buffer(0), d_chunk_left(0), d_twiddle_bytes(false), d_set_twiddle(false), d_error(false) {
         if (d_buf_size & CHUNK_TYPE_MASK)
             throw std::out_of_range("A chunked_outbuf (or chunked_ostream) was built using a buffer larger than 0x00ffffff");
 
@@ -118,6 +122,7 @@ public:
 	}
 
 	int_type read_next_chunk();
+	int_type read_next_chunk_header();
 
 	int bytes_in_buffer() const { return (egptr() - gptr()); }
 
@@ -145,6 +150,7 @@ public:
 #endif
 
 	int read_next_chunk() { return d_cbuf.read_next_chunk(); }
+	int read_next_chunk_header() { return d_cbuf.read_next_chunk_header(); }
 
 	/**
 	 * How many bytes have been read from the stream and are now in the internal buffer?
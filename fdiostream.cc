@@ -27,6 +27,16 @@
 
 #include "config.h"
 
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#include <cerrno>
+
 #include "fdiostream.h"
 #include <cstring> // for memcpy
 //#define DODS_DEBUG
@@ -58,7 +68,7 @@ fdoutbuf::~fdoutbuf()
 int fdoutbuf::flushBuffer()
 {
 	int num = pptr() - pbase();
-	if (write(1, buffer, num) != num) {
+	if (write(fd, buffer, num) != num) {
 		return EOF;
 	}
 	pbump(-num);
@@ -94,9 +104,146 @@ int fdoutbuf::sync()
 /** write multiple characters */
 std::streamsize fdoutbuf::xsputn(const char *s, std::streamsize num)
 {
+	// Characters written by overflow() go first
+	if (flushBuffer() == EOF)
+		return 0;
+
 	return write(fd, s, num);
 }
 
+/** If fd is non-blocking (e.g., a socket), wait until it can be written. */
+static bool wait_for_output(int fd)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	return poll(&pfd, 1, -1) == 1;
+}
+
+/** Write part of an open file to the stream's file descriptor. Anything in
+ the stream's buffer is written first. Where the OS can, the data are moved
+ by the kernel using sendfile(2) or, when writing to a pipe, splice(2), so
+ they are never copied into this process; otherwise they are copied through
+ a buffer.
+
+ This is meant for sending responses held in a cache (see DAPCache3).
+
+ @param in_fd Read from this file descriptor. Its file offset is not
+ changed.
+ @param offset Start this many bytes into the file.
+ @param count Send this many bytes; if -1, send the rest of the file.
+ @return The number of bytes sent or -1 on error (errno is set). Fewer than
+ \c count bytes are sent if the file is shorter. */
+std::streamsize fdoutbuf::send_file(int in_fd, off_t offset, std::streamsize count)
+{
+	if (sync() == -1)
+		return -1;
+
+	if (count < 0) {
+		struct stat st;
+		if (fstat(in_fd, &st) == -1)
+			return -1;
+		count = st.st_size > offset ? st.st_size - offset: 0;
+	}
+
+	std::streamsize sent = 0;
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+	while (sent < count) {
+		ssize_t n = sendfile(fd, in_fd, &offset, count - sent);
+		if (n > 0) {
+			sent += n;
+		}
+		else if (n == 0) {
+			return sent;	// end of file
+		}
+		else if (errno == EINTR) {
+			continue;
+		}
+		else if (errno == EAGAIN) {
+			if (!wait_for_output(fd))
+				return -1;
+		}
+		else if (sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+			break;			// this pair of descriptors isn't supported
+		}
+		else {
+			return -1;
+		}
+	}
+
+	if (sent == count)
+		return sent;
+#endif
+
+#ifdef HAVE_SPLICE
+	// Older kernels can't sendfile(2) to a pipe, but can splice(2) to one
+	struct stat out_st;
+	if (sent < count && fstat(fd, &out_st) == 0 && S_ISFIFO(out_st.st_mode)) {
+		while (sent < count) {
+			ssize_t n = splice(in_fd, &offset, fd, 0, count - sent, SPLICE_F_MORE);
+			if (n > 0) {
+				sent += n;
+			}
+			else if (n == 0) {
+				return sent;
+			}
+			else if (errno == EINTR) {
+				continue;
+			}
+			else if (errno == EAGAIN) {
+				if (!wait_for_output(fd))
+					return -1;
+			}
+			else if (sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+				break;
+			}
+			else {
+				return -1;
+			}
+		}
+
+		if (sent == count)
+			return sent;
+	}
+#endif
+
+	std::streamsize copied = copy_file(in_fd, offset, count - sent);
+	return copied < 0 ? -1 : sent + copied;
+}
+
+/** Copy part of a file to the stream's file descriptor through a buffer.
+ @see send_file() */
+std::streamsize fdoutbuf::copy_file(int in_fd, off_t offset, std::streamsize count)
+{
+	char buf[16 * 1024];
+	std::streamsize sent = 0;
+	while (sent < count) {
+		ssize_t n = pread(in_fd, buf, std::min(count - sent, (std::streamsize) sizeof(buf)), offset);
+		if (n == 0)
+			break;
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		for (ssize_t written = 0; written < n;) {
+			ssize_t w = write(fd, buf + written, n - written);
+			if (w < 0) {
+				if (errno == EINTR) continue;
+				if (errno == EAGAIN && wait_for_output(fd)) continue;
+				return -1;
+			}
+			written += w;
+		}
+
+		offset += n;
+		sent += n;
+	}
+
+	return sent;
+}
+
 /*
  How the buffer works for input streams:
 
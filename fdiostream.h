@@ -32,6 +32,8 @@
 #include <unistd.h>
 #endif
 
+#include <sys/types.h>
+
 #include <iostream>
 #include <streambuf>
 #include <algorithm>
@@ -58,8 +60,11 @@ public:
 	fdoutbuf(int _fd, bool _close);
 	virtual ~fdoutbuf();
 
+	std::streamsize send_file(int in_fd, off_t offset = 0, std::streamsize count = -1);
+
 protected:
 	int flushBuffer();
+	std::streamsize copy_file(int in_fd, off_t offset, std::streamsize count);
 
 	virtual int overflow(int c);
 	virtual int sync();
@@ -88,6 +93,16 @@ public:
 			std::ostream(&buf), buf(_fd, _close)
 	{
 	}
+
+	/** Write part of an open file to the stream without copying it through
+	 the stream's buffer. See fdoutbuf::send_file().
+	 @return The number of bytes sent; sets badbit on error. */
+	std::streamsize send_file(int in_fd, off_t offset = 0, std::streamsize count = -1)
+	{
+		std::streamsize n = buf.send_file(in_fd, offset, count);
+		if (n < 0) setstate(std::ios::badbit);
+		return n;
+	}
 };
 
 /** fdintbuf is a stream buffer specialization designed specifically for files
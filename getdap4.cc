@@ -299,9 +299,10 @@ int main(int argc, char *argv[])
     						<< url->get_version().c_str() << endl;
 
                     // Always write the DMR
-                    XMLWriter xml;
+                    XMLWriter xml(cout);
                     dmr.print_dap4(xml);
-                    cout << xml.get_doc() << endl;
+                    xml.end_document();
+                    cout << endl;
 
                     if (get_dap4_data)
                     	print_data(dmr, print_rows);
@@ -325,9 +326,10 @@ int main(int argc, char *argv[])
                             cout << "DMR:" << endl;
                         }
 
-                        XMLWriter xml;
+                        XMLWriter xml(cout);
                         dmr.print_dap4(xml);
-                        cout << xml.get_doc() << endl;
+                        xml.end_document();
+                        cout << endl;
                     }
                     catch (Error & e) {
                         cerr << e.get_error_message() << endl;
@@ -349,9 +351,10 @@ int main(int argc, char *argv[])
                              cout << "DMR:" << endl;
                          }
 
-                         XMLWriter xml;
+                         XMLWriter xml(cout);
                          dmr.print_dap4(xml);
-                         cout << xml.get_doc() << endl;
+                         xml.end_document();
+                         cout << endl;
 
                          print_data(dmr, print_rows);
                     }
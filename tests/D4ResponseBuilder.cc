@@ -36,6 +36,8 @@
 #include "D4ConstraintEvaluator.h"
 //#include "D4FunctionEvaluator.h"
 
+#include "DataResponseCache.h"
+
 #include "mime_util.h"	// for last_modified_time() and rfc_822_date()
 #include "escaping.h"
 
@@ -58,6 +60,7 @@ void D4ResponseBuilder::initialize()
 	// that a subclass can have more control over this process.
 	d_dataset = "";
 	d_timeout = 0;
+	d_response_cache = 0;
 
 	d_default_protocol = "4.0"; // DAP_PROTOCOL_VERSION;
 }
@@ -119,11 +122,54 @@ void D4ResponseBuilder::send_dmr(ostream &out, DMR &dmr, bool with_mime_headers,
 {
 	if (with_mime_headers) set_mime_text(out, dap4_dmr, x_plain, last_modified_time(d_dataset), dmr.dap_version());
 
-	XMLWriter xml;
+	XMLWriter xml(out);
 	dmr.print_dap4(xml, constrained /* true == constrained */);
-	out << xml.get_doc() << flush;
+	xml.end_document();
+	out << flush;
+}
+
+/**
+ * Write the DMR and data, chunked with checksums, of the DAP4 data response.
+ * This is the whole response less the MIME headers.
+ */
+static void write_dap(ostream &out, DMR &dmr, bool constrained)
+{
+    // Write the DMR
+    XMLWriter xml;
+    dmr.print_dap4(xml, constrained);
+
+    // now make the chunked output stream; set the size to be at least chunk_size
+    // but make sure that the whole of the xml plus the CRLF can fit in the first
+    // chunk. (+2 for the CRLF bytes).
+    chunked_ostream cos(out, max((unsigned int)CHUNK_SIZE, xml.get_doc_size()+2));
+
+    // using flush means that the DMR and CRLF are in the first chunk.
+    cos << xml.get_doc() << CRLF << flush;
+
+    // Write the data, chunked with checksums
+    D4StreamMarshaller m(cos);
+    dmr.root()->serialize(m, dmr, constrained);
 }
 
+/** Writes a DAP4 data response for DataResponseCache. */
+class DMRWriter: public DataResponseWriter {
+    DMR &d_dmr;
+    bool d_constrained;
+
+public:
+    DMRWriter(DMR &dmr, bool constrained) : d_dmr(dmr), d_constrained(constrained) { }
+
+    virtual void write(ostream &out)
+    {
+        write_dap(out, d_dmr, d_constrained);
+    }
+};
+
+/**
+ * Write the DAP4 data response. If a response cache has been set, the
+ * response is sent from it; the key includes the CE set with set_ce() when
+ * \c constrained is true.
+ */
 void D4ResponseBuilder::send_dap(ostream &out, DMR &dmr, bool with_mime_headers, bool constrained)
 {
 	try {
@@ -137,24 +183,31 @@ void D4ResponseBuilder::send_dap(ostream &out, DMR &dmr, bool with_mime_headers,
 			throw Error(msg);
 		}
 
-		if (with_mime_headers)
-			set_mime_binary(out, dap4_data, x_plain, last_modified_time(d_dataset), dmr.dap_version());
-
-	    // Write the DMR
-	    XMLWriter xml;
-	    dmr.print_dap4(xml, constrained);
-
-	    // now make the chunked output stream; set the size to be at least chunk_size
-	    // but make sure that the whole of the xml plus the CRLF can fit in the first
-	    // chunk. (+2 for the CRLF bytes).
-	    chunked_ostream cos(out, max((unsigned int)CHUNK_SIZE, xml.get_doc_size()+2));
-
-	    // using flush means that the DMR and CRLF are in the first chunk.
-	    cos << xml.get_doc() << CRLF << flush;
+		int fd;
+		off_t offset;
+		DMRWriter writer(dmr, constrained);
+		if (d_response_cache
+				&& d_response_cache->get_response("dap", d_dataset, constrained ? d_dap4ce : "",
+						last_modified_time(d_dataset), writer, fd, offset)) {
+			try {
+				if (with_mime_headers)
+					set_mime_binary(out, dap4_data, x_plain, last_modified_time(d_dataset), dmr.dap_version());
+
+				d_response_cache->send_response(out, fd, offset);
+			}
+			catch (...) {
+				d_response_cache->release(fd);
+				throw;
+			}
+
+			d_response_cache->release(fd);
+		}
+		else {
+			if (with_mime_headers)
+				set_mime_binary(out, dap4_data, x_plain, last_modified_time(d_dataset), dmr.dap_version());
 
-	    // Write the data, chunked with checksums
-	    D4StreamMarshaller m(cos);
-	    dmr.root()->serialize(m, dmr, constrained);
+			write_dap(out, dmr, constrained);
+		}
 
 		out << flush;
 
@@ -33,6 +33,7 @@ namespace libdap {
 // class ConstraintEvaluator;
 class DDS;
 class DMR;
+class DataResponseCache;
 
 /**
  * Used for testing only. This duplicates code in the bes/dap module.
@@ -47,8 +48,10 @@ class D4ResponseBuilder
 
 protected:
     std::string d_dataset;  		/// Name of the dataset/database
+    std::string d_dap4ce;		/// DAP4 Constraint expression
     int d_timeout;  		/// Response timeout after N seconds
     std::string d_default_protocol;	/// Version std::string for the library's default protocol version
+    DataResponseCache *d_response_cache; /// Cache data responses here; not owned
 
     void initialize();
 
@@ -71,6 +74,15 @@ public:
     virtual std::string get_dataset_name() const { return d_dataset; }
     virtual void set_dataset_name(const std::string _dataset);
 
+    /** The CE is only used to find cached data responses. */
+    virtual std::string get_ce() const { return d_dap4ce; }
+    virtual void set_ce(const std::string &ce) { d_dap4ce = ce; }
+
+    /** Send data responses from this cache; null (the default) turns
+     caching off. Not deleted by this object. */
+    virtual DataResponseCache *get_response_cache() const { return d_response_cache; }
+    virtual void set_response_cache(DataResponseCache *cache) { d_response_cache = cache; }
+
     // These are used for DAP4 testing by dmr-test.
     virtual void establish_timeout(ostream &stream) const;
     virtual void remove_timeout() const;
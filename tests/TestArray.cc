@@ -50,6 +50,7 @@
 //#define DODS_DEBUG
 
 #include "util.h"
+#include "Hyperslab.h"
 #include "debug.h"
 
 #include "TestInt8.h"
@@ -232,11 +233,6 @@ void TestArray::m_build_special_values()
     }
 }
 
-int TestArray::m_offset(int y, Dim_iter X, int x)
-{
-    return y * dimension_size(X, false) + x;
-}
-
 /**
  * @brief Load an 2D array with values.
  * Use the read() function for the prototype element of the array to
@@ -271,23 +267,7 @@ void TestArray::m_constrained_matrix(vector<T>&constrained_array)
 
     DBG(cerr << "whole_array: "; copy(whole_array.begin(), whole_array.end(), ostream_iterator<T>(cerr, ", ")); cerr << endl);
 
-    Dim_iter Y = dim_begin();
-    Dim_iter X = Y + 1;
-
-    DBG(cerr << "dimension_start(Y): " << dimension_start(Y) << endl); DBG(cerr << "dimension_stop(Y): " << dimension_stop(Y) << endl); DBG(cerr << "dimension_start(X): " << dimension_start(X) << endl); DBG(cerr << "dimension_stop(X): " << dimension_stop(X) << endl);
-
-    int constrained_size = 0;
-    int y = dimension_start(Y);
-    while (y < dimension_stop(Y) + 1) {
-        int x = dimension_start(X);
-
-        while (x < dimension_stop(X) + 1) {
-            constrained_array[constrained_size++] = whole_array[m_offset(y, X, x)];
-            x += dimension_stride(X);
-        }
-
-        y += dimension_stride(Y);
-    }
+    Hyperslab::extract(Hyperslab(*this, false), &whole_array[0], sizeof(T), Hyperslab(*this), &constrained_array[0]);
 }
 
 template<typename T>
@@ -309,23 +289,7 @@ void TestArray::m_enum_constrained_matrix(vector<T>&constrained_array)
 
     DBG(cerr << "whole_array: "; copy(whole_array.begin(), whole_array.end(), ostream_iterator<T>(cerr, ", ")); cerr << endl);
 
-    Dim_iter Y = dim_begin();
-    Dim_iter X = Y + 1;
-
-    DBG(cerr << "dimension_start(Y): " << dimension_start(Y) << endl); DBG(cerr << "dimension_stop(Y): " << dimension_stop(Y) << endl); DBG(cerr << "dimension_start(X): " << dimension_start(X) << endl); DBG(cerr << "dimension_stop(X): " << dimension_stop(X) << endl);
-
-    int constrained_size = 0;
-    int y = dimension_start(Y);
-    while (y < dimension_stop(Y) + 1) {
-        int x = dimension_start(X);
-
-        while (x < dimension_stop(X) + 1) {
-            constrained_array[constrained_size++] = whole_array[m_offset(y, X, x)];
-            x += dimension_stride(X);
-        }
-
-        y += dimension_stride(Y);
-    }
+    Hyperslab::extract(Hyperslab(*this, false), &whole_array[0], sizeof(T), Hyperslab(*this), &constrained_array[0]);
 }
 
 /**
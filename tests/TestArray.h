@@ -49,7 +49,6 @@ class TestArray: public Array, public TestCommon {
     bool m_name_is_special();
     void m_build_special_values();
 
-    int m_offset(int y, Dim_iter Y, int x);
 
     template <typename T, class C> void m_constrained_matrix(vector<T> &constrained_array);
     template <typename T> void m_enum_constrained_matrix(vector<T> &constrained_array);
@@ -103,9 +103,10 @@ test_dap4_parser(const string &name, bool debug, bool print)
     cout << "Parse successful" << endl;
 
     if (print) {
-        XMLWriter xml("    ");
+        XMLWriter xml(cout, "    ");
         dataset->print_dap4(xml, false);
-        cout << xml.get_doc() << endl;
+        xml.end_document();
+        cout << endl;
     }
 
     delete factory;
@@ -441,10 +442,11 @@ main(int argc, char *argv[])
         	DMR *client = read_data_plain(file_name, debug);
 
         	if (print) {
-        		XMLWriter xml;
+        		XMLWriter xml(cout);
         		// received data never have send_p set; don't set 'constrained'
         		client->print_dap4(xml, false /* constrained */);
-        		cout << xml.get_doc() << endl;
+        		xml.end_document();
+        		cout << endl;
 
 				cout << "The data:" << endl;
         	}
@@ -461,9 +463,10 @@ main(int argc, char *argv[])
         	intern_data(dmr, /*ce,*/ series_values);
 
         	if (print) {
-        		XMLWriter xml;
+        		XMLWriter xml(cout);
         		dmr->print_dap4(xml, false /*constrained*/);
-        		cout << xml.get_doc() << endl;
+        		xml.end_document();
+        		cout << endl;
 
 				cout << "The data:" << endl;
         	}
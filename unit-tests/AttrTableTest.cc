@@ -38,6 +38,7 @@
 
 #include "GNURegex.h"
 #include "AttrTable.h"
+#include "AttrValues.h"
 #include "debug.h"
 
 #include "testFile.h"
@@ -147,6 +148,7 @@ class AttrTableTest: public TestFixture {
         CPPUNIT_TEST(get_attr_iter_test);
         CPPUNIT_TEST(del_attr_table_test);
         CPPUNIT_TEST(append_attr_vector_test);
+        CPPUNIT_TEST(index_test);
 #endif
 #if 0
         CPPUNIT_TEST(print_xml_test);
@@ -404,6 +406,84 @@ String longer%20name \"second test\";";
             CPPUNIT_ASSERT(cont_a->get_attr_num("size") == 3);
         }
 
+        // Lookups use an index of the names; check it follows additions and
+        // deletions and that the order of the entries doesn't change.
+        void index_test() {
+            AttrTable t;
+            for (int i = 0; i < 100; ++i) {
+                ostringstream oss;
+                oss << "attr_" << 99 - i;
+                t.append_attr(oss.str(), "Int32", "1");
+            }
+            t.append_attr("attr_42", "Int32", "2");
+            AttrTable *c = t.append_container("c");
+            c->append_attr("inner", "String", "x");
+
+            CPPUNIT_ASSERT(t.get_size() == 101);
+            CPPUNIT_ASSERT(t.get_name(t.attr_begin()) == "attr_99");
+            CPPUNIT_ASSERT(t.get_name(t.get_attr_iter(57)) == "attr_42");
+            CPPUNIT_ASSERT(t.get_attr_num("attr_42") == 2);
+            CPPUNIT_ASSERT(t.simple_find("attr_42") == t.get_attr_iter(57));
+            CPPUNIT_ASSERT(t.simple_find_container("c") == c);
+            CPPUNIT_ASSERT(t.simple_find_container("attr_42") == 0);
+            CPPUNIT_ASSERT_THROW(t.append_container("attr_0"), Error);
+            CPPUNIT_ASSERT_THROW(t.append_attr("c", "Int32", "1"), Error);
+
+            // Entries after a deleted one move up
+            t.del_attr("attr_99");
+            t.del_attr("attr_42", 0);
+            CPPUNIT_ASSERT(t.simple_find("attr_99") == t.attr_end());
+            CPPUNIT_ASSERT(t.simple_find("attr_42") == t.get_attr_iter(56));
+            CPPUNIT_ASSERT(t.get_attr("attr_42") == "2");
+            CPPUNIT_ASSERT(t.get_attr("attr_0") == "1");
+
+            AttrTable *at;
+            AttrTable::Attr_iter i;
+            t.find("inner", &at, &i);
+            CPPUNIT_ASSERT(at == c && c->get_name(i) == "inner");
+            t.find("c.inner", &at, &i);
+            CPPUNIT_ASSERT(at == c && c->get_name(i) == "inner");
+            t.find("missing", &at, &i);
+            CPPUNIT_ASSERT(at == 0);
+
+            i = t.del_attr_table(t.simple_find("c"));
+            CPPUNIT_ASSERT(i == t.attr_end());
+            CPPUNIT_ASSERT(t.simple_find_container("c") == 0);
+            t.append_attr("c", "Int32", "1");
+            CPPUNIT_ASSERT(t.get_attr("c") == "1");
+            delete c;
+
+            // Copies have their own index
+            AttrTable copy = t;
+            copy.del_attr("attr_0");
+            CPPUNIT_ASSERT(t.get_attr("attr_0") == "1");
+            CPPUNIT_ASSERT(copy.get_attr("attr_0") == "");
+            CPPUNIT_ASSERT(copy.get_attr("attr_1") == "1");
+
+            // Every name is still found at its place
+            for (AttrTable::Attr_iter j = t.attr_begin(); j != t.attr_end(); ++j)
+                CPPUNIT_ASSERT(t.simple_find(t.get_name(j)) == j);
+
+            // When the first of two entries with a name is deleted, the
+            // second is found
+            for (int n = 0; n < 2; ++n) {
+                AttrTable::entry *e = new AttrTable::entry;
+                e->name = "dup";
+                e->type = Attr_int32;
+                e->attr = new AttrValues(Attr_int32);
+                e->attr->append(n == 0 ? "3" : "4");
+                t.m_add_entry(e);
+            }
+            t.del_attr("dup");
+            CPPUNIT_ASSERT(t.get_attr("dup") == "4");
+            CPPUNIT_ASSERT(t.simple_find("dup") == t.get_attr_iter(t.get_size() - 1));
+            t.del_attr("dup");
+            CPPUNIT_ASSERT(t.simple_find("dup") == t.attr_end());
+
+            t.erase();
+            CPPUNIT_ASSERT(t.simple_find("attr_1") == t.attr_end());
+        }
+
         void print_xml_test() {
             at1->print_xml(stdout);
         }
@@ -0,0 +1,318 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AttrValues.h"
+#include "AttrTable.h"
+#include "D4Attributes.h"
+#include "XMLWriter.h"
+#include "InternalErr.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+class AttrValuesTest: public TestFixture {
+public:
+    AttrValuesTest()
+    {
+    }
+
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    CPPUNIT_TEST_SUITE (AttrValuesTest);
+
+    CPPUNIT_TEST (binary_test);
+    CPPUNIT_TEST (format_test);
+    CPPUNIT_TEST (text_test);
+    CPPUNIT_TEST (bad_text_test);
+    CPPUNIT_TEST (mixed_test);
+    CPPUNIT_TEST (attr_table_test);
+    CPPUNIT_TEST (d4_attributes_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void binary_test()
+    {
+        dods_int32 v[] = { 1, -2, 300000 };
+        AttrValues values(Attr_int32);
+        values.append(v, 3);
+
+        CPPUNIT_ASSERT(values.is_binary());
+        CPPUNIT_ASSERT(values.size() == 3);
+        CPPUNIT_ASSERT(values.data<dods_int32>()[2] == 300000);
+        CPPUNIT_ASSERT(values.value(1) == "-2");
+
+        // Formatting a value doesn't keep the text
+        const AttrValues &cv = values;
+        CPPUNIT_ASSERT(cv.text().size() == 3 && cv.text()[0] == "1");
+        CPPUNIT_ASSERT(values.is_binary());
+
+        values.erase(0);
+        CPPUNIT_ASSERT(values.size() == 2 && values.value(0) == "-2");
+        CPPUNIT_ASSERT(cv.text().size() == 2);
+
+        CPPUNIT_ASSERT_THROW(values.data<dods_uint32>(), InternalErr);
+        dods_float64 d = 1.0;
+        CPPUNIT_ASSERT_THROW(values.append(&d, 1), InternalErr);
+
+        // A caller that may change the strings gets text only
+        values.text().push_back("7");
+        CPPUNIT_ASSERT(!values.is_binary());
+        CPPUNIT_ASSERT(values.data<dods_int32>()[2] == 7);
+    }
+
+    void format_test()
+    {
+        dods_float32 f[] = { 0.1f, 0.0099999998f, 3.4028235e38f, -1.5f };
+        AttrValues floats(Attr_float32);
+        floats.append(f, 4);
+        CPPUNIT_ASSERT(floats.value(0) == "0.1");
+        CPPUNIT_ASSERT(floats.value(1) == "0.01");
+        CPPUNIT_ASSERT(floats.value(3) == "-1.5");
+
+        dods_float64 d[] = { 35.09, 1.0 / 3.0, 1e-300 };
+        AttrValues doubles(Attr_float64);
+        doubles.append(d, 3);
+        CPPUNIT_ASSERT(doubles.value(0) == "35.09");
+        CPPUNIT_ASSERT(doubles.value(2) == "1e-300");
+
+        // All of them read back as the same values
+        AttrValues f2(Attr_float32);
+        f2.append(floats.text());
+        for (int i = 0; i < 4; ++i)
+            CPPUNIT_ASSERT(f2.data<dods_float32>()[i] == f[i]);
+
+        AttrValues d2(Attr_float64);
+        d2.append(doubles.text());
+        for (int i = 0; i < 3; ++i)
+            CPPUNIT_ASSERT(d2.data<dods_float64>()[i] == d[i]);
+
+        dods_byte b[] = { 0, 255 };
+        AttrValues bytes(Attr_byte);
+        bytes.append(b, 2);
+        CPPUNIT_ASSERT(bytes.value(1) == "255");
+    }
+
+    void text_test()
+    {
+        // Values read as text print the way they were read
+        AttrValues values(Attr_float64);
+        values.append("0.");
+        values.append("1.50");
+        values.append("0x10");
+        CPPUNIT_ASSERT(!values.is_binary());
+
+        const dods_float64 *d = values.data<dods_float64>();
+        CPPUNIT_ASSERT(d[0] == 0.0 && d[1] == 1.5 && d[2] == 16.0);
+        CPPUNIT_ASSERT(values.is_binary());
+        CPPUNIT_ASSERT(values.value(0) == "0." && values.value(1) == "1.50");
+
+        // Both forms are kept up to date
+        values.append("2");
+        CPPUNIT_ASSERT(values.size() == 4 && values.data<dods_float64>()[3] == 2.0);
+        CPPUNIT_ASSERT(values.value(3) == "2");
+
+        AttrValues strings(Attr_string);
+        strings.append("a value");
+        CPPUNIT_ASSERT_THROW(strings.data<dods_float64>(), InternalErr);
+    }
+
+    void bad_text_test()
+    {
+        AttrValues values(Attr_int16);
+        values.append("12");
+        values.append("40000");
+        CPPUNIT_ASSERT_THROW(values.data<dods_int16>(), Error);
+        CPPUNIT_ASSERT(values.size() == 2 && values.value(1) == "40000");
+
+        AttrValues unsigned_values(Attr_uint32);
+        unsigned_values.append("-1");
+        CPPUNIT_ASSERT_THROW(unsigned_values.data<dods_uint32>(), Error);
+    }
+
+    void mixed_test()
+    {
+        dods_uint16 v[] = { 1, 2 };
+        AttrValues values(Attr_uint16);
+        values.append(v, 2);
+
+        values.append("3");
+        CPPUNIT_ASSERT(values.is_binary() && values.size() == 3);
+
+        // A value that isn't a UInt16 makes them all text
+        values.append("junk");
+        CPPUNIT_ASSERT(!values.is_binary());
+        CPPUNIT_ASSERT(values.size() == 4 && values.value(0) == "1" && values.value(3) == "junk");
+
+        // Binary values copied to an empty object stay binary
+        AttrValues source(Attr_uint16), dest(Attr_uint16);
+        source.append(v, 2);
+        dest.append(source);
+        CPPUNIT_ASSERT(dest.is_binary() && dest.size() == 2);
+
+        // ... and are formatted when appended to text
+        AttrValues text(Attr_uint16);
+        text.append("0");
+        text.append(source);
+        CPPUNIT_ASSERT(!text.is_binary() && text.size() == 3 && text.value(2) == "2");
+    }
+
+    void attr_table_test()
+    {
+        dods_float64 range[] = { -1.8, 35.09 };
+        AttrValues values(Attr_float64);
+        values.append(range, 2);
+
+        AttrTable at;
+        at.append_attr("units", "String", "degC");
+        CPPUNIT_ASSERT(at.append_attr("actual_range", values) == 2);
+
+        CPPUNIT_ASSERT(at.get_type("actual_range") == "Float64");
+        CPPUNIT_ASSERT(at.get_attr("actual_range", 1) == "35.09");
+        CPPUNIT_ASSERT(at.get_attr_values("actual_range")->data<dods_float64>()[0] == -1.8);
+        CPPUNIT_ASSERT(at.get_attr_values("actual_range")->is_binary());
+        CPPUNIT_ASSERT(at.get_attr_values("units")->value(0) == "degC");
+
+        ostringstream oss;
+        at.print(oss);
+        DBG(cerr << oss.str() << endl);
+        CPPUNIT_ASSERT(oss.str() == "    String units \"degC\";\n    Float64 actual_range -1.8, 35.09;\n");
+
+        // Copies hold binary values too
+        AttrTable copy = at;
+        CPPUNIT_ASSERT(copy.get_attr_values("actual_range")->is_binary());
+
+        // Text appended to the attribute is parsed
+        at.append_attr("actual_range", "Float64", "40");
+        CPPUNIT_ASSERT(at.get_attr_values("actual_range")->is_binary());
+        CPPUNIT_ASSERT(at.get_attr_num("actual_range") == 3);
+
+        CPPUNIT_ASSERT_THROW(at.append_attr("units", values), Error);
+
+        // The vector of strings can be changed by the caller
+        vector<string> *sv = at.get_attr_vector("actual_range");
+        CPPUNIT_ASSERT(sv->size() == 3 && (*sv)[2] == "40");
+        (*sv)[2] = "41";
+        CPPUNIT_ASSERT(at.get_attr("actual_range", 2) == "41");
+        CPPUNIT_ASSERT(at.get_attr_values("actual_range")->data<dods_float64>()[2] == 41.0);
+    }
+
+    void d4_attributes_test()
+    {
+        dods_int16 fill = -999;
+        AttrValues values(Attr_int16);
+        values.append(&fill, 1);
+
+        AttrTable at;
+        at.append_attr("_FillValue", values);
+        at.append_attr("long_name", "String", "temperature");
+
+        D4Attributes attrs;
+        attrs.transform_to_dap4(at);
+
+        D4Attribute *a = attrs.get("_FillValue");
+        CPPUNIT_ASSERT(a && a->type() == attr_int16_c);
+        CPPUNIT_ASSERT(a->values().is_binary());
+        CPPUNIT_ASSERT(a->num_values() == 1 && a->value(0) == "-999");
+        CPPUNIT_ASSERT(a->values().data<dods_int16>()[0] == -999);
+        CPPUNIT_ASSERT(attrs.get("long_name")->value(0) == "temperature");
+
+        XMLWriter xml;
+        attrs.print_dap4(xml);
+        string doc = xml.get_doc();
+        DBG(cerr << doc << endl);
+        CPPUNIT_ASSERT(doc.find("<Value>-999</Value>") != string::npos);
+
+        // DAP4 types without an AttrType are held as text
+        D4Attribute big("big", attr_int64_c);
+        big.add_value("9007199254740993");
+        CPPUNIT_ASSERT(!big.values().is_binary() && big.value(0) == "9007199254740993");
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION (AttrValuesTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::AttrValuesTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
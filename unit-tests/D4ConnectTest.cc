@@ -0,0 +1,390 @@
+
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "D4Connect.h"
+#include "HTTPConnect.h"
+#include "Response.h"
+#include "DMR.h"
+#include "D4Group.h"
+#include "Array.h"
+#include "Int32.h"
+#include "D4BaseTypeFactory.h"
+#include "D4StreamMarshaller.h"
+#include "chunked_stream.h"
+#include "chunked_ostream.h"
+#include "crc.h"
+#include "XMLWriter.h"
+#include "escaping.h"
+#include "Error.h"
+#include "util.h"
+#include "GetOpt.h"
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+const int rows = 6;
+const int cols = 2;
+
+/** The value of a[row][col] in the test Array. */
+static dods_int32 value_at(int row, int col)
+{
+    return row * 10 + col;
+}
+
+/** Write a chunk of a response. As chunked_ostream does, the header is
+    written in the host's byte order. */
+static void write_chunk(ostream &out, uint32_t type, const string &data)
+{
+    uint32_t header = data.size() | type;
+    out.write(reinterpret_cast<char*>(&header), sizeof(header));
+    out.write(data.data(), data.size());
+}
+
+/** Write the DAP4 data response for one Int32 array as a big-endian server
+    would: the values and their checksum are big-endian and the chunk
+    headers don't have CHUNK_LITTLE_ENDIAN set. */
+static void write_big_endian_response(ostream &out, const string &dmr, const vector<dods_int32> &values)
+{
+    string data;
+    for (vector<dods_int32>::const_iterator i = values.begin(); i != values.end(); ++i)
+        for (int b = 3; b >= 0; --b)
+            data += static_cast<char>((static_cast<uint32_t>(*i) >> (8 * b)) & 0xff);
+
+    Crc32 crc;
+    crc.AddData(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    uint32_t checksum = crc.GetCrc32();
+    for (int b = 3; b >= 0; --b)
+        data += static_cast<char>((checksum >> (8 * b)) & 0xff);
+
+    write_chunk(out, CHUNK_DATA, dmr + "\r\n");
+    write_chunk(out, CHUNK_DATA, data);
+    write_chunk(out, CHUNK_END, "");
+}
+
+/** A Response read from a file that is deleted once it is opened. */
+class FileResponse: public Response {
+    fstream d_file;
+
+public:
+    FileResponse(const string &name) : Response()
+    {
+        d_file.open(name.c_str(), ios::in | ios::binary);
+        unlink(name.c_str());
+        set_cpp_stream(&d_file);
+        set_type(dap4_data);
+    }
+
+    virtual ~FileResponse()
+    {
+        // d_file is gone before ~Response() runs
+        set_cpp_stream(0);
+    }
+};
+
+/** A D4Connect that, in place of a server, builds the DAP4 data response for
+    the rows of a[6][2] that each request asks for. A request for the rows
+    starting at \c fail_row fails and the response for those starting at
+    \c corrupt_row has one of its data bytes changed. If \c big_endian is
+    set, the responses are those of a big-endian server. */
+class StubD4Connect: public D4Connect {
+    pthread_mutex_t d_mutex;
+
+public:
+    vector<string> ces;
+    int fail_row;
+    int corrupt_row;
+    bool big_endian;
+
+    StubD4Connect() : D4Connect("http://localhost/test"), fail_row(-1), corrupt_row(-1), big_endian(false)
+    {
+        pthread_mutex_init(&d_mutex, 0);
+    }
+
+    virtual ~StubD4Connect()
+    {
+        pthread_mutex_destroy(&d_mutex);
+    }
+
+protected:
+    virtual Response *fetch_url(HTTPConnect &, const string &url)
+    {
+        string ce = www2id(url.substr(url.find("dap4.ce=") + 8));
+
+        pthread_mutex_lock(&d_mutex);
+        ces.push_back(ce);
+        pthread_mutex_unlock(&d_mutex);
+
+        int start, stride, stop;
+        if (sscanf(ce.c_str(), "/a[%d:%d:%d]", &start, &stride, &stop) != 3)
+            throw Error("Bad constraint: " + ce);
+
+        if (start == fail_row)
+            throw Error("Could not read rows starting at " + long_to_string(start));
+
+        vector<dods_int32> values;
+        for (int r = start; r <= stop; r += stride)
+            for (int c = 0; c < cols; ++c)
+                values.push_back(value_at(r, c));
+
+        D4BaseTypeFactory factory;
+        DMR dmr(&factory, "test");
+        Int32 proto("a");
+        Array *a = new Array("a", &proto, true);
+        a->append_dim(values.size() / cols);
+        a->append_dim(cols);
+        a->set_value(values, values.size());
+        a->set_read_p(true);
+        dmr.root()->add_var_nocopy(a);
+        dmr.root()->set_send_p(true);
+
+        char name[] = "/tmp/D4ConnectTest_XXXXXX";
+        int fd = mkstemp(name);
+        if (fd < 0)
+            throw Error("Could not make a temporary file.");
+        close(fd);
+
+        {
+            ofstream out(name, ios::out | ios::binary);
+
+            XMLWriter xml;
+            dmr.print_dap4(xml, false);
+
+            if (big_endian) {
+                write_big_endian_response(out, xml.get_doc(), values);
+            }
+            else {
+                chunked_ostream cos(out, max((unsigned int) CHUNK_SIZE, xml.get_doc_size() + 2));
+                cos << xml.get_doc() << "\r\n" << flush;
+
+                D4StreamMarshaller m(cos);
+                dmr.root()->serialize(m, dmr, false);
+            }
+        }
+
+        if (start == corrupt_row) {
+            // The response ends with the last value and then its four byte
+            // checksum; change the last value.
+            fstream f(name, ios::in | ios::out | ios::binary);
+            f.seekp(-5, ios::end);
+            f.put('\x7f');
+        }
+
+        return new FileResponse(name);
+    }
+};
+
+class D4ConnectTest: public TestFixture {
+private:
+    D4BaseTypeFactory factory;
+    DMR *dmr;
+    Array *a;
+
+public:
+    D4ConnectTest() : dmr(0), a(0)
+    {
+    }
+
+    ~D4ConnectTest()
+    {
+    }
+
+    void setUp()
+    {
+        dmr = new DMR(&factory, "test");
+        Int32 proto("a");
+        a = new Array("a", &proto, true);
+        a->append_dim(rows);
+        a->append_dim(cols);
+        dmr->root()->add_var_nocopy(a);
+    }
+
+    void tearDown()
+    {
+        delete dmr;
+        dmr = 0;
+        a = 0;
+    }
+
+    CPPUNIT_TEST_SUITE (D4ConnectTest);
+
+    CPPUNIT_TEST (request_dap4_array_test);
+    CPPUNIT_TEST (request_dap4_array_constrained_test);
+    CPPUNIT_TEST (request_dap4_array_error_test);
+    CPPUNIT_TEST (request_dap4_array_checksum_test);
+    CPPUNIT_TEST (request_dap4_array_big_endian_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void request_dap4_array_test()
+    {
+        StubD4Connect conn;
+        conn.request_dap4_array(*dmr, a, 3);
+
+        sort(conn.ces.begin(), conn.ces.end());
+        CPPUNIT_ASSERT(conn.ces.size() == 3);
+        CPPUNIT_ASSERT(conn.ces[0] == "/a[0:1:1][0:1:1]");
+        CPPUNIT_ASSERT(conn.ces[1] == "/a[2:1:3][0:1:1]");
+        CPPUNIT_ASSERT(conn.ces[2] == "/a[4:1:5][0:1:1]");
+
+        CPPUNIT_ASSERT(a->read_p());
+        CPPUNIT_ASSERT(a->length() == rows * cols);
+
+        vector<dods_int32> values(a->length());
+        a->value(&values[0]);
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < cols; ++c)
+                CPPUNIT_ASSERT(values[r * cols + c] == value_at(r, c));
+    }
+
+    void request_dap4_array_constrained_test()
+    {
+        // rows 1, 3 and 5 in two pieces: [1] and [3, 5]
+        a->add_constraint(a->dim_begin(), 1, 2, 5);
+
+        StubD4Connect conn;
+        conn.request_dap4_array(*dmr, a, 2);
+
+        sort(conn.ces.begin(), conn.ces.end());
+        CPPUNIT_ASSERT(conn.ces.size() == 2);
+        CPPUNIT_ASSERT(conn.ces[0] == "/a[1:2:1][0:1:1]");
+        CPPUNIT_ASSERT(conn.ces[1] == "/a[3:2:5][0:1:1]");
+
+        CPPUNIT_ASSERT(a->length() == 3 * cols);
+
+        vector<dods_int32> values(a->length());
+        a->value(&values[0]);
+        for (int i = 0; i < 3; ++i)
+            for (int c = 0; c < cols; ++c)
+                CPPUNIT_ASSERT(values[i * cols + c] == value_at(1 + 2 * i, c));
+    }
+
+    void request_dap4_array_error_test()
+    {
+        StubD4Connect conn;
+        conn.fail_row = 2;
+
+        CPPUNIT_ASSERT_THROW(conn.request_dap4_array(*dmr, a, 3), Error);
+        CPPUNIT_ASSERT(conn.ces.size() == 3);
+        CPPUNIT_ASSERT(!a->read_p());
+    }
+
+    void request_dap4_array_checksum_test()
+    {
+        StubD4Connect conn;
+        conn.corrupt_row = 4;
+
+        try {
+            conn.request_dap4_array(*dmr, a, 3);
+            CPPUNIT_FAIL("Expected an Error for the bad checksum");
+        }
+        catch (Error &e) {
+            DBG(cerr << e.get_error_message() << endl);
+            CPPUNIT_ASSERT(e.get_error_message().find("checksum") != string::npos);
+        }
+        CPPUNIT_ASSERT(!a->read_p());
+    }
+
+    // The values and checksum of a big-endian server are swapped on a
+    // little-endian client, and the reverse
+    void request_dap4_array_big_endian_test()
+    {
+        StubD4Connect conn;
+        conn.big_endian = true;
+        conn.request_dap4_array(*dmr, a, 3);
+
+        CPPUNIT_ASSERT(a->read_p());
+        CPPUNIT_ASSERT(a->length() == rows * cols);
+
+        vector<dods_int32> values(a->length());
+        a->value(&values[0]);
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < cols; ++c)
+                CPPUNIT_ASSERT(values[r * cols + c] == value_at(r, c));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION (D4ConnectTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::D4ConnectTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
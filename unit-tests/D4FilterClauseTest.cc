@@ -28,6 +28,7 @@
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <memory>
 #include <sstream>
 
 #include "Byte.h"
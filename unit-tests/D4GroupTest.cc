@@ -210,6 +210,58 @@ public:
         CPPUNIT_ASSERT(btp->get_parent()->name() == "child" && btp->get_parent()->get_parent()->name() == "/");
     }
 
+    void test_find_paths() {
+        load_group_with_stuff(root);
+
+        D4Group *child = new D4Group("child");
+        load_group_with_stuff(child);
+        load_group_with_nested_constructors_and_scalars(child);
+        root->add_group_nocopy(child);
+
+        D4Group *grandchild = new D4Group("grandchild");
+        load_group_with_scalars(grandchild);
+        grandchild->dims()->add_dim_nocopy(new D4Dimension("depth", 7));
+        child->add_group_nocopy(grandchild);
+
+        CPPUNIT_ASSERT(root->find_child_grp("child") == child);
+        CPPUNIT_ASSERT(!root->find_child_grp("grandchild"));
+
+        CPPUNIT_ASSERT(root->find_var("/child/grandchild/i64")->FQN() == "/child/grandchild/i64");
+        CPPUNIT_ASSERT(root->find_var("/child/p.c.i64")->FQN() == "/child/p.c.i64");
+        CPPUNIT_ASSERT(!root->find_var("/child/nothere/b"));
+        CPPUNIT_ASSERT(!root->find_var("/child/p.c.nothere"));
+
+        CPPUNIT_ASSERT(root->find_dim("/child/grandchild/depth")->size() == 7);
+        CPPUNIT_ASSERT(root->find_dim("/child/lat")->fully_qualified_name() == "/child/lat");
+        CPPUNIT_ASSERT(!root->find_dim("/child/depth"));
+        CPPUNIT_ASSERT(root->find_enum_def("/child/colors")->parent() == child->enum_defs());
+        CPPUNIT_ASSERT(!root->find_enum_def("/child/shades"));
+
+        // Things renamed after they were added are still found
+        grandchild->set_name("gc");
+        child->find_dim("time")->set_name("t");
+        child->find_enum_def("colors")->set_name("shades");
+
+        CPPUNIT_ASSERT(!root->find_var("/child/grandchild/i64"));
+        CPPUNIT_ASSERT(root->find_var("/child/gc/i64")->FQN() == "/child/gc/i64");
+        CPPUNIT_ASSERT(!root->find_dim("/child/time"));
+        CPPUNIT_ASSERT(root->find_dim("/child/t")->size() == 20);
+        CPPUNIT_ASSERT(!root->find_enum_def("/child/colors"));
+        CPPUNIT_ASSERT(root->find_enum_def("/child/shades"));
+
+        // A copy has its own names
+        D4Group copy(*root);
+        D4Group *child_copy = copy.find_child_grp("child");
+        CPPUNIT_ASSERT(child_copy && child_copy != child);
+        CPPUNIT_ASSERT(copy.find_dim("/child/t") == child_copy->dims()->find_dim("t"));
+        CPPUNIT_ASSERT(copy.find_dim("/child/t") != root->find_dim("/child/t"));
+        CPPUNIT_ASSERT(child_copy->enum_defs()->parent() == child_copy);
+
+        child_copy->find_enum_def("shades")->set_name("hues");
+        CPPUNIT_ASSERT(copy.find_enum_def("/child/hues"));
+        CPPUNIT_ASSERT(!root->find_enum_def("/child/hues"));
+    }
+
     void test_print_everything() {
         load_group_with_scalars(root);
         load_group_with_stuff(root);
@@ -330,6 +382,7 @@ public:
         CPPUNIT_TEST(test_print_everything);
 
         CPPUNIT_TEST(test_find_var);
+        CPPUNIT_TEST(test_find_paths);
 
         CPPUNIT_TEST(test_print_copy_ctor);
         CPPUNIT_TEST(test_print_assignment);
@@ -29,6 +29,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 #include <cppunit/TextTestRunner.h>
 #include <cppunit/extensions/TestFactoryRegistry.h>
@@ -44,6 +45,7 @@
 #include "D4BaseTypeFactory.h"
 #include "D4ParserSax2.h"
 #include "D4Maps.h"
+#include "D4Attributes.h"
 
 #include "InternalErr.h"
 #include "debug.h"
@@ -128,6 +130,29 @@ public:
         }
     }
 
+    // Pass the document to the parser 'piece' bytes at a time, as a client
+    // reading a response does
+    void compare_dmr_round_trip_chunked_version(const string &src, const string &bl, unsigned int piece)
+    {
+        try {
+            string document = readTestBaseline(string(TEST_SRC_DIR) + src);
+
+            parser->begin_parse(dmr, parser_debug);
+            for (string::size_type pos = 0; pos < document.size(); pos += piece)
+                parser->parse_chunk(document.data() + pos, min((string::size_type)piece, document.size() - pos));
+            parser->end_parse();
+
+            dmr->print_dap4(*xml, false);
+            string doc = xml->get_doc();
+            string baseline = readTestBaseline(string(TEST_SRC_DIR) + bl);
+            DBG(cerr << "DMR: " << doc << endl);
+            CPPUNIT_ASSERT(doc == baseline);
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message().c_str());
+        }
+    }
+
     void test_empty_dmr()
     {
         compare_dmr_round_trip("/D4-xml/DMR_empty.xml", "/D4-xml/DMR_empty_baseline.xml");
@@ -280,6 +305,57 @@ public:
         compare_dmr_round_trip_string_version("/D4-xml/DMR_7.5.xml", "/D4-xml/DMR_7.5_baseline.xml");
     }
 
+    void test_group_with_attributes_def_chunked_version()
+    {
+        compare_dmr_round_trip_chunked_version("/D4-xml/DMR_6.1.xml", "/D4-xml/DMR_6.1_baseline.xml", 7);
+    }
+
+    void test_all_simple_var_def_chunked_version()
+    {
+        compare_dmr_round_trip_chunked_version("/D4-xml/DMR_4.xml", "/D4-xml/DMR_4_baseline.xml", 1);
+    }
+
+    // Lines longer than the stream reader's buffer are read in pieces
+    void test_long_line_stream_version()
+    {
+        try {
+            string value(3000, 'x');
+            string document = "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+                "<Dataset xmlns=\"http://xml.opendap.org/ns/DAP/4.0#\" name=\"long\">\n"
+                "<Attribute name=\"a\" type=\"String\"><Value>" + value + "</Value></Attribute>"
+                "<Int32 name=\"i\"/></Dataset>";
+
+            istringstream iss(document);
+            parser->intern(iss, dmr, parser_debug);
+
+            D4Attribute *a = dmr->root()->attributes()->get("a");
+            CPPUNIT_ASSERT(a && a->num_values() == 1);
+            CPPUNIT_ASSERT(a->value(0) == value);
+            CPPUNIT_ASSERT(dmr->root()->var("i"));
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message().c_str());
+        }
+    }
+
+    // A parse that is not ended, as when reading the document fails, is
+    // freed by the parser's destructor.
+    void test_unfinished_parse()
+    {
+        string document = "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+            "<Dataset xmlns=\"http://xml.opendap.org/ns/DAP/4.0#\" name=\"part\">\n"
+            "<Int32 name=\"i\"/><Structure name=\"s\"><Int32 name=\"j\"/>";
+
+        parser->begin_parse(dmr, parser_debug);
+        parser->parse_chunk(document.data(), document.size());
+
+        delete parser;
+        parser = 0;
+
+        CPPUNIT_ASSERT(dmr->root()->var("i"));
+        CPPUNIT_ASSERT(!dmr->root()->var("s"));
+    }
+
     void test_map_1()
     {
         compare_dmr_round_trip_string_version("/D4-xml/DMR_8.xml", "/D4-xml/DMR_8_baseline.xml");
@@ -325,6 +401,11 @@ public:
     CPPUNIT_TEST(test_structure_with_attributes_def_string_version);
     CPPUNIT_TEST(test_array_var_def4_string_version);
 
+    CPPUNIT_TEST(test_group_with_attributes_def_chunked_version);
+    CPPUNIT_TEST(test_all_simple_var_def_chunked_version);
+    CPPUNIT_TEST(test_long_line_stream_version);
+    CPPUNIT_TEST(test_unfinished_parse);
+
     CPPUNIT_TEST(test_array_1);
     CPPUNIT_TEST(test_array_2);
     CPPUNIT_TEST(test_array_3);
@@ -0,0 +1,443 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "DAPCache3.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+// Four of these files overflow a 1MB cache
+static const unsigned long FILE_SIZE = 300 * 1024;
+
+static const string cache_dir = "cache-testsuite/dap_cache3";
+
+// Each run of a CountingProducer adds a byte to this file, so runs in every
+// process are counted.
+static const string produced_log = "cache-testsuite/dap_cache3_produced";
+
+namespace libdap {
+
+// Writes FILE_SIZE bytes slowly, so other requests pile up behind it. If
+// fail is set, the first run throws instead.
+class CountingProducer: public DAPCacheProducer {
+    bool d_fail;
+
+public:
+    CountingProducer(bool fail = false) : d_fail(fail) { }
+
+    virtual void produce(const string &, int fd)
+    {
+        int log = open(produced_log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+        CPPUNIT_ASSERT(log >= 0 && write(log, "x", 1) == 1);
+        close(log);
+
+        usleep(200000);
+
+        if (d_fail) {
+            d_fail = false;
+            throw Error("The producer failed.");
+        }
+
+        vector<char> buf(FILE_SIZE, 'x');
+        CPPUNIT_ASSERT(write(fd, &buf[0], buf.size()) == (ssize_t) buf.size());
+    }
+};
+
+struct Requester {
+    DAPCache3 *cache;
+    string target;
+    DAPCacheProducer *producer;
+    bool ok;
+};
+
+// Get the file using get_or_create() and check all of it is there.
+static void *request(void *arg)
+{
+    Requester *r = static_cast<Requester*>(arg);
+    r->ok = false;
+
+    try {
+        int fd;
+        r->cache->get_or_create(r->target, *r->producer, fd);
+
+        struct stat buf;
+        r->ok = fstat(fd, &buf) == 0 && buf.st_size == (off_t) FILE_SIZE;
+
+        r->cache->unlock_and_close(fd);
+    }
+    catch (Error &e) {
+        DBG(cerr << "Requester: " << e.get_error_message() << endl);
+    }
+
+    return 0;
+}
+
+// Run n threads that request the same file; return how many got all of it.
+static int run_requesters(DAPCache3 *cache, const string &target, DAPCacheProducer &producer, int n)
+{
+    vector<Requester> requesters(n);
+    vector<pthread_t> threads(n);
+    for (int i = 0; i < n; ++i) {
+        requesters[i].cache = cache;
+        requesters[i].target = target;
+        requesters[i].producer = &producer;
+        pthread_create(&threads[i], 0, request, &requesters[i]);
+    }
+
+    int ok = 0;
+    for (int i = 0; i < n; ++i) {
+        pthread_join(threads[i], 0);
+        if (requesters[i].ok)
+            ++ok;
+    }
+
+    return ok;
+}
+
+class DAPCache3Test: public TestFixture {
+private:
+    DAPCache3 *cache;
+
+    // Add a file to the cache the way a server does
+    string add_file(const string &name, unsigned long size = FILE_SIZE)
+    {
+        string target = cache->get_cache_file_name(name, false);
+        int fd;
+        CPPUNIT_ASSERT(cache->create_and_lock(target, fd));
+
+        vector<char> buf(size, 'x');
+        CPPUNIT_ASSERT(write(fd, &buf[0], buf.size()) == (ssize_t) buf.size());
+
+        cache->exclusive_to_shared_lock(fd);
+        cache->update_cache_info(target);
+        cache->update_and_purge(target);
+        cache->unlock_and_close(target);
+
+        return target;
+    }
+
+    static bool exists(const string &name)
+    {
+        return access(name.c_str(), F_OK) == 0;
+    }
+
+    void read_file(const string &name)
+    {
+        int fd;
+        CPPUNIT_ASSERT(cache->get_read_lock(name, fd));
+        cache->unlock_and_close(name);
+    }
+
+public:
+    DAPCache3Test() : cache(0)
+    {
+    }
+
+    void setUp()
+    {
+        system(("rm -rf " + cache_dir + " " + produced_log).c_str());
+        cache = new DAPCache3(cache_dir, "dap", 1);
+    }
+
+    void tearDown()
+    {
+        delete cache;
+        cache = 0;
+    }
+
+    CPPUNIT_TEST_SUITE (DAPCache3Test);
+
+    CPPUNIT_TEST (purge_lru_test);
+    CPPUNIT_TEST (use_changes_purge_order_test);
+    CPPUNIT_TEST (index_persists_test);
+    CPPUNIT_TEST (index_recovery_test);
+    CPPUNIT_TEST (gds_policy_test);
+    CPPUNIT_TEST (tinylfu_policy_test);
+    CPPUNIT_TEST (statistics_test);
+    CPPUNIT_TEST (single_flight_threads_test);
+    CPPUNIT_TEST (single_flight_failure_test);
+    CPPUNIT_TEST (single_flight_processes_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void purge_lru_test()
+    {
+        vector<string> files;
+        for (int i = 0; i < 4; ++i) {
+            files.push_back(add_file(string(1, 'a' + i)));
+        }
+
+        // The target size is 80% of 1MB, so the two oldest files go
+        CPPUNIT_ASSERT(!exists(files[0]));
+        CPPUNIT_ASSERT(!exists(files[1]));
+        CPPUNIT_ASSERT(exists(files[2]));
+        CPPUNIT_ASSERT(exists(files[3]));
+        CPPUNIT_ASSERT(cache->get_cache_size() == 2 * FILE_SIZE);
+    }
+
+    void use_changes_purge_order_test()
+    {
+        vector<string> files;
+        for (int i = 0; i < 3; ++i) {
+            files.push_back(add_file(string(1, 'a' + i)));
+        }
+
+        // Reading 'a' makes it the most recently used file
+        read_file(files[0]);
+
+        files.push_back(add_file("d"));
+
+        DBG(cerr << "Files left: " << exists(files[0]) << exists(files[1]) << exists(files[2])
+                << exists(files[3]) << endl);
+
+        CPPUNIT_ASSERT(exists(files[0]));
+        CPPUNIT_ASSERT(!exists(files[1]));
+        CPPUNIT_ASSERT(!exists(files[2]));
+        CPPUNIT_ASSERT(exists(files[3]));
+    }
+
+    // A new instance reads the index and not the cache directory.
+    void index_persists_test()
+    {
+        string a = add_file("a");
+        delete cache;
+
+        // This file is not in the index
+        string b = cache_dir + "/dap#b";
+        system(("dd if=/dev/zero of=" + b + " bs=1024 count=10 2>/dev/null").c_str());
+
+        cache = new DAPCache3(cache_dir, "dap", 1);
+        cache->update_and_purge("");
+
+        CPPUNIT_ASSERT(cache->d_index.size() == 1);
+        CPPUNIT_ASSERT(cache->d_index.find(a) != cache->d_index.end());
+        CPPUNIT_ASSERT(cache->get_cache_size() == FILE_SIZE);
+    }
+
+    // A cache info file without an index, e.g., one from an older version
+    // of the library, is rebuilt by reading the cache directory.
+    void index_recovery_test()
+    {
+        string a = add_file("a");
+        delete cache;
+        cache = 0;
+
+        string b = cache_dir + "/dap#b";
+        system(("dd if=/dev/zero of=" + b + " bs=1024 count=10 2>/dev/null").c_str());
+
+        CPPUNIT_ASSERT(truncate((cache_dir + "/dap.cache.info").c_str(), sizeof(unsigned long long)) == 0);
+
+        cache = new DAPCache3(cache_dir, "dap", 1);
+        cache->update_and_purge("");
+
+        CPPUNIT_ASSERT(cache->d_index.size() == 2);
+        CPPUNIT_ASSERT(cache->d_index.find(b) != cache->d_index.end());
+        CPPUNIT_ASSERT(cache->get_cache_size() == FILE_SIZE + 10 * 1024);
+    }
+
+    // GreedyDual-Size purges the large file even though it's newer
+    void gds_policy_test()
+    {
+        cache->set_policy(new DAPCacheGDSPolicy);
+
+        string small = add_file("small", 100 * 1024);
+        string large = add_file("large", 700 * 1024);
+        string c = add_file("c");
+
+        CPPUNIT_ASSERT(exists(small));
+        CPPUNIT_ASSERT(!exists(large));
+        CPPUNIT_ASSERT(exists(c));
+        CPPUNIT_ASSERT(cache->get_cache_size() == 400 * 1024);
+    }
+
+    // A file used once doesn't push out a file that's been used several
+    // times.
+    void tinylfu_policy_test()
+    {
+        cache->set_policy(new DAPCacheTinyLFUPolicy);
+
+        vector<string> files;
+        for (int i = 0; i < 3; ++i) {
+            files.push_back(add_file(string(1, 'a' + i)));
+            read_file(files[i]);
+            read_file(files[i]);
+        }
+
+        string once = add_file("once");
+
+        CPPUNIT_ASSERT(!exists(once));
+        for (int i = 0; i < 3; ++i)
+            CPPUNIT_ASSERT(exists(files[i]));
+        CPPUNIT_ASSERT(cache->get_statistics().rejected == 1);
+
+        // It's kept once it has been asked for more often than the others
+        once = add_file("once");
+        CPPUNIT_ASSERT(!exists(once));
+        once = add_file("once");
+        CPPUNIT_ASSERT(!exists(once));
+        once = add_file("once");
+        CPPUNIT_ASSERT(exists(once));
+        CPPUNIT_ASSERT(!exists(files[0]));
+        CPPUNIT_ASSERT(cache->get_statistics().admitted == 1);
+    }
+
+    void statistics_test()
+    {
+        string a = add_file("a");
+
+        int fd;
+        CPPUNIT_ASSERT(!cache->get_read_lock(cache_dir + "/dap#missing", fd));
+        read_file(a);
+        read_file(a);
+
+        DAPCache3::Statistics stats = cache->get_statistics();
+        CPPUNIT_ASSERT(stats.policy == "lru");
+        CPPUNIT_ASSERT(stats.hits == 2);
+        CPPUNIT_ASSERT(stats.misses == 1);
+        CPPUNIT_ASSERT(stats.bytes_saved == 2 * FILE_SIZE);
+        CPPUNIT_ASSERT(stats.hit_ratio() > 0.66 && stats.hit_ratio() < 0.67);
+
+        cache->set_policy(new DAPCacheGDSPolicy);
+        CPPUNIT_ASSERT(cache->get_statistics().policy == "gds");
+        CPPUNIT_ASSERT(cache->get_statistics().hits == 0);
+    }
+
+    static int produced()
+    {
+        struct stat buf;
+        return stat(produced_log.c_str(), &buf) == 0 ? buf.st_size : 0;
+    }
+
+    void single_flight_threads_test()
+    {
+        CountingProducer producer;
+        string target = cache->get_cache_file_name("single", false);
+
+        CPPUNIT_ASSERT(run_requesters(cache, target, producer, 16) == 16);
+        CPPUNIT_ASSERT(produced() == 1);
+    }
+
+    // When the producer fails, a waiting thread makes the file
+    void single_flight_failure_test()
+    {
+        CountingProducer producer(true);
+        string target = cache->get_cache_file_name("single", false);
+
+        CPPUNIT_ASSERT(run_requesters(cache, target, producer, 8) == 7);
+        CPPUNIT_ASSERT(produced() == 2);
+    }
+
+    // Several processes, each with several threads
+    void single_flight_processes_test()
+    {
+        const int processes = 6;
+        string target = cache->get_cache_file_name("single", false);
+
+        vector<pid_t> pids;
+        for (int i = 0; i < processes; ++i) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                DAPCache3 *child_cache = new DAPCache3(cache_dir, "dap", 1);
+                CountingProducer producer;
+                int ok = run_requesters(child_cache, target, producer, 4);
+                delete child_cache;
+                _exit(ok == 4 ? 0 : 1);
+            }
+            pids.push_back(pid);
+        }
+
+        for (vector<pid_t>::iterator i = pids.begin(); i != pids.end(); ++i) {
+            int status;
+            CPPUNIT_ASSERT(waitpid(*i, &status, 0) == *i);
+            CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        CPPUNIT_ASSERT(produced() == 1);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DAPCache3Test);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::DAPCache3Test::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
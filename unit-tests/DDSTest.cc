@@ -30,6 +30,8 @@
 
 #include <sstream>
 
+#include <libxml/xmlmemory.h>
+
 #include "Byte.h"
 #include "Int16.h"
 #include "UInt16.h"
@@ -108,6 +110,10 @@ public:
         CPPUNIT_TEST(transfer_attributes_test_2);
 
         CPPUNIT_TEST(symbol_name_test);
+        CPPUNIT_TEST(var_test);
+        CPPUNIT_TEST(var_stack_test);
+        CPPUNIT_TEST(var_index_update_test);
+        CPPUNIT_TEST(var_index_rename_test);
 
         // These test both transfer_attributes() and print_xml()
         CPPUNIT_TEST(print_xml_test);
@@ -192,6 +198,150 @@ public:
         }
     }
 
+    // point { x; inner { y; }; }; pair { x; y; }; z
+    void build_nested(DDS &dds) {
+        Structure inner("inner");
+        inner.add_var_nocopy(new Byte("y"));
+
+        Structure point("point");
+        point.add_var_nocopy(new Int32("x"));
+        point.add_var(&inner);
+        dds.add_var(&point);
+
+        Structure pair("pair");
+        pair.add_var_nocopy(new Int32("x"));
+        pair.add_var_nocopy(new Byte("y"));
+        dds.add_var(&pair);
+
+        dds.add_var_nocopy(new Float64("z"));
+    }
+
+    void var_test() {
+        build_nested(*dds1);
+
+        // An ambiguous leaf name finds the first variable looking depth-first
+        BaseType *x = dds1->var("x");
+        CPPUNIT_ASSERT(x && x->FQN() == "point.x");
+        BaseType *y = dds1->var("y");
+        CPPUNIT_ASSERT(y && y->FQN() == "point.inner.y");
+
+        CPPUNIT_ASSERT(dds1->var("pair.x")->FQN() == "pair.x");
+        CPPUNIT_ASSERT(dds1->var("pair.y")->FQN() == "pair.y");
+        CPPUNIT_ASSERT(dds1->var("point.inner.y") == y);
+        CPPUNIT_ASSERT(dds1->var("inner.y") == y);
+        CPPUNIT_ASSERT(dds1->var("z")->type() == dods_float64_c);
+
+        CPPUNIT_ASSERT(!dds1->var("w"));
+        CPPUNIT_ASSERT(!dds1->var("pair.z"));
+        CPPUNIT_ASSERT(!dds1->var("point.y"));
+
+        // Constructor::var() with a leaf name
+        Structure *pair = static_cast<Structure*>(dds1->var("pair"));
+        CPPUNIT_ASSERT(pair->var("y", false)->FQN() == "pair.y");
+        CPPUNIT_ASSERT(pair->var("y", true)->FQN() == "pair.y");
+        CPPUNIT_ASSERT(!pair->var("inner", false));
+    }
+
+    void var_stack_test() {
+        build_nested(*dds1);
+
+        // The stack holds the constructors that hold the variable, outermost
+        // on top
+        BaseType::btp_stack s;
+        CPPUNIT_ASSERT(dds1->var("y", &s)->FQN() == "point.inner.y");
+        CPPUNIT_ASSERT(s.size() == 2);
+        CPPUNIT_ASSERT(s.top()->name() == "point");
+        s.pop();
+        CPPUNIT_ASSERT(s.top()->name() == "inner");
+        s.pop();
+
+        CPPUNIT_ASSERT(dds1->var("point.inner.y", &s));
+        CPPUNIT_ASSERT(s.size() == 2 && s.top()->name() == "inner");
+        while (!s.empty())
+            s.pop();
+
+        CPPUNIT_ASSERT(dds1->var("z", &s) && s.empty());
+
+        Structure *point = static_cast<Structure*>(dds1->var("point"));
+        CPPUNIT_ASSERT(point->var("y", false, &s)->FQN() == "point.inner.y");
+        CPPUNIT_ASSERT(s.size() == 2 && s.top()->name() == "point");
+    }
+
+    void var_index_update_test() {
+        build_nested(*dds1);
+        CPPUNIT_ASSERT(dds1->var("y")->FQN() == "point.inner.y");
+
+        // Removing a nested variable changes what the DDS finds
+        Structure *point = static_cast<Structure*>(dds1->var("point"));
+        point->del_var("inner");
+        CPPUNIT_ASSERT(dds1->var("y")->FQN() == "pair.y");
+        CPPUNIT_ASSERT(!dds1->var("point.inner.y"));
+
+        // ... as do adding and renaming
+        point->add_var_nocopy(new Byte("y"));
+        CPPUNIT_ASSERT(dds1->var("y")->FQN() == "point.y");
+        dds1->var("pair.x")->set_name("w");
+        CPPUNIT_ASSERT(dds1->var("w")->FQN() == "pair.w");
+        CPPUNIT_ASSERT(!dds1->var("pair.x"));
+
+        dds1->del_var("pair");
+        CPPUNIT_ASSERT(!dds1->var("w"));
+
+        dds1->add_var_nocopy(new Byte("w"));
+        CPPUNIT_ASSERT(dds1->var("w")->type() == dods_byte_c);
+
+        // A copy has its own index
+        DDS copy(*dds1);
+        CPPUNIT_ASSERT(copy.var("y") && copy.var("y") != dds1->var("y"));
+        CPPUNIT_ASSERT(copy.var("y")->FQN() == "point.y");
+    }
+
+    // Renaming a variable marks the indexes of the constructors and the DDS
+    // that hold it, and only those.
+    void var_index_rename_test() {
+        build_nested(*dds1);
+        Structure *point = static_cast<Structure*>(dds1->var("point"));
+        Structure *inner = static_cast<Structure*>(dds1->var("point.inner"));
+        CPPUNIT_ASSERT(dds1->var("y")->FQN() == "point.inner.y");
+        CPPUNIT_ASSERT(point->var("y", false)->FQN() == "point.inner.y");
+        CPPUNIT_ASSERT(inner->var("y"));
+
+        inner->var("y")->set_name("v");
+        CPPUNIT_ASSERT(dds1->var("y")->FQN() == "pair.y");
+        CPPUNIT_ASSERT(dds1->var("v")->FQN() == "point.inner.v");
+        CPPUNIT_ASSERT(point->var("v", false)->FQN() == "point.inner.v");
+        CPPUNIT_ASSERT(!point->var("y", false));
+        CPPUNIT_ASSERT(inner->var("v") && !inner->var("y"));
+
+        // A variable at the top level
+        dds1->var("z")->set_name("u");
+        CPPUNIT_ASSERT(!dds1->var("z"));
+        CPPUNIT_ASSERT(dds1->var("u")->type() == dods_float64_c);
+
+        // Assigning to a variable renames it, and it stays in the DDS
+        Float64 t("t");
+        *static_cast<Float64*>(dds1->var("u")) = t;
+        CPPUNIT_ASSERT(!dds1->var("u"));
+        CPPUNIT_ASSERT(dds1->var("t") && !dds1->var("t")->get_parent());
+        dds1->var("t")->set_name("s");
+        CPPUNIT_ASSERT(dds1->var("s") && !dds1->var("t"));
+
+        // A copy of a variable isn't in the DDS
+        BaseType *copy = dds1->var("s")->ptr_duplicate();
+        copy->set_name("r");
+        CPPUNIT_ASSERT(dds1->var("s") && !dds1->var("r"));
+        delete copy;
+
+        // A copy of a field, added to the DDS, is at the top level
+        BaseType *field = inner->var("v")->ptr_duplicate();
+        CPPUNIT_ASSERT(field->get_parent() == inner);
+        dds1->add_var_nocopy(field);
+        CPPUNIT_ASSERT(!field->get_parent());
+        field->set_name("w");
+        CPPUNIT_ASSERT(dds1->var("w") == field);
+        CPPUNIT_ASSERT(inner->var("v") && !inner->var("w"));
+    }
+
     void print_xml_test() {
         try {
             dds2->parse((string) TEST_SRC_DIR + "/dds-testsuite/test.19b");
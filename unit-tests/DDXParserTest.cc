@@ -29,6 +29,10 @@
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
 #include "GetOpt.h"
 
 #include "DDXParserSAX2.h"
@@ -96,6 +100,9 @@ public:
 	// FILE I/O tests
 	CPPUNIT_TEST(top_level_simple_types_test_file_stream);
 	CPPUNIT_TEST(structure_test_file_ptr);
+	CPPUNIT_TEST(parse_chunk_test);
+	CPPUNIT_TEST(unfinished_parse_test);
+	CPPUNIT_TEST(long_line_test);
 
 #if 0
 	// All of these fail; maybe because on OSX 10.9 something about
@@ -566,6 +573,84 @@ public:
         }
     }
 
+    // Pass the DDX to the parser a few bytes at a time, as a client reading
+    // a response does
+    void parse_chunk_test()
+    {
+        try {
+            ifstream input((string(TEST_SRC_DIR) + "/ddx-testsuite/test.0b.ddx").c_str());
+            ostringstream oss;
+            oss << input.rdbuf();
+            string document = oss.str();
+
+            string blob;
+            ddx_parser->begin_parse(dds, blob);
+            for (string::size_type pos = 0; pos < document.size(); pos += 5)
+                ddx_parser->parse_chunk(document.data() + pos, min((string::size_type)5, document.size() - pos));
+            ddx_parser->end_parse();
+
+            CPPUNIT_ASSERT(dds->get_dataset_name() == "testdata");
+            CPPUNIT_ASSERT(dds->var("sst"));
+        }
+        catch (DDXParseFailed &e) {
+            DBG(cerr << endl << "Error: " << e.get_error_message() << endl);
+            CPPUNIT_FAIL("test.0b.ddx failed.");
+        }
+    }
+
+    // A parse that is not ended, as when reading the response fails, is
+    // freed by the parser's destructor
+    void unfinished_parse_test()
+    {
+        string document = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<Dataset name=\"part\" xmlns=\"http://xml.opendap.org/ns/DAP2\">\n"
+            "<Int32 name=\"i\"/><Structure name=\"s\"><Int32 name=\"j\"/>";
+
+        string blob;
+        ddx_parser->begin_parse(dds, blob);
+        ddx_parser->parse_chunk(document.data(), document.size());
+
+        delete ddx_parser;
+        ddx_parser = 0;
+
+        CPPUNIT_ASSERT(!dds->var("s"));
+    }
+
+    // Lines longer than the FILE* reader's buffer are read in pieces
+    void long_line_test()
+    {
+        try {
+            string value(3000, 'x');
+            string document = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<Dataset name=\"long\" xmlns=\"http://xml.opendap.org/ns/DAP2\">\n"
+                "<Attribute name=\"a\" type=\"String\"><value>" + value + "</value></Attribute>"
+                "<Int32 name=\"i\"/></Dataset>\n";
+
+            FILE *in = tmpfile();
+            fwrite(document.data(), 1, document.size(), in);
+            rewind(in);
+
+            string blob;
+            ddx_parser->intern_stream(in, dds, blob);
+            fclose(in);
+
+            CPPUNIT_ASSERT(dds->get_attr_table().get_attr("a") == value);
+            CPPUNIT_ASSERT(dds->var("i"));
+
+            istringstream iss(document);
+            DDS dds2(factory);
+            DDXParser parser2(factory);
+            parser2.intern_stream(iss, &dds2, blob);
+
+            CPPUNIT_ASSERT(dds2.get_attr_table().get_attr("a") == value);
+            CPPUNIT_ASSERT(dds2.var("i"));
+        }
+        catch (DDXParseFailed &e) {
+            DBG(cerr << endl << "Error: " << e.get_error_message() << endl);
+            CPPUNIT_FAIL("Parsing a DDX with a long line failed.");
+        }
+    }
+
     // Error tests start here.
 
     void unknown_tag_test()
@@ -0,0 +1,279 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "DataResponseCache.h"
+#include "DAPCache3.h"
+#include "fdiostream.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+static const string cache_dir = "cache-testsuite/response_cache";
+
+namespace libdap {
+
+// Writes its response and counts how often it was asked to.
+class TestWriter: public DataResponseWriter {
+public:
+    string response;
+    int runs;
+    bool fail;
+
+    TestWriter(const string &r) : response(r), runs(0), fail(false) { }
+
+    virtual void write(ostream &out)
+    {
+        ++runs;
+        if (fail)
+            throw Error("Could not read the data.");
+
+        out << response;
+    }
+};
+
+class DataResponseCacheTest: public TestFixture {
+private:
+    DAPCache3 *cache;
+    DataResponseCache *responses;
+
+    // Get a response the way DODSFilter::send_data() does.
+    string get(const string &ce, time_t lmt, TestWriter &writer)
+    {
+        int fd;
+        off_t offset;
+        CPPUNIT_ASSERT(responses->get_response("dods", "/data/fnoc1.nc", ce, lmt, writer, fd, offset));
+
+        ostringstream oss;
+        responses->send_response(oss, fd, offset);
+        responses->release(fd);
+
+        return oss.str();
+    }
+
+public:
+    DataResponseCacheTest() : cache(0), responses(0)
+    {
+    }
+
+    void setUp()
+    {
+        system(("rm -rf " + cache_dir).c_str());
+        cache = new DAPCache3(cache_dir, "dap", 1);
+        responses = new DataResponseCache(cache);
+    }
+
+    void tearDown()
+    {
+        delete responses;
+        responses = 0;
+        delete cache;
+        cache = 0;
+    }
+
+    CPPUNIT_TEST_SUITE (DataResponseCacheTest);
+
+    CPPUNIT_TEST (normalize_ce_test);
+    CPPUNIT_TEST (file_name_test);
+    CPPUNIT_TEST (hit_test);
+    CPPUNIT_TEST (escaped_name_test);
+    CPPUNIT_TEST (modified_test);
+    CPPUNIT_TEST (writer_error_test);
+    CPPUNIT_TEST (send_to_fdostream_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void normalize_ce_test()
+    {
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce(" u, v & u > 2 ") == "u,v&u>2");
+        // Escapes are not decoded; a%20b is not ab
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce("a%20b, c") == "a%20b,c");
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce("s=%22a b%22") == "s=%22ab%22");
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce("s&s = \"a b\"") == "s&s=\"a b\"");
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce("s&s=\"a \\\" b\" ") == "s&s=\"a \\\" b\"");
+        // The order of the clauses is kept
+        CPPUNIT_ASSERT(DataResponseCache::normalize_ce("v,u") == "v,u");
+    }
+
+    void file_name_test()
+    {
+        string name = responses->get_cache_file_name("dods", "/data/fnoc1.nc", "u, v");
+        DBG(cerr << "name: " << name << endl);
+
+        CPPUNIT_ASSERT(name.find(cache_dir + "/dap#dods_") == 0);
+        CPPUNIT_ASSERT(name == responses->get_cache_file_name("dods", "/data/fnoc1.nc", "u,v"));
+        CPPUNIT_ASSERT(name != responses->get_cache_file_name("dap", "/data/fnoc1.nc", "u,v"));
+        CPPUNIT_ASSERT(name != responses->get_cache_file_name("dods", "/data/fnoc2.nc", "u,v"));
+        CPPUNIT_ASSERT(name != responses->get_cache_file_name("dods", "/data/fnoc1.nc", "v,u"));
+    }
+
+    void hit_test()
+    {
+        TestWriter writer("Dataset {} fnoc1;\nData:\n12345");
+
+        CPPUNIT_ASSERT(get("u", 1000, writer) == writer.response);
+        CPPUNIT_ASSERT(writer.runs == 1);
+
+        CPPUNIT_ASSERT(get(" u ", 1000, writer) == writer.response);
+        CPPUNIT_ASSERT(writer.runs == 1);
+        CPPUNIT_ASSERT(cache->get_statistics().hits == 1);
+
+        // A different CE is a different response
+        TestWriter other("Dataset {} fnoc1;\nData:\n67890");
+        CPPUNIT_ASSERT(get("v", 1000, other) == other.response);
+        CPPUNIT_ASSERT(other.runs == 1);
+        CPPUNIT_ASSERT(get("u", 1000, writer) == writer.response);
+    }
+
+    void escaped_name_test()
+    {
+        // The variable named 'a b' (a%20b in the CE) and the variable ab
+        // must not share an entry.
+        TestWriter spaced("Dataset {} fnoc1;\nData:\na b");
+        TestWriter plain("Dataset {} fnoc1;\nData:\nab");
+
+        CPPUNIT_ASSERT(get("a%20b", 1000, spaced) == spaced.response);
+        CPPUNIT_ASSERT(get("ab", 1000, plain) == plain.response);
+        CPPUNIT_ASSERT(plain.runs == 1);
+
+        CPPUNIT_ASSERT(get("a%20b", 1000, spaced) == spaced.response);
+        CPPUNIT_ASSERT(get("ab", 1000, plain) == plain.response);
+        CPPUNIT_ASSERT(spaced.runs == 1 && plain.runs == 1);
+    }
+
+    void modified_test()
+    {
+        TestWriter old_writer("old data");
+        CPPUNIT_ASSERT(get("u", 1000, old_writer) == "old data");
+
+        TestWriter new_writer("new data");
+        CPPUNIT_ASSERT(get("u", 2000, new_writer) == "new data");
+        CPPUNIT_ASSERT(new_writer.runs == 1);
+
+        CPPUNIT_ASSERT(get("u", 2000, new_writer) == "new data");
+        CPPUNIT_ASSERT(new_writer.runs == 1);
+    }
+
+    void writer_error_test()
+    {
+        TestWriter writer("data");
+        writer.fail = true;
+
+        int fd;
+        off_t offset;
+        CPPUNIT_ASSERT_THROW(responses->get_response("dods", "/data/fnoc1.nc", "u", 1000, writer, fd, offset), Error);
+        CPPUNIT_ASSERT(access(responses->get_cache_file_name("dods", "/data/fnoc1.nc", "u").c_str(), F_OK) != 0);
+
+        writer.fail = false;
+        CPPUNIT_ASSERT(get("u", 1000, writer) == "data");
+        CPPUNIT_ASSERT(writer.runs == 2);
+    }
+
+    void send_to_fdostream_test()
+    {
+        string response(100000, 'x');
+        response += "end";
+        TestWriter writer(response);
+
+        int fd;
+        off_t offset;
+        CPPUNIT_ASSERT(responses->get_response("dap", "/data/fnoc1.nc", "u", 1000, writer, fd, offset));
+
+        string out_name = cache_dir + "/response_out";
+        int out_fd = open(out_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        CPPUNIT_ASSERT(out_fd >= 0);
+        {
+            fdostream out(out_fd, true);
+            out << "headers\r\n";
+            responses->send_response(out, fd, offset);
+        }
+        responses->release(fd);
+
+        ifstream in(out_name.c_str());
+        ostringstream oss;
+        oss << in.rdbuf();
+        CPPUNIT_ASSERT(oss.str() == "headers\r\n" + response);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DataResponseCacheTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::DataResponseCacheTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
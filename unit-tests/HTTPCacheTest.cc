@@ -25,6 +25,8 @@
 #include <unistd.h>   // for access stat
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #include <cstdio>     // for create_cache_root_test
 #include <string>
@@ -32,6 +34,7 @@
 #include <algorithm>
 #include <memory>
 #include <iterator>
+#include <sstream>
 
 #include <cppunit/TextTestRunner.h>
 #include <cppunit/extensions/TestFactoryRegistry.h>
@@ -75,6 +78,45 @@ inline static int file_size(string name)
     return s.st_size;
 }
 
+// Used by multi_thread_hits_test(); each thread reads every URL in
+// 'urls' 'iterations' times.
+struct HitsThreadArgs {
+    HTTPCache *cache;
+    const vector<string> *urls;
+    int iterations;
+    int errors;
+};
+
+static void *read_cached_responses(void *arg)
+{
+    HitsThreadArgs *args = static_cast<HitsThreadArgs*>(arg);
+
+    try {
+        for (int i = 0; i < args->iterations; ++i) {
+            for (vector<string>::const_iterator u = args->urls->begin(); u != args->urls->end(); ++u) {
+                FILE *body = args->cache->get_cached_response(*u);
+                if (!body) {
+                    ++args->errors;
+                    continue;
+                }
+
+                char line[64];
+                if (!fgets(line, sizeof(line), body) || string(line) != "Response for " + *u + "\n")
+                    ++args->errors;
+
+                args->cache->release_cached_response(body);
+                fclose(body);
+            }
+        }
+    }
+    catch (Error &e) {
+        DBG(cerr << "Thread error: " << e.get_error_message() << endl);
+        ++args->errors;
+    }
+
+    return 0;
+}
+
 #if 0
 inline static void
 print_entry(HTTPCache *, HTTPCacheTable::CacheEntry **e)
@@ -165,9 +207,9 @@ public:
     CPPUNIT_TEST(cache_index_write_test);
     CPPUNIT_TEST(create_cache_root_test);
     CPPUNIT_TEST(set_cache_root_test);
-    CPPUNIT_TEST(get_single_user_lock_test);
+    CPPUNIT_TEST(get_cache_root_lock_test);
 
-    CPPUNIT_TEST(release_single_user_lock_test);
+    CPPUNIT_TEST(release_cache_root_lock_test);
     CPPUNIT_TEST(create_hash_directory_test);
     CPPUNIT_TEST(create_location_test);
     CPPUNIT_TEST(parse_headers_test);
@@ -187,6 +229,13 @@ public:
     CPPUNIT_TEST(get_conditional_response_headers_test);
     CPPUNIT_TEST(update_response_test);
     CPPUNIT_TEST(cache_gc_test);
+    CPPUNIT_TEST(multi_thread_hits_test);
+    CPPUNIT_TEST(index_journal_test);
+    CPPUNIT_TEST(failed_compaction_test);
+    CPPUNIT_TEST(lru_gc_test);
+    CPPUNIT_TEST(hot_tier_test);
+    CPPUNIT_TEST(stale_while_revalidate_test);
+    CPPUNIT_TEST(shared_cache_test);
 
     // Make this the last test because when distcheck is run, running
     // it before other tests will break them.
@@ -335,32 +384,32 @@ public:
         remove("/home/jimg/test_cache/");
     }
 
-    void get_single_user_lock_test()
+    void get_cache_root_lock_test()
     {
         hc->set_cache_root("/tmp/dods_test_cache");
-        hc->release_single_user_lock();
+        hc->release_cache_root_lock();
 
-        CPPUNIT_ASSERT(hc->get_single_user_lock());
+        CPPUNIT_ASSERT(hc->get_cache_root_lock());
         CPPUNIT_ASSERT(access("/tmp/dods_test_cache/.lock", F_OK) == 0);
 
         // Second time should fail
-        CPPUNIT_ASSERT(!hc->get_single_user_lock());
+        CPPUNIT_ASSERT(!hc->get_cache_root_lock());
     }
 
-    void release_single_user_lock_test()
+    void release_cache_root_lock_test()
     {
         hc->set_cache_root("/tmp/dods_test_cache");
-        remove("/tmp/dods_test_cache/.lock"); // in case prev. test fails
-        hc->d_locked_open_file = 0;
+        hc->release_cache_root_lock();
 
-        CPPUNIT_ASSERT(hc->get_single_user_lock());
+        CPPUNIT_ASSERT(hc->get_cache_root_lock());
         CPPUNIT_ASSERT(access("/tmp/dods_test_cache/.lock", F_OK) == 0);
 
-        hc->release_single_user_lock();
-        CPPUNIT_ASSERT(hc->get_single_user_lock());
+        // The lock file is left for the other processes using the cache
+        hc->release_cache_root_lock();
         CPPUNIT_ASSERT(access("/tmp/dods_test_cache/.lock", F_OK) == 0);
+        CPPUNIT_ASSERT(hc->get_cache_root_lock());
 
-        CPPUNIT_ASSERT(!hc->get_single_user_lock());
+        CPPUNIT_ASSERT(!hc->get_cache_root_lock());
 
         remove("/tmp/dods_test_cache/.lock");
     }
@@ -863,6 +912,528 @@ public:
         }
     }
 
+    // Cache a set of responses and then have several threads read them at
+    // the same time. This is also a benchmark for the cache's hit path; use
+    // -d to see how long the reads take.
+    void multi_thread_hits_test()
+    {
+        const int num_urls = 32;
+        const int num_threads = 8;
+        const int iterations = 50;
+
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache("cache-testsuite/mt_cache/", true));
+
+            vector<string> urls;
+            for (int i = 0; i < num_urls; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/mt_cache/" << i << ".dds";
+                urls.push_back(url.str());
+
+                FILE *body = tmpfile();
+                fprintf(body, "Response for %s\n", url.str().c_str());
+                rewind(body);
+                CPPUNIT_ASSERT(pc->cache_response(url.str(), time(0), h, body));
+                fclose(body);
+            }
+
+            vector<HitsThreadArgs> args(num_threads);
+            vector<pthread_t> threads(num_threads);
+
+            for (int t = 0; t < num_threads; ++t) {
+                args[t].cache = pc.get();
+                args[t].urls = &urls;
+                args[t].iterations = iterations;
+                args[t].errors = 0;
+                CPPUNIT_ASSERT(pthread_create(&threads[t], 0, read_cached_responses, &args[t]) == 0);
+            }
+
+            for (int t = 0; t < num_threads; ++t)
+                pthread_join(threads[t], 0);
+
+            for (int t = 0; t < num_threads; ++t)
+                CPPUNIT_ASSERT(args[t].errors == 0);
+
+            // Every response is released and each hit was counted
+            CPPUNIT_ASSERT(!pc->d_http_cache_table->is_locked_read_responses());
+            for (vector<string>::iterator u = urls.begin(); u != urls.end(); ++u) {
+                HTTPCacheTable::CacheEntry *e = pc->d_http_cache_table->get_locked_entry_from_cache_table(*u);
+                CPPUNIT_ASSERT(e);
+                CPPUNIT_ASSERT(e->hits == num_threads * iterations);
+                CPPUNIT_ASSERT(e->readers == 1);
+                e->unlock_read_response();
+            }
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    // Check the entries index_journal_test() expects in a table read from
+    // the journal_cache index.
+    void check_journaled_entries(HTTPCacheTable &table, const vector<string> &urls)
+    {
+        HTTPCacheTable::CacheEntry *e = table.get_locked_entry_from_cache_table(localhost_url);
+        CPPUNIT_ASSERT(e);
+        e->unlock_read_response();
+
+        e = table.get_locked_entry_from_cache_table(urls[0]);
+        CPPUNIT_ASSERT(e);
+        CPPUNIT_ASSERT(e->hits == 2);
+        e->unlock_read_response();
+
+        CPPUNIT_ASSERT(!table.get_locked_entry_from_cache_table(urls[1]));
+
+        for (vector<string>::size_type i = 2; i < urls.size(); ++i) {
+            e = table.get_locked_entry_from_cache_table(urls[i]);
+            CPPUNIT_ASSERT(e);
+            CPPUNIT_ASSERT(e->url == urls[i]);
+            e->unlock_read_response();
+        }
+    }
+
+    void index_journal_test()
+    {
+        const string root = "cache-testsuite/journal_cache/";
+
+        try {
+            // Start with an ASCII index like those written by older versions
+            mkdir(root.c_str(), 0777);
+            FILE *ascii = fopen((root + ".index").c_str(), "w");
+            CPPUNIT_ASSERT(ascii);
+            fputs(index_file_line.c_str(), ascii);
+            fclose(ascii);
+
+            auto_ptr<HTTPCache> pc(new HTTPCache(root, true));
+            HTTPCacheTable *table = pc->d_http_cache_table;
+
+            vector<string> urls;
+            for (int i = 0; i < 3; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/journal_cache/" << i << ".dds";
+                urls.push_back(url.str());
+
+                FILE *body = tmpfile();
+                fprintf(body, "Response for %s\n", url.str().c_str());
+                rewind(body);
+                CPPUNIT_ASSERT(pc->cache_response(url.str(), time(0), h, body));
+                fclose(body);
+            }
+
+            for (int i = 0; i < 2; ++i) {
+                FILE *body = pc->get_cached_response(urls[0]);
+                CPPUNIT_ASSERT(body);
+                pc->release_cached_response(body);
+                fclose(body);
+            }
+
+            table->remove_entry_from_cache_table(urls[1]);
+
+            // The changes are in the journal
+            CPPUNIT_ASSERT(access((root + ".index.journal").c_str(), F_OK) == 0);
+            {
+                HTTPCacheTable journaled(root, table->get_block_size());
+                check_journaled_entries(journaled, urls);
+            }
+
+            // Writing a snapshot replaces both the journal and the ASCII index
+            table->cache_index_write();
+            CPPUNIT_ASSERT(access((root + ".index.bin").c_str(), F_OK) == 0);
+            CPPUNIT_ASSERT(access((root + ".index.journal").c_str(), F_OK) != 0);
+            CPPUNIT_ASSERT(access((root + ".index").c_str(), F_OK) != 0);
+            {
+                HTTPCacheTable snapshot(root, table->get_block_size());
+                check_journaled_entries(snapshot, urls);
+            }
+
+            // A long journal is compacted by a background thread
+            table->d_journal_compact_records = 4;
+            for (int i = 3; i < 20; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/journal_cache/" << i << ".dds";
+                urls.push_back(url.str());
+
+                FILE *body = tmpfile();
+                fprintf(body, "Response for %s\n", url.str().c_str());
+                rewind(body);
+                CPPUNIT_ASSERT(pc->cache_response(url.str(), time(0), h, body));
+                fclose(body);
+            }
+
+            CPPUNIT_ASSERT(table->d_compaction_started);
+            pthread_join(table->d_compaction_thread, 0);
+            table->d_compaction_started = false;
+            {
+                HTTPCacheTable compacted(root, table->get_block_size());
+                check_journaled_entries(compacted, urls);
+            }
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    // Cache a response for each of 'urls' in 'cache'
+    void cache_test_responses(HTTPCache *cache, const vector<string> &urls)
+    {
+        for (vector<string>::const_iterator u = urls.begin(); u != urls.end(); ++u) {
+            FILE *body = tmpfile();
+            fprintf(body, "Response for %s\n", u->c_str());
+            rewind(body);
+            CPPUNIT_ASSERT(cache->cache_response(*u, time(0), h, body));
+            fclose(body);
+        }
+    }
+
+    // Check that a table read from the failed_compaction index has 'urls'
+    void check_compacted_entries(HTTPCacheTable &table, const vector<string> &urls)
+    {
+        for (vector<string>::const_iterator u = urls.begin(); u != urls.end(); ++u) {
+            HTTPCacheTable::CacheEntry *e = table.get_locked_entry_from_cache_table(*u);
+            CPPUNIT_ASSERT(e);
+            e->unlock_read_response();
+        }
+    }
+
+    // The journal set aside by a compaction that failed is added to by the
+    // next compaction, not replaced.
+    void failed_compaction_test()
+    {
+        const string root = "cache-testsuite/failed_compaction/";
+        const string tmp = root + ".index.bin.tmp";
+        const string old_journal = root + ".index.journal.old";
+
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache(root, true));
+            HTTPCacheTable *table = pc->d_http_cache_table;
+
+            // The snapshot can't be written while this is a directory, and
+            // the directory isn't removed while it holds a file
+            mkdir(tmp.c_str(), 0777);
+            fclose(fopen((tmp + "/keep").c_str(), "w"));
+
+            vector<string> urls(1, "http://test.opendap.org/failed_compaction/0.dds");
+            cache_test_responses(pc.get(), urls);
+            CPPUNIT_ASSERT_THROW(table->cache_index_write(), Error);
+            CPPUNIT_ASSERT(access(old_journal.c_str(), F_OK) == 0);
+
+            // A record cut short by a crash; the records added after it
+            // must still be read
+            FILE *old = fopen(old_journal.c_str(), "ab");
+            CPPUNIT_ASSERT(old);
+            fputc(0xff, old);
+            fclose(old);
+
+            vector<string> more(1, "http://test.opendap.org/failed_compaction/1.dds");
+            cache_test_responses(pc.get(), more);
+            urls.push_back(more[0]);
+            CPPUNIT_ASSERT_THROW(table->cache_index_write(), Error);
+            {
+                HTTPCacheTable reread(root, table->get_block_size());
+                check_compacted_entries(reread, urls);
+            }
+
+            remove((tmp + "/keep").c_str());
+            rmdir(tmp.c_str());
+            table->cache_index_write();
+            CPPUNIT_ASSERT(access(old_journal.c_str(), F_OK) != 0);
+            {
+                HTTPCacheTable reread(root, table->get_block_size());
+                check_compacted_entries(reread, urls);
+            }
+        }
+        catch (Error &e) {
+            remove((tmp + "/keep").c_str());
+            rmdir(tmp.c_str());
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    void lru_gc_test()
+    {
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache("cache-testsuite/lru_cache/", true));
+
+            vector<string> urls;
+            for (int i = 0; i < 10; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/lru_cache/" << i << ".dds";
+                urls.push_back(url.str());
+            }
+            cache_test_responses(pc.get(), urls);
+
+            // Use the first response so that it's not the least recently used
+            FILE *body = pc->get_cached_response(urls[0]);
+            CPPUNIT_ASSERT(body);
+            pc->release_cached_response(body);
+            fclose(body);
+
+            // Make the cache hold five responses; each uses one block
+            unsigned long block_size = pc->d_http_cache_table->get_block_size();
+            pc->d_folder_size = 0;
+            pc->d_gc_buffer = 0;
+            pc->d_total_size = 5 * block_size;
+
+            vector<string> more(1, "http://test.opendap.org/lru_cache/10.dds");
+            cache_test_responses(pc.get(), more);
+
+            DBG(cerr << "current size: " << pc->d_http_cache_table->get_current_size() << endl);
+            CPPUNIT_ASSERT(pc->d_http_cache_table->get_current_size() <= pc->d_total_size);
+            CPPUNIT_ASSERT(pc->is_url_in_cache(urls[0]));
+            for (int i = 1; i < 7; ++i)
+                CPPUNIT_ASSERT(!pc->is_url_in_cache(urls[i]));
+            for (int i = 7; i < 10; ++i)
+                CPPUNIT_ASSERT(pc->is_url_in_cache(urls[i]));
+            CPPUNIT_ASSERT(pc->is_url_in_cache(more[0]));
+
+            // Now let a separate thread make room
+            pc->set_background_gc(true);
+            CPPUNIT_ASSERT(pc->is_background_gc());
+
+            more.clear();
+            for (int i = 11; i < 15; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/lru_cache/" << i << ".dds";
+                more.push_back(url.str());
+            }
+            cache_test_responses(pc.get(), more);
+
+            for (int tries = 0; tries < 100 && pc->startGC(); ++tries)
+                usleep(10000);
+
+            pc->set_background_gc(false);
+            CPPUNIT_ASSERT(!pc->is_background_gc());
+
+            CPPUNIT_ASSERT(pc->d_http_cache_table->get_current_size() <= pc->d_total_size);
+            for (vector<string>::iterator u = more.begin(); u != more.end(); ++u)
+                CPPUNIT_ASSERT(pc->is_url_in_cache(*u));
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    // Read a cached response's body and check it's the one written by
+    // cache_test_responses()
+    void check_cached_response(HTTPCache *cache, const string &url)
+    {
+        vector<string> headers;
+        FILE *body = cache->get_cached_response(url, headers);
+        CPPUNIT_ASSERT(body);
+        CPPUNIT_ASSERT(!headers.empty());
+
+        char line[1024];
+        CPPUNIT_ASSERT(fgets(line, sizeof(line), body));
+        DBG(cerr << "Read: " << line);
+        CPPUNIT_ASSERT(string(line) == "Response for " + url + "\n");
+
+        cache->release_cached_response(body);
+        fclose(body);
+    }
+
+    void hot_tier_test()
+    {
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache("cache-testsuite/hot_cache/", true));
+            pc->set_hot_tier_size(0x10000, 0x1000);
+
+            vector<string> urls;
+            for (int i = 0; i < 4; ++i) {
+                ostringstream url;
+                url << "http://test.opendap.org/hot_cache/" << i << ".dds";
+                urls.push_back(url.str());
+            }
+            cache_test_responses(pc.get(), urls);
+
+            // The first use reads from disk, the second loads the response
+            // into memory and the third reads it from memory
+            for (int i = 0; i < 3; ++i)
+                check_cached_response(pc.get(), urls[0]);
+
+            HTTPCacheTable::HotTierStatistics stats = pc->get_hot_tier_statistics();
+            DBG(cerr << "hits: " << stats.hits << ", misses: " << stats.misses << endl);
+            CPPUNIT_ASSERT(stats.hits == 1);
+            CPPUNIT_ASSERT(stats.misses == 2);
+            CPPUNIT_ASSERT(stats.promotions == 1);
+            CPPUNIT_ASSERT(stats.entries == 1);
+            CPPUNIT_ASSERT(stats.size > 0);
+
+            for (vector<string>::iterator u = urls.begin() + 1; u != urls.end(); ++u) {
+                check_cached_response(pc.get(), *u);
+                check_cached_response(pc.get(), *u);
+            }
+
+            stats = pc->get_hot_tier_statistics();
+            CPPUNIT_ASSERT(stats.entries == 4);
+
+            // Shrink the hot tier so that it holds only one response; the
+            // least recently used are dropped
+            pc->set_hot_tier_size(stats.size / 4 + 1, 0x1000);
+            stats = pc->get_hot_tier_statistics();
+            CPPUNIT_ASSERT(stats.entries == 1);
+            CPPUNIT_ASSERT(stats.demotions == 3);
+
+            check_cached_response(pc.get(), urls[3]);
+            CPPUNIT_ASSERT(pc->get_hot_tier_statistics().hits == 2);
+
+            // Removing the response from the cache drops it from memory
+            pc->d_http_cache_table->remove_entry_from_cache_table(urls[3]);
+            stats = pc->get_hot_tier_statistics();
+            CPPUNIT_ASSERT(stats.entries == 0);
+            CPPUNIT_ASSERT(stats.size == 0);
+
+            // Responses larger than the entry limit stay on disk
+            pc->set_hot_tier_size(0x10000, 0);
+            for (int i = 0; i < 3; ++i)
+                check_cached_response(pc.get(), urls[1]);
+            CPPUNIT_ASSERT(pc->get_hot_tier_statistics().entries == 0);
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    void stale_while_revalidate_test()
+    {
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache("cache-testsuite/swr_cache/", true));
+
+            string url = "http://test.opendap.org/swr_cache/stale.dds";
+            cache_test_responses(pc.get(), vector<string>(1, url));
+
+            // Make the response 50 seconds past its expiration time
+            HTTPCacheTable::CacheEntry *entry = pc->d_http_cache_table->get_locked_entry_from_cache_table(url);
+            CPPUNIT_ASSERT(entry);
+            entry->response_time = time(0);
+            entry->corrected_initial_age = 100;
+            entry->freshness_lifetime = 50;
+            entry->must_revalidate = false;
+            entry->unlock_read_response();
+
+            CPPUNIT_ASSERT(!pc->is_url_valid(url));
+
+            // Off by default
+            CPPUNIT_ASSERT(pc->get_stale_while_revalidate() == 0);
+            CPPUNIT_ASSERT(!pc->is_url_usable_while_revalidating(url));
+
+            pc->set_stale_while_revalidate(60);
+            CPPUNIT_ASSERT(pc->is_url_usable_while_revalidating(url));
+
+            pc->set_stale_while_revalidate(30);
+            CPPUNIT_ASSERT(!pc->is_url_usable_while_revalidating(url));
+
+            // must-revalidate responses are never used stale
+            pc->set_stale_while_revalidate(60);
+            entry = pc->d_http_cache_table->get_locked_entry_from_cache_table(url);
+            entry->must_revalidate = true;
+            entry->unlock_read_response();
+            CPPUNIT_ASSERT(!pc->is_url_usable_while_revalidating(url));
+
+            // Only one revalidation of a URL at a time
+            CPPUNIT_ASSERT(pc->start_revalidation(url));
+            CPPUNIT_ASSERT(!pc->start_revalidation(url));
+            pc->end_revalidation(url);
+            CPPUNIT_ASSERT(pc->start_revalidation(url));
+            pc->end_revalidation(url);
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
+    // Several programs may use the same cache; use a second process to
+    // change the cache while this one is using it.
+    void shared_cache_test()
+    {
+        const string root = "cache-testsuite/shared_cache/";
+        const string url0 = "http://test.opendap.org/shared_cache/0.dds";
+        const string url1 = "http://test.opendap.org/shared_cache/1.dds";
+
+        try {
+            auto_ptr<HTTPCache> pc(new HTTPCache(root, false));
+            cache_test_responses(pc.get(), vector<string>(1, url0));
+
+            HTTPCacheTable::CacheEntry *entry = pc->d_http_cache_table->get_locked_entry_from_cache_table(url0);
+            CPPUNIT_ASSERT(entry);
+            string cachename = entry->get_cachename();
+            entry->unlock_read_response();
+
+            int ready[2], done[2];
+            CPPUNIT_ASSERT(pipe(ready) == 0 && pipe(done) == 0);
+
+            pid_t pid = fork();
+            CPPUNIT_ASSERT(pid >= 0);
+            if (pid == 0) {
+                int status = 1;
+                try {
+                    HTTPCache *other = new HTTPCache(root, false);
+                    if (other->is_url_in_cache(url0)) {
+                        // Add a response and replace the first one
+                        cache_test_responses(other, vector<string>(1, url1));
+                        cache_test_responses(other, vector<string>(1, url0));
+                        status = 0;
+                    }
+
+                    char c = 'r';
+                    if (write(ready[1], &c, 1) != 1 || read(done[0], &c, 1) != 1)
+                        status = 1;
+
+                    // Writes a new snapshot
+                    delete other;
+                }
+                catch (...) {
+                    status = 1;
+                }
+                _exit(status);
+            }
+
+            char c;
+            CPPUNIT_ASSERT(read(ready[0], &c, 1) == 1);
+
+            check_cached_response(pc.get(), url1);
+
+            vector<string> headers;
+            string name;
+            FILE *body = pc->get_cached_response(url0, headers, name);
+            CPPUNIT_ASSERT(body);
+            pc->release_cached_response(body);
+            fclose(body);
+            CPPUNIT_ASSERT(name != cachename);
+            CPPUNIT_ASSERT(access(cachename.c_str(), F_OK) != 0);
+
+            // The cache cannot be purged while another process uses it
+            try {
+                pc->purge_cache();
+                CPPUNIT_FAIL("Purged a cache that's in use");
+            }
+            catch (Error &e) {
+                DBG(cerr << e.get_error_message() << endl);
+            }
+
+            c = 'd';
+            CPPUNIT_ASSERT(write(done[1], &c, 1) == 1);
+
+            int status;
+            CPPUNIT_ASSERT(waitpid(pid, &status, 0) == pid);
+            CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+            close(ready[0]); close(ready[1]);
+            close(done[0]); close(done[1]);
+
+            // The other process wrote a new snapshot; read it
+            check_cached_response(pc.get(), url0);
+            check_cached_response(pc.get(), url1);
+            CPPUNIT_ASSERT(access((root + ".index.bin").c_str(), F_OK) == 0);
+
+            pc->purge_cache();
+            CPPUNIT_ASSERT(!pc->is_url_in_cache(url0));
+            CPPUNIT_ASSERT(!pc->is_url_in_cache(url1));
+        }
+        catch (Error &e) {
+            CPPUNIT_FAIL(e.get_error_message());
+        }
+    }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(HTTPCacheTest);
@@ -35,6 +35,7 @@
 
 #include "GNURegex.h"
 #include "HTTPConnect.h"
+#include "HTTPConnectionPool.h"
 #include "RCReader.h"
 
 #include "debug.h"
@@ -150,6 +151,7 @@ class HTTPConnectTest: public TestFixture {
     CPPUNIT_TEST(set_xdap_protocol_test);
     CPPUNIT_TEST(read_url_password_test);
     CPPUNIT_TEST(read_url_password_test2);
+    CPPUNIT_TEST(connection_pool_test);
 
   // CPPUNIT_TEST(read_url_password_proxy_test);
 
@@ -724,6 +726,30 @@ class HTTPConnectTest: public TestFixture {
         delete resp_h;
         resp_h = 0;
     }
+
+    // When an HTTPConnect is deleted its curl handle should go back to the
+    // pool and be used by the next HTTPConnect.
+    void connection_pool_test() {
+        HTTPConnectionPool *pool = HTTPConnectionPool::instance();
+        CPPUNIT_ASSERT(pool->is_enabled());
+
+        unsigned int idle = pool->get_idle_handle_count();
+        CURL *curl = http->d_curl;
+        delete http;
+        http = 0;
+        CPPUNIT_ASSERT(pool->get_idle_handle_count() == idle + 1);
+
+        http = new HTTPConnect(RCReader::instance());
+        CPPUNIT_ASSERT(http->d_curl == curl);
+        CPPUNIT_ASSERT(pool->get_idle_handle_count() == idle);
+
+        // The pooled handle should still work
+        FILE *dump = fopen("/dev/null", "w");
+        vector<string> resp_h;
+        long status = http->read_url(netcdf_das_url, dump, &resp_h);
+        fclose(dump);
+        CPPUNIT_ASSERT(status == 200);
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(HTTPConnectTest);
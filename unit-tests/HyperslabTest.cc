@@ -0,0 +1,389 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Hyperslab.h"
+#include "Array.h"
+#include "Int16.h"
+#include "Str.h"
+#include "InternalErr.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+// The whole of an array with these dimension sizes
+static Hyperslab whole(const vector<int> &sizes)
+{
+    Hyperslab slab;
+    for (unsigned int d = 0; d < sizes.size(); ++d)
+        slab.append(0, 1, sizes[d] - 1);
+
+    return slab;
+}
+
+// Values of 'to' taken one at a time from 'values', which holds 'from'
+template<typename T>
+static vector<T> naive_extract(const Hyperslab &from, const vector<T> &values, const Hyperslab &to)
+{
+    vector<T> result;
+    unsigned int dims = to.dimensions();
+    vector<int> index(dims, 0);
+    for (unsigned long n = 0; n < to.elements(); ++n) {
+        unsigned long offset = 0;
+        for (unsigned int d = 0; d < dims; ++d)
+            offset = offset * from.count(d) + (to.start[d] + index[d] * to.stride[d] - from.start[d]) / from.stride[d];
+        result.push_back(values[offset]);
+
+        for (int d = dims - 1; d >= 0 && ++index[d] == to.count(d); --d)
+            index[d] = 0;
+    }
+
+    return result;
+}
+
+template<typename T>
+static vector<T> extract(const Hyperslab &from, const vector<T> &values, const Hyperslab &to,
+        unsigned int threads = 1)
+{
+    vector<T> result(to.elements());
+    Hyperslab::extract(from, &values[0], sizeof(T), to, &result[0], threads);
+    return result;
+}
+
+class HyperslabTest: public TestFixture {
+private:
+    vector<int> sizes;          // 6 x 7 x 8
+    vector<dods_int16> values;  // element i is i
+
+public:
+    HyperslabTest()
+    {
+    }
+
+    void setUp()
+    {
+        sizes.clear();
+        sizes.push_back(6);
+        sizes.push_back(7);
+        sizes.push_back(8);
+
+        values.resize(6 * 7 * 8);
+        for (unsigned int i = 0; i < values.size(); ++i)
+            values[i] = i;
+    }
+
+    void tearDown()
+    {
+    }
+
+    CPPUNIT_TEST_SUITE (HyperslabTest);
+
+    CPPUNIT_TEST (contains_test);
+    CPPUNIT_TEST (whole_test);
+    CPPUNIT_TEST (contiguous_test);
+    CPPUNIT_TEST (stride_test);
+    CPPUNIT_TEST (single_index_test);
+    CPPUNIT_TEST (partial_source_test);
+    CPPUNIT_TEST (widths_test);
+    CPPUNIT_TEST (random_test);
+    CPPUNIT_TEST (threads_test);
+    CPPUNIT_TEST (not_contained_test);
+    CPPUNIT_TEST (array_test);
+    CPPUNIT_TEST (array_strings_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void contains_test()
+    {
+        Hyperslab slab;
+        slab.append(0, 2, 18);
+        slab.append(5, 1, 25);
+
+        Hyperslab other;
+        other.append(4, 4, 12);
+        other.append(5, 1, 25);
+        CPPUNIT_ASSERT(slab.contains(other));
+
+        // Odd rows aren't in the slab
+        other.start[0] = 3;
+        CPPUNIT_ASSERT(!slab.contains(other));
+
+        // Past the end
+        other.start[0] = 4;
+        other.stop[1] = 26;
+        CPPUNIT_ASSERT(!slab.contains(other));
+
+        // A single index needs no particular stride
+        other.stop[1] = 25;
+        other.start[0] = other.stop[0] = 6;
+        other.stride[0] = 3;
+        CPPUNIT_ASSERT(slab.contains(other));
+    }
+
+    void whole_test()
+    {
+        Hyperslab from = whole(sizes);
+        CPPUNIT_ASSERT(extract(from, values, from) == values);
+    }
+
+    void contiguous_test()
+    {
+        // Whole rows of a block of the middle dimension merge into one run
+        Hyperslab to;
+        to.append(1, 1, 4);
+        to.append(2, 1, 5);
+        to.append(0, 1, 7);
+
+        Hyperslab from = whole(sizes);
+        CPPUNIT_ASSERT(extract(from, values, to) == naive_extract(from, values, to));
+    }
+
+    void stride_test()
+    {
+        Hyperslab to;
+        to.append(0, 2, 4);
+        to.append(1, 3, 4);
+        to.append(1, 2, 7);
+
+        Hyperslab from = whole(sizes);
+        vector<dods_int16> result = extract(from, values, to);
+        CPPUNIT_ASSERT(result == naive_extract(from, values, to));
+        CPPUNIT_ASSERT(result.size() == 3 * 2 * 4);
+        CPPUNIT_ASSERT(result[0] == 0 * 56 + 1 * 8 + 1);
+        CPPUNIT_ASSERT(result[5] == 0 * 56 + 4 * 8 + 3);
+    }
+
+    void single_index_test()
+    {
+        // A column: one index of the two inner dimensions
+        Hyperslab to;
+        to.append(0, 1, 5);
+        to.append(3, 1, 3);
+        to.append(6, 1, 6);
+
+        Hyperslab from = whole(sizes);
+        vector<dods_int16> result = extract(from, values, to);
+        CPPUNIT_ASSERT(result.size() == 6);
+        for (int i = 0; i < 6; ++i)
+            CPPUNIT_ASSERT(result[i] == i * 56 + 3 * 8 + 6);
+
+        // One element
+        to.start[0] = to.stop[0] = 2;
+        result = extract(from, values, to);
+        CPPUNIT_ASSERT(result.size() == 1 && result[0] == 2 * 56 + 3 * 8 + 6);
+    }
+
+    void partial_source_test()
+    {
+        // The source holds every other row of a block
+        Hyperslab from;
+        from.append(1, 1, 4);
+        from.append(0, 2, 6);
+        from.append(0, 1, 7);
+        vector<dods_int16> block = naive_extract(whole(sizes), values, from);
+
+        Hyperslab to;
+        to.append(2, 1, 3);
+        to.append(2, 4, 6);
+        to.append(1, 3, 7);
+
+        vector<dods_int16> result = extract(from, block, to);
+        CPPUNIT_ASSERT(result == naive_extract(whole(sizes), values, to));
+    }
+
+    void widths_test()
+    {
+        Hyperslab from = whole(sizes);
+        Hyperslab to;
+        to.append(1, 2, 5);
+        to.append(0, 1, 6);
+        to.append(0, 3, 6);
+
+        vector<dods_byte> bytes(values.begin(), values.end());
+        CPPUNIT_ASSERT(extract(from, bytes, to) == naive_extract(from, bytes, to));
+
+        vector<dods_float64> doubles(values.begin(), values.end());
+        CPPUNIT_ASSERT(extract(from, doubles, to) == naive_extract(from, doubles, to));
+
+        // Elements of an unusual size are copied one at a time
+        vector<char> triples(values.size() * 3);
+        for (unsigned int i = 0; i < triples.size(); ++i)
+            triples[i] = i % 127;
+
+        vector<char> result(to.elements() * 3);
+        Hyperslab::extract(from, &triples[0], 3, to, &result[0]);
+
+        vector<dods_int16> index = naive_extract(from, values, to);
+        for (unsigned int i = 0; i < index.size(); ++i)
+            for (int j = 0; j < 3; ++j)
+                CPPUNIT_ASSERT(result[i * 3 + j] == triples[index[i] * 3 + j]);
+    }
+
+    void random_test()
+    {
+        srandom(17);
+        Hyperslab from = whole(sizes);
+        for (int n = 0; n < 500; ++n) {
+            Hyperslab to;
+            for (unsigned int d = 0; d < sizes.size(); ++d) {
+                int start = random() % sizes[d];
+                int stride = random() % 4 + 1;
+                int stop = start + random() % (sizes[d] - start);
+                to.append(start, stride, stop);
+            }
+
+            CPPUNIT_ASSERT(extract(from, values, to) == naive_extract(from, values, to));
+        }
+    }
+
+    void threads_test()
+    {
+        // Big enough to be split across threads
+        vector<int> big;
+        big.push_back(64);
+        big.push_back(128);
+        big.push_back(128);
+
+        Hyperslab from = whole(big);
+        vector<dods_int32> data(from.elements());
+        for (unsigned int i = 0; i < data.size(); ++i)
+            data[i] = i;
+
+        Hyperslab to;
+        to.append(1, 1, 63);
+        to.append(0, 1, 127);
+        to.append(3, 1, 120);
+
+        vector<dods_int32> expected = naive_extract(from, data, to);
+        CPPUNIT_ASSERT(extract(from, data, to, 4) == expected);
+        CPPUNIT_ASSERT(extract(from, data, to, 7) == expected);
+        CPPUNIT_ASSERT(extract(from, data, to, 1000) == expected);
+    }
+
+    void not_contained_test()
+    {
+        Hyperslab from;
+        from.append(0, 2, 4);
+        from.append(0, 1, 7);
+
+        Hyperslab to;
+        to.append(1, 1, 1);
+        to.append(0, 1, 7);
+
+        vector<dods_int16> dest(8);
+        CPPUNIT_ASSERT_THROW(Hyperslab::extract(from, &values[0], 2, to, &dest[0]), InternalErr);
+    }
+
+    void array_test()
+    {
+        Int16 proto("t");
+        Array a("t", &proto);
+        a.append_dim(6, "time");
+        a.append_dim(7, "lat");
+        a.append_dim(8, "lon");
+
+        Array::Dim_iter d = a.dim_begin();
+        a.add_constraint(d, 1, 2, 5);
+        a.add_constraint(d + 1, 2, 1, 4);
+        a.add_constraint(d + 2, 0, 3, 7);
+
+        Hyperslab whole_array(a, false);
+        CPPUNIT_ASSERT(whole_array.elements() == values.size());
+
+        a.set_value_slice(&values[0], whole_array);
+        CPPUNIT_ASSERT(a.length() == 3 * 3 * 3);
+
+        vector<dods_int16> result(a.length());
+        a.value(&result[0]);
+        CPPUNIT_ASSERT(result == naive_extract(whole_array, values, Hyperslab(a)));
+    }
+
+    void array_strings_test()
+    {
+        Str proto("s");
+        Array a("s", &proto);
+        a.append_dim(8, "n");
+
+        vector<string> strings(8);
+        CPPUNIT_ASSERT_THROW(a.set_value_slice(&strings[0], Hyperslab(a, false)), InternalErr);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(HyperslabTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::HyperslabTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <sstream>
+#include <string>
+
+#include "InternedString.h"
+#include "Byte.h"
+#include "AttrTable.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+/** Copy, assign and destroy a shared InternedString and make new ones from
+    the same text, racing the other threads doing the same. */
+static void *copy_strings(void *arg)
+{
+    const InternedString &shared = *static_cast<InternedString*>(arg);
+
+    for (int i = 0; i < 20000; ++i) {
+        InternedString a = shared;
+        InternedString b(string("threaded_name"));
+        InternedString c;
+        c = a;
+        if (&c.str() != &shared.str() || &b.str() != &shared.str())
+            return arg;
+        {
+            // The last reference to this text is dropped on every pass
+            InternedString d(string("threaded_temporary"));
+            InternedString e = d;
+        }
+    }
+
+    return 0;
+}
+
+class InternedStringTest: public TestFixture {
+public:
+    InternedStringTest()
+    {
+    }
+
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    CPPUNIT_TEST_SUITE (InternedStringTest);
+
+    CPPUNIT_TEST (sharing_test);
+    CPPUNIT_TEST (assignment_test);
+    CPPUNIT_TEST (base_type_test);
+    CPPUNIT_TEST (threads_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void sharing_test()
+    {
+        unsigned long n = InternedString::size();
+        {
+            InternedString a("interned_string_test"), b(string("interned_string_test"));
+            CPPUNIT_ASSERT(InternedString::size() == n + 1);
+            CPPUNIT_ASSERT(&a.str() == &b.str());
+            CPPUNIT_ASSERT(a.str() == "interned_string_test");
+
+            InternedString c = a;
+            CPPUNIT_ASSERT(&c.str() == &a.str());
+            CPPUNIT_ASSERT(InternedString::size() == n + 1);
+
+            // The empty string is not in the table
+            InternedString e(""), f;
+            CPPUNIT_ASSERT(e.empty() && f.empty() && e.str() == "");
+            CPPUNIT_ASSERT(InternedString::size() == n + 1);
+        }
+
+        // Removed with the last copy
+        CPPUNIT_ASSERT(InternedString::size() == n);
+    }
+
+    void assignment_test()
+    {
+        unsigned long n = InternedString::size();
+
+        InternedString a("first_name"), b;
+        b = a;
+        CPPUNIT_ASSERT(b.str() == "first_name");
+
+        a = string("second_name");
+        CPPUNIT_ASSERT(a.str() == "second_name" && b.str() == "first_name");
+        CPPUNIT_ASSERT(InternedString::size() == n + 2);
+
+        b = a;
+        CPPUNIT_ASSERT(InternedString::size() == n + 1);
+
+        b = b;
+        a = string("");
+        CPPUNIT_ASSERT(b.str() == "second_name" && a.empty());
+
+        b = a;
+        CPPUNIT_ASSERT(InternedString::size() == n);
+    }
+
+    void base_type_test()
+    {
+        Byte b("temperature", "dataset.nc");
+        CPPUNIT_ASSERT(!b.has_attr_table());
+
+        // Reading the attributes doesn't make a table
+        ostringstream oss;
+        b.dump(oss);
+        CPPUNIT_ASSERT(!b.has_attr_table());
+
+        b.get_attr_table().append_attr("units", "String", "K");
+        CPPUNIT_ASSERT(b.has_attr_table());
+
+        Byte c = b;
+        CPPUNIT_ASSERT(c.name() == "temperature" && c.dataset() == "dataset.nc");
+        CPPUNIT_ASSERT(c.get_attr_table().get_attr("units") == "K");
+
+        c.set_name("pressure");
+        CPPUNIT_ASSERT(c.name() == "pressure" && b.name() == "temperature");
+
+        Byte d("d");
+        d = b;
+        CPPUNIT_ASSERT(d.name() == "temperature" && d.get_attr_table().get_attr("units") == "K");
+    }
+
+    void threads_test()
+    {
+        unsigned long n = InternedString::size();
+        {
+            InternedString shared("threaded_name");
+
+            pthread_t threads[4];
+            for (int i = 0; i < 4; ++i)
+                CPPUNIT_ASSERT(pthread_create(&threads[i], 0, copy_strings, &shared) == 0);
+
+            for (int i = 0; i < 4; ++i) {
+                void *status;
+                pthread_join(threads[i], &status);
+                CPPUNIT_ASSERT(status == 0);
+            }
+
+            CPPUNIT_ASSERT(shared.str() == "threaded_name");
+            CPPUNIT_ASSERT(InternedString::size() == n + 1);
+        }
+
+        CPPUNIT_ASSERT(InternedString::size() == n);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION (InternedStringTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::InternedStringTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -19,6 +19,8 @@
 #include <fstream>
 #include <cstring>
 
+#include <libxml/xmlmemory.h>
+
 #include "TestByte.h"
 #include "TestInt16.h"
 #include "TestInt32.h"
@@ -0,0 +1,315 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+
+#include "config.h"
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "MetadataSnapshot.h"
+#include "Int32.h"
+#include "Float64.h"
+#include "DDS.h"
+#include "DMR.h"
+#include "D4Group.h"
+#include "D4Attributes.h"
+#include "AttrValues.h"
+#include "DDXParserSAX2.h"
+#include "D4ParserSax2.h"
+#include "BaseTypeFactory.h"
+#include "D4BaseTypeFactory.h"
+#include "XMLWriter.h"
+#include "GetOpt.h"
+
+#include "test_config.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+class MetadataSnapshotTest: public TestFixture {
+private:
+    BaseTypeFactory factory;
+    D4BaseTypeFactory d4_factory;
+
+    string print(DMR &dmr)
+    {
+        XMLWriter xml;
+        dmr.print_dap4(xml, false);
+        return xml.get_doc();
+    }
+
+    string print(DDS &dds)
+    {
+        ostringstream oss;
+        dds.print_xml_writer(oss, false, "");
+        dds.print_das(oss);
+        return oss.str();
+    }
+
+    string snapshot(DMR &dmr)
+    {
+        ostringstream oss;
+        MetadataSnapshot::save(dmr, oss);
+        return oss.str();
+    }
+
+    string snapshot(DDS &dds)
+    {
+        ostringstream oss;
+        MetadataSnapshot::save(dds, oss);
+        return oss.str();
+    }
+
+    void dmr_round_trip(const string &file)
+    {
+        DMR dmr(&d4_factory);
+        ifstream in((string(TEST_SRC_DIR) + file).c_str());
+        D4ParserSax2 parser;
+        parser.intern(in, &dmr);
+
+        istringstream snap(snapshot(dmr));
+        DMR loaded(&d4_factory);
+        MetadataSnapshot::load(snap, loaded);
+
+        DBG(cerr << file << ": " << snap.str().size() << " bytes" << endl << print(loaded));
+        CPPUNIT_ASSERT_EQUAL(print(dmr), print(loaded));
+    }
+
+    void dds_round_trip(const string &file)
+    {
+        DDS dds(&factory);
+        DDXParser parser(&factory);
+        string blob;
+        parser.intern(string(TEST_SRC_DIR) + file, &dds, blob);
+
+        istringstream snap(snapshot(dds));
+        DDS loaded(&factory);
+        MetadataSnapshot::load(snap, loaded);
+
+        DBG(cerr << file << ": " << snap.str().size() << " bytes" << endl << print(loaded));
+        CPPUNIT_ASSERT_EQUAL(print(dds), print(loaded));
+    }
+
+public:
+    CPPUNIT_TEST_SUITE (MetadataSnapshotTest);
+
+    CPPUNIT_TEST (dmr_test);
+    CPPUNIT_TEST (dds_test);
+    CPPUNIT_TEST (binary_values_test);
+    CPPUNIT_TEST (alias_test);
+    CPPUNIT_TEST (header_test);
+    CPPUNIT_TEST (bad_count_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void dmr_test()
+    {
+        const char *files[] = { "DMR_0.xml", "DMR_0.1.xml", "DMR_1.xml", "DMR_2.xml", "DMR_2.1.xml", "DMR_3.xml",
+                "DMR_3.1.xml", "DMR_3.2.xml", "DMR_3.3.xml", "DMR_3.4.xml", "DMR_3.5.xml", "DMR_4.xml", "DMR_4.1.xml",
+                "DMR_5.xml", "DMR_5.1.xml", "DMR_6.xml", "DMR_6.1.xml", "DMR_6.2.xml", "DMR_7.xml", "DMR_7.1.xml",
+                "DMR_7.2.xml", "DMR_7.3.xml", "DMR_7.4.xml", "DMR_7.5.xml", "DMR_8.xml" };
+
+        for (unsigned int i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+            dmr_round_trip(string("/D4-xml/") + files[i]);
+    }
+
+    void dds_test()
+    {
+        const char *files[] = { "test.00.ddx", "test.01.ddx", "test.02.ddx", "test.04.ddx",
+                "test.05.ddx", "test.06.ddx", "test.07.ddx", "test.08.ddx", "test.09.ddx", "test.0a.ddx",
+                "test.0b.ddx", "test.0c.ddx", "test.1.other_xml.ddx" };
+
+        for (unsigned int i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+            dds_round_trip(string("/ddx-testsuite/") + files[i]);
+    }
+
+    // Values held only in binary form stay that way
+    void binary_values_test()
+    {
+        DMR dmr(&d4_factory, "binary");
+        D4Attribute *attr = new D4Attribute("valid_range", attr_float64_c);
+        dods_float64 range[] = { -1.5, 1e300 };
+        attr->values().append(range, 2);
+        dmr.root()->attributes()->add_attribute_nocopy(attr);
+
+        Int32 *i = new Int32("i");
+        i->set_is_dap4(true);
+        D4Attribute *scale = new D4Attribute("scale", attr_int32_c);
+        scale->add_value("010");    // text is kept as it was
+        i->attributes()->add_attribute_nocopy(scale);
+        dmr.root()->add_var_nocopy(i);
+
+        DMR loaded(&d4_factory);
+        string snap = snapshot(dmr);
+        MetadataSnapshot::load(snap.data(), snap.size(), loaded);
+
+        AttrValues &values = loaded.root()->attributes()->find("valid_range")->values();
+        CPPUNIT_ASSERT(values.is_binary() && !values.has_text());
+        CPPUNIT_ASSERT(values.size() == 2 && values.data<dods_float64>()[1] == 1e300);
+
+        CPPUNIT_ASSERT(loaded.root()->var("i")->attributes()->find("scale")->value(0) == "010");
+        CPPUNIT_ASSERT_EQUAL(print(dmr), print(loaded));
+    }
+
+    void alias_test()
+    {
+        DDS dds(&factory, "aliases");
+        Float64 *f = new Float64("f");
+        AttrTable &at = f->get_attr_table();
+        at.append_attr("units", "String", "m");
+        at.add_value_alias(&dds.get_attr_table(), "unit", "units");
+        dds.add_var_nocopy(f);
+
+        AttrTable *global = dds.get_attr_table().append_container("NC_GLOBAL");
+        global->append_attr("title", "String", "\"aliased\"");
+        dds.get_attr_table().add_container_alias("globals", global);
+
+        DDS loaded(&factory);
+        string snap = snapshot(dds);
+        MetadataSnapshot::load(snap.data(), snap.size(), loaded);
+
+        CPPUNIT_ASSERT_EQUAL(print(dds), print(loaded));
+
+        // The aliases share the values of the attributes they name
+        AttrTable &lat = loaded.var("f")->get_attr_table();
+        CPPUNIT_ASSERT(lat.get_attr_values("unit") == lat.get_attr_values("units"));
+        CPPUNIT_ASSERT(loaded.get_attr_table().get_attr_table("globals")
+                == loaded.get_attr_table().get_attr_table("NC_GLOBAL"));
+    }
+
+    void header_test()
+    {
+        DDS dds(&factory, "header");
+        dds.add_var_nocopy(new Int32("i"));
+        string snap = snapshot(dds);
+
+        DMR dmr(&d4_factory);
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(snap.data(), snap.size(), dmr), Error);
+
+        DDS loaded(&factory);
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(snap.data(), snap.size() - 1, loaded), Error);
+
+        string old_version = snap;
+        old_version[12] = MetadataSnapshot::format_version + 1;
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(old_version.data(), old_version.size(), loaded), Error);
+
+        string not_a_snapshot = "<?xml version=\"1.0\"?>";
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(not_a_snapshot.data(), not_a_snapshot.size(), loaded), Error);
+    }
+
+    // A count too large for what's left of the snapshot is an Error, not an
+    // overflow or a huge allocation
+    void bad_count_test()
+    {
+        DMR dmr(&d4_factory, "counts");
+        D4Attribute *range = new D4Attribute("valid_range", attr_float64_c);
+        dods_float64 values[] = { -1.5, 1e300 };
+        range->values().append(values, 2);
+        dmr.root()->attributes()->add_attribute_nocopy(range);
+
+        D4Attribute *title = new D4Attribute("title", attr_str_c);
+        title->add_value("bad counts");
+        dmr.root()->attributes()->add_attribute_nocopy(title);
+
+        string snap = snapshot(dmr);
+        DMR loaded(&d4_factory);
+
+        // 2^61 + 1 values of eight bytes wrap to the size of one
+        string binary = snap;
+        size_t pos = binary.find(string(reinterpret_cast<char*>(values), sizeof(values)));
+        CPPUNIT_ASSERT(pos != string::npos && binary[pos - 1] == 2);
+        binary.replace(pos - 1, 1, "\x81\x80\x80\x80\x80\x80\x80\x80\x20");
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(binary.data(), binary.size(), loaded), Error);
+
+        // The text value's count is before its length
+        string text = snap;
+        pos = text.find("bad counts");
+        CPPUNIT_ASSERT(pos != string::npos && text[pos - 2] == 1);
+        text.replace(pos - 2, 1, "\xff\xff\xff\xff\xff\xff\xff\xff\x7f");
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(text.data(), text.size(), loaded), Error);
+
+        // The number of attributes
+        string attrs = snap;
+        pos = attrs.find(string(reinterpret_cast<char*>(values), sizeof(values)));
+        CPPUNIT_ASSERT(attrs[pos - 5] == 2);
+        attrs[pos - 5] = '\x7f';
+        CPPUNIT_ASSERT_THROW(MetadataSnapshot::load(attrs.data(), attrs.size(), loaded), Error);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION (MetadataSnapshotTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::MetadataSnapshotTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <sstream>
+#include <string>
+
+#include "ProjectionOverlay.h"
+#include "Byte.h"
+#include "Int32.h"
+#include "Array.h"
+#include "Structure.h"
+#include "D4Sequence.h"
+#include "DDS.h"
+#include "DMR.h"
+#include "D4Group.h"
+#include "D4Dimensions.h"
+#include "D4RValue.h"
+#include "D4FilterClause.h"
+#include "BaseTypeFactory.h"
+#include "D4BaseTypeFactory.h"
+#include "XMLWriter.h"
+#include "InternalErr.h"
+#include "GetOpt.h"
+
+// D4FilterClause.h includes the DAP2 CE parser's header, which defines this
+#undef DDS
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+// Project one row of the shared DDS's array, many times, on a thread of
+// its own.
+struct Request {
+    DDS *dds;
+    int row;
+    bool ok;
+};
+
+static void *serve(void *arg)
+{
+    Request *request = static_cast<Request*>(arg);
+    request->ok = true;
+
+    for (int i = 0; i < 200 && request->ok; ++i) {
+        ProjectionOverlay overlay;
+        ProjectionOverlay::Scope scope(overlay);
+
+        request->dds->mark_all(false);
+        Array *a = static_cast<Array*>(request->dds->var("a"));
+        a->set_send_p(true);
+        a->add_constraint(a->dim_begin(), request->row, 1, request->row);
+
+        ostringstream oss;
+        request->dds->print_constrained(oss);
+
+        ostringstream expected;
+        expected << "Dataset {\n    Int32 a[rows = 1][cols = 3];\n} shared;\n";
+        if (oss.str() != expected.str() || a->length() != 3 || a->dimension_start(a->dim_begin()) != request->row)
+            request->ok = false;
+
+        // The variables have no attributes; printing the DAS must not make
+        // tables for them in the shared DDS
+        ostringstream das;
+        request->dds->print_das(das);
+        if (das.str() != "Attributes {\n}\n")
+            request->ok = false;
+    }
+
+    return 0;
+}
+
+class ProjectionOverlayTest: public TestFixture {
+private:
+    BaseTypeFactory factory;
+    DDS *dds;
+
+public:
+    ProjectionOverlayTest() : dds(0)
+    {
+    }
+
+    void setUp()
+    {
+        dds = new DDS(&factory, "shared");
+
+        Int32 a_proto("a");
+        Array *a = new Array("a", &a_proto);
+        a->append_dim(4, "rows");
+        a->append_dim(3, "cols");
+        dds->add_var_nocopy(a);
+
+        Structure *s = new Structure("s");
+        s->add_var_nocopy(new Byte("b"));
+        dds->add_var_nocopy(s);
+
+        dds->mark_all(true);
+        ProjectionOverlay::share(*dds);
+    }
+
+    void tearDown()
+    {
+        delete dds;
+    }
+
+    CPPUNIT_TEST_SUITE (ProjectionOverlayTest);
+
+    CPPUNIT_TEST (flags_test);
+    CPPUNIT_TEST (array_test);
+    CPPUNIT_TEST (copy_test);
+    CPPUNIT_TEST (var_index_test);
+    CPPUNIT_TEST (threads_test);
+    CPPUNIT_TEST (dmr_test);
+    CPPUNIT_TEST (filter_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void flags_test()
+    {
+        BaseType *b = dds->var("s.b");
+        CPPUNIT_ASSERT(b && b->is_shared() && b->send_p());
+
+        {
+            ProjectionOverlay overlay;
+            ProjectionOverlay::Scope scope(overlay);
+
+            dds->mark_all(false);
+            dds->mark("s.b", true);
+            b->set_read_p(true);
+            b->set_in_selection(true);
+
+            CPPUNIT_ASSERT(b->send_p() && b->read_p() && b->is_in_selection());
+            CPPUNIT_ASSERT(dds->var("s")->send_p() && !dds->var("a")->send_p());
+
+            ostringstream oss;
+            dds->print_constrained(oss);
+            DBG(cerr << oss.str() << endl);
+            CPPUNIT_ASSERT(oss.str() == "Dataset {\n    Structure {\n        Byte b;\n    } s;\n} shared;\n");
+
+            // Variables that aren't shared keep their own state
+            Byte own("own");
+            own.set_send_p(false);
+            CPPUNIT_ASSERT(!own.send_p() && overlay.find(&own) == 0);
+        }
+
+        // The variables weren't changed
+        CPPUNIT_ASSERT(b->send_p() && !b->read_p() && !b->is_in_selection());
+        CPPUNIT_ASSERT(dds->var("a")->send_p());
+    }
+
+    void array_test()
+    {
+        Array *a = static_cast<Array*>(dds->var("a"));
+        {
+            ProjectionOverlay overlay;
+            ProjectionOverlay::Scope scope(overlay);
+
+            // Reading the dimensions doesn't copy them into the overlay
+            Array::Dim_iter i = a->dim_begin();
+            CPPUNIT_ASSERT(a->dimensions() == 2 && a->dimension_size(i, true) == 4);
+            CPPUNIT_ASSERT(overlay.size() == 0);
+
+            // An iterator got before the copy still refers to the same dimension
+            a->add_constraint(i, 1, 2, 3);
+            CPPUNIT_ASSERT(a->dimension_size(i, true) == 2 && a->dimension_stride(i) == 2);
+            CPPUNIT_ASSERT(a->length() == 6);
+
+            a->reset_constraint();
+            CPPUNIT_ASSERT(a->length() == 12);
+
+            a->add_constraint(a->dim_begin() + 1, 2, 1, 2);
+            CPPUNIT_ASSERT(a->length() == 4);
+
+            // Scopes nest; an empty overlay shows the variables' own state
+            ProjectionOverlay inner;
+            {
+                ProjectionOverlay::Scope inner_scope(inner);
+                CPPUNIT_ASSERT(a->length() == 12);
+            }
+            CPPUNIT_ASSERT(a->length() == 4);
+        }
+
+        CPPUNIT_ASSERT(a->length() == 12);
+        CPPUNIT_ASSERT(a->dimension_size(a->dim_begin() + 1, true) == 3);
+
+        // Without a Scope, the shared Array can't be constrained
+        CPPUNIT_ASSERT_THROW(a->add_constraint(a->dim_begin(), 1, 1, 1), InternalErr);
+        CPPUNIT_ASSERT_THROW(a->reset_constraint(), InternalErr);
+    }
+
+    void copy_test()
+    {
+        ProjectionOverlay overlay;
+        ProjectionOverlay::Scope scope(overlay);
+
+        Array *a = static_cast<Array*>(dds->var("a"));
+        a->add_constraint(a->dim_begin(), 0, 1, 1);
+        a->set_send_p(false);
+
+        // A copy holds the overlay's state for the shared variable
+        Array *copy = static_cast<Array*>(a->ptr_duplicate());
+        CPPUNIT_ASSERT(!copy->is_shared());
+        CPPUNIT_ASSERT(copy->length() == 6 && !copy->send_p());
+        CPPUNIT_ASSERT(overlay.find(copy) == 0);
+
+        copy->set_send_p(true);
+        CPPUNIT_ASSERT(copy->send_p() && !a->send_p());
+
+        delete copy;
+    }
+
+    void var_index_test()
+    {
+        CPPUNIT_ASSERT(dds->var("b") == dds->var("s.b"));
+
+        // Changing the variables of another tree doesn't touch the index
+        Structure other("other");
+        other.add_var(new Byte("x"));
+        other.var("x")->set_name("b");
+
+        CPPUNIT_ASSERT(dds->var("b") && dds->var("b")->name() == "b");
+        CPPUNIT_ASSERT(static_cast<Structure*>(dds->var("s"))->var("b"));
+    }
+
+    void threads_test()
+    {
+        const int n = 4;
+        pthread_t threads[n];
+        Request requests[n];
+
+        for (int i = 0; i < n; ++i) {
+            requests[i].dds = dds;
+            requests[i].row = i;
+            CPPUNIT_ASSERT(pthread_create(&threads[i], 0, serve, &requests[i]) == 0);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            pthread_join(threads[i], 0);
+            CPPUNIT_ASSERT(requests[i].ok);
+        }
+
+        CPPUNIT_ASSERT(dds->var("a")->length() == 12);
+    }
+
+    void dmr_test()
+    {
+        D4BaseTypeFactory d4_factory;
+        DMR dmr(&d4_factory, "shared");
+
+        D4Dimension *row = new D4Dimension("row", 5);
+        dmr.root()->dims()->add_dim_nocopy(row);
+
+        Int32 x_proto("x");
+        Array *x = new Array("x", &x_proto);
+        x->set_is_dap4(true);
+        x->append_dim(row);
+        x->append_dim(3);
+        dmr.root()->add_var_nocopy(x);
+
+        ProjectionOverlay::share(dmr);
+        CPPUNIT_ASSERT(row->is_shared());
+
+        {
+            ProjectionOverlay overlay;
+            ProjectionOverlay::Scope scope(overlay);
+
+            row->set_constraint(1, 1, 2);
+            x->add_constraint(x->dim_begin(), row);
+
+            CPPUNIT_ASSERT(row->constrained() && row->c_stop() == 2 && row->used_by_projected_var());
+            CPPUNIT_ASSERT(x->length() == 6);
+
+            XMLWriter xml;
+            row->print_dap4(xml);
+            DBG(cerr << xml.get_doc() << endl);
+            CPPUNIT_ASSERT(string(xml.get_doc()).find("size=\"2\"") != string::npos);
+
+            // Copies of a shared DMR hold the overlay's constraints
+            DMR copy(dmr);
+            D4Dimension *copy_row = copy.root()->dims()->find_dim("row");
+            CPPUNIT_ASSERT(!copy_row->is_shared() && copy_row->constrained());
+            CPPUNIT_ASSERT(copy.root()->var("x")->length() == 6);
+        }
+
+        CPPUNIT_ASSERT(!row->constrained() && !row->used_by_projected_var());
+        CPPUNIT_ASSERT(x->length() == 15);
+    }
+
+    void filter_test()
+    {
+        D4Sequence seq("seq");
+        seq.add_var(new Int32("i"));
+
+        D4BaseTypeFactory d4_factory;
+        DMR dmr(&d4_factory, "shared");
+        dmr.root()->add_var(&seq);
+        D4Sequence *shared = static_cast<D4Sequence*>(dmr.root()->var("seq"));
+        ProjectionOverlay::share(dmr);
+
+        {
+            ProjectionOverlay overlay;
+            ProjectionOverlay::Scope scope(overlay);
+
+            D4FilterClause *clause = new D4FilterClause(D4FilterClause::less, new D4RValue(shared->var("i")),
+                    new D4RValue(10LL));
+            shared->clauses().add_clause(clause);
+
+            CPPUNIT_ASSERT(overlay.find(shared) && overlay.find(shared)->clauses->size() == 1);
+            CPPUNIT_ASSERT(shared->clauses().size() == 1);
+        }
+
+        CPPUNIT_ASSERT(shared->clauses().size() == 0);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION (ProjectionOverlayTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::ProjectionOverlayTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
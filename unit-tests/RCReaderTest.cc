@@ -103,6 +103,7 @@ public:
     CPPUNIT_TEST(proxy_test4);
     CPPUNIT_TEST(proxy_test5);
     CPPUNIT_TEST(validate_ssl_test);
+    CPPUNIT_TEST(connection_pool_test);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -363,6 +364,31 @@ public:
                 << endl);
         CPPUNIT_ASSERT(reader->get_validate_ssl() == 0);
     }
+
+    // Check the defaults for the connection pool parameters and then read
+    // values from a file.
+    void connection_pool_test() {
+        string rc = (string)"DODS_CONF=" + TEST_SRC_DIR + "/rcreader-testsuite/dodsrc_ssl_1" ;
+        DBG(cerr << "rc: " << rc << endl);
+        my_putenv(rc);
+
+        RCReader::delete_instance();
+        RCReader::initialize_instance();
+        RCReader *reader = RCReader::instance();
+        CPPUNIT_ASSERT(reader->get_connection_pool_size() == 8);
+        CPPUNIT_ASSERT(reader->get_connection_idle_timeout() == 60);
+
+        rc = (string)"DODS_CONF=" + TEST_SRC_DIR + "/rcreader-testsuite/dodsrc_pool_1" ;
+        DBG(cerr << "rc: " << rc << endl);
+        my_putenv(rc);
+
+        RCReader::delete_instance();
+        RCReader::initialize_instance();
+        reader = RCReader::instance();
+        DBG(cerr << "reader->get_connection_pool_size(): " << reader->get_connection_pool_size() << endl);
+        CPPUNIT_ASSERT(reader->get_connection_pool_size() == 3);
+        CPPUNIT_ASSERT(reader->get_connection_idle_timeout() == 17);
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(RCReaderTest);
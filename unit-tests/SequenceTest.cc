@@ -55,7 +55,7 @@ using namespace std;
 int test_variable_sleep_interval;
 
 //  Note: MS VC++ won't tolerate the embedded newlines in strings, hence the \n
-//  is explicit.
+//  is explicit. d_attr is 0 for a variable without attributes.
 static const char *s_as_string = \
         "BaseType \\(0x.*\\):\n\
           _name: s\n\
@@ -65,7 +65,7 @@ static const char *s_as_string = \
           _send_p: 0\n\
           _synthesized_p: 0\n\
           d_parent: 0.*\n\
-          d_attr: 0x.*\n\
+          d_attr: 0.*\n\
 BaseType \\(0x.*\\):\n\
           _name: i1\n\
           _type: Int32\n\
@@ -74,7 +74,7 @@ BaseType \\(0x.*\\):\n\
           _send_p: 0\n\
           _synthesized_p: 0\n\
           d_parent: 0x.*\n\
-          d_attr: 0x.*\n\
+          d_attr: 0.*\n\
 BaseType \\(0x.*\\):\n\
           _name: str1\n\
           _type: String\n\
@@ -83,7 +83,7 @@ BaseType \\(0x.*\\):\n\
           _send_p: 0\n\
           _synthesized_p: 0\n\
           d_parent: 0x.*\n\
-          d_attr: 0x.*\n\
+          d_attr: 0.*\n\
 BaseType \\(0x.*\\):\n\
           _name: i2\n\
           _type: Int32\n\
@@ -92,7 +92,7 @@ BaseType \\(0x.*\\):\n\
           _send_p: 0\n\
           _synthesized_p: 0\n\
           d_parent: 0x.*\n\
-          d_attr: 0x.*\n\
+          d_attr: 0.*\n\
 \n";
 
 static Regex s_regex(s_as_string);
@@ -0,0 +1,290 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+#include <vector>
+
+#include "SlabCache.h"
+#include "Array.h"
+#include "Int32.h"
+#include "Str.h"
+#include "GetOpt.h"
+
+// #define DODS_DEBUG
+
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+static const string dataset = "/data/coads.nc";
+
+namespace libdap {
+
+// The value of element [i][j] of the test arrays
+static int element(int i, int j)
+{
+    return i * 100 + j;
+}
+
+class SlabCacheTest: public TestFixture {
+private:
+    SlabCache *cache;
+
+    // A 20 x 30 array of Int32 constrained to [start0:stride0:stop0][start1:stride1:stop1]
+    Array *make_array(int start0, int stride0, int stop0, int start1, int stride1, int stop1)
+    {
+        Int32 proto("sst");
+        Array *a = new Array("sst", &proto);
+        a->append_dim(20, "lat");
+        a->append_dim(30, "lon");
+
+        Array::Dim_iter d = a->dim_begin();
+        a->add_constraint(d, start0, stride0, stop0);
+        a->add_constraint(d + 1, start1, stride1, stop1);
+
+        return a;
+    }
+
+    // What a server's read() does
+    void read(Array *a)
+    {
+        vector<dods_int32> values;
+        Array::Dim_iter d = a->dim_begin();
+        for (int i = a->dimension_start(d, true); i <= a->dimension_stop(d, true); i += a->dimension_stride(d, true))
+            for (int j = a->dimension_start(d + 1, true); j <= a->dimension_stop(d + 1, true);
+                    j += a->dimension_stride(d + 1, true))
+                values.push_back(element(i, j));
+
+        a->set_value(values, values.size());
+        a->set_read_p(true);
+    }
+
+    // Add the slab [start0:stride0:stop0][start1:stride1:stop1] to the cache
+    void add(int start0, int stride0, int stop0, int start1, int stride1, int stop1, time_t lmt = 1000)
+    {
+        Array *a = make_array(start0, stride0, stop0, start1, stride1, stop1);
+        read(a);
+        cache->add(*a, dataset, lmt);
+        delete a;
+    }
+
+    // Is the slab in the cache, with the right values?
+    bool cached(int start0, int stride0, int stop0, int start1, int stride1, int stop1, time_t lmt = 1000)
+    {
+        Array *a = make_array(start0, stride0, stop0, start1, stride1, stop1);
+        bool found = cache->read(*a, dataset, lmt);
+        if (found) {
+            CPPUNIT_ASSERT(a->read_p());
+
+            Array *expected = make_array(start0, stride0, stop0, start1, stride1, stop1);
+            read(expected);
+
+            vector<dods_int32> got(a->length());
+            vector<dods_int32> want(expected->length());
+            a->value(&got[0]);
+            expected->value(&want[0]);
+            CPPUNIT_ASSERT(got == want);
+
+            delete expected;
+        }
+
+        delete a;
+        return found;
+    }
+
+public:
+    SlabCacheTest() : cache(0)
+    {
+    }
+
+    void setUp()
+    {
+        cache = new SlabCache;
+    }
+
+    void tearDown()
+    {
+        delete cache;
+        cache = 0;
+    }
+
+    CPPUNIT_TEST_SUITE (SlabCacheTest);
+
+    CPPUNIT_TEST (subset_test);
+    CPPUNIT_TEST (stride_test);
+    CPPUNIT_TEST (several_slabs_test);
+    CPPUNIT_TEST (superset_replaces_test);
+    CPPUNIT_TEST (modified_test);
+    CPPUNIT_TEST (purge_test);
+    CPPUNIT_TEST (strings_not_cached_test);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void subset_test()
+    {
+        add(0, 1, 9, 0, 1, 19);
+        CPPUNIT_ASSERT(cached(0, 1, 9, 0, 1, 19));
+        CPPUNIT_ASSERT(cached(2, 1, 5, 3, 1, 17));
+        CPPUNIT_ASSERT(cached(9, 1, 9, 19, 1, 19));
+        CPPUNIT_ASSERT(!cached(2, 1, 10, 3, 1, 17));
+        CPPUNIT_ASSERT(!cached(0, 1, 9, 0, 1, 20));
+
+        CPPUNIT_ASSERT(cache->get_hits() == 3);
+        CPPUNIT_ASSERT(cache->get_misses() == 2);
+    }
+
+    void stride_test()
+    {
+        add(0, 2, 18, 0, 3, 27);
+        CPPUNIT_ASSERT(cached(2, 4, 18, 3, 6, 27));
+        CPPUNIT_ASSERT(cached(4, 2, 8, 9, 3, 12));
+        CPPUNIT_ASSERT(!cached(1, 2, 9, 0, 3, 27));
+        CPPUNIT_ASSERT(!cached(0, 2, 18, 0, 1, 27));
+    }
+
+    void several_slabs_test()
+    {
+        // Tiles along the first dimension, and one that spans many
+        for (int i = 0; i < 20; i += 5)
+            add(i, 1, i + 4, 0, 1, 9);
+        add(0, 1, 19, 10, 1, 19);
+
+        CPPUNIT_ASSERT(cache->get_slab_count() == 5);
+
+        CPPUNIT_ASSERT(cached(11, 1, 13, 2, 1, 8));
+        CPPUNIT_ASSERT(cached(16, 1, 19, 0, 1, 9));
+        CPPUNIT_ASSERT(cached(3, 1, 17, 12, 1, 15));
+        // Spans two tiles
+        CPPUNIT_ASSERT(!cached(3, 1, 6, 0, 1, 9));
+    }
+
+    void superset_replaces_test()
+    {
+        add(2, 1, 5, 2, 1, 5);
+        add(6, 1, 9, 2, 1, 5);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 2);
+
+        add(0, 1, 19, 0, 1, 29);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 1);
+        CPPUNIT_ASSERT(cache->get_size() == 20 * 30 * sizeof(dods_int32));
+
+        // Already there
+        add(3, 1, 4, 3, 1, 4);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 1);
+    }
+
+    void modified_test()
+    {
+        add(0, 1, 9, 0, 1, 9, 1000);
+        CPPUNIT_ASSERT(cached(0, 1, 9, 0, 1, 9, 1000));
+        CPPUNIT_ASSERT(!cached(0, 1, 9, 0, 1, 9, 2000));
+        CPPUNIT_ASSERT(cache->get_slab_count() == 0);
+        CPPUNIT_ASSERT(cache->get_size() == 0);
+    }
+
+    void purge_test()
+    {
+        // Room for three 10 x 10 slabs
+        delete cache;
+        cache = new SlabCache(3 * 10 * 10 * sizeof(dods_int32));
+
+        add(0, 1, 9, 0, 1, 9);
+        add(10, 1, 19, 0, 1, 9);
+        add(0, 1, 9, 10, 1, 19);
+        CPPUNIT_ASSERT(cached(0, 1, 9, 0, 1, 9));   // now the most recently used
+
+        add(10, 1, 19, 10, 1, 19);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 3);
+        CPPUNIT_ASSERT(cached(0, 1, 9, 0, 1, 9));
+        CPPUNIT_ASSERT(!cached(10, 1, 19, 0, 1, 9));
+        CPPUNIT_ASSERT(cached(10, 1, 19, 10, 1, 19));
+
+        // Bigger than the whole cache
+        add(0, 1, 19, 0, 1, 29);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 3);
+    }
+
+    void strings_not_cached_test()
+    {
+        Str proto("name");
+        Array a("names", &proto);
+        a.append_dim(3, "n");
+        vector<string> values(3, "x");
+        a.set_value(values, 3);
+        a.set_read_p(true);
+
+        cache->add(a, dataset, 1000);
+        CPPUNIT_ASSERT(cache->get_slab_count() == 0);
+        CPPUNIT_ASSERT(!cache->read(a, dataset, 1000));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SlabCacheTest);
+
+} // namespace libdap
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                debug = 1;  // debug is a static global
+                break;
+            default:
+                break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::SlabCacheTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
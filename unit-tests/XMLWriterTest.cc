@@ -0,0 +1,314 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <cstdio>
+
+#include <sstream>
+#include <string>
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <GetOpt.h> // Part of libdap
+
+#include "XMLWriter.h"
+#include "InternalErr.h"
+#include "debug.h"
+
+using namespace CppUnit;
+using namespace std;
+using namespace libdap;
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+// The baselines below are what libxml2's xmlTextWriter writes for the same
+// calls.
+static const string prolog = "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n";
+
+class XMLWriterTest: public TestFixture {
+private:
+    // Write a small document that uses most of the writer
+    void write_doc(XMLWriter &xml) {
+        CPPUNIT_ASSERT(xml.start_element("Dataset") == 0);
+        CPPUNIT_ASSERT(xml.write_attribute("name", "test") == 0);
+        CPPUNIT_ASSERT(xml.start_element("Int32") == 0);
+        CPPUNIT_ASSERT(xml.write_attribute("name", "i") == 0);
+        CPPUNIT_ASSERT(xml.end_element() == 0);
+        CPPUNIT_ASSERT(xml.start_element("Attribute") == 0);
+        CPPUNIT_ASSERT(xml.start_element("Value") == 0);
+        CPPUNIT_ASSERT(xml.write_string("a value") == 0);
+        CPPUNIT_ASSERT(xml.end_element() == 0);
+        CPPUNIT_ASSERT(xml.write_element("Value", "") == 0);
+        CPPUNIT_ASSERT(xml.end_element() == 0);
+        CPPUNIT_ASSERT(xml.end_element() == 0);
+    }
+
+public:
+    XMLWriterTest() {
+    }
+
+    ~XMLWriterTest() {
+    }
+
+    void setUp() {
+    }
+
+    void tearDown() {
+    }
+
+    void test_indent() {
+        XMLWriter xml("  ");
+        write_doc(xml);
+        string doc = xml.get_doc();
+        DBG(cerr << "test_indent: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<Dataset name=\"test\">\n"
+            "  <Int32 name=\"i\"/>\n"
+            "  <Attribute>\n"
+            "    <Value>a value</Value>\n"
+            "    <Value></Value>\n"
+            "  </Attribute>\n"
+            "</Dataset>\n");
+        CPPUNIT_ASSERT(xml.get_doc_size() == doc.size());
+    }
+
+    void test_no_indent() {
+        XMLWriter xml("");
+        write_doc(xml);
+        string doc = xml.get_doc();
+        DBG(cerr << "test_no_indent: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<Dataset name=\"test\"><Int32 name=\"i\"/><Attribute><Value>a value</Value>"
+            "<Value></Value></Attribute></Dataset>\n");
+    }
+
+    void test_mixed_content() {
+        XMLWriter xml("  ");
+        xml.start_element("a");
+        xml.write_string("text");
+        xml.start_element("b");
+        xml.end_element();
+        xml.write_raw("<c/>");
+        string doc = xml.get_doc();
+        DBG(cerr << "test_mixed_content: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<a>text  <b/>\n<c/></a>\n");
+    }
+
+    void test_escaping() {
+        XMLWriter xml("  ");
+        xml.start_element("a");
+        xml.write_attribute("v", "<>&\"'\r\n\t");
+        xml.write_string("<>&\"'\r\n\t");
+        string doc = xml.get_doc();
+        DBG(cerr << "test_escaping: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<a v=\"&lt;&gt;&amp;&quot;'&#13;&#10;&#9;\">&lt;&gt;&amp;&quot;'&#13;\n\t</a>\n");
+    }
+
+    // UTF-8 is written as ISO-8859-1, with character references for what
+    // can't be.
+    void test_encoding() {
+        XMLWriter xml("  ");
+        xml.start_element("a");
+        xml.write_attribute("v", "\xc3\xa9\xe2\x82\xac");
+        xml.write_string("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+        string doc = xml.get_doc();
+        DBG(cerr << "test_encoding: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<a v=\"\xe9&#8364;\">\xe9&#8364;&#128512;</a>\n");
+    }
+
+    void test_not_utf8() {
+        XMLWriter xml("  ");
+        xml.start_element("a");
+        CPPUNIT_ASSERT(xml.write_attribute("v", "caf\xe9") == -1);
+        CPPUNIT_ASSERT(xml.write_string("\x80") == -1);
+        CPPUNIT_ASSERT(xml.write_string("\xe2\x82") == -1);
+    }
+
+    void test_out_of_order() {
+        XMLWriter xml("  ");
+        CPPUNIT_ASSERT(xml.end_element() == -1);
+        CPPUNIT_ASSERT(xml.write_attribute("v", "1") == -1);
+        xml.start_element("a");
+        xml.write_string("text");
+        CPPUNIT_ASSERT(xml.write_attribute("v", "1") == -1);
+        xml.start_pi("pi");
+        CPPUNIT_ASSERT(xml.start_element("b") == -1);
+        CPPUNIT_ASSERT(xml.end_element() == -1);
+        CPPUNIT_ASSERT(xml.start_pi("xml") == -1);
+        xml.end_document();
+        CPPUNIT_ASSERT(xml.start_element("b") == -1);
+    }
+
+    // As D4AsyncUtil uses them
+    void test_namespace_and_pi() {
+        XMLWriter xml("    ");
+        xml.start_pi("xml-stylesheet");
+        xml.write_string("type='text/xsl'");
+        xml.write_string(" href='style.xsl'");
+        xml.end_pi();
+        xml.start_element_ns("dap", "AsynchronousResponse", "http://xml.opendap.org/ns/DAP/4.0#");
+        xml.write_attribute("status", "required");
+        xml.start_element_ns(0, "Inner", "urn:x");
+        string doc = xml.get_doc();
+        DBG(cerr << "test_namespace_and_pi: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog + "<?xml-stylesheet type='text/xsl' href='style.xsl'?>\n"
+            "<dap:AsynchronousResponse status=\"required\" xmlns:dap=\"http://xml.opendap.org/ns/DAP/4.0#\">\n"
+            "    <Inner xmlns=\"urn:x\"/>\n"
+            "</dap:AsynchronousResponse>\n");
+    }
+
+    // A streamed document is the same as one built in memory, and is
+    // written before it's finished.
+    void test_stream() {
+        XMLWriter mem;
+        ostringstream oss;
+        XMLWriter xml(oss);
+
+        mem.start_element("Dataset");
+        xml.start_element("Dataset");
+        for (int i = 0; i < 10000; ++i) {
+            ostringstream name;
+            name << "var_" << i;
+            mem.start_element("Float64");
+            mem.write_attribute("name", name.str().c_str());
+            mem.end_element();
+            xml.start_element("Float64");
+            xml.write_attribute("name", name.str().c_str());
+            xml.end_element();
+        }
+
+        DBG(cerr << "test_stream: written before the end: " << oss.str().size() << endl);
+        CPPUNIT_ASSERT(oss.str().size() > 0);
+
+        xml.end_document();
+        CPPUNIT_ASSERT(oss.str() == mem.get_doc());
+    }
+
+    void test_file() {
+        FILE *tmp = tmpfile();
+        CPPUNIT_ASSERT(tmp);
+        {
+            XMLWriter xml(tmp);
+            write_doc(xml);
+            xml.end_document();
+        }
+
+        XMLWriter mem;
+        write_doc(mem);
+        string expected = mem.get_doc();
+
+        rewind(tmp);
+        string doc;
+        char buf[1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof buf, tmp)) > 0)
+            doc.append(buf, n);
+        fclose(tmp);
+
+        DBG(cerr << "test_file: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == expected);
+    }
+
+    // Code written for the older XMLWriter uses the xmlTextWriter functions
+    void test_get_writer() {
+        XMLWriter xml("");
+        xml.start_element("Dataset");
+        xml.write_attribute("name", "test");
+        CPPUNIT_ASSERT(xmlTextWriterStartElement(xml.get_writer(), (const xmlChar*) "Attribute") >= 0);
+        CPPUNIT_ASSERT(xmlTextWriterWriteAttribute(xml.get_writer(), (const xmlChar*) "name", (const xmlChar*) "a<b") >= 0);
+        CPPUNIT_ASSERT(xml.write_element("value", "1") == 0);
+        CPPUNIT_ASSERT(xmlTextWriterEndElement(xml.get_writer()) >= 0);
+        CPPUNIT_ASSERT(xml.write_element("Byte", 0) == 0);
+        xml.end_element();
+
+        string doc = xml.get_doc();
+        DBG(cerr << "test_get_writer: doc: " << doc << endl);
+        CPPUNIT_ASSERT(doc == prolog
+            + "<Dataset name=\"test\"><Attribute name=\"a&lt;b\"><value>1</value></Attribute><Byte/></Dataset>\n");
+    }
+
+    void test_get_doc_streamed() {
+        ostringstream oss;
+        XMLWriter xml(oss);
+        xml.start_element("a");
+        xml.get_doc();
+    }
+
+    CPPUNIT_TEST_SUITE( XMLWriterTest );
+
+        CPPUNIT_TEST(test_indent);
+        CPPUNIT_TEST(test_no_indent);
+        CPPUNIT_TEST(test_mixed_content);
+        CPPUNIT_TEST(test_escaping);
+        CPPUNIT_TEST(test_encoding);
+        CPPUNIT_TEST(test_not_utf8);
+        CPPUNIT_TEST(test_out_of_order);
+        CPPUNIT_TEST(test_namespace_and_pi);
+        CPPUNIT_TEST(test_stream);
+        CPPUNIT_TEST(test_file);
+        CPPUNIT_TEST(test_get_writer);
+        CPPUNIT_TEST_EXCEPTION(test_get_doc_streamed, InternalErr);
+
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(XMLWriterTest);
+
+int main(int argc, char*argv[]) {
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = 1;  // debug is a static global
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("XMLWriterTest::") + argv[i++];
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
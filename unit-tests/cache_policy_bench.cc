@@ -0,0 +1,201 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Replay an access log against DAPCache3 once for each purge/admission
+// policy and print the hit ratio and bytes read from the cache for each.
+// Cached files are made with ftruncate(2), so they take little disk space
+// no matter how large the log says they are.
+//
+// The log has one access per line: the size of the response in bytes and
+// its name. Lines starting with '#' are ignored. See
+// cache-testsuite/policy_trace.txt.
+
+#include "config.h"
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DAPCache3.h"
+#include "DAPCachePolicy.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+using namespace std;
+using namespace libdap;
+
+struct Access {
+    string name;
+    unsigned long long size;
+};
+
+static void usage(const string &name)
+{
+    cerr << "usage: " << name << " [-s cache size in MB] [-c cache directory] access-log" << endl;
+}
+
+static vector<Access> read_trace(const string &file)
+{
+    ifstream in(file.c_str());
+    if (!in)
+        throw Error("Could not open the access log: " + file);
+
+    vector<Access> trace;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        istringstream iss(line);
+        Access access;
+        if (!(iss >> access.size >> access.name))
+            throw Error("Malformed line in the access log: " + line);
+
+        trace.push_back(access);
+    }
+
+    return trace;
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// DAPCache3 is a singleton, so each policy is run in its own process.
+static void replay(const string &dir, unsigned long long size, DAPCachePolicy *policy, const vector<Access> &trace)
+{
+    double start = now();
+
+    DAPCache3 *cache = DAPCache3::get_instance(dir, "bench", size);
+    cache->set_policy(policy);
+
+    for (vector<Access>::const_iterator i = trace.begin(); i != trace.end(); ++i) {
+        string target = cache->get_cache_file_name(i->name);
+
+        int fd;
+        if (cache->get_read_lock(target, fd)) {
+            cache->unlock_and_close(target);
+        }
+        else if (cache->create_and_lock(target, fd)) {
+            if (ftruncate(fd, i->size) != 0)
+                throw Error("Could not make the cached file: " + target);
+
+            cache->exclusive_to_shared_lock(fd);
+            cache->update_cache_info(target);
+            cache->update_and_purge(target);
+            cache->unlock_and_close(target);
+        }
+    }
+
+    DAPCache3::Statistics stats = cache->get_statistics();
+    printf("%-14s %9.3f %14.1f %9lu %9lu %9.2f\n", stats.policy.c_str(), stats.hit_ratio(),
+            stats.bytes_saved / 1048576.0, stats.purged, stats.rejected, now() - start);
+}
+
+int main(int argc, char *argv[])
+{
+    GetOpt getopt(argc, argv, "s:c:h");
+    int option_char;
+
+    unsigned long long size = 100;
+    string dir = "policy_bench_cache";
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 's':
+                size = strtoull(getopt.optarg, 0, 10);
+                break;
+            case 'c':
+                dir = getopt.optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if (getopt.optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        vector<Access> trace = read_trace(argv[getopt.optind]);
+
+        vector<DAPCachePolicy*> policies;
+        policies.push_back(new DAPCacheLRUPolicy);
+        policies.push_back(new DAPCacheGDSPolicy);
+        policies.push_back(new DAPCacheTinyLFUPolicy(new DAPCacheLRUPolicy));
+        policies.push_back(new DAPCacheTinyLFUPolicy(new DAPCacheGDSPolicy));
+
+        cout << trace.size() << " accesses, " << size << "MB cache" << endl;
+        printf("%-14s %9s %14s %9s %9s %9s\n", "policy", "hit ratio", "MB saved", "purged", "rejected",
+                "seconds");
+
+        for (vector<DAPCachePolicy*>::iterator p = policies.begin(); p != policies.end(); ++p) {
+            system(("rm -rf " + dir).c_str());
+            fflush(stdout);
+
+            pid_t pid = fork();
+            if (pid < 0)
+                throw Error("Could not fork.");
+
+            if (pid == 0) {
+                // The cache deletes the policy
+                try {
+                    replay(dir, size, *p, trace);
+                }
+                catch (Error &e) {
+                    cerr << "Error: " << e.get_error_message() << endl;
+                    exit(1);
+                }
+                fflush(stdout);
+                exit(0);
+            }
+
+            int status;
+            waitpid(pid, &status, 0);
+            delete *p;
+        }
+
+        system(("rm -rf " + dir).c_str());
+    }
+    catch (Error &e) {
+        cerr << "Error: " << e.get_error_message() << endl;
+        return 1;
+    }
+
+    return 0;
+}
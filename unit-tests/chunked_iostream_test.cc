@@ -33,6 +33,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 
 #include "GetOpt.h"
@@ -322,6 +323,46 @@ public:
     	}
     }
 
+    // The first chunk is read a piece at a time after read_next_chunk_header();
+    // the data after it are read as usual.
+    void test_read_next_chunk_header() {
+    	string first(10000, 'a');
+    	for (string::size_type i = 0; i < first.size(); i += 7)
+    		first[i] = 'b';
+    	string rest(5000, 'c');
+
+    	stringstream chunked;
+    	{
+    		chunked_ostream cos(chunked, first.size());
+    		cos << first << flush;
+    		cos.write(rest.data(), rest.size());
+    	}
+
+#if BYTE_ORDER_PREFIX
+    	chunked_istream cis(chunked, 32, 0x00);
+#else
+    	chunked_istream cis(chunked, 32);
+#endif
+    	int chunk_size = cis.read_next_chunk_header();
+    	CPPUNIT_ASSERT(chunk_size == (int)first.size());
+    	CPPUNIT_ASSERT(cis.bytes_in_buffer() == 0);
+
+    	string read_first;
+    	char piece[100];
+    	while ((int)read_first.size() < chunk_size) {
+    		cis.read(piece, min(100, chunk_size - (int)read_first.size()));
+    		CPPUNIT_ASSERT(cis.gcount() > 0);
+    		read_first.append(piece, cis.gcount());
+    	}
+    	CPPUNIT_ASSERT(read_first == first);
+
+    	string read_rest;
+    	char c;
+    	while (cis.get(c))
+    		read_rest += c;
+    	CPPUNIT_ASSERT(read_rest == rest);
+    }
+
     // these are the tests
     void test_write_1_read_1_small_file() {
     	single_char_write(small_file, 32);
@@ -521,6 +562,8 @@ public:
 
     CPPUNIT_TEST(test_write_24_read_24_big_file_2_error);
 
+    CPPUNIT_TEST(test_read_next_chunk_header);
+
     CPPUNIT_TEST_SUITE_END();
 };
 
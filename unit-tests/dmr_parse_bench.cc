@@ -0,0 +1,229 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Measure how fast D4ParserSax2 builds DMRs. Without arguments a large DMR
+// is made, with groups, shared dimensions, maps, enumerations, structures
+// and several attributes per variable, like those the HDF5 and netCDF
+// handlers build for big files; DMRs can also be named on the command line
+// (tests/dmr-testsuite/*.xml). Each is parsed -n times from a string and
+// from a stream.
+//
+// Example: ./dmr_parse_bench -n 20 -v 20000
+
+#include "config.h"
+
+#include <sys/time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "BaseType.h"
+#include "DMR.h"
+#include "D4ParserSax2.h"
+#include "D4BaseTypeFactory.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+using namespace std;
+using namespace libdap;
+
+static void usage(const string &name)
+{
+    cerr << "usage: " << name << " [-n repetitions] [-v variables] [file.xml ...]" << endl;
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static string make_dmr(int vars)
+{
+    ostringstream oss;
+    oss << "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+            << "<Dataset xmlns=\"http://xml.opendap.org/ns/DAP/4.0#\" name=\"bench\" dapVersion=\"4.0\" dmrVersion=\"1.0\">\n"
+            << "    <Dimension name=\"time\" size=\"365\"/>\n"
+            << "    <Dimension name=\"lat\" size=\"180\"/>\n"
+            << "    <Dimension name=\"lon\" size=\"360\"/>\n"
+            << "    <Enumeration name=\"quality\" basetype=\"Byte\">\n"
+            << "        <EnumConst name=\"good\" value=\"0\"/>\n"
+            << "        <EnumConst name=\"suspect\" value=\"1\"/>\n"
+            << "        <EnumConst name=\"bad\" value=\"2\"/>\n"
+            << "    </Enumeration>\n"
+            << "    <Float64 name=\"lat\">\n"
+            << "        <Dim name=\"/lat\"/>\n"
+            << "        <Attribute name=\"units\" type=\"String\">\n"
+            << "            <Value>degrees_north</Value>\n"
+            << "        </Attribute>\n"
+            << "    </Float64>\n"
+            << "    <Float64 name=\"lon\">\n"
+            << "        <Dim name=\"/lon\"/>\n"
+            << "        <Attribute name=\"units\" type=\"String\">\n"
+            << "            <Value>degrees_east</Value>\n"
+            << "        </Attribute>\n"
+            << "    </Float64>\n";
+
+    const int per_group = 100;
+    for (int g = 0; g * per_group < vars; ++g) {
+        oss << "    <Group name=\"g" << g << "\">\n";
+        for (int v = g * per_group; v < vars && v < (g + 1) * per_group; ++v) {
+            if (v % 10 == 9) {
+                oss << "        <Structure name=\"s" << v << "\">\n"
+                        << "            <Int32 name=\"count\"/>\n"
+                        << "            <Enum name=\"flag\" enum=\"/quality\"/>\n"
+                        << "            <String name=\"comment\"/>\n"
+                        << "            <Attribute name=\"description\" type=\"String\">\n"
+                        << "                <Value>A structure &amp; its fields</Value>\n"
+                        << "            </Attribute>\n"
+                        << "        </Structure>\n";
+                continue;
+            }
+
+            oss << "        <Float32 name=\"v" << v << "\">\n"
+                    << "            <Dim name=\"/time\"/>\n"
+                    << "            <Dim name=\"/lat\"/>\n"
+                    << "            <Dim name=\"/lon\"/>\n"
+                    << "            <Attribute name=\"long_name\" type=\"String\">\n"
+                    << "                <Value>Variable number " << v << "</Value>\n"
+                    << "            </Attribute>\n"
+                    << "            <Attribute name=\"units\" type=\"String\">\n"
+                    << "                <Value>K</Value>\n"
+                    << "            </Attribute>\n"
+                    << "            <Attribute name=\"_FillValue\" type=\"Float32\">\n"
+                    << "                <Value>-9999.</Value>\n"
+                    << "            </Attribute>\n"
+                    << "            <Attribute name=\"valid_range\" type=\"Float32\">\n"
+                    << "                <Value>0.</Value>\n"
+                    << "                <Value>400.</Value>\n"
+                    << "            </Attribute>\n"
+                    << "            <Map name=\"/lat\"/>\n"
+                    << "            <Map name=\"/lon\"/>\n"
+                    << "        </Float32>\n";
+        }
+        oss << "    </Group>\n";
+    }
+
+    oss << "</Dataset>\n";
+    return oss.str();
+}
+
+static unsigned long count_elements(const string &doc)
+{
+    unsigned long n = 0;
+    for (string::size_type i = doc.find('<'); i != string::npos; i = doc.find('<', i + 1))
+        if (i + 1 < doc.size() && doc[i + 1] != '/' && doc[i + 1] != '?')
+            ++n;
+
+    return n;
+}
+
+static void bench(const string &label, const string &doc, int reps)
+{
+    D4BaseTypeFactory factory;
+
+    double start = now();
+    for (int r = 0; r < reps; ++r) {
+        DMR dmr(&factory);
+        D4ParserSax2 parser;
+        parser.intern(doc, &dmr);
+    }
+    double from_string = (now() - start) / reps;
+
+    start = now();
+    for (int r = 0; r < reps; ++r) {
+        istringstream in(doc);
+        DMR dmr(&factory);
+        D4ParserSax2 parser;
+        parser.intern(in, &dmr);
+    }
+    double from_stream = (now() - start) / reps;
+
+    double mb = doc.size() / 1048576.0;
+    double elements = count_elements(doc);
+
+    printf("%-24s %9.2f %8.0f %11.3f %10.1f %8.0f %11.3f %10.1f\n", label.c_str(), mb, elements,
+            from_string * 1000, mb / from_string, elements / from_string / 1000, from_stream * 1000, mb / from_stream);
+}
+
+int main(int argc, char *argv[])
+{
+    GetOpt getopt(argc, argv, "n:v:h");
+    int option_char;
+
+    int reps = 20;
+    int vars = 20000;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'n':
+                reps = atoi(getopt.optarg);
+                break;
+            case 'v':
+                vars = atoi(getopt.optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if (reps < 1 || vars < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%-24s %9s %8s %11s %10s %8s %11s %10s\n", "", "", "", "string", "", "", "stream", "");
+    printf("%-24s %9s %8s %11s %10s %8s %11s %10s\n", "dmr", "MB", "elements", "ms/parse", "MB/s", "kelem/s",
+            "ms/parse", "MB/s");
+
+    try {
+        if (getopt.optind == argc) {
+            ostringstream label;
+            label << "generated (" << vars << " vars)";
+            bench(label.str(), make_dmr(vars), reps);
+        }
+
+        for (int a = getopt.optind; a < argc; ++a) {
+            ifstream in(argv[a]);
+            if (!in)
+                throw Error(string("Could not open ") + argv[a]);
+
+            string doc((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            string file = argv[a];
+            bench(file.substr(file.rfind('/') + 1), doc, reps);
+        }
+    }
+    catch (Error &e) {
+        cerr << e.get_error_message() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -30,11 +30,13 @@
 //#define DODS_DEBUG
 
 #include <fcntl.h>
+#include <unistd.h>
 #include <stdio.h>
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <iterator>
 
 #include "fdiostream.h"
 #include "test_config.h"
@@ -84,6 +86,9 @@ public:
     CPPUNIT_TEST(large_read_test);
     CPPUNIT_TEST(large_read_test_file_pointer);
 #endif
+    CPPUNIT_TEST(send_file_test);
+    CPPUNIT_TEST(send_file_range_test);
+    CPPUNIT_TEST(send_file_pipe_test);
     CPPUNIT_TEST_SUITE_END();
 
     void write_file()
@@ -328,7 +333,73 @@ public:
 	CPPUNIT_ASSERT(string(buf + num - 13) == "{ 1995 } };");
     }
 
+    static string read_all(const string &name)
+    {
+	ifstream ifs(name.c_str());
+	return string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    }
+
+    // Buffered text and the sent file come out in order
+    void send_file_test()
+    {
+	int fd = open("tmp.txt", O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	CPPUNIT_ASSERT( "send_file_test open tmp.txt" && fd != -1 ) ;
+	int in_fd = open(ff_test1_data.c_str(), O_RDONLY);
+	CPPUNIT_ASSERT(in_fd != -1);
+
+	{
+	    fdostream out(fd, true);
+	    out << "Header\n";
+	    CPPUNIT_ASSERT(out.send_file(in_fd) == 54351);
+	    out << "Trailer\n";
+	}
+
+	// The input file's offset is not changed
+	CPPUNIT_ASSERT(lseek(in_fd, 0, SEEK_CUR) == 0);
+	close(in_fd);
+
+	CPPUNIT_ASSERT(read_all("tmp.txt") == "Header\n" + read_all(ff_test1_data) + "Trailer\n");
+    }
 
+    void send_file_range_test()
+    {
+	int fd = open("tmp.txt", O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	CPPUNIT_ASSERT( "send_file_range_test open tmp.txt" && fd != -1 ) ;
+	int in_fd = open(fdiostream_txt.c_str(), O_RDONLY);
+	CPPUNIT_ASSERT(in_fd != -1);
+
+	{
+	    fdostream out(fd, true);
+	    CPPUNIT_ASSERT(out.send_file(in_fd, 7, 4) == 4);
+	    // Asking for more than is there sends what there is
+	    CPPUNIT_ASSERT(out.send_file(in_fd, 12, 1000) == (streamsize) read_all(fdiostream_txt).size() - 12);
+	}
+	close(in_fd);
+
+	CPPUNIT_ASSERT(read_all("tmp.txt").substr(0, 14) == "fromfdiostream");
+    }
+
+    void send_file_pipe_test()
+    {
+	int fds[2];
+	CPPUNIT_ASSERT(pipe(fds) == 0);
+	int in_fd = open(fdiostream_txt.c_str(), O_RDONLY);
+	CPPUNIT_ASSERT(in_fd != -1);
+
+	{
+	    fdostream out(fds[1], true);
+	    out << "<";
+	    CPPUNIT_ASSERT(out.send_file(in_fd, 0, 22) == 22);
+	    out << ">";
+	}
+	close(in_fd);
+
+	char buf[64];
+	ssize_t num = read(fds[0], buf, sizeof(buf));
+	close(fds[0]);
+	CPPUNIT_ASSERT(num == 24);
+	CPPUNIT_ASSERT(string(buf, num) == "<Output from fdiostream>");
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(fdiostreamTest);
@@ -0,0 +1,196 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Measure how many cache hits HTTPCache serves per second as the number of
+// threads reading from it grows. -u responses are cached in a new cache
+// under -d, then 1, 2, 4, ... -t threads each read every response -n
+// times. The cache is purged when the program exits.
+//
+// Example: ./http_cache_bench -t 16 -u 256 -n 100
+
+#include "config.h"
+
+#include <sys/time.h>
+#include <pthread.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HTTPCache.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+using namespace std;
+using namespace libdap;
+
+struct ReaderArgs {
+    HTTPCache *cache;
+    const vector<string> *urls;
+    int iterations;
+    int errors;
+};
+
+static void usage(const string &name)
+{
+    cerr << "usage: " << name << " [-d cache_dir] [-t max_threads] [-u urls] [-n iterations]" << endl;
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *read_responses(void *arg)
+{
+    ReaderArgs *args = static_cast<ReaderArgs*>(arg);
+
+    try {
+        for (int i = 0; i < args->iterations; ++i) {
+            for (vector<string>::const_iterator u = args->urls->begin(); u != args->urls->end(); ++u) {
+                FILE *body = args->cache->get_cached_response(*u);
+                if (!body) {
+                    ++args->errors;
+                    continue;
+                }
+
+                args->cache->release_cached_response(body);
+                fclose(body);
+            }
+        }
+    }
+    catch (Error &e) {
+        ++args->errors;
+    }
+
+    return 0;
+}
+
+// Run 'threads' readers at once; return the time they took
+static double bench(HTTPCache *cache, const vector<string> &urls, int threads, int iterations)
+{
+    vector<ReaderArgs> args(threads);
+    vector<pthread_t> ids(threads);
+
+    double start = now();
+
+    for (int t = 0; t < threads; ++t) {
+        args[t].cache = cache;
+        args[t].urls = &urls;
+        args[t].iterations = iterations;
+        args[t].errors = 0;
+        if (pthread_create(&ids[t], 0, read_responses, &args[t]) != 0)
+            throw Error("Could not start a thread.");
+    }
+
+    for (int t = 0; t < threads; ++t)
+        pthread_join(ids[t], 0);
+
+    double elapsed = now() - start;
+
+    for (int t = 0; t < threads; ++t)
+        if (args[t].errors)
+            throw Error("A cached response could not be read.");
+
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    GetOpt getopt(argc, argv, "d:t:u:n:h");
+    int option_char;
+
+    string dir = "http_cache_bench_cache/";
+    int max_threads = 8;
+    int num_urls = 64;
+    int iterations = 100;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'd':
+                dir = getopt.optarg;
+                break;
+            case 't':
+                max_threads = atoi(getopt.optarg);
+                break;
+            case 'u':
+                num_urls = atoi(getopt.optarg);
+                break;
+            case 'n':
+                iterations = atoi(getopt.optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if (max_threads < 1 || num_urls < 1 || iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        HTTPCache *cache = HTTPCache::instance(dir, true);
+
+        vector<string> headers;
+        headers.push_back("ETag: jhrgjhrgjhrg");
+        headers.push_back("Last-Modified: Sat, 05 Nov 1994 08:49:37 GMT");
+
+        vector<string> urls;
+        for (int i = 0; i < num_urls; ++i) {
+            ostringstream url;
+            url << "http://test.opendap.org/http_cache_bench/" << i << ".dds";
+            urls.push_back(url.str());
+
+            FILE *body = tmpfile();
+            fprintf(body, "Response for %s\n", url.str().c_str());
+            rewind(body);
+            bool cached = cache->cache_response(url.str(), time(0), headers, body);
+            fclose(body);
+            if (!cached)
+                throw Error("Could not cache " + url.str());
+        }
+
+        printf("%8s %12s %12s %12s\n", "threads", "hits", "seconds", "hits/s");
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            double elapsed = bench(cache, urls, threads, iterations);
+            long hits = static_cast<long>(threads) * iterations * num_urls;
+            printf("%8d %12ld %12.3f %12.0f\n", threads, hits, elapsed, hits / elapsed);
+        }
+
+        cache->purge_cache();
+    }
+    catch (Error &e) {
+        cerr << e.get_error_message() << endl;
+        return 1;
+    }
+
+    return 0;
+}
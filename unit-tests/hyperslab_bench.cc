@@ -0,0 +1,182 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Time Hyperslab::extract() against the nested start/stride/stop loop that
+// handlers (and tests/TestArray.cc) use, for a few common constraints on a
+// 3-D array of Float32.
+
+#include "config.h"
+
+#include <sys/time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Hyperslab.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+using namespace std;
+using namespace libdap;
+
+static void usage(const string &name)
+{
+    cerr << "usage: " << name << " [-n repetitions] [-t threads] [-s TIMExLATxLON]" << endl;
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// The loop the engine replaces: one element at a time, three dimensions.
+static void nested_loop(const vector<float> &values, const Hyperslab &from, const Hyperslab &to, float *dest)
+{
+    int ny = from.count(1), nx = from.count(2);
+    for (int t = to.start[0]; t <= to.stop[0]; t += to.stride[0])
+        for (int y = to.start[1]; y <= to.stop[1]; y += to.stride[1])
+            for (int x = to.start[2]; x <= to.stop[2]; x += to.stride[2])
+                *dest++ = values[(t * ny + y) * nx + x];
+}
+
+static Hyperslab slab(int t0, int ts, int t1, int y0, int ys, int y1, int x0, int xs, int x1)
+{
+    Hyperslab s;
+    s.append(t0, ts, t1);
+    s.append(y0, ys, y1);
+    s.append(x0, xs, x1);
+    return s;
+}
+
+int main(int argc, char *argv[])
+{
+    GetOpt getopt(argc, argv, "n:t:s:h");
+    int option_char;
+
+    int reps = 10;
+    unsigned int threads = 4;
+    int nt = 64, ny = 512, nx = 512;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'n':
+                reps = atoi(getopt.optarg);
+                break;
+            case 't':
+                threads = atoi(getopt.optarg);
+                break;
+            case 's':
+                if (sscanf(getopt.optarg, "%dx%dx%d", &nt, &ny, &nx) != 3) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if (nt < 4 || ny < 4 || nx < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        Hyperslab from = slab(0, 1, nt - 1, 0, 1, ny - 1, 0, 1, nx - 1);
+        vector<float> values(from.elements());
+        for (unsigned long i = 0; i < values.size(); ++i)
+            values[i] = i;
+
+        struct Case {
+            const char *name;
+            Hyperslab to;
+        };
+
+        vector<Case> cases;
+        Case c;
+        c.name = "whole array";
+        c.to = from;
+        cases.push_back(c);
+        c.name = "tile";
+        c.to = slab(0, 1, nt - 1, ny / 4, 1, ny / 2, nx / 4, 1, nx / 2);
+        cases.push_back(c);
+        c.name = "rows";
+        c.to = slab(0, 1, nt - 1, ny / 4, 1, ny / 2, 0, 1, nx - 1);
+        cases.push_back(c);
+        c.name = "stride 2";
+        c.to = slab(0, 1, nt - 1, 0, 2, ny - 1, 0, 2, nx - 1);
+        cases.push_back(c);
+        c.name = "stride 3";
+        c.to = slab(0, 3, nt - 1, 0, 3, ny - 1, 0, 3, nx - 1);
+        cases.push_back(c);
+        c.name = "time series";
+        c.to = slab(0, 1, nt - 1, ny / 2, 1, ny / 2, nx / 2, 1, nx / 2);
+        cases.push_back(c);
+
+        cout << nt << " x " << ny << " x " << nx << " Float32, " << reps << " repetitions" << endl;
+        printf("%-12s %12s %12s %12s %12s\n", "constraint", "elements", "loop (ms)", "extract (ms)",
+                "threads (ms)");
+
+        for (vector<Case>::iterator i = cases.begin(); i != cases.end(); ++i) {
+            vector<float> expected(i->to.elements());
+            vector<float> result(i->to.elements());
+
+            double start = now();
+            for (int r = 0; r < reps; ++r)
+                nested_loop(values, from, i->to, &expected[0]);
+            double loop = (now() - start) / reps;
+
+            start = now();
+            for (int r = 0; r < reps; ++r)
+                Hyperslab::extract(from, &values[0], sizeof(float), i->to, &result[0]);
+            double extract = (now() - start) / reps;
+
+            if (result != expected)
+                throw Error(string("Wrong values for ") + i->name);
+
+            start = now();
+            for (int r = 0; r < reps; ++r)
+                Hyperslab::extract(from, &values[0], sizeof(float), i->to, &result[0], threads);
+            double threaded = (now() - start) / reps;
+
+            if (result != expected)
+                throw Error(string("Wrong values for ") + i->name + " (threads)");
+
+            printf("%-12s %12lu %12.3f %12.3f %12.3f\n", i->name, i->to.elements(), loop * 1000, extract * 1000,
+                    threaded * 1000);
+        }
+    }
+    catch (Error &e) {
+        cerr << "Error: " << e.get_error_message() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2016 OPeNDAP, Inc.
+// Author: James Gallagher <jgallagher@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Measure the memory used to hold DMRs and DDSs. Each file named on the
+// command line (tests/dmr-testsuite/*.xml, tests/dds-testsuite/*.dds) is
+// parsed -n times and all the copies are kept, as a server holding many
+// datasets' metadata would; the bytes allocated for them are counted by
+// replacing operator new and operator delete.
+//
+// Example: ./metadata_memory_bench -n 1000 ../tests/dmr-testsuite/*.xml
+
+#include "config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "BaseType.h"
+#include "Constructor.h"
+#include "DDS.h"
+#include "DMR.h"
+#include "D4Group.h"
+#include "D4ParserSax2.h"
+#include "BaseTypeFactory.h"
+#include "D4BaseTypeFactory.h"
+#include "Error.h"
+#include "GetOpt.h"
+
+using namespace std;
+using namespace libdap;
+
+// Each block allocated by operator new is preceded by its size
+static const size_t header = 16;
+static size_t live_bytes = 0;
+
+#if __cplusplus >= 201103L
+#define BAD_ALLOC_SPEC
+#else
+#define BAD_ALLOC_SPEC throw(std::bad_alloc)
+#endif
+
+void *operator new(size_t n) BAD_ALLOC_SPEC
+{
+    char *p = static_cast<char*>(malloc(n + header));
+    if (!p)
+        throw std::bad_alloc();
+
+    *reinterpret_cast<size_t*>(p) = n;
+    live_bytes += n;
+    return p + header;
+}
+
+void operator delete(void *p) throw()
+{
+    if (!p)
+        return;
+
+    char *block = static_cast<char*>(p) - header;
+    live_bytes -= *reinterpret_cast<size_t*>(block);
+    free(block);
+}
+
+void *operator new[](size_t n) BAD_ALLOC_SPEC
+{
+    return operator new(n);
+}
+
+void operator delete[](void *p) throw()
+{
+    operator delete(p);
+}
+
+static void usage(const string &name)
+{
+    cerr << "usage: " << name << " [-n copies] file.xml|file.dds ..." << endl;
+}
+
+static unsigned long count_vars(Constructor::Vars_iter i, Constructor::Vars_iter e)
+{
+    unsigned long n = 0;
+    for (; i != e; ++i) {
+        ++n;
+        if ((*i)->is_constructor_type()) {
+            Constructor *c = static_cast<Constructor*>(*i);
+            n += count_vars(c->var_begin(), c->var_end());
+        }
+    }
+
+    return n;
+}
+
+static unsigned long count_vars(D4Group *g)
+{
+    unsigned long n = count_vars(g->var_begin(), g->var_end());
+    for (D4Group::groupsIter i = g->grp_begin(), e = g->grp_end(); i != e; ++i)
+        n += count_vars(*i);
+
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    GetOpt getopt(argc, argv, "n:h");
+    int option_char;
+
+    int copies = 100;
+
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+            case 'n':
+                copies = atoi(getopt.optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if (getopt.optind == argc || copies < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cout << "sizeof(BaseType) " << sizeof(BaseType) << ", sizeof(AttrTable) " << sizeof(AttrTable) << endl;
+    printf("%-32s %8s %14s %12s\n", "file", "vars", "bytes/copy", "bytes/var");
+
+    unsigned long total_vars = 0;
+    size_t total_bytes = 0;
+
+    for (int a = getopt.optind; a < argc; ++a) {
+        string file = argv[a];
+        string base = file.substr(file.rfind('/') + 1);
+        bool is_dds = file.size() > 4 && file.substr(file.size() - 4) == ".dds";
+
+        try {
+            size_t start = live_bytes;
+            unsigned long vars = 0;
+
+            if (is_dds) {
+                BaseTypeFactory factory;
+                vector<DDS*> ddss;
+                for (int c = 0; c < copies; ++c) {
+                    DDS *dds = new DDS(&factory);
+                    dds->parse(file);
+                    ddss.push_back(dds);
+                }
+
+                vars = count_vars(ddss[0]->var_begin(), ddss[0]->var_end());
+                total_bytes += live_bytes - start;
+                printf("%-32s %8lu %14.0f %12.1f\n", base.c_str(), vars, double(live_bytes - start) / copies,
+                        double(live_bytes - start) / copies / (vars ? vars : 1));
+
+                for (vector<DDS*>::iterator i = ddss.begin(); i != ddss.end(); ++i)
+                    delete *i;
+            }
+            else {
+                D4BaseTypeFactory factory;
+                vector<DMR*> dmrs;
+                for (int c = 0; c < copies; ++c) {
+                    ifstream in(file.c_str());
+                    if (!in)
+                        throw Error("Could not open " + file);
+
+                    DMR *dmr = new DMR(&factory);
+                    D4ParserSax2 parser;
+                    parser.intern(in, dmr);
+                    dmrs.push_back(dmr);
+                }
+
+                vars = count_vars(dmrs[0]->root());
+                total_bytes += live_bytes - start;
+                printf("%-32s %8lu %14.0f %12.1f\n", base.c_str(), vars, double(live_bytes - start) / copies,
+                        double(live_bytes - start) / copies / (vars ? vars : 1));
+
+                for (vector<DMR*>::iterator i = dmrs.begin(); i != dmrs.end(); ++i)
+                    delete *i;
+            }
+
+            total_vars += vars;
+        }
+        catch (Error &e) {
+            cerr << base << ": " << e.get_error_message() << endl;
+        }
+    }
+
+    printf("%-32s %8lu %14.0f %12.1f\n", "total", total_vars, double(total_bytes) / copies,
+            double(total_bytes) / copies / (total_vars ? total_vars : 1));
+
+    return 0;
+}